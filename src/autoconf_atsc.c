@@ -76,6 +76,8 @@ void autoconf_psip_need_update(auto_p_t *auto_p, unsigned char *buf)
 			}
 			log_message( log_module, MSG_DEBUG,"PSIP Need update. stored version : %d, new: %d\n",
 					auto_p->psip_version,psip->version_number);
+			if(!auto_p->psip_need_update)
+				ts_section_cache_flush(auto_p->autoconf_temp_psip);
 			auto_p->psip_need_update=1;
 		}
 }
@@ -62,6 +62,8 @@ void autoconf_cat_need_update(auto_p_t *auto_p, unsigned char *buf)
                 return;
             }
             log_message( log_module, MSG_DEBUG,"CAT Need update. stored version : %d, new: %d\n",auto_p->cat_version,cat->version_number);
+            if(!auto_p->cat_need_update)
+                ts_section_cache_flush(auto_p->autoconf_temp_cat);
             auto_p->cat_need_update=1;
         }
         else if(auto_p->cat_all_sections_seen && auto_p->cat_need_update==1) //We can have a wrong need update if the packet was broken (the CRC32 is checked only if we think it's good)
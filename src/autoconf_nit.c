@@ -63,6 +63,8 @@ void autoconf_nit_need_update(auto_p_t *auto_p, unsigned char *buf)
 				return;
 			}
 			log_message( log_module, MSG_DEBUG,"NIT Need update. stored version : %d, new: %d\n",auto_p->nit_version,nit->version_number);
+			if(!auto_p->nit_need_update)
+				ts_section_cache_flush(auto_p->autoconf_temp_nit);
 			auto_p->nit_need_update=1;
 		}
 }
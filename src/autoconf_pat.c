@@ -61,6 +61,8 @@ void autoconf_pat_need_update(auto_p_t *auto_p, unsigned char *buf)
 				return;
 			}
 			log_message( log_module, MSG_DEBUG,"PAT Need update. stored version : %d, new: %d\n",auto_p->pat_version,pat->version_number);
+			if(!auto_p->pat_need_update)
+				ts_section_cache_flush(auto_p->autoconf_temp_pat);
 			auto_p->pat_need_update=1;
 		}
 		else if(auto_p->pat_all_sections_seen && auto_p->pat_need_update==1) //We can have a wrong need update if the packet was broken (the CRC32 is checked only if we think it's good)
@@ -69,6 +69,8 @@ void autoconf_sdt_need_update(auto_p_t *auto_p, unsigned char *buf)
 				return;
 			}
 			log_message( log_module, MSG_DEBUG,"SDT Need update. stored version : %d, new: %d\n",auto_p->sdt_version,sdt->version_number);
+			if(!auto_p->sdt_need_update)
+				ts_section_cache_flush(auto_p->autoconf_temp_sdt);
 			auto_p->sdt_need_update=1;
 		}
 		else if(auto_p->sdt_all_sections_seen && auto_p->sdt_need_update==1) //We can have a wrong need update if the packet was broken (the CRC32 is checked only if we think it's good)
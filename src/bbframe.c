@@ -0,0 +1,226 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief DVB-S2 baseband frames given as a pseudo TS
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "bbframe.h"
+#include "log.h"
+
+static char *log_module="BBFrame: ";
+
+static void *bbframe_new_ctx(void);
+static void bbframe_free_ctx(void *ctx);
+static void bbframe_reset_ctx(void *ctx);
+static void bbframe_process(decap_t *decap, const unsigned char *ts_packet);
+
+const decap_ops_t bbframe_decap_ops={
+	.name="BBFrame",
+	.max_frame_packets=BBFRAME_MAX_FRAME_PACKETS,
+	.new_ctx=bbframe_new_ctx,
+	.free_ctx=bbframe_free_ctx,
+	.reset_ctx=bbframe_reset_ctx,
+	.process=bbframe_process,
+};
+
+/** @brief Allocate the state of a baseband frame decapsulator
+ * @return NULL on error
+ */
+static void *bbframe_new_ctx(void)
+{
+	bbframe_ctx_t *ctx;
+
+	ctx=calloc(1, sizeof(bbframe_ctx_t));
+	if(ctx==NULL)
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	return ctx;
+}
+
+static void bbframe_free_ctx(void *ctx)
+{
+	free(ctx);
+}
+
+/** @brief Drop the frame being filled */
+static void bbframe_reset_ctx(void *ctx)
+{
+	((bbframe_ctx_t *)ctx)->active=0;
+	((bbframe_ctx_t *)ctx)->frame_pos=0;
+}
+
+/** @brief The CRC-8 of the baseband header (x^8+x^7+x^6+x^4+x^2+1) */
+static uint8_t bbframe_crc8(const unsigned char *data, int len)
+{
+	uint8_t crc=0;
+
+	for(int i=0;i<len;i++)
+	{
+		crc^=data[i];
+		for(int bit=0;bit<8;bit++)
+			crc=(crc & 0x80) ? (crc<<1)^0xD5 : crc<<1;
+	}
+	return crc;
+}
+
+/** @brief Extract the TS packets of a complete frame to the stream of its ISI
+ *
+ * In TS mode, each user packet is a TS packet whose sync byte is replaced by
+ * the CRC-8 of the previous one, maybe followed by the ISSY and the deleted
+ * null packets byte. The TS packet cut at the end of the data field is kept in
+ * the stream and completed by the next frame of this ISI.
+ */
+static void bbframe_extract(decap_t *decap, bbframe_ctx_t *ctx)
+{
+	const unsigned char *header=ctx->frame;
+	const unsigned char *data=ctx->frame+BBFRAME_HEADER_SIZE;
+	decap_stream_t *stream;
+	unsigned int upl, dfl, syncd, pos, size;
+
+	//TS/GS field : only the TS mode carries TS packets, the generic streams (GSE) are not extracted
+	if((header[0]>>6)!=3)
+	{
+		log_message(log_module, MSG_DEBUG, "Not a TS frame (TS/GS %d), dropped\n", header[0]>>6);
+		decap->bad_frames++;
+		return;
+	}
+	upl=((header[2]<<8) | header[3])>>3;
+	dfl=ctx->frame_size-BBFRAME_HEADER_SIZE;
+	syncd=(header[7]<<8) | header[8];
+	if(upl<TS_PACKET_SIZE)
+	{
+		log_message(log_module, MSG_DEBUG, "User packets too short for TS : %u bytes\n", upl);
+		decap->bad_frames++;
+		return;
+	}
+
+	//The ISI for multiple input streams, 0 for a single stream
+	stream=decap_frame_stream(decap, (header[0] & 0x20) ? 0 : header[1]);
+	if(stream==NULL)
+		return;
+
+	if(syncd==0xFFFF) { //No user packet starts in the data field
+		size=dfl;
+		if(stream->partial_len && size > TS_PACKET_SIZE-stream->partial_len)
+			size=TS_PACKET_SIZE-stream->partial_len;
+		decap_stream_resume(stream, data, size);
+		return;
+	}
+	syncd>>=3;
+	//The end of the packet cut by the previous frame, without the ISSY and the DNP
+	if(syncd > upl-TS_PACKET_SIZE)
+		decap_stream_resume(stream, data, syncd-(upl-TS_PACKET_SIZE));
+
+	for(pos=syncd; pos < dfl; pos+=upl) {
+		size=dfl-pos-1;
+		if(size>TS_PACKET_SIZE-1)
+			size=TS_PACKET_SIZE-1;
+		decap_stream_packet(stream, data+pos+1, size);
+	}
+}
+
+/** @brief Add bytes to the frames, the complete frames are extracted */
+static void bbframe_feed(decap_t *decap, bbframe_ctx_t *ctx, const unsigned char *buf, unsigned int len)
+{
+	unsigned int size;
+
+	while(len && ctx->active)
+	{
+		if(ctx->frame_pos<BBFRAME_HEADER_SIZE)
+		{
+			size=BBFRAME_HEADER_SIZE-ctx->frame_pos;
+			if(size>len)
+				size=len;
+			memcpy(ctx->frame+ctx->frame_pos, buf, size);
+			ctx->frame_pos+=size;
+			buf+=size;
+			len-=size;
+			if(ctx->frame_pos<BBFRAME_HEADER_SIZE)
+				return;
+			if(bbframe_crc8(ctx->frame, BBFRAME_HEADER_SIZE-1)!=ctx->frame[BBFRAME_HEADER_SIZE-1])
+			{
+				//Bad header or stuffing after the last frame, we wait for the next start
+				log_message(log_module, MSG_DEBUG, "Bad CRC of the baseband header\n");
+				decap->bad_frames++;
+				bbframe_reset_ctx(ctx);
+				return;
+			}
+			ctx->frame_size=BBFRAME_HEADER_SIZE+(((ctx->frame[4]<<8) | ctx->frame[5])>>3);
+		}
+		size=ctx->frame_size-ctx->frame_pos;
+		if(size>len)
+			size=len;
+		memcpy(ctx->frame+ctx->frame_pos, buf, size);
+		ctx->frame_pos+=size;
+		buf+=size;
+		len-=size;
+		if(ctx->frame_pos==ctx->frame_size)
+		{
+			bbframe_extract(decap, ctx);
+			ctx->frame_pos=0;
+		}
+	}
+}
+
+/** @brief Give a TS packet of the PID carrying the frames */
+static void bbframe_process(decap_t *decap, const unsigned char *ts_packet)
+{
+	bbframe_ctx_t *ctx=(bbframe_ctx_t *)decap->ctx;
+	int offset;
+	unsigned int len, pointer;
+
+	offset=ts_payload_offset(ts_packet);
+	if(offset<=0 || offset>=TS_PACKET_SIZE)
+		return;
+	len=TS_PACKET_SIZE-offset;
+	if(!(ts_packet[1] & 0x40))
+	{
+		bbframe_feed(decap, ctx, ts_packet+offset, len);
+		return;
+	}
+	pointer=ts_packet[offset];
+	if(pointer+1>=len)
+	{
+		log_message(log_module, MSG_DEBUG, "invalid pointer field: %u\n", pointer);
+		bbframe_reset_ctx(ctx);
+		return;
+	}
+	//The end of the previous frame
+	bbframe_feed(decap, ctx, ts_packet+offset+1, pointer);
+	if(ctx->active && ctx->frame_pos)
+	{
+		log_message(log_module, MSG_DEBUG, "Frame not complete, dropped\n");
+		decap->bad_frames++;
+	}
+	ctx->active=1;
+	ctx->frame_pos=0;
+	bbframe_feed(decap, ctx, ts_packet+offset+1+pointer, len-1-pointer);
+}
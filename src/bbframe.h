@@ -0,0 +1,66 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief DVB-S2 baseband frames given as a pseudo TS
+ *
+ * Some DVB-S2 demodulators can give the baseband frames instead of the TS, in
+ * the TS packets of a PID. The frames are carried like the T2-MI packets : a
+ * packet with the payload_unit_start_indicator starts with a pointer field
+ * giving the position of the first frame starting in it, and the frames
+ * follow each other. The TS packets of each input stream (ISI) of the frames
+ * in TS mode are given to the stream of this ISI (see decap.h).
+ */
+
+#ifndef _BBFRAME_H
+#define _BBFRAME_H
+
+#include <stdint.h>
+
+#include "decap.h"
+
+/** The size of the baseband header */
+#define BBFRAME_HEADER_SIZE 10
+/** The biggest baseband frame : the header and a data field of 65535 bits */
+#define BBFRAME_MAX_SIZE (BBFRAME_HEADER_SIZE+8192)
+/** The maximum number of TS packets given by one frame */
+#define BBFRAME_MAX_FRAME_PACKETS (8192/TS_PACKET_SIZE+2)
+/** The default PID of the pseudo TS */
+#define BBFRAME_DEFAULT_PID 270
+
+/** @brief The state of a baseband frame decapsulator */
+typedef struct bbframe_ctx_t{
+  /** Are we filling a frame ? */
+  int active;
+  /** The number of bytes of the frame received, and its size once the header is read */
+  unsigned int frame_pos;
+  unsigned int frame_size;
+  unsigned char frame[BBFRAME_MAX_SIZE];
+}bbframe_ctx_t;
+
+extern const decap_ops_t bbframe_decap_ops;
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief Micro-benchmark of the CRC32 kernels (bytewise, slicing-by-8, PCLMULQDQ folding)
+ *
+ * Usage : bench_crc32 [length [iterations]]
+ * The kernels are first checked against the bytewise one, then each kernel
+ * computes the CRC32 of a buffer of length bytes (default : the section sizes
+ * 188, 1024 and 4096) iterations times.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "crc32.h"
+
+static const char *kernels[]={"bytewise", "slicing-by-8", "pclmul"};
+#define NUM_KERNELS (int)(sizeof(kernels)/sizeof(kernels[0]))
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/** @brief Check that the kernels give the same CRC32 for all the lengths and alignments */
+static int bench_check(const unsigned char *buf, int max_len)
+{
+	uint32_t ref, crc;
+	int errors=0;
+
+	for(int len=0;len<=max_len;len++)
+		for(int align=0;align<8;align++)
+		{
+			crc32_select_kernel("bytewise");
+			ref=crc32_mpeg(CRC32_INIT, buf+align, len);
+			for(int k=1;k<NUM_KERNELS;k++)
+			{
+				if(crc32_select_kernel(kernels[k])<0)
+					continue;
+				crc=crc32_mpeg(CRC32_INIT, buf+align, len);
+				if(crc!=ref && errors++<10)
+					fprintf(stderr, "%s : length %d alignment %d : 0x%08x instead of 0x%08x\n", kernels[k], len, align, crc, ref);
+			}
+		}
+	return errors;
+}
+
+static void bench_kernel(const char *kernel, const unsigned char *buf, int len, long iterations)
+{
+	uint32_t crc=CRC32_INIT;
+	double start, elapsed;
+
+	if(crc32_select_kernel(kernel)<0)
+	{
+		printf("%-14s %6d bytes : not supported by this CPU\n", kernel, len);
+		return;
+	}
+	start=bench_now();
+	//Each CRC32 continues the previous one, the calls cannot be merged by the compiler
+	for(long i=0;i<iterations;i++)
+		crc=crc32_mpeg(crc, buf, len);
+	elapsed=bench_now()-start;
+	printf("%-14s %6d bytes : %9.1f MB/s %8.1f ns/section (0x%08x)\n", kernel, len,
+			len*(double)iterations/elapsed/1e6, elapsed*1e9/iterations, crc);
+}
+
+int main(int argc, char **argv)
+{
+	int lengths[]={188, 1024, 4096};
+	int num_lengths=sizeof(lengths)/sizeof(lengths[0]);
+	long bytes=200*1000*1000;
+	long iterations=0;
+	unsigned char *buf;
+
+	if(argc>1)
+	{
+		lengths[0]=atoi(argv[1]);
+		num_lengths=1;
+	}
+	if(argc>2)
+		iterations=atol(argv[2]);
+	if(lengths[0]<=0 || iterations<0)
+	{
+		fprintf(stderr, "Usage : %s [length [iterations]]\n", argv[0]);
+		return 1;
+	}
+	buf=malloc(lengths[num_lengths-1]+4096+8);
+	if(buf==NULL)
+		return 1;
+	srand(1);
+	for(int i=0;i<lengths[num_lengths-1]+4096+8;i++)
+		buf[i]=rand();
+
+	crc32_init();
+	printf("Kernel chosen by crc32_init : %s\n", crc32_kernel_name());
+	if(bench_check(buf, 4096))
+	{
+		fprintf(stderr, "The CRC32 kernels do not agree\n");
+		free(buf);
+		return 1;
+	}
+	for(int l=0;l<num_lengths;l++)
+		for(int k=0;k<NUM_KERNELS;k++)
+			bench_kernel(kernels[k], buf, lengths[l], iterations ? iterations : bytes/lengths[l]);
+	free(buf);
+	return 0;
+}
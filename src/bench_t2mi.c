@@ -0,0 +1,191 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+
+/** @file
+ * @brief Throughput benchmark of the T2-MI decapsulation, fed with a recorded capture
+ *
+ * Usage : bench_t2mi capture.ts [pid [plp [passes]]]
+ * The capture (a TS recorded from a T2-MI feed, for example with dvbzap
+ * dump_file) is loaded in memory, then given passes times to the decapsulator
+ * by blocks of the size of a DVR read. The PID carrying the T2-MI is 4096 by
+ * default, plp is a PLP id or all (default : all the PLPs).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+
+#include "decap.h"
+#include "log.h"
+
+/** The number of packets given at once, as a DVR read of dvbzap */
+#define BENCH_BLOCK_PACKETS DEFAULT_TS_BUFFER_SIZE
+
+/** @brief The decapsulator logs through log_message, only the errors and the warnings are shown */
+void log_message( char* log_module, int type, const char *psz_format, ... )
+{
+	va_list args;
+
+	if(type>MSG_WARN)
+		return;
+	va_start( args, psz_format );
+	fprintf(stderr, "%s", log_module);
+	vfprintf(stderr, psz_format, args);
+	va_end( args );
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/** @brief The packets given by the decapsulator, counted by PLP */
+typedef struct bench_out_t{
+  uint64_t packets[256];
+  uint64_t bad_sync;
+}bench_out_t;
+
+static void bench_flush(void *arg, int id, unsigned char *buf, int len)
+{
+	bench_out_t *out=arg;
+
+	out->packets[id]+=len/TS_PACKET_SIZE;
+	for(int i=0;i<len;i+=TS_PACKET_SIZE)
+		if(buf[i]!=TS_SYNC_BYTE)
+			out->bad_sync++;
+}
+
+/** @brief Load the capture, the bytes before the first synchronised packet are skipped
+ * @return the packets, NULL on error
+ */
+static unsigned char *bench_load(const char *filename, int *num_packets)
+{
+	FILE *capture;
+	unsigned char *buf;
+	long size, start;
+
+	capture=fopen(filename, "rb");
+	if(capture==NULL)
+	{
+		fprintf(stderr, "Cannot open %s : %s\n", filename, strerror(errno));
+		return NULL;
+	}
+	fseek(capture, 0, SEEK_END);
+	size=ftell(capture);
+	rewind(capture);
+	buf=malloc(size>0 ? size : 1);
+	if(buf==NULL || fread(buf, 1, size, capture)!=(size_t)size)
+	{
+		fprintf(stderr, "Cannot read %s\n", filename);
+		fclose(capture);
+		free(buf);
+		return NULL;
+	}
+	fclose(capture);
+	for(start=0;start+2*TS_PACKET_SIZE<size;start++)
+		if(buf[start]==TS_SYNC_BYTE && buf[start+TS_PACKET_SIZE]==TS_SYNC_BYTE && buf[start+2*TS_PACKET_SIZE]==TS_SYNC_BYTE)
+			break;
+	*num_packets=(size-start)/TS_PACKET_SIZE;
+	if(*num_packets<3)
+	{
+		fprintf(stderr, "%s is not a TS\n", filename);
+		free(buf);
+		return NULL;
+	}
+	memmove(buf, buf+start, (size_t)*num_packets*TS_PACKET_SIZE);
+	return buf;
+}
+
+int main(int argc, char **argv)
+{
+	int pid=4096, plp=-1, passes=20;
+	int num_packets, block;
+	uint64_t pid_packets=0, out_packets=0;
+	double start, elapsed=0;
+	unsigned char *buf;
+	bench_out_t out;
+	decap_t *decap=NULL;
+
+	if(argc>2)
+		pid=atoi(argv[2]);
+	if(argc>3 && strcmp(argv[3], "all"))
+		plp=atoi(argv[3]);
+	if(argc>4)
+		passes=atoi(argv[4]);
+	if(argc<2 || pid<1 || pid>8191 || plp>255 || passes<1)
+	{
+		fprintf(stderr, "Usage : %s capture.ts [pid [plp [passes]]]\n", argv[0]);
+		return 1;
+	}
+	buf=bench_load(argv[1], &num_packets);
+	if(buf==NULL)
+		return 1;
+	memset(&out, 0, sizeof(out));
+	for(int pass=0;pass<passes;pass++)
+	{
+		//A new decapsulator for each pass, the end of the capture does not continue on its start
+		decap_free(decap);
+		decap=decap_new(DECAP_T2MI, pid, plp<0);
+		if(decap==NULL || (plp>=0 && decap_add_stream(decap, plp)==NULL))
+		{
+			decap_free(decap);
+			free(buf);
+			return 1;
+		}
+		start=bench_now();
+		for(int i=0;i<num_packets;i+=block)
+		{
+			block=num_packets-i<BENCH_BLOCK_PACKETS ? num_packets-i : BENCH_BLOCK_PACKETS;
+			pid_packets+=decap_process(decap, buf+(size_t)i*TS_PACKET_SIZE, block, bench_flush, &out);
+		}
+		elapsed+=bench_now()-start;
+	}
+	for(int id=0;id<256;id++)
+		if(out.packets[id])
+		{
+			printf("PLP %3d : %llu packets out\n", id, (unsigned long long)out.packets[id]/passes);
+			out_packets+=out.packets[id];
+		}
+	printf("Capture : %d packets, %llu on PID %d, %llu frames, %llu bad frames, %llu continuity errors\n",
+			num_packets, (unsigned long long)pid_packets/passes, pid,
+			(unsigned long long)decap->frames, (unsigned long long)decap->bad_frames, (unsigned long long)decap->cc_errors);
+	if(out.bad_sync)
+		printf("%llu packets out without sync byte\n", (unsigned long long)out.bad_sync);
+	printf("%d passes : %.1f MB/s of capture, %.1f MB/s of T2-MI, %.1f ns/packet of the PID, %.1f%% of the packets out\n",
+			passes, (double)num_packets*passes*TS_PACKET_SIZE/elapsed/1e6,
+			pid_packets*TS_PACKET_SIZE/elapsed/1e6,
+			pid_packets ? elapsed*1e9/pid_packets : 0,
+			pid_packets ? 100.0*out_packets/pid_packets : 0);
+	decap_free(decap);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+
+/** @file
+ * @brief Loopback benchmark of the multicast send : one sendto per datagram against UDP GSO
+ *
+ * Usage : bench_udp_gso [datagrams [segments]]
+ * The datagrams (7 TS packets, as sent by dvbzap) are sent to a socket of
+ * 127.0.0.1 with sendudp, then queued with udp_gso_add to be sent segments by
+ * segments (default 64, see multicast_gso). They are received between the
+ * rounds of sends, out of the time measured, to check that none was lost.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "mumudvb.h"
+#include "network.h"
+#include "log.h"
+
+/** The size of the datagrams, 7 TS packets */
+#define BENCH_DATAGRAM_SIZE (7*TS_PACKET_SIZE)
+/** The datagrams sent between two receptions, they have to fit in the receive buffer */
+#define BENCH_ROUND 256
+
+/** @brief network.c logs through log_message, only the errors and the warnings are shown */
+void log_message( char* log_module, int type, const char *psz_format, ... )
+{
+	va_list args;
+
+	if(type>MSG_WARN)
+		return;
+	va_start( args, psz_format );
+	fprintf(stderr, "%s", log_module);
+	vfprintf(stderr, psz_format, args);
+	va_end( args );
+}
+
+/** @brief network.c stops the program through set_interrupted on the socket errors */
+int set_interrupted(int value)
+{
+	if(value)
+	{
+		fprintf(stderr, "Network error, exiting\n");
+		exit(1);
+	}
+	return value;
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/** @brief Receive the datagrams waiting
+ * @return the number of datagrams received
+ */
+static long bench_drain(int rx_fd)
+{
+	unsigned char buf[65536];
+	long received=0;
+
+	while(recv(rx_fd, buf, sizeof(buf), MSG_DONTWAIT)>0)
+		received++;
+	return received;
+}
+
+/** @brief Send the datagrams, with GSO if gso is not NULL, and print the result */
+static void bench_send(const char *name, int fd, struct sockaddr_in *dest, udp_gso_t *gso, int rx_fd, long datagrams)
+{
+	unsigned char data[BENCH_DATAGRAM_SIZE];
+	double start, elapsed=0;
+	long received=0;
+
+	for(int i=0;i<BENCH_DATAGRAM_SIZE;i++)
+		data[i]=rand();
+	for(long sent=0;sent<datagrams;)
+	{
+		start=bench_now();
+		for(int i=0;i<BENCH_ROUND && sent<datagrams;i++,sent++)
+		{
+			data[3]=sent;
+			if(gso)
+				udp_gso_add(gso, data, BENCH_DATAGRAM_SIZE);
+			else
+				sendudp(fd, dest, data, BENCH_DATAGRAM_SIZE);
+		}
+		if(gso)
+			udp_gso_flush(gso);
+		elapsed+=bench_now()-start;
+		received+=bench_drain(rx_fd);
+	}
+	received+=bench_drain(rx_fd);
+	printf("%-8s : %ld datagrams, %ld received, %ld send calls, %8.1f MB/s %7.1f ns/datagram\n", name,
+			datagrams, received, gso ? (long)gso->calls : datagrams,
+			(double)datagrams*BENCH_DATAGRAM_SIZE/elapsed/1e6, elapsed*1e9/datagrams);
+}
+
+int main(int argc, char **argv)
+{
+	long datagrams=200000;
+	int segments=UDP_GSO_MAX_SEGMENTS;
+	int fd, rx_fd, rcvbuf=16<<20;
+	struct sockaddr_in dest;
+	socklen_t dest_len=sizeof(dest);
+	udp_gso_t *gso;
+
+	if(argc>1)
+		datagrams=atol(argv[1]);
+	if(argc>2)
+		segments=atoi(argv[2]);
+	if(datagrams<=0 || segments<2 || segments>UDP_GSO_MAX_SEGMENTS)
+	{
+		fprintf(stderr, "Usage : %s [datagrams [segments]], segments between 2 and %d\n", argv[0], UDP_GSO_MAX_SEGMENTS);
+		return 1;
+	}
+	memset(&dest, 0, sizeof(dest));
+	dest.sin_family=AF_INET;
+	dest.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+	rx_fd=socket(AF_INET, SOCK_DGRAM, 0);
+	fd=socket(AF_INET, SOCK_DGRAM, 0);
+	if(rx_fd<0 || fd<0 ||
+			setsockopt(rx_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf))<0 ||
+			bind(rx_fd, (struct sockaddr *) &dest, sizeof(dest))<0 ||
+			getsockname(rx_fd, (struct sockaddr *) &dest, &dest_len)<0)
+	{
+		fprintf(stderr, "Cannot open the loopback sockets : %s\n", strerror(errno));
+		return 1;
+	}
+
+	bench_send("sendto", fd, &dest, NULL, rx_fd, datagrams);
+	gso=udp_gso_new(segments);
+	if(gso==NULL)
+		return 1;
+	if(udp_gso_add_dest(gso, fd, (struct sockaddr *) &dest, sizeof(dest)))
+		printf("UDP GSO is not supported, the datagrams are sent one by one\n");
+	else
+		bench_send("GSO", fd, &dest, gso, rx_fd, datagrams);
+	if(gso->disabled)
+		printf("UDP GSO was refused, the datagrams were sent one by one\n");
+	udp_gso_free(gso);
+	close(fd);
+	close(rx_fd);
+	return 0;
+}
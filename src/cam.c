@@ -1138,7 +1138,11 @@ int cam_new_packet(int pid, int curr_channel, cam_p_t *cam_p, mumudvb_channel_t
 			}
 		}
 		else //we force update of the PMT packet
+		{
+			if(!actual_channel->pmt_need_update)
+				ts_section_cache_flush(actual_channel->pmt_packet);
 			actual_channel->pmt_need_update=1;
+		}
 	}
 	return ret;
 }
@@ -25,9 +25,24 @@
 /** @file
  * @brief File for CRC32 calculation
  * it contains the precomputed table
+ *
+ * The CRC32 is computed with slicing by 8 (8 bytes per step), or by folding
+ * with the carry-less multiplication (PCLMULQDQ) when the CPU has it. The
+ * kernel is chosen at runtime by crc32_init.
  */
 
+#include "config.h"
+
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC32_PCLMUL
+#endif
+
+#include "crc32.h"
 
 /**CRC table for PAT rebuilding, cam support and autoconfiguration*/
 uint32_t crc32_table[256] =
@@ -98,3 +113,177 @@ uint32_t crc32_table[256] =
 	0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
+/** The tables for slicing by 8 : crc32_slice_table[k][b] is the CRC of the byte b followed by k null bytes */
+static uint32_t crc32_slice_table[8][256];
+
+/** @brief CRC32 one byte at a time, used for the small buffers and the tails */
+static inline uint32_t crc32_bytes(uint32_t crc, const unsigned char *data, size_t len)
+{
+	while(len--)
+		crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *data++)&0xff];
+	return crc;
+}
+
+static uint32_t crc32_bytewise(uint32_t crc, const unsigned char *data, size_t len)
+{
+	return crc32_bytes(crc, data, len);
+}
+
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *data, size_t len)
+{
+	uint32_t high;
+
+	for(;len>=8;len-=8, data+=8)
+	{
+		high=crc^(((uint32_t)data[0]<<24)|((uint32_t)data[1]<<16)|((uint32_t)data[2]<<8)|data[3]);
+		crc=crc32_slice_table[7][high>>24] ^
+			crc32_slice_table[6][(high>>16)&0xff] ^
+			crc32_slice_table[5][(high>>8)&0xff] ^
+			crc32_slice_table[4][high&0xff] ^
+			crc32_slice_table[3][data[4]] ^
+			crc32_slice_table[2][data[5]] ^
+			crc32_slice_table[1][data[6]] ^
+			crc32_slice_table[0][data[7]];
+	}
+	return crc32_bytes(crc, data, len);
+}
+
+#ifdef CRC32_PCLMUL
+/** The folding constants, x^(n+64) mod P in the high part and x^n mod P in the low part
+ * for a fold of n bits : 512 for the four lanes, 384, 256 and 128 to merge the lanes */
+static uint64_t crc32_fold_512[2], crc32_fold_384[2], crc32_fold_256[2], crc32_fold_128[2];
+
+/** @brief x^n mod P */
+static uint32_t crc32_xn_mod_p(int n)
+{
+	uint32_t r=1;
+	while(n--)
+		r=(r&0x80000000) ? (r<<1)^crc32_table[1] : r<<1;
+	return r;
+}
+
+static void crc32_fold_constants(uint64_t *k, int n)
+{
+	k[0]=crc32_xn_mod_p(n);
+	k[1]=crc32_xn_mod_p(n+64);
+}
+
+/** @brief Multiply the 128 bits polynomial a by x^n modulo P (the result is congruent, not reduced)
+ * The first byte of the data is in the highest bits */
+__attribute__((target("pclmul,sse2")))
+static inline __m128i crc32_fold(__m128i a, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x11), _mm_clmulepi64_si128(a, k, 0x00));
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *data, size_t len)
+{
+	const __m128i swap=_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+	__m128i k, a0, a1, a2, a3;
+	unsigned char rest[16];
+
+	if(len<128)
+		return crc32_slice8(crc, data, len);
+	a0=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), swap);
+	a1=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+16)), swap);
+	a2=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+32)), swap);
+	a3=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+48)), swap);
+	//The CRC is added to the first 32 bits of the data
+	a0=_mm_xor_si128(a0, _mm_set_epi32(crc,0,0,0));
+	data+=64;
+	len-=64;
+
+	//Four lanes of 128 bits, each one is moved by 512 bits
+	k=_mm_set_epi64x(crc32_fold_512[1], crc32_fold_512[0]);
+	for(;len>=64;len-=64, data+=64)
+	{
+		a0=_mm_xor_si128(crc32_fold(a0, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), swap));
+		a1=_mm_xor_si128(crc32_fold(a1, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+16)), swap));
+		a2=_mm_xor_si128(crc32_fold(a2, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+32)), swap));
+		a3=_mm_xor_si128(crc32_fold(a3, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+48)), swap));
+	}
+	//We merge the lanes
+	a3=_mm_xor_si128(a3, crc32_fold(a0, _mm_set_epi64x(crc32_fold_384[1], crc32_fold_384[0])));
+	a3=_mm_xor_si128(a3, crc32_fold(a1, _mm_set_epi64x(crc32_fold_256[1], crc32_fold_256[0])));
+	a3=_mm_xor_si128(a3, crc32_fold(a2, _mm_set_epi64x(crc32_fold_128[1], crc32_fold_128[0])));
+	k=_mm_set_epi64x(crc32_fold_128[1], crc32_fold_128[0]);
+	for(;len>=16;len-=16, data+=16)
+		a3=_mm_xor_si128(crc32_fold(a3, k), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), swap));
+
+	//The remaining 128 bits are reduced as data with a null CRC
+	_mm_storeu_si128((__m128i *)rest, _mm_shuffle_epi8(a3, swap));
+	crc=crc32_slice8(0, rest, 16);
+	return crc32_bytes(crc, data, len);
+}
+#endif
+
+static uint32_t (*crc32_kernel)(uint32_t crc, const unsigned char *data, size_t len)=crc32_bytewise;
+static const char *crc32_kernel_str="bytewise";
+
+/** @brief Build the tables and choose the CRC32 kernel for this CPU */
+void crc32_init(void)
+{
+	for(int b=0;b<256;b++)
+	{
+		crc32_slice_table[0][b]=crc32_table[b];
+		for(int k=1;k<8;k++)
+			crc32_slice_table[k][b]=(crc32_slice_table[k-1][b]<<8)^crc32_table[crc32_slice_table[k-1][b]>>24];
+	}
+	crc32_kernel=crc32_slice8;
+	crc32_kernel_str="slicing-by-8";
+#ifdef CRC32_PCLMUL
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+	{
+		crc32_fold_constants(crc32_fold_512, 512);
+		crc32_fold_constants(crc32_fold_384, 384);
+		crc32_fold_constants(crc32_fold_256, 256);
+		crc32_fold_constants(crc32_fold_128, 128);
+		crc32_kernel=crc32_pclmul;
+		crc32_kernel_str="pclmul";
+	}
+#endif
+}
+
+/** @brief Use the CRC32 kernel named name (bytewise, slicing-by-8 or pclmul), for the benchmarks
+ * crc32_init has to be called before
+ * @return -1 if the kernel is unknown or not supported by this CPU
+ */
+int crc32_select_kernel(const char *name)
+{
+	if(!strcmp(name, "bytewise"))
+	{
+		crc32_kernel=crc32_bytewise;
+		crc32_kernel_str="bytewise";
+	}
+	else if(!strcmp(name, "slicing-by-8"))
+	{
+		crc32_kernel=crc32_slice8;
+		crc32_kernel_str="slicing-by-8";
+	}
+#ifdef CRC32_PCLMUL
+	else if(!strcmp(name, "pclmul") && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+	{
+		crc32_kernel=crc32_pclmul;
+		crc32_kernel_str="pclmul";
+	}
+#endif
+	else
+		return -1;
+	return 0;
+}
+
+/** @brief The name of the CRC32 kernel chosen by crc32_init */
+const char *crc32_kernel_name(void)
+{
+	return crc32_kernel_str;
+}
+
+/** @brief Update the CRC32 with len bytes
+ * Start with CRC32_INIT, a section with its CRC32 at the end gives 0
+ */
+uint32_t crc32_mpeg(uint32_t crc, const unsigned char *data, size_t len)
+{
+	return crc32_kernel(crc, data, len);
+}
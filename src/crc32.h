@@ -0,0 +1,45 @@
+/* 
+ * mumudvb - UDP-ize a DVB transport stream.
+ * 
+ * (C) 2004-2009 Brice DUBOST
+ * 
+ * The latest version can be found at http://mumudvb.net
+ * 
+ * Copyright notice:
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/** @file
+ * @brief CRC32 (MPEG-2 polynomial) of the PSI/SI sections and of the SAP messages
+ */
+
+#ifndef _CRC32_H
+#define _CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** The initial value of the CRC32 */
+#define CRC32_INIT 0xffffffff
+
+extern uint32_t crc32_table[256];
+
+void crc32_init(void);
+const char *crc32_kernel_name(void);
+int crc32_select_kernel(const char *name);
+uint32_t crc32_mpeg(uint32_t crc, const unsigned char *data, size_t len);
+
+#endif
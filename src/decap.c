@@ -0,0 +1,300 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief Decapsulation of the TS carried inside the TS read from the card
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "decap.h"
+#include "t2mi.h"
+#include "bbframe.h"
+#include "log.h"
+
+static char *log_module="Decap: ";
+
+/** @brief The decapsulator of each type */
+static const decap_ops_t *decap_ops(int type)
+{
+	switch(type)
+	{
+		case DECAP_T2MI:
+			return &t2mi_decap_ops;
+		case DECAP_BBFRAME:
+			return &bbframe_decap_ops;
+		default:
+			return NULL;
+	}
+}
+
+/** @brief Allocate the decapsulation of a PID
+ *
+ * The streams are added with decap_add_stream, or as they are seen if all_streams is set
+ * @return NULL on error
+ */
+decap_t *decap_new(int type, int pid, int all_streams)
+{
+	decap_t *decap;
+	const decap_ops_t *ops=decap_ops(type);
+
+	if(ops==NULL)
+	{
+		log_message( log_module,  MSG_ERROR, "Unknown decapsulation type %d\n", type);
+		return NULL;
+	}
+	decap=calloc(1, sizeof(decap_t));
+	if(decap==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	decap->type=type;
+	decap->ops=ops;
+	decap->pid=pid;
+	decap->all_streams=all_streams;
+	memset(decap->stream_index, -1, sizeof(decap->stream_index));
+	decap->ctx=ops->new_ctx();
+	if(decap->ctx==NULL)
+	{
+		free(decap);
+		return NULL;
+	}
+	log_message( log_module,  MSG_INFO, "%s decapsulation of PID %d\n", ops->name, pid);
+	return decap;
+}
+
+void decap_free(decap_t *decap)
+{
+	if(decap==NULL)
+		return;
+	for(int i=0;i<decap->num_streams;i++)
+		free(decap->streams[i].buffer);
+	decap->ops->free_ctx(decap->ctx);
+	free(decap);
+}
+
+/** @brief Start again, the frames and the TS packets not complete are dropped */
+static void decap_reset(decap_t *decap)
+{
+	decap->ops->reset_ctx(decap->ctx);
+	for(int i=0;i<decap->num_streams;i++)
+		decap->streams[i].partial_len=0;
+}
+
+/** @brief Log the frames and the TS packets of each stream */
+void decap_log_totals(decap_t *decap)
+{
+	if(decap==NULL)
+		return;
+	log_message( log_module, MSG_INFO, "%s decapsulation of PID %d : %llu frames, %llu bad frames, %llu continuity errors\n",
+			decap->ops->name, decap->pid, (unsigned long long) decap->frames,
+			(unsigned long long) decap->bad_frames, (unsigned long long) decap->cc_errors);
+	for(int i=0;i<decap->num_streams;i++)
+		log_message( log_module, MSG_INFO, "\tstream %d : %llu TS packets, %llu dropped\n", decap->streams[i].id,
+				(unsigned long long) decap->streams[i].packets, (unsigned long long) decap->streams[i].dropped);
+}
+
+/** @brief Add a stream (a PLP, an ISI) to extract
+ * @return the stream, NULL if there is too many streams or on error
+ */
+decap_stream_t *decap_add_stream(decap_t *decap, uint8_t id)
+{
+	decap_stream_t *stream;
+
+	if(decap->stream_index[id]>=0)
+		return &decap->streams[(int)decap->stream_index[id]];
+	if(decap->num_streams>=DECAP_MAX_STREAMS)
+	{
+		log_message( log_module,  MSG_WARN, "Too many streams, stream %d is not extracted, limit : %d\n", id, DECAP_MAX_STREAMS);
+		return NULL;
+	}
+	stream=&decap->streams[decap->num_streams];
+	memset(stream, 0, sizeof(decap_stream_t));
+	stream->id=id;
+	stream->buffer_size=decap->ops->max_frame_packets*DECAP_BUFFER_FRAMES*TS_PACKET_SIZE;
+	stream->buffer=malloc(stream->buffer_size);
+	if(stream->buffer==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	decap->stream_index[id]=decap->num_streams;
+	decap->num_streams++;
+	log_message( log_module, MSG_DETAIL, "PID %d : extracting %s stream %d\n", decap->pid, decap->ops->name, id);
+	return stream;
+}
+
+/** @brief The stream of an id, NULL if it is not extracted */
+static decap_stream_t *decap_get_stream(decap_t *decap, uint8_t id)
+{
+	if(decap->stream_index[id]<0)
+		return NULL;
+	return &decap->streams[(int)decap->stream_index[id]];
+}
+
+/** @brief The stream for the packets of a frame, with room for the frame
+ * The stream is added if all the streams are extracted
+ * @return NULL if the stream is not extracted
+ */
+decap_stream_t *decap_frame_stream(decap_t *decap, uint8_t id)
+{
+	decap_stream_t *stream;
+
+	decap->frames++;
+	stream=decap_get_stream(decap, id);
+	if(stream==NULL && decap->all_streams)
+	{
+		stream=decap_add_stream(decap, id);
+		if(stream!=NULL)
+			log_message( log_module, MSG_INFO, "PID %d : new %s stream %d found\n", decap->pid, decap->ops->name, id);
+	}
+	if(stream==NULL)
+		return NULL;
+	if(stream->buffer_len+decap->ops->max_frame_packets*TS_PACKET_SIZE > stream->buffer_size)
+	{
+		if(decap->flush)
+			decap->flush(decap->flush_arg, stream->id, stream->buffer, stream->buffer_len);
+		stream->buffer_len=0;
+	}
+	return stream;
+}
+
+/** @brief Add bytes to the TS packet being rebuilt, give it when it is complete */
+static void decap_stream_add(decap_stream_t *stream, const unsigned char *data, unsigned int len)
+{
+	if(stream->partial_len+len > TS_PACKET_SIZE)
+	{
+		log_message(log_module, MSG_DETAIL, "Stream %d : TS packet too long (%u bytes), dropped\n", stream->id, stream->partial_len+len);
+		stream->partial_len=0;
+		stream->dropped++;
+		return;
+	}
+	memcpy(stream->partial+stream->partial_len, data, len);
+	stream->partial_len+=len;
+	if(stream->partial_len<TS_PACKET_SIZE)
+		return;
+	if(stream->buffer_len+TS_PACKET_SIZE > stream->buffer_size)
+	{
+		log_message(log_module, MSG_DETAIL, "Stream %d : position out of buffer bounds: %u + %u > %u\n",
+				stream->id, stream->buffer_len, TS_PACKET_SIZE, stream->buffer_size);
+		stream->dropped++;
+	}
+	else
+	{
+		memcpy(stream->buffer+stream->buffer_len, stream->partial, TS_PACKET_SIZE);
+		stream->buffer_len+=TS_PACKET_SIZE;
+		stream->packets++;
+	}
+	stream->partial_len=0;
+}
+
+/** @brief The bytes at the start of a data field, before the first packet starting in it
+ * They end the packet cut by the previous frame, if any
+ */
+void decap_stream_resume(decap_stream_t *stream, const unsigned char *data, unsigned int len)
+{
+	if(stream->partial_len && len)
+		decap_stream_add(stream, data, len);
+}
+
+/** @brief Start a TS packet : the sync byte then the len (at most 187) bytes of data
+ * If the previous packet is not complete, it is dropped
+ */
+void decap_stream_packet(decap_stream_t *stream, const unsigned char *data, unsigned int len)
+{
+	if(stream->partial_len)
+	{
+		log_message(log_module, MSG_DETAIL, "Stream %d : unaligned packet (%u bytes), dropped\n", stream->id, stream->partial_len);
+		stream->partial_len=0;
+		stream->dropped++;
+	}
+	if(len==TS_PACKET_SIZE-1 && stream->buffer_len+TS_PACKET_SIZE <= stream->buffer_size)
+	{
+		//Whole packet, written in place
+		stream->buffer[stream->buffer_len]=TS_SYNC_BYTE;
+		memcpy(stream->buffer+stream->buffer_len+1, data, len);
+		stream->buffer_len+=TS_PACKET_SIZE;
+		stream->packets++;
+		return;
+	}
+	stream->partial[0]=TS_SYNC_BYTE;
+	stream->partial_len=1;
+	decap_stream_add(stream, data, len);
+}
+
+/** @brief Give the packets read from the card to the decapsulator
+ *
+ * The packets of the other PIDs are ignored. The packets of each stream are
+ * given to flush when its buffer is full and at the end.
+ * @param buf the packets, num_packets * 188 bytes
+ * @return the number of packets of the PID
+ */
+int decap_process(decap_t *decap, unsigned char *buf, int num_packets, decap_flush_t flush, void *flush_arg)
+{
+	unsigned char *ts_packet;
+	decap_stream_t *stream;
+	uint8_t last_cc;
+	int count=0;
+
+	decap->flush=flush;
+	decap->flush_arg=flush_arg;
+	for(int i=0;i<num_packets;i++)
+	{
+		ts_packet=buf+i*TS_PACKET_SIZE;
+		if((((ts_packet[1] & 0x1f) << 8) | ts_packet[2])!=decap->pid)
+			continue;
+		//Broken packet, we drop what it belongs to
+		if(ts_packet[1] & 0x80)
+		{
+			decap_reset(decap);
+			continue;
+		}
+		last_cc=decap->last_cc;
+		if(ts_cc_check(&decap->last_cc, ts_packet))
+		{
+			decap->cc_errors++;
+			decap_reset(decap);
+		}
+		//The packet is sent twice
+		else if((last_cc & TS_CC_SEEN) && (ts_packet[3] & 0x10) && (ts_packet[3] & 0x0f)==(last_cc & 0x0f))
+			continue;
+		decap->ops->process(decap, ts_packet);
+		count++;
+	}
+	for(int i=0;i<decap->num_streams;i++)
+	{
+		stream=&decap->streams[i];
+		if(stream->buffer_len && flush)
+			flush(flush_arg, stream->id, stream->buffer, stream->buffer_len);
+		stream->buffer_len=0;
+	}
+	decap->flush=NULL;
+	decap->flush_arg=NULL;
+	return count;
+}
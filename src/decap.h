@@ -0,0 +1,132 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief Decapsulation of the TS carried inside the TS read from the card
+ *
+ * Some feeds carry the TS to stream inside a PID of the TS received : T2-MI
+ * (the baseband frames of the PLPs of a DVB-T2 modulator), or the DVB-S2
+ * baseband frames given as a pseudo TS by some demodulators. The decapsulator
+ * of the input type rebuilds the frames, and the TS packets of each inner
+ * stream (the PLP or the ISI) are written to the buffer of this stream.
+ *
+ * The decapsulation runs with the demux, on the packets taken from the card
+ * buffer. The stream buffers are sized for each decapsulator and are given to
+ * the flush function when they have no room left for a frame, so they do not
+ * depend on the size of the DVR reads.
+ */
+
+#ifndef _DECAP_H
+#define _DECAP_H
+
+#include <stdint.h>
+
+#include "mumudvb.h"
+
+/** The maximum number of inner streams given by a decapsulator */
+#define DECAP_MAX_STREAMS 32
+/** The number of frames each stream buffer can hold */
+#define DECAP_BUFFER_FRAMES 8
+
+/** The types of decapsulation */
+enum
+{
+	DECAP_NONE=0,
+	DECAP_T2MI,
+	DECAP_BBFRAME,
+};
+
+/** @brief The TS of one inner stream */
+typedef struct decap_stream_t{
+  /** The PLP or the ISI */
+  uint8_t id;
+  /** The TS packet not yet complete */
+  unsigned char partial[TS_PACKET_SIZE];
+  unsigned int partial_len;
+  /** The packets given since the last flush */
+  unsigned char *buffer;
+  unsigned int buffer_size;
+  unsigned int buffer_len;
+  /** The number of TS packets given and dropped (broken packets) */
+  uint64_t packets;
+  uint64_t dropped;
+}decap_stream_t;
+
+struct decap_t;
+
+/** @brief A decapsulator */
+typedef struct decap_ops_t{
+  const char *name;
+  /** The maximum number of TS packets given by one frame */
+  int max_frame_packets;
+  void *(*new_ctx)(void);
+  void (*free_ctx)(void *ctx);
+  void (*reset_ctx)(void *ctx);
+  /** Give a TS packet of the PID carrying the frames */
+  void (*process)(struct decap_t *decap, const unsigned char *ts_packet);
+}decap_ops_t;
+
+/** @brief Called with the packets of a stream, len bytes */
+typedef void (*decap_flush_t)(void *arg, int id, unsigned char *buf, int len);
+
+/** @brief The decapsulation of one PID */
+typedef struct decap_t{
+  int type;
+  const decap_ops_t *ops;
+  /** The state of the decapsulator */
+  void *ctx;
+  /** The PID carrying the frames */
+  int pid;
+  /** Do we add a stream for each new PLP or ISI seen ? */
+  int all_streams;
+  /** The streams extracted */
+  int num_streams;
+  decap_stream_t streams[DECAP_MAX_STREAMS];
+  /** The index in streams of each id, -1 if not extracted */
+  int8_t stream_index[256];
+  /** Where the stream buffers go during decap_process */
+  decap_flush_t flush;
+  void *flush_arg;
+  /** The continuity counter state of the PID */
+  uint8_t last_cc;
+  /** The number of frames decoded, of frames dropped (broken, not TS) and of continuity errors */
+  uint64_t frames;
+  uint64_t bad_frames;
+  uint64_t cc_errors;
+}decap_t;
+
+decap_t *decap_new(int type, int pid, int all_streams);
+void decap_free(decap_t *decap);
+void decap_log_totals(decap_t *decap);
+decap_stream_t *decap_add_stream(decap_t *decap, uint8_t id);
+int decap_process(decap_t *decap, unsigned char *buf, int num_packets, decap_flush_t flush, void *flush_arg);
+
+/* For the decapsulators */
+decap_stream_t *decap_frame_stream(decap_t *decap, uint8_t id);
+void decap_stream_resume(decap_stream_t *stream, const unsigned char *data, unsigned int len);
+void decap_stream_packet(decap_stream_t *stream, const unsigned char *data, unsigned int len);
+
+#endif
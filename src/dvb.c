@@ -40,6 +40,8 @@
 #include "log.h"
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "errors.h"
 
 static char *log_module="DVB: ";
 
@@ -67,6 +69,15 @@ open_fe (int *fd_frontend, char *base_path, int tuner, int rw, int full_path)
 	char *frontend_name=NULL;
 	int asprintf_ret;
 	int rw_flag;
+	if(!full_path && dvb_emu_path(base_path))
+	{
+		if((*fd_frontend = dvb_emu_open(base_path, tuner, DVB_EMU_FRONTEND)) < 0)
+		{
+			log_message( log_module,  MSG_ERROR, "EMULATED FRONTEND: \"%s\" : %s\n", base_path, strerror(errno));
+			return -1;
+		}
+		return 1;
+	}
 	if(full_path) //used for pipe input
 		asprintf_ret=asprintf(&frontend_name,"%s",base_path);
 	else
@@ -93,9 +104,10 @@ open_fe (int *fd_frontend, char *base_path, int tuner, int rw, int full_path)
  * opened before. Ie it will ask the card for this PID.
  * @param fd the file descriptor
  * @param pid the pid for the filter
+ * @param output DMX_OUT_TS_TAP (the packets are read on the dvr) or DMX_OUT_TSDEMUX_TAP (on fd)
  */
-void
-set_ts_filt (int fd, uint16_t pid)
+int
+set_ts_filt (int fd, uint16_t pid, int output)
 {
 	struct dmx_pes_filter_params pesFilterParams;
 
@@ -104,20 +116,220 @@ set_ts_filt (int fd, uint16_t pid)
 	memset(&pesFilterParams, 0, sizeof(pesFilterParams));
 	pesFilterParams.pid = pid;
 	pesFilterParams.input = DMX_IN_FRONTEND;
-	pesFilterParams.output = DMX_OUT_TS_TAP;
+	pesFilterParams.output = output;
 	pesFilterParams.pes_type = DMX_PES_OTHER;
 	pesFilterParams.flags = DMX_IMMEDIATE_START;
 
-	if (ioctl (fd, DMX_SET_PES_FILTER, &pesFilterParams) < 0)
+	if (dvb_ioctl(fd, DMX_SET_PES_FILTER, &pesFilterParams) < 0)
 	{
+		int err=errno;
 		log_message( log_module,  MSG_ERROR, "FILTER %i: ", pid);
-		log_message( log_module,  MSG_ERROR, "DMX SET PES FILTER : %s\n", strerror(errno));
+		log_message( log_module,  MSG_ERROR, "DMX SET PES FILTER : %s\n", strerror(err));
+		errno=err;
+		return -1;
+	}
+	return 0;
+}
+
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+/** @brief Read a counter of the DVB API v5 statistics
+ * @return 1 if the counter is available
+ */
+static int fe_stats_counter(struct dtv_property *prop, uint64_t *value)
+{
+	if(!prop->u.st.len || prop->u.st.stat[0].scale!=FE_SCALE_COUNTER)
+		return 0;
+	*value=prop->u.st.stat[0].uvalue;
+	return 1;
+}
+
+/** @brief Compute an error rate from two samples of the counters
+ * @return 1 if the rate is available
+ */
+static int fe_stats_rate(uint64_t errors, uint64_t total, uint64_t prev_errors, uint64_t prev_total, double *rate)
+{
+	//The counters can be reset by the driver (new tuning)
+	if(total<=prev_total || errors<prev_errors)
+		return 0;
+	*rate=(double)(errors-prev_errors)/(total-prev_total);
+	return 1;
+}
+
+/** @brief Take a sample of the statistics with the DVB API v5 : all the measures in one FE_GET_PROPERTY
+ *
+ * @param prev the previous sample, for the error rates
+ * @return 0 on success, -1 if the frontend does not support the v5 statistics
+ */
+static int fe_stats_read_v5(strength_parameters_t *strengthparams, fe_stats_t *prev, fe_stats_t *sample)
+{
+	struct dtv_property props[] = {
+			{ .cmd = DTV_STAT_SIGNAL_STRENGTH },
+			{ .cmd = DTV_STAT_CNR },
+			{ .cmd = DTV_STAT_PRE_ERROR_BIT_COUNT },
+			{ .cmd = DTV_STAT_PRE_TOTAL_BIT_COUNT },
+			{ .cmd = DTV_STAT_POST_ERROR_BIT_COUNT },
+			{ .cmd = DTV_STAT_POST_TOTAL_BIT_COUNT },
+			{ .cmd = DTV_STAT_ERROR_BLOCK_COUNT },
+			{ .cmd = DTV_STAT_TOTAL_BLOCK_COUNT },
+	};
+	struct dtv_properties cmdseq = {
+			.num = sizeof(props)/sizeof(props[0]),
+			.props = props
+	};
+	struct dtv_stats *stat;
+
+	if(dvb_ioctl(strengthparams->fds->fd_frontend, FE_GET_PROPERTY, &cmdseq) < 0)
+		return -1;
+
+	stat=&props[0].u.st.stat[0];
+	if(props[0].u.st.len && stat->scale==FE_SCALE_DECIBEL)
+	{
+		sample->strength=stat->svalue/1000.0;
+		sample->valid|=FE_STATS_STRENGTH_DBM;
+		strengthparams->strength=stat->svalue;
+	}
+	else if(props[0].u.st.len && stat->scale==FE_SCALE_RELATIVE)
+	{
+		sample->strength=stat->uvalue*100.0/65535;
+		sample->valid|=FE_STATS_STRENGTH_REL;
+		strengthparams->strength=stat->uvalue;
+	}
+	stat=&props[1].u.st.stat[0];
+	if(props[1].u.st.len && stat->scale==FE_SCALE_DECIBEL)
+	{
+		sample->cnr=stat->svalue/1000.0;
+		sample->valid|=FE_STATS_CNR_DB;
+		strengthparams->snr=stat->svalue;
+	}
+	else if(props[1].u.st.len && stat->scale==FE_SCALE_RELATIVE)
+	{
+		sample->cnr=stat->uvalue*100.0/65535;
+		sample->valid|=FE_STATS_CNR_REL;
+		strengthparams->snr=stat->uvalue;
+	}
+	if(fe_stats_counter(&props[2], &sample->pre_error_bits) && fe_stats_counter(&props[3], &sample->pre_total_bits))
+	{
+		sample->valid|=FE_STATS_PRE_COUNT;
+		if((prev->valid & FE_STATS_PRE_COUNT) &&
+				fe_stats_rate(sample->pre_error_bits, sample->pre_total_bits, prev->pre_error_bits, prev->pre_total_bits, &sample->pre_ber))
+			sample->valid|=FE_STATS_PRE_BER;
+		strengthparams->ber=sample->pre_error_bits;
+	}
+	if(fe_stats_counter(&props[4], &sample->post_error_bits) && fe_stats_counter(&props[5], &sample->post_total_bits))
+	{
+		sample->valid|=FE_STATS_POST_COUNT;
+		if((prev->valid & FE_STATS_POST_COUNT) &&
+				fe_stats_rate(sample->post_error_bits, sample->post_total_bits, prev->post_error_bits, prev->post_total_bits, &sample->post_ber))
+			sample->valid|=FE_STATS_POST_BER;
+	}
+	if(fe_stats_counter(&props[6], &sample->error_blocks) && fe_stats_counter(&props[7], &sample->total_blocks))
+	{
+		sample->valid|=FE_STATS_BLOCK_COUNT;
+		if((prev->valid & FE_STATS_BLOCK_COUNT) &&
+				fe_stats_rate(sample->error_blocks, sample->total_blocks, prev->error_blocks, prev->total_blocks, &sample->per))
+			sample->valid|=FE_STATS_PER;
+		strengthparams->ub=sample->error_blocks;
+	}
+	return 0;
+}
+#endif
+
+/** @brief Take a sample of the statistics with the legacy ioctls (one per measure, driver specific units)
+ *
+ * Only the measures not already in the sample are read : the frontends
+ * supporting the v5 statistics often report FE_SCALE_NOT_AVAILABLE for some of them
+ */
+static void fe_stats_read_legacy(strength_parameters_t *strengthparams, fe_stats_t *sample, int *meas_ok)
+{
+	uint16_t value16;
+	uint32_t value32;
+	struct {
+		unsigned long request;
+		char *name;
+		int measures; //The v5 measures giving the same information
+	} legacy_ioctls[] = {
+			{ FE_READ_BER, "BER", FE_STATS_PRE_COUNT },
+			{ FE_READ_SIGNAL_STRENGTH, "strength", FE_STATS_STRENGTH_DBM|FE_STATS_STRENGTH_REL },
+			{ FE_READ_SNR, "SNR", FE_STATS_CNR_DB|FE_STATS_CNR_REL },
+			{ FE_READ_UNCORRECTED_BLOCKS, "uncorrected blocks", FE_STATS_BLOCK_COUNT },
+	};
+	int iRet;
+
+	for(int i=0;i<4;i++)
+	{
+		if(sample->valid & legacy_ioctls[i].measures)
+			continue;
+		if(legacy_ioctls[i].request==FE_READ_SIGNAL_STRENGTH || legacy_ioctls[i].request==FE_READ_SNR)
+			iRet=dvb_ioctl(strengthparams->fds->fd_frontend, legacy_ioctls[i].request, &value16);
+		else
+			iRet=dvb_ioctl(strengthparams->fds->fd_frontend, legacy_ioctls[i].request, &value32);
+		if(iRet < 0)
+		{
+			if(meas_ok[i])
+			{
+				meas_ok[i]=0;
+				log_message( log_module,  MSG_WARN, "An issue happened during the IOCTLS to take %s measurements error: %s",legacy_ioctls[i].name,strerror(errno));
+			}
+			continue;
+		}
+		meas_ok[i]=1;
+		switch(legacy_ioctls[i].request)
+		{
+		case FE_READ_BER:
+			strengthparams->ber=value32;
+			break;
+		case FE_READ_SIGNAL_STRENGTH:
+			strengthparams->strength=value16;
+			//Most of the drivers give a relative strength on 16 bits
+			sample->strength=value16*100.0/65535;
+			sample->valid|=FE_STATS_STRENGTH_REL;
+			break;
+		case FE_READ_SNR:
+			strengthparams->snr=value16;
+			sample->cnr=value16*100.0/65535;
+			sample->valid|=FE_STATS_CNR_REL;
+			break;
+		case FE_READ_UNCORRECTED_BLOCKS:
+			strengthparams->ub=value32;
+			break;
+		}
+	}
+}
+
+/** @brief Display a sample of the statistics */
+static void fe_stats_display(strength_parameters_t *strengthparams, fe_stats_t *sample)
+{
+	char line[256];
+	int len=0;
+
+	if(!strengthparams->stats_v5)
+	{
+		log_message( log_module,  MSG_INFO, "Bit error rate: %10d Signal strength: %10d SNR: %10d Uncorrected blocks: %10d\n", strengthparams->ber,strengthparams->strength,strengthparams->snr,strengthparams->ub);
+		return;
 	}
+	line[0]='\0';
+	if(sample->valid & FE_STATS_STRENGTH_DBM)
+		len+=snprintf(line+len, sizeof(line)-len, "Signal strength: %.1f dBm ", sample->strength);
+	else if(sample->valid & FE_STATS_STRENGTH_REL)
+		len+=snprintf(line+len, sizeof(line)-len, "Signal strength: %.1f %% ", sample->strength);
+	if(sample->valid & FE_STATS_CNR_DB)
+		len+=snprintf(line+len, sizeof(line)-len, "CNR: %.1f dB ", sample->cnr);
+	else if(sample->valid & FE_STATS_CNR_REL)
+		len+=snprintf(line+len, sizeof(line)-len, "CNR: %.1f %% ", sample->cnr);
+	if(sample->valid & FE_STATS_PRE_BER)
+		len+=snprintf(line+len, sizeof(line)-len, "BER: %.2e ", sample->pre_ber);
+	if(sample->valid & FE_STATS_POST_BER)
+		len+=snprintf(line+len, sizeof(line)-len, "Post BER: %.2e ", sample->post_ber);
+	if(sample->valid & FE_STATS_BLOCK_COUNT)
+		snprintf(line+len, sizeof(line)-len, "Uncorrected blocks: %llu", (unsigned long long) sample->error_blocks);
+	log_message( log_module,  MSG_INFO, "%s\n", line);
 }
 
 /**
  * @brief Show the reception power.
  * This information is not alway reliable
+ * The statistics are taken every tune_p->stats_interval ms, with one FE_GET_PROPERTY
+ * if the frontend supports the DVB API v5 statistics, with the legacy ioctls otherwise.
  * @param fds the file descriptors of the card
  */
 void *show_power_func(void* arg)
@@ -126,79 +338,67 @@ void *show_power_func(void* arg)
 	strengthparams= (strength_parameters_t  *) arg;
 	fe_status_t festatus_old;
 	int lock_lost;
-	int meas_ber_ok=1;
-	int meas_strength_ok=1;
-	int meas_snr_ok=1;
-	int meas_ub_ok=1;
-	int wait_time=20;//in units of 100ms
-	int i;
+	int meas_ok[4]={1,1,1,1};
+	fe_stats_t sample;
+	uint64_t last_display=0;
+	uint64_t next_sample;
 	strengthparams->strength = 0;
 	strengthparams->ber = 0;
 	strengthparams->snr = 0;
 	strengthparams->ub = 0;
 	strengthparams->ts_discontinuities = 0; //could be initialized somewhere else but sounds fine here
+	pthread_mutex_lock(&strengthparams->stats_lock);
+	strengthparams->stats_history_pos = 0;
+	strengthparams->stats_history_num = 0;
+	memset(&strengthparams->stats,0,sizeof(fe_stats_t));
+	pthread_mutex_unlock(&strengthparams->stats_lock);
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+	strengthparams->stats_v5 = 1;
+#else
+	strengthparams->stats_v5 = 0;
+#endif
 	memset(&festatus_old,0,sizeof(fe_status_t));
 	lock_lost=0;
 	while(!strengthparams->tune_p->strengththreadshutdown)
 	{
+		next_sample=get_time()+(uint64_t)strengthparams->tune_p->stats_interval*1000;
 		if(strengthparams->tune_p->card_tuned)
 		{
 			if(strengthparams->tune_p->display_strenght )
 				mumu_timing();
 
-			if (ioctl (strengthparams->fds->fd_frontend, FE_READ_BER, &strengthparams->ber) < 0)
-			{
-				if(meas_ber_ok)
-				{
-					meas_ber_ok=0;
-					log_message( log_module,  MSG_WARN, "An issue happened during the IOCTLS to take BER measurements error: %s",strerror(errno));
-				}
-			}
-			else
-				meas_ber_ok=1;
-
-			if (ioctl (strengthparams->fds->fd_frontend, FE_READ_SIGNAL_STRENGTH, &strengthparams->strength) < 0)
-			{
-				if(meas_strength_ok)
-				{
-					meas_strength_ok=0;
-					log_message( log_module,  MSG_WARN, "An issue happened during the IOCTLS to take strength measurements error: %s",strerror(errno));
-				}
-			}
-			else
-				meas_strength_ok=1;
-			if (ioctl (strengthparams->fds->fd_frontend, FE_READ_SNR, &strengthparams->snr) < 0)
+			memset(&sample,0,sizeof(fe_stats_t));
+			sample.time=get_time();
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+			if(strengthparams->stats_v5 && fe_stats_read_v5(strengthparams, &strengthparams->stats, &sample) < 0)
 			{
-				if(meas_snr_ok)
-				{
-					meas_snr_ok=0;
-					log_message( log_module,  MSG_WARN, "An issue happened during the IOCTLS to take SNR measurements error: %s",strerror(errno));
-				}
+				log_message( log_module,  MSG_DETAIL, "No DVB API v5 statistics (%s), we use the legacy ioctls\n", strerror(errno));
+				strengthparams->stats_v5 = 0;
 			}
-			else
-				meas_snr_ok=1;
-			if (ioctl (strengthparams->fds->fd_frontend, FE_READ_UNCORRECTED_BLOCKS, &strengthparams->ub) < 0 )
-			{
-				if(meas_ub_ok)
-				{
-					meas_ub_ok=0;
-					log_message( log_module,  MSG_WARN, "An issue happened during the IOCTLS to take uncorrected blocks measurements error: %s",strerror(errno));
-				}
-			}
-			else
-				meas_ub_ok=1;
-
+#endif
+			//The measures the v5 statistics did not give are taken with the legacy ioctls
+			fe_stats_read_legacy(strengthparams, &sample, meas_ok);
+			//The sample is published under the lock, the HTTP monitoring reads it
+			pthread_mutex_lock(&strengthparams->stats_lock);
+			strengthparams->stats=sample;
+			strengthparams->stats_history[strengthparams->stats_history_pos]=sample;
+			strengthparams->stats_history_pos=(strengthparams->stats_history_pos+1)%FE_STATS_HISTORY_LEN;
+			if(strengthparams->stats_history_num<FE_STATS_HISTORY_LEN)
+				strengthparams->stats_history_num++;
+			pthread_mutex_unlock(&strengthparams->stats_lock);
 		}
-		if(strengthparams->tune_p->display_strenght && strengthparams->tune_p->card_tuned)
+		if(strengthparams->tune_p->display_strenght && strengthparams->tune_p->card_tuned &&
+				(get_time()-last_display)>=FE_STATS_DISPLAY_INTERVAL*1000)
 		{
-			log_message( log_module,  MSG_INFO, "Bit error rate: %10d Signal strength: %10d SNR: %10d Uncorrected blocks: %10d\n", strengthparams->ber,strengthparams->strength,strengthparams->snr,strengthparams->ub);
+			last_display=get_time();
+			fe_stats_display(strengthparams, &strengthparams->stats);
 			log_message( log_module,  MSG_INFO, "ts_discontinuities %10d",strengthparams->ts_discontinuities);
 
 			log_message( log_module,  MSG_FLOOD, "Timing: ioctls took %ld micro seconds\n",mumu_timing());
 		}
 		if((strengthparams->tune_p->check_status ||strengthparams->tune_p->display_strenght) && strengthparams->tune_p->card_tuned)
 		{
-			if (ioctl (strengthparams->fds->fd_frontend, FE_READ_STATUS, &strengthparams->festatus) != -1)
+			if (dvb_ioctl(strengthparams->fds->fd_frontend, FE_READ_STATUS, &strengthparams->festatus) != -1)
 			{
 				if((!(strengthparams->festatus & FE_HAS_LOCK) ) && (festatus_old != strengthparams->festatus))
 				{
@@ -217,17 +417,65 @@ void *show_power_func(void* arg)
 				}
 			}
 		}
-		for(i=0;i<wait_time && !strengthparams->tune_p->strengththreadshutdown;i++)
-			usleep(100000);
+		//We wait by steps of 100ms at most to see the shutdown
+		while(!strengthparams->tune_p->strengththreadshutdown && get_time()<next_sample)
+		{
+			uint64_t wait=next_sample-get_time();
+			usleep(wait<100000 ? wait : 100000);
+		}
 	}
 	return 0;
 }
 
 
 /**
- * @brief Open file descriptors for the card. open dvr and one demuxer fd per asked pid. This function can be called 
+ * @brief Open a demux or dvr device of the card (emulated or not)
+ * if <dev><tuner> is not found, we use <dev>0 (for cards with multiple frontends like CXD2837ER)
+ * @return the file descriptor, -1 on error
+ */
+static int
+open_card_dev(char *base_path, char *dev_name, int tuner, int emu_type, int flags)
+{
+	char *dev_path=NULL;
+	int fd;
+
+	if(dvb_emu_path(base_path))
+	{
+		if((fd = dvb_emu_open(base_path, tuner, emu_type)) < 0)
+			log_message( log_module,  MSG_ERROR, "EMULATED %s : %s : %s\n", dev_name, base_path, strerror(errno));
+		return fd;
+	}
+	if(asprintf(&dev_path,"%s/%s%d",base_path,dev_name,tuner)==-1)
+		return -1;
+	if (!file_exists(dev_path) && tuner > 0) {
+		free(dev_path);
+		if(asprintf(&dev_path,"%s/%s%d",base_path,dev_name,0)==-1)
+			return -1;
+	}
+	if((fd = open (dev_path, flags)) < 0)
+	{
+		int err=errno;
+		log_message( log_module,  MSG_ERROR, "%s DEVICE: %s : %s\n", dev_name, dev_path, strerror(err));
+		errno=err;
+	}
+	free(dev_path);
+	return fd;
+}
+
+/** @brief Does this error mean the card has no more hardware filters ? */
+static int filters_exhausted(int err)
+{
+	return err==EBUSY || err==ENOSPC || err==EMFILE || err==ENOMEM;
+}
+
+/**
+ * @brief Open file descriptors for the card. open the demuxer : one fd for all the pids
+ * (DMX_ADD_PID) or, with old kernels, one fd per asked pid and the dvr. This function can be called
  * more than one time if new pids are added (typical case autoconf)
- * return -1 in case of error
+ * When the card gives the full TS (fds->full_ts) only the shared demuxer is opened
+ * The shared demuxer gives the packets itself (DMX_OUT_TSDEMUX_TAP, the kernel refuses DMX_ADD_PID
+ * for the filters sending to the dvr), see card_data_fd
+ * return -1 in case of error, FILTERS_FULL_TS if the card cannot open more demuxers
  * @param card the card number
  * @param asked_pid the array of asked pids
  * @param fds the structure with the file descriptors
@@ -237,78 +485,298 @@ create_card_fd(char *base_path, int tuner, uint8_t *asked_pid, fds_t *fds)
 {
 
 	int curr_pid = 0;
-	char *demuxdev_name=NULL;
-	char *dvrdev_name=NULL;
-	int asprintf_ret;
 
-	asprintf_ret=asprintf(&demuxdev_name,"%s/%s%d",base_path,DEMUX_DEV_NAME,tuner);
-	if(asprintf_ret==-1)
-		return -1;
-
-	// if demux<tuner> not found, attempt to use demux0 (for cards with multiple frontends like CXD2837ER)
-	if (!file_exists(demuxdev_name) && tuner > 0) {
-		asprintf_ret=asprintf(&demuxdev_name,"%s/%s%d",base_path,DEMUX_DEV_NAME,0);
-		if(asprintf_ret==-1)
-			return -1;
-	}
-
-	for(curr_pid=0;curr_pid<8193;curr_pid++)
-		//file descriptors for the demuxer (used to set the filters)
-		//we check if we need to open the file descriptor (some cards are limited)
-		if ((asked_pid[curr_pid] != 0)&& (fds->fd_demuxer[curr_pid]==0) )
-			if((fds->fd_demuxer[curr_pid] = open (demuxdev_name, O_RDWR)) < 0)
+#ifndef DMX_ADD_PID
+	fds->demux_per_pid=1;
+#endif
+	if(!fds->demux_per_pid || fds->full_ts)
+	{
+		//One file descriptor for all the PIDs
+		if (fds->fd_demux==0)
+		{
+			if((fds->fd_demux = open_card_dev(base_path, DEMUX_DEV_NAME, tuner, DVB_EMU_DEMUX, O_RDWR | O_NONBLOCK)) < 0)
 			{
-				log_message( log_module,  MSG_ERROR, "FD PID %i: ", curr_pid);
-				log_message( log_module,  MSG_ERROR, "DEMUX DEVICE: %s : %s\n", demuxdev_name, strerror(errno));
-				free(demuxdev_name);
+				fds->fd_demux=0;
 				return -1;
 			}
-
-
-	asprintf_ret=asprintf(&dvrdev_name,"%s/%s%d",base_path,DVR_DEV_NAME,tuner);
-	if(asprintf_ret==-1)
-		return -1;
-
-	// if dvr<tuner> not found, attempt to use dvr0 (for cards with multiple frontends like CXD2837ER)
-	if (!file_exists(dvrdev_name) && tuner > 0) {
-		asprintf_ret=asprintf(&dvrdev_name,"%s/%s%d",base_path,DVR_DEV_NAME,0);
-		if(asprintf_ret==-1)
-			return -1;
+#ifdef DMX_ADD_PID
+			//The default buffer of a demux file descriptor is too small for a TS
+			if (dvb_ioctl (fds->fd_demux, DMX_SET_BUFFER_SIZE, DEMUX_BUFFER_SIZE) < 0)
+				log_message( log_module,  MSG_WARN, "DMX SET BUFFER SIZE : %s\n", strerror(errno));
+#endif
+		}
+#ifdef DMX_ADD_PID
+		return 0;
+#endif
+	}
+	else
+	{
+		for(curr_pid=0;curr_pid<8193;curr_pid++)
+			//file descriptors for the demuxer (used to set the filters)
+			//we check if we need to open the file descriptor (some cards are limited)
+			if ((asked_pid[curr_pid] != 0)&& (fds->fd_demuxer[curr_pid]==0) )
+				if((fds->fd_demuxer[curr_pid] = open_card_dev(base_path, DEMUX_DEV_NAME, tuner, DVB_EMU_DEMUX, O_RDWR)) < 0)
+				{
+					fds->fd_demuxer[curr_pid]=0;
+					if(filters_exhausted(errno))
+						return FILTERS_FULL_TS;
+					log_message( log_module,  MSG_ERROR, "FD PID %i: ", curr_pid);
+					return -1;
+				}
 	}
 
 	if (fds->fd_dvr==0)  //this function can be called more than one time, we check if we opened it before
-		if ((fds->fd_dvr = open (dvrdev_name, O_RDONLY | O_NONBLOCK)) < 0)
+		if ((fds->fd_dvr = open_card_dev(base_path, DVR_DEV_NAME, tuner, DVB_EMU_DVR, O_RDONLY | O_NONBLOCK)) < 0)
 		{
-			log_message( log_module,  MSG_ERROR, "DVR DEVICE: %s : %s\n", dvrdev_name, strerror(errno));
-			free(dvrdev_name);
+			fds->fd_dvr=0;
 			return -1;
 		}
 
-
-	free(dvrdev_name);
-	free(demuxdev_name);
 	return 0;
 
 }
 
+#ifdef DMX_ADD_PID
+/**
+ * @brief Add a PID to the demux file descriptor shared by all the PIDs
+ * The first PID sets the filter (DMX_SET_PES_FILTER), the next ones are added with DMX_ADD_PID
+ * @return FILTERS_OK on success, FILTERS_PER_PID if the kernel does not support DMX_ADD_PID,
+ * FILTERS_FULL_TS if there is no more hardware filters, -1 on error
+ */
+static int
+add_demux_pid(fds_t *fds, uint16_t pid)
+{
+	int err;
+
+	if(!fds->demux_num_pids)
+	{
+		if(set_ts_filt (fds->fd_demux, pid, DEMUX_SHARED_OUTPUT) < 0)
+			return filters_exhausted(errno) ? FILTERS_FULL_TS : -1;
+		fds->demux_num_pids=1;
+		return FILTERS_OK;
+	}
+	log_message( log_module,  MSG_DEBUG, "Adding PID %d to the demux filter\n", pid);
+	if (dvb_ioctl (fds->fd_demux, DMX_ADD_PID, &pid) < 0)
+	{
+		err=errno;
+		//Old kernels : we can only have one PID per file descriptor
+		if(fds->demux_num_pids==1 && (err==ENOTTY || err==EINVAL))
+			return FILTERS_PER_PID;
+		if(filters_exhausted(err))
+			return FILTERS_FULL_TS;
+		log_message( log_module,  MSG_ERROR, "DMX ADD PID %d : %s\n", pid, strerror(err));
+		return -1;
+	}
+	fds->demux_num_pids++;
+	return FILTERS_OK;
+}
+#endif
+
+/**
+ * @brief Switch the card to the full TS : one filter on the PID 8192 and the asked pids
+ * are selected by the software filter. Used when there is no more hardware filters.
+ * @return -1 in case of error
+ */
+static int
+set_full_ts(char *base_path, int tuner, uint8_t *asked_pid, fds_t *fds)
+{
+	pid_sw_filter_t *sw_filter=&fds->sw_filter;
+
+	log_message( log_module,  MSG_INFO, "No more hardware PID filters, we take the full TS and filter the PIDs in software\n");
+	for(int curr_pid=0;curr_pid<8193;curr_pid++)
+		if(fds->fd_demuxer[curr_pid])
+		{
+			dvb_close(fds->fd_demuxer[curr_pid]);
+			fds->fd_demuxer[curr_pid]=0;
+		}
+	fds->full_ts=1;
+	if (fds->fd_demux==0)
+	{
+		if (create_card_fd (base_path, tuner, asked_pid, fds) < 0)
+			return -1;
+	}
+	else
+		dvb_ioctl (fds->fd_demux, DMX_STOP);
+	fds->demux_num_pids=0;
+	if (set_ts_filt (fds->fd_demux, 8192, DEMUX_SHARED_OUTPUT) < 0)
+		return -1;
+	fds->demux_num_pids=1;
+
+	memset(sw_filter->bitmap, 0, sizeof(sw_filter->bitmap));
+	for(int curr_pid=0;curr_pid<8193;curr_pid++)
+		if (asked_pid[curr_pid] != PID_NOT_ASKED)
+			asked_pid[curr_pid] = PID_ASKED;
+	sw_filter->active=1;
+	sw_filter->whole_ts=1;
+	//In full TS, set_filters only updates the software filter
+	return set_filters(asked_pid, fds) == FILTERS_OK ? 0 : -1;
+}
+
+/** @brief Count the PIDs which will need a hardware filter */
+static int
+count_hw_filters(uint8_t *asked_pid)
+{
+	int num=0;
+	for(int curr_pid=0;curr_pid<8193;curr_pid++)
+		if (asked_pid[curr_pid] != PID_NOT_ASKED)
+			num++;
+	return num;
+}
 
 /**
  * @brief Open filters for the pids in asked_pid. This function update the asked_pid array and 
  * can be called more than one time if new pids are added (typical case autoconf)
- * Ie it asks the card for the pid list by calling set_ts_filt
+ * Ie it asks the card for the new pids only, with DMX_ADD_PID on the shared demux file
+ * descriptor or by calling set_ts_filt on the file descriptor of each pid
+ * When the card gives the full TS, only the software filter is updated
  * @param asked_pid the array of asked pids
  * @param fds the structure with the file descriptors
+ * @return FILTERS_PER_PID if we have to go back to one file descriptor per pid (create_card_fd has to be called again),
+ * FILTERS_FULL_TS if there is no more hardware filters, FILTERS_OK otherwise
  */
-void set_filters(uint8_t *asked_pid, fds_t *fds)
+int set_filters(uint8_t *asked_pid, fds_t *fds)
 {
 
+	if(fds->full_ts)
+	{
+		for(int curr_pid=0;curr_pid<8193;curr_pid++)
+			if (asked_pid[curr_pid] == PID_ASKED )
+			{
+				if(curr_pid==8192)
+					memset(fds->sw_filter.bitmap, 0xff, sizeof(fds->sw_filter.bitmap));
+				else
+					fds->sw_filter.bitmap[curr_pid>>6] |= 1ULL<<(curr_pid&63);
+				asked_pid[curr_pid] = PID_FILTERED;
+			}
+		return FILTERS_OK;
+	}
+	if(fds->max_hw_filters && count_hw_filters(asked_pid) > fds->max_hw_filters)
+		return FILTERS_FULL_TS;
+#ifdef DMX_ADD_PID
+	if(!fds->demux_per_pid)
+	{
+		for(int curr_pid=0;curr_pid<8193;curr_pid++)
+			if (asked_pid[curr_pid] == PID_ASKED )
+			{
+				int iRet=add_demux_pid(fds, curr_pid);
+				if(iRet==FILTERS_FULL_TS)
+					return FILTERS_FULL_TS;
+				if(iRet==FILTERS_PER_PID)
+				{
+					log_message( log_module,  MSG_INFO, "DMX_ADD_PID not supported by the kernel, we use one demux file descriptor per PID\n");
+					//The shared file descriptor keeps the first PID, its packets now go to the dvr
+					for(int first_pid=0;first_pid<8193;first_pid++)
+						if(asked_pid[first_pid] == PID_FILTERED && fds->fd_demuxer[first_pid]==0)
+						{
+							fds->fd_demuxer[first_pid]=fds->fd_demux;
+							if(set_ts_filt (fds->fd_demux, first_pid, DMX_OUT_TS_TAP) < 0)
+								asked_pid[first_pid] = PID_ASKED;
+							break;
+						}
+					fds->fd_demux=0;
+					fds->demux_num_pids=0;
+					fds->demux_per_pid=1;
+					return FILTERS_PER_PID;
+				}
+				asked_pid[curr_pid] = PID_FILTERED;
+				if(curr_pid==8192)
+					fds->sw_filter.whole_ts=1;
+			}
+		return FILTERS_OK;
+	}
+#endif
 	for(int curr_pid=0;curr_pid<8193;curr_pid++)
 		if (asked_pid[curr_pid] == PID_ASKED )
 		{
-			set_ts_filt (fds->fd_demuxer[curr_pid], curr_pid);
+			if(set_ts_filt (fds->fd_demuxer[curr_pid], curr_pid, DMX_OUT_TS_TAP) < 0 && filters_exhausted(errno))
+				return FILTERS_FULL_TS;
 			asked_pid[curr_pid] = PID_FILTERED;
+			if(curr_pid==8192)
+				fds->sw_filter.whole_ts=1;
 		}
+	return FILTERS_OK;
+}
+
+/**
+ * @brief The file descriptor giving the packets : the shared demuxer when it is used
+ * (DMX_OUT_TSDEMUX_TAP), the dvr with one demuxer per pid
+ */
+int card_data_fd(fds_t *fds)
+{
+#ifdef DMX_ADD_PID
+	if(fds->fd_demux)
+		return fds->fd_demux;
+#endif
+	return fds->fd_dvr;
+}
 
+/**
+ * @brief Open the file descriptors and the filters for the asked pids, see create_card_fd and set_filters
+ * If the card runs out of hardware filters (or max_hw_filters is reached), the card gives the full TS
+ * and the pids are filtered in software
+ * The file descriptor polled for the packets (fds->pfds[0]) follows the changes, see card_data_fd
+ * @return -1 in case of error
+ */
+int open_card_filters(char *base_path, int tuner, uint8_t *asked_pid, fds_t *fds)
+{
+	int iRet;
+
+	if(!fds->full_ts && fds->max_hw_filters && count_hw_filters(asked_pid) > fds->max_hw_filters)
+		iRet = FILTERS_FULL_TS;
+	else if ((iRet = create_card_fd (base_path, tuner, asked_pid, fds)) < 0)
+		return -1;
+	if (iRet == FILTERS_OK)
+		iRet = set_filters(asked_pid, fds);
+	if (iRet == FILTERS_PER_PID)
+	{
+		//Fallback to one file descriptor per pid
+		if ((iRet = create_card_fd (base_path, tuner, asked_pid, fds)) < 0)
+			return -1;
+		if (iRet == FILTERS_OK)
+			iRet = set_filters(asked_pid, fds);
+	}
+	if (iRet == FILTERS_FULL_TS && set_full_ts(base_path, tuner, asked_pid, fds) < 0)
+		return -1;
+	if(fds->pfds)
+		fds->pfds[0].fd=card_data_fd(fds);
+	return 0;
+}
+
+/**
+ * @brief Stop filtering a pid
+ * @param pid the pid
+ * @param fds the structure with the file descriptors
+ */
+void remove_filter(uint16_t pid, fds_t *fds)
+{
+	if(fds->full_ts)
+	{
+		if(pid<8192)
+			fds->sw_filter.bitmap[pid>>6] &= ~(1ULL<<(pid&63));
+		return;
+	}
+	if(pid==8192)
+		fds->sw_filter.whole_ts=0;
+	if(fds->fd_demuxer[pid])
+	{
+		dvb_close(fds->fd_demuxer[pid]);
+		fds->fd_demuxer[pid]=0;
+		return;
+	}
+#ifdef DMX_ADD_PID
+	if(fds->fd_demux && fds->demux_num_pids)
+	{
+		log_message( log_module,  MSG_DEBUG, "Removing PID %d from the demux filter\n", pid);
+		if (dvb_ioctl (fds->fd_demux, DMX_REMOVE_PID, &pid) < 0)
+		{
+			log_message( log_module,  MSG_ERROR, "DMX REMOVE PID %d : %s\n", pid, strerror(errno));
+			return;
+		}
+		//No more PIDs, the next one will set the filter again
+		if(!--fds->demux_num_pids)
+			dvb_ioctl (fds->fd_demux, DMX_STOP);
+	}
+#endif
 }
 
 
@@ -325,38 +793,150 @@ close_card_fd(fds_t *fds)
 	{
 		if(fds->fd_demuxer[curr_pid])
 		{
-			close(fds->fd_demuxer[curr_pid]);
+			dvb_close(fds->fd_demuxer[curr_pid]);
 			fds->fd_demuxer[curr_pid]=0;
 		}
 	}
+	if(fds->fd_demux)
+		dvb_close (fds->fd_demux);
+	fds->fd_demux=0;
+	fds->demux_num_pids=0;
+	fds->full_ts=0;
+	fds->sw_filter.active=0;
+	fds->sw_filter.whole_ts=0;
 
 	if(fds->fd_dvr)
-		close (fds->fd_dvr);
+		dvb_close (fds->fd_dvr);
 	fds->fd_dvr=0;
 	if(fds->fd_frontend)
-		close (fds->fd_frontend);
+		dvb_close (fds->fd_frontend);
 	fds->fd_frontend=0;
 
 }
 
 
+/**
+ * @brief Allocate the ring between the card reading thread and the main loop
+ * @param num_packets the minimum number of packets, rounded up to a power of two
+ * @return 0 on success
+ */
+int card_ring_init(card_ring_t *ring, int num_packets)
+{
+	unsigned int size=1;
+
+	while(size<(unsigned int)num_packets)
+		size<<=1;
+	memset(ring,0,sizeof(card_ring_t));
+	ring->efd=eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(ring->efd<0)
+	{
+		log_message( log_module,  MSG_ERROR, "Cannot create the eventfd for the card reading thread : %s\n", strerror(errno));
+		return -1;
+	}
+	if(posix_memalign((void **)&ring->packets, CACHE_LINE_SIZE, (size_t)size*TS_PACKET_SIZE))
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		ring->packets=NULL;
+		close(ring->efd);
+		return -1;
+	}
+	ring->size=size;
+	log_message( log_module,  MSG_DEBUG, "Card reading thread ring : %u packets\n", size);
+	return 0;
+}
+
+/** @brief Free the ring */
+void card_ring_free(card_ring_t *ring)
+{
+	if(ring->packets==NULL)
+		return;
+	free(ring->packets);
+	ring->packets=NULL;
+	close(ring->efd);
+}
+
+/** @brief Wait for packets in the ring (consumer side)
+ * The consumer only sleeps on the eventfd when the ring is empty
+ * @param timeout the maximum waiting time in ms
+ * @return the number of packets in the ring, 0 on timeout
+ */
+int card_ring_wait(card_ring_t *ring, int timeout)
+{
+	unsigned int tail=ring->tail;
+	unsigned int head;
+	struct pollfd pfd;
+	uint64_t value;
+
+	head=__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	if(head!=tail)
+		return head-tail;
+	//We tell the thread we are waiting, then check again to avoid missing a wake up
+	__atomic_store_n(&ring->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+	head=__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+	if(head==tail)
+	{
+		pfd.fd=ring->efd;
+		pfd.events=POLLIN;
+		if(poll(&pfd, 1, timeout)>0)
+		{
+			if(read(ring->efd, &value, sizeof(value))<0 && errno!=EAGAIN)
+				log_message( log_module,  MSG_WARN, "eventfd read : %s\n", strerror(errno));
+		}
+		head=__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	}
+	__atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_RELAXED);
+	return head-tail;
+}
+
+/** @brief Get the packets to process (consumer side)
+ * @param packets set to the first packet
+ * @return the number of contiguous packets available
+ */
+int card_ring_peek(card_ring_t *ring, unsigned char **packets)
+{
+	unsigned int tail=ring->tail;
+	unsigned int available=__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)-tail;
+	unsigned int contiguous=ring->size-(tail & (ring->size-1));
+
+	*packets=ring->packets+(size_t)(tail & (ring->size-1))*TS_PACKET_SIZE;
+	return available<contiguous ? available : contiguous;
+}
+
+/** @brief Give back the processed packets to the reading thread (consumer side) */
+void card_ring_release(card_ring_t *ring, int num_packets)
+{
+	__atomic_store_n(&ring->tail, ring->tail+num_packets, __ATOMIC_RELEASE);
+}
+
 /**
  * @brief Function for the tread reading data from the card
+ * The packets are read directly in the free slots of card_buffer->ring. When the
+ * ring is full we still read the card (to avoid DVR overflows) and count the lost packets.
  * @param arg the structure with the thread parameters
  */
 void *read_card_thread_func(void* arg)
 {
 	card_thread_parameters_t  *threadparams;
 	threadparams= (card_thread_parameters_t  *) arg;
+	card_ring_t *ring=&threadparams->card_buffer->ring;
+	unsigned char *drop_buffer;
+	unsigned int head, tail, free_slots, contiguous;
+	uint64_t dropped_before=0;
+	uint64_t value=1;
+	int max_packets;
+	int bytes_read;
 
 	int poll_ret;
-	pthread_mutex_lock(&threadparams->carddatamutex);
-	threadparams->card_buffer->bytes_in_write_buffer=0;
-	pthread_mutex_unlock(&threadparams->carddatamutex);
 	int throwing_packets=0;
+	drop_buffer=malloc(TS_PACKET_SIZE*threadparams->card_buffer->dvr_buffer_size);
+	if(drop_buffer==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		set_interrupted(ERROR_MEMORY<<8);
+		return NULL;
+	}
 	log_message( log_module,  MSG_DEBUG, "Reading thread start\n");
 
-	usleep(100000); //some waiting to be sure the main program is waiting //it is probably useless
 	while(!threadparams->threadshutdown&& !get_interrupted())
 	{
 		//Poll the DVB descriptors
@@ -365,78 +945,176 @@ void *read_card_thread_func(void* arg)
 		{
 			log_message( log_module,  MSG_ERROR, "Thread polling issue\n");
 			set_interrupted(-poll_ret);
+			free(drop_buffer);
 			return NULL;
 		}
-		if((!(threadparams->fds->pfds[0].revents&POLLIN)) && (!(threadparams->fds->pfds[0].revents&POLLPRI))) //Timeout, we give the ball back to the main for unicast polling
+		if((!(threadparams->fds->pfds[0].revents&POLLIN)) && (!(threadparams->fds->pfds[0].revents&POLLPRI))) //Timeout
 		{
-			if(threadparams->main_waiting)
-			{
-				pthread_cond_signal(&threadparams->threadcond);
-			}
 			//no DVB packet, we continue
 			continue;
 		}
-		if((threadparams->card_buffer->bytes_in_write_buffer+TS_PACKET_SIZE*threadparams->card_buffer->dvr_buffer_size)>threadparams->card_buffer->write_buffer_size)
+		head=ring->head;
+		tail=__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		free_slots=ring->size-(head-tail);
+		if(!free_slots)
 		{
-			/**@todo : use a dynamic buffer ?*/
+			//The ring is full, the packets are lost but counted
 			if(!throwing_packets)
 			{
-				throwing_packets=1; /** @todo count them*/
+				throwing_packets=1;
+				dropped_before=ring->dropped_packets;
 				log_message( log_module,  MSG_INFO, "Thread trowing dvb packets\n");
 			}
-			if(threadparams->main_waiting)
-			{
-				pthread_cond_signal(&threadparams->threadcond);
-			}
+			bytes_read=card_read(threadparams->fds->pfds[0].fd, drop_buffer, threadparams->card_buffer);
+			ring->dropped_packets+=bytes_read/TS_PACKET_SIZE;
 			continue;
 		}
-		throwing_packets=0;
-		pthread_mutex_lock(&threadparams->carddatamutex);
-		threadparams->card_buffer->bytes_in_write_buffer+=card_read(threadparams->fds->fd_dvr,
-				threadparams->card_buffer->writing_buffer+threadparams->card_buffer->bytes_in_write_buffer,
+		if(throwing_packets)
+		{
+			throwing_packets=0;
+			log_message( log_module,  MSG_INFO, "Thread stopped trowing packets, %llu packets lost\n",
+					(unsigned long long) (ring->dropped_packets-dropped_before));
+		}
+		contiguous=ring->size-(head & (ring->size-1));
+		max_packets=threadparams->card_buffer->dvr_buffer_size;
+		if((unsigned int)max_packets>free_slots)
+			max_packets=free_slots;
+		if((unsigned int)max_packets>contiguous)
+			max_packets=contiguous;
+		bytes_read=card_read_max(threadparams->fds->pfds[0].fd,
+				ring->packets+(size_t)(head & (ring->size-1))*TS_PACKET_SIZE,
+				max_packets,
 				threadparams->card_buffer);
-
-		if(threadparams->main_waiting)
+		if(bytes_read<=0)
+			continue;
+		__atomic_store_n(&ring->head, head+bytes_read/TS_PACKET_SIZE, __ATOMIC_RELEASE);
+		//Wake up the consumer if it sleeps (the fence pairs with the one in card_ring_wait)
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&ring->consumer_waiting, __ATOMIC_RELAXED))
 		{
-			pthread_cond_signal(&threadparams->threadcond);
+			if(write(ring->efd, &value, sizeof(value))<0 && errno!=EAGAIN)
+				log_message( log_module,  MSG_WARN, "eventfd write : %s\n", strerror(errno));
 		}
-		pthread_mutex_unlock(&threadparams->carddatamutex);
 	}
+	free(drop_buffer);
 	return NULL;
 }
 
 
 
 
+/** @brief : Keep only the packets of the PIDs set in the software filter (full TS)
+ * The packets are moved to the front of the buffer
+ * @return the number of bytes kept
+ */
+static int card_sw_filter(card_buffer_t *card_buffer, unsigned char *buffer, int len)
+{
+	const pid_sw_filter_t *sw_filter=card_buffer->sw_filter;
+	int kept=0;
+	uint16_t pid;
+
+	for(int pos=0;pos<len;pos+=TS_PACKET_SIZE)
+	{
+		pid=((buffer[pos+1] & 0x1f) << 8) | buffer[pos+2];
+		if(pid_sw_filter_test(sw_filter, pid))
+		{
+			if(kept!=pos)
+				memmove(buffer+kept, buffer+pos, TS_PACKET_SIZE);
+			kept+=TS_PACKET_SIZE;
+		}
+	}
+	card_buffer->sw_filtered_packets+=(len-kept)/TS_PACKET_SIZE;
+	return kept;
+}
+
 /** @brief : Read data from the card
  * This function have to be called after a poll to ensure there is data to read
  * 
  */
 int card_read(int fd_dvr, unsigned char *dest_buffer, card_buffer_t *card_buffer)
 {
-	/* Attempt to read 188 bytes * dvr_buffer_size from /dev/____/dvr */
-	int bytes_read;
-	if ((bytes_read = read (fd_dvr, dest_buffer, TS_PACKET_SIZE*card_buffer->dvr_buffer_size)) > 0)
+	return card_read_max(fd_dvr, dest_buffer, card_buffer->dvr_buffer_size, card_buffer);
+}
+
+/** @brief : Log a read error of the card */
+static void card_read_error(card_buffer_t *card_buffer)
+{
+	if(errno==EOVERFLOW)
 	{
-		if((bytes_read>0 )&& (bytes_read % TS_PACKET_SIZE))
+		log_message( log_module,  MSG_WARN,"Error : DVR buffer overrun \n");
+		card_buffer->overflow_number++;
+	} else if(errno!=EAGAIN)
+		log_message( log_module,  MSG_WARN,"Error : DVR Read error : %s \n",strerror(errno));
+}
+
+/** @brief : Read at most max_packets packets from the card
+ * This function have to be called after a poll to ensure there is data to read
+ * The data goes through the framer : the packets given are aligned 188 bytes packets
+ * even if the stream has 192 or 204 bytes packets or lost its sync
+ */
+int card_read_max(int fd_dvr, unsigned char *dest_buffer, int max_packets, card_buffer_t *card_buffer)
+{
+	ts_framer_t *framer=&card_buffer->framer;
+	unsigned char *framer_buffer;
+	int bytes_read, good_bytes, read_len, packet_size;
+	int whole_ts;
+
+	//The null packet reinsertion needs the framer buffer, the output is bigger than the input
+	if(framer->locked && framer->packet_size==TS_PACKET_SIZE && !framer->buffer_len && !framer->null_reinsert)
+	{
+		/* Attempt to read 188 bytes * max_packets from /dev/____/dvr */
+		if ((bytes_read = dvb_read (fd_dvr, dest_buffer, TS_PACKET_SIZE*max_packets)) < 0)
+		{
+			card_read_error(card_buffer);
+			return 0;
+		}
+		good_bytes=ts_framer_fast(framer, dest_buffer, bytes_read);
+		if(good_bytes<bytes_read)
 		{
-			log_message( log_module,  MSG_WARN, "Warning : partial packet received len %d\n", bytes_read);
-			card_buffer->partial_packet_number++;
-			bytes_read-=bytes_read % TS_PACKET_SIZE;
-			if(bytes_read<=0)
+			//Partial packet or sync lost, the framer takes the rest
+			if(bytes_read % TS_PACKET_SIZE)
+			{
+				log_message( log_module,  MSG_DEBUG, "Partial packet received len %d\n", bytes_read);
+				card_buffer->partial_packet_number++;
+			}
+			if((framer_buffer=ts_framer_reserve(framer, bytes_read-good_bytes))==NULL)
 				return 0;
+			memcpy(framer_buffer, dest_buffer+good_bytes, bytes_read-good_bytes);
+			framer->buffer_len+=bytes_read-good_bytes;
+			bytes_read=good_bytes+TS_PACKET_SIZE*ts_framer_frame(framer, dest_buffer+good_bytes, max_packets-good_bytes/TS_PACKET_SIZE);
 		}
 	}
-	if(bytes_read<0)
+	else
 	{
-		if(errno==EOVERFLOW)
+		//Not aligned 188 bytes packets, the data goes through the framer buffer
+		packet_size=framer->packet_size ? framer->packet_size : TS_FRAMER_MAX_PACKET_SIZE;
+		read_len=max_packets*packet_size-framer->buffer_len;
+		//Not locked, we need more data to confirm the lock
+		if(!framer->locked && read_len<packet_size)
+			read_len=packet_size;
+		if(read_len>0)
 		{
-			log_message( log_module,  MSG_WARN,"Error : DVR buffer overrun \n");
-			card_buffer->overflow_number++;
-		} else if(errno!=EAGAIN)
-			log_message( log_module,  MSG_WARN,"Error : DVR Read error : %s \n",strerror(errno));
-		return 0;
+			if((framer_buffer=ts_framer_reserve(framer, read_len))==NULL)
+				return 0;
+			if ((bytes_read = dvb_read (fd_dvr, framer_buffer, read_len)) < 0)
+			{
+				card_read_error(card_buffer);
+				return 0;
+			}
+			framer->buffer_len+=bytes_read;
+		}
+		bytes_read=TS_PACKET_SIZE*ts_framer_frame(framer, dest_buffer, max_packets);
 	}
+	//The statistics are done on the whole TS read, before the software filter
+	if(bytes_read>0 && card_buffer->pid_stats)
+		pid_stats_count(card_buffer->pid_stats, dest_buffer, bytes_read);
+	whole_ts=card_buffer->sw_filter && card_buffer->sw_filter->whole_ts;
+	if(card_buffer->tr101290)
+		tr101290_process(card_buffer->tr101290, dest_buffer, bytes_read, framer->resync_number, whole_ts);
+	if(bytes_read>0 && card_buffer->pcr_stats)
+		pcr_stats_count(card_buffer->pcr_stats, dest_buffer, bytes_read, whole_ts);
+	if(bytes_read>0 && card_buffer->sw_filter && card_buffer->sw_filter->active)
+		bytes_read=card_sw_filter(card_buffer, dest_buffer, bytes_read);
 	return bytes_read;
 }
 
@@ -470,7 +1148,7 @@ void show_card_capabilities( int card, int tuner )
 
 	//get frontend info
 	struct dvb_frontend_info fe_info;
-	i_ret = ioctl(frontend_fd,FE_GET_INFO, &fe_info);
+	i_ret = dvb_ioctl(frontend_fd,FE_GET_INFO, &fe_info);
 	if (i_ret < 0){
 		log_message( log_module,  MSG_ERROR, "FE_GET_INFO: %s \n", strerror(errno));
 		close (frontend_fd);
@@ -48,6 +48,7 @@
 
 #include "mumudvb.h"
 #include "tune.h"
+#include "dvb_emu.h"
 
 #define DVB_DEV_PATH "/dev/dvb/adapter%card"
 #define FRONTEND_DEV_NAME "frontend"
@@ -57,6 +58,16 @@
 //The timeout for DVB polling, must exist otherwise the program would block without data on the card
 #define DVB_POLL_TIMEOUT 100
 
+//The buffer of the shared demux file descriptor (the default dvr buffer of the kernel)
+#define DEMUX_BUFFER_SIZE (10*188*1024)
+
+#ifdef DMX_ADD_PID
+//The shared demux file descriptor gives the packets itself, DMX_ADD_PID only works with this output
+#define DEMUX_SHARED_OUTPUT DMX_OUT_TSDEMUX_TAP
+#else
+#define DEMUX_SHARED_OUTPUT DMX_OUT_TS_TAP
+#endif
+
 enum
 {
 	PID_NOT_ASKED=0,
@@ -64,46 +75,118 @@ enum
 	PID_FILTERED,
 };
 
+/** The values returned by set_filters */
+enum
+{
+	FILTERS_OK=0,
+	/** DMX_ADD_PID is not supported, we have to use one demux file descriptor per PID */
+	FILTERS_PER_PID,
+	/** No more hardware filters, we have to take the full TS */
+	FILTERS_FULL_TS,
+};
+
+
+/** The number of samples kept in the history of the signal statistics */
+#define FE_STATS_HISTORY_LEN 128
+/** The minimum interval between two displays of the statistics (ms) */
+#define FE_STATS_DISPLAY_INTERVAL 2000
+
+/** The measures available in a sample of the statistics */
+enum
+{
+	FE_STATS_STRENGTH_DBM=0x01,
+	FE_STATS_STRENGTH_REL=0x02,
+	FE_STATS_CNR_DB=0x04,
+	FE_STATS_CNR_REL=0x08,
+	FE_STATS_PRE_COUNT=0x10,
+	FE_STATS_POST_COUNT=0x20,
+	FE_STATS_BLOCK_COUNT=0x40,
+	FE_STATS_PRE_BER=0x80,
+	FE_STATS_POST_BER=0x100,
+	FE_STATS_PER=0x200,
+};
+
+/** @brief One sample of the signal statistics */
+typedef struct fe_stats_t{
+	/** The time of the sample (us) */
+	uint64_t time;
+	/** The measures available (FE_STATS_*) */
+	int valid;
+	/** The signal strength in dBm (FE_STATS_STRENGTH_DBM) or in % (FE_STATS_STRENGTH_REL) */
+	double strength;
+	/** The carrier to noise ratio in dB (FE_STATS_CNR_DB) or in % (FE_STATS_CNR_REL) */
+	double cnr;
+	/** The bit error rates before and after the inner code, and the block error rate, since the previous sample */
+	double pre_ber, post_ber, per;
+	/** The counters given by the frontend */
+	uint64_t pre_error_bits, pre_total_bits;
+	uint64_t post_error_bits, post_total_bits;
+	uint64_t error_blocks, total_blocks;
+}fe_stats_t;
 
 /** The parameters for the thread for showing the strength */
 typedef struct strength_parameters_t{
 	tune_p_t *tune_p;
 	fds_t *fds;
 	fe_status_t festatus;
+	/** The values in the units of the driver (with the DVB API v5 statistics : the
+	 * relative or 0.001 dB values and the error counters of the frontend)
+	 * Without them, the strength and the SNR (FE_READ_SIGNAL_STRENGTH, FE_READ_SNR) are
+	 * taken as relative values on 16 bits, 65535 for 100 %, whatever the driver means */
 	int strength, ber, snr, ub;
 	int ts_discontinuities;
+	/** Does the frontend give the DVB API v5 statistics ? */
+	int stats_v5;
+	/** Protects stats and the history, read by the HTTP monitoring */
+	pthread_mutex_t stats_lock;
+	/** The last sample */
+	fe_stats_t stats;
+	/** The last samples, stats_history_pos is the next one written */
+	fe_stats_t stats_history[FE_STATS_HISTORY_LEN];
+	int stats_history_pos;
+	int stats_history_num;
+	/** The statistics of each PID, NULL if disabled */
+	pid_stats_t *pid_stats;
+	/** The TR 101 290 analyzer, NULL if disabled */
+	tr101290_t *tr101290;
+	/** The PCR tracking of each program, NULL if disabled */
+	pcr_stats_t *pcr_stats;
 }strength_parameters_t;
 
 /** The parameters for the thread for reading the data from the card */
 typedef struct card_thread_parameters_t{
-	//mutex for the data buffer
-	pthread_mutex_t carddatamutex;
-	//Condition variable for locking the main program in order to wait for new data
-	pthread_cond_t threadcond;
 	//file descriptors
 	fds_t *fds;
 	//The shutdown for the thread
 	volatile int threadshutdown;
-	//The buffer for the card
+	//The buffer for the card, the packets are put in card_buffer->ring
 	card_buffer_t *card_buffer;
 	//
 	int thread_running;
-	/** Is main waiting ?*/
-	int main_waiting;
 }card_thread_parameters_t;
 
 void *read_card_thread_func(void* arg);
 
+int card_ring_init(card_ring_t *ring, int num_packets);
+void card_ring_free(card_ring_t *ring);
+int card_ring_wait(card_ring_t *ring, int timeout);
+int card_ring_peek(card_ring_t *ring, unsigned char **packets);
+void card_ring_release(card_ring_t *ring, int num_packets);
+
 
 
 int open_fe (int *fd_frontend, char *base_path, int tuner, int rw, int full_path);
-void set_ts_filt (int fd,uint16_t pid);
+int set_ts_filt (int fd,uint16_t pid, int output);
 int create_card_fd(char *base_path, int tuner, uint8_t *asked_pid, fds_t *fds);
-void set_filters(uint8_t *asked_pid, fds_t *fds);
+int set_filters(uint8_t *asked_pid, fds_t *fds);
+int open_card_filters(char *base_path, int tuner, uint8_t *asked_pid, fds_t *fds);
+int card_data_fd(fds_t *fds);
+void remove_filter(uint16_t pid, fds_t *fds);
 void close_card_fd(fds_t *fds);
 
 void *show_power_func(void* arg);
 int card_read(int fd_dvr, unsigned char *dest_buffer, card_buffer_t *card_buffer);
+int card_read_max(int fd_dvr, unsigned char *dest_buffer, int max_packets, card_buffer_t *card_buffer);
 
 void list_dvb_cards ();
 #endif
@@ -0,0 +1,975 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/** @file
+ * @brief Emulated DVB adapter
+ *
+ * The emulated file descriptors are real descriptors on /dev/null, so they can
+ * be polled and closed like the device ones. A table indexed by the descriptor
+ * tells dvb_ioctl, dvb_read, dvb_poll and dvb_close which ones are emulated.
+ *
+ * All the descriptors opened on the same path and tuner share one adapter : the
+ * frontend state, the PID filters of the demux and the TS file read by the dvr
+ * (or by the demux descriptor itself for its filter with DMX_OUT_TSDEMUX_TAP).
+ * The dvr only gives data once the frontend is locked. With emu_bitrate the file
+ * is served at the transport stream rate and the data not read in time is lost
+ * like with a real DVR buffer (EOVERFLOW).
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/dvb/dmx.h>
+
+#include "dvb_emu.h"
+#include "mumudvb.h"
+#include "log.h"
+
+static char *log_module="DVB emu: ";
+
+/** The default time to lock, in ms */
+#define DVB_EMU_DEFAULT_LOCK_DELAY 200
+/** The bitrate used for the error counters when emu_bitrate is not set (bit/s) */
+#define DVB_EMU_DEFAULT_RATE 40000000
+/** The size of the emulated DVR buffer, data older than that is lost */
+#define DVB_EMU_DVR_BUFFER_SIZE (10*188*1024)
+/** The maximum time a read waits for data, in ms (same as DVB_POLL_TIMEOUT) */
+#define DVB_EMU_MAX_WAIT 100
+/** The number of properties remembered by FE_SET_PROPERTY */
+#define DVB_EMU_MAX_PROPS 128
+
+/** The parameters of the emulated adapters, read from the configuration file */
+dvb_emu_p_t dvb_emu_p={
+		.fe_type=FE_QPSK,
+		.lock=1,
+		.lock_delay=DVB_EMU_DEFAULT_LOCK_DELAY,
+		.strength=-45.0,
+		.cnr=12.0,
+		.variation=0.5,
+		.ber=0,
+		.ucb_rate=0,
+		.bitrate=0,
+		.overflow=0,
+		.loop=1,
+		.max_filters=0,
+};
+
+/** @brief An emulated adapter, shared by its frontend, demux and dvr descriptors */
+typedef struct dvb_emu_adapter_t{
+  /** The card path (with the prefix) */
+  char path[DEFAULT_PATH_LEN];
+  int tuner;
+  /** The number of descriptors open on this adapter */
+  int refcount;
+  pthread_mutex_t lock;
+  /** The frontend type, changed with the delivery system */
+  fe_type_t fe_type;
+  uint32_t delivery_system;
+  /** The properties given by FE_SET_PROPERTY */
+  uint32_t props[DVB_EMU_MAX_PROPS];
+  struct dvb_frontend_parameters feparams;
+  int tuned;
+  int oneshot;
+  uint64_t tune_time;
+  /** The last status reported by FE_GET_EVENT */
+  fe_status_t event_status;
+  unsigned int seed;
+  /** The number of filters sending each PID to the dvr (8192 is the full TS) */
+  int pid_filters[8193];
+  /** The total number of filters */
+  int num_filters;
+  /** The TS file served by the dvr and the demux descriptors */
+  int ts_fd;
+  /** The number of bytes of the file served since the lock */
+  uint64_t bytes_served;
+  int num_reads;
+  struct dvb_emu_adapter_t *next;
+}dvb_emu_adapter_t;
+
+/** @brief An emulated file descriptor */
+typedef struct dvb_emu_fd_t{
+  int type;
+  dvb_emu_adapter_t *adapter;
+  /** The PIDs filtered by this demux descriptor */
+  uint16_t *pids;
+  int num_pids;
+  /** The output of the filter (DMX_OUT_TS_TAP : the dvr) */
+  int output;
+}dvb_emu_fd_t;
+
+static dvb_emu_fd_t *dvb_emu_fds[DVB_EMU_MAX_FD];
+static int dvb_emu_num_fds=0;
+static dvb_emu_adapter_t *dvb_emu_adapters=NULL;
+static pthread_mutex_t dvb_emu_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Read a line of the configuration file to check if there is an emulation parameter
+ *
+ * @param dvb_emu_p the emulation parameters
+ * @param substring The currrent line
+ */
+int read_dvb_emu_configuration(dvb_emu_p_t *dvb_emu_p, char *substring)
+{
+	char delimiteurs[] = CONFIG_FILE_SEPARATOR;
+	if (!strcmp (substring, "emu_fe_type"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		if (!strcmp (substring, "dvbs"))
+			dvb_emu_p->fe_type=FE_QPSK;
+		else if (!strcmp (substring, "dvbt"))
+			dvb_emu_p->fe_type=FE_OFDM;
+		else if (!strcmp (substring, "dvbc"))
+			dvb_emu_p->fe_type=FE_QAM;
+		else if (!strcmp (substring, "atsc"))
+			dvb_emu_p->fe_type=FE_ATSC;
+		else
+		{
+			log_message( log_module,  MSG_ERROR,
+					"Config issue : emu_fe_type. Unknown frontend type : %s (dvbs, dvbt, dvbc or atsc)\n",substring);
+			return -1;
+		}
+	}
+	else if (!strcmp (substring, "emu_lock"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->lock = atoi (substring);
+	}
+	else if (!strcmp (substring, "emu_lock_delay"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->lock_delay = atoi (substring);
+		if(dvb_emu_p->lock_delay<0)
+			dvb_emu_p->lock_delay=0;
+	}
+	else if (!strcmp (substring, "emu_strength"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->strength = atof (substring);
+	}
+	else if (!strcmp (substring, "emu_cnr"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->cnr = atof (substring);
+	}
+	else if (!strcmp (substring, "emu_variation"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->variation = atof (substring);
+	}
+	else if (!strcmp (substring, "emu_ber"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->ber = atof (substring);
+	}
+	else if (!strcmp (substring, "emu_ucb_rate"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->ucb_rate = atoi (substring);
+	}
+	else if (!strcmp (substring, "emu_bitrate"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->bitrate = atoi (substring);
+	}
+	else if (!strcmp (substring, "emu_overflow"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->overflow = atoi (substring);
+	}
+	else if (!strcmp (substring, "emu_loop"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->loop = atoi (substring);
+	}
+	else if (!strcmp (substring, "emu_max_filters"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		dvb_emu_p->max_filters = atoi (substring);
+	}
+	else
+		return 0; //Nothing concerning the emulation, we return 0 to explore the other possibilities
+
+	return 1;//We found something for the emulation, we tell main to go for a new line
+}
+
+/** @brief Is this card path an emulated adapter ? */
+int dvb_emu_path(const char *path)
+{
+	return !strncmp(path, DVB_EMU_PREFIX, strlen(DVB_EMU_PREFIX));
+}
+
+static uint32_t dvb_emu_default_delivery_system(fe_type_t fe_type)
+{
+	switch(fe_type)
+	{
+	case FE_OFDM:
+		return SYS_DVBT;
+	case FE_QAM:
+		return SYS_DVBC_ANNEX_AC;
+	case FE_ATSC:
+		return SYS_ATSC;
+	default:
+		return SYS_DVBS;
+	}
+}
+
+/** @brief Change the frontend type like a multi standard frontend does */
+static void dvb_emu_set_delivery_system(dvb_emu_adapter_t *adapter, uint32_t delivery_system)
+{
+	adapter->delivery_system=delivery_system;
+	switch(delivery_system)
+	{
+	case SYS_DVBS:
+	case SYS_DVBS2:
+	case SYS_DSS:
+		adapter->fe_type=FE_QPSK;
+		break;
+	case SYS_DVBT:
+#ifdef DVBT2
+	case SYS_DVBT2:
+#endif
+	case SYS_ISDBT:
+		adapter->fe_type=FE_OFDM;
+		break;
+	case SYS_DVBC_ANNEX_AC:
+	case SYS_DVBC_ANNEX_B:
+		adapter->fe_type=FE_QAM;
+		break;
+	case SYS_ATSC:
+		adapter->fe_type=FE_ATSC;
+		break;
+	default:
+		break;
+	}
+}
+
+/** @brief Find or create the adapter for path/tuner. Called with dvb_emu_mutex locked */
+static dvb_emu_adapter_t *dvb_emu_get_adapter(const char *base_path, int tuner)
+{
+	dvb_emu_adapter_t *adapter;
+
+	for(adapter=dvb_emu_adapters;adapter!=NULL;adapter=adapter->next)
+		if(adapter->tuner==tuner && !strcmp(adapter->path, base_path))
+			return adapter;
+	if(strlen(base_path)>=DEFAULT_PATH_LEN)
+	{
+		errno=ENAMETOOLONG;
+		return NULL;
+	}
+	adapter=calloc(1, sizeof(dvb_emu_adapter_t));
+	if(adapter==NULL)
+		return NULL;
+	strcpy(adapter->path, base_path);
+	adapter->tuner=tuner;
+	adapter->fe_type=dvb_emu_p.fe_type;
+	adapter->delivery_system=dvb_emu_default_delivery_system(dvb_emu_p.fe_type);
+	adapter->ts_fd=-1;
+	adapter->seed=(unsigned int)get_time();
+	pthread_mutex_init(&adapter->lock, NULL);
+	adapter->next=dvb_emu_adapters;
+	dvb_emu_adapters=adapter;
+	log_message( log_module,  MSG_INFO, "Emulated adapter %s tuner %d\n", base_path, tuner);
+	return adapter;
+}
+
+/** @brief Release a reference on the adapter. Called with dvb_emu_mutex locked */
+static void dvb_emu_put_adapter(dvb_emu_adapter_t *adapter)
+{
+	dvb_emu_adapter_t **prev;
+
+	if(--adapter->refcount>0)
+		return;
+	for(prev=&dvb_emu_adapters;*prev!=NULL;prev=&(*prev)->next)
+		if(*prev==adapter)
+		{
+			*prev=adapter->next;
+			break;
+		}
+	if(adapter->ts_fd>=0)
+		close(adapter->ts_fd);
+	pthread_mutex_destroy(&adapter->lock);
+	free(adapter);
+}
+
+/** @brief Open an emulated device
+ *
+ * @param base_path the card path, DVB_EMU_PREFIX followed by the TS file
+ * @param type DVB_EMU_FRONTEND, DVB_EMU_DEMUX or DVB_EMU_DVR
+ * @return the file descriptor, -1 on error (errno is set)
+ */
+int dvb_emu_open(const char *base_path, int tuner, int type)
+{
+	dvb_emu_fd_t *emu_fd;
+	int fd;
+	int err;
+
+	emu_fd=calloc(1, sizeof(dvb_emu_fd_t));
+	if(emu_fd==NULL)
+		return -1;
+	fd=open("/dev/null", O_RDWR | O_NONBLOCK);
+	if(fd<0)
+	{
+		free(emu_fd);
+		return -1;
+	}
+	if(fd>=DVB_EMU_MAX_FD)
+	{
+		close(fd);
+		free(emu_fd);
+		errno=EMFILE;
+		return -1;
+	}
+	pthread_mutex_lock(&dvb_emu_mutex);
+	emu_fd->adapter=dvb_emu_get_adapter(base_path, tuner);
+	if(emu_fd->adapter==NULL)
+	{
+		err=errno;
+		pthread_mutex_unlock(&dvb_emu_mutex);
+		close(fd);
+		free(emu_fd);
+		errno=err;
+		return -1;
+	}
+	if(type!=DVB_EMU_FRONTEND && emu_fd->adapter->ts_fd<0)
+	{
+		emu_fd->adapter->ts_fd=open(base_path+strlen(DVB_EMU_PREFIX), O_RDONLY);
+		if(emu_fd->adapter->ts_fd<0)
+		{
+			err=errno;
+			if(!emu_fd->adapter->refcount)
+			{
+				emu_fd->adapter->refcount=1;
+				dvb_emu_put_adapter(emu_fd->adapter);
+			}
+			pthread_mutex_unlock(&dvb_emu_mutex);
+			close(fd);
+			free(emu_fd);
+			errno=err;
+			return -1;
+		}
+	}
+	emu_fd->adapter->refcount++;
+	emu_fd->type=type;
+	dvb_emu_fds[fd]=emu_fd;
+	dvb_emu_num_fds++;
+	pthread_mutex_unlock(&dvb_emu_mutex);
+	return fd;
+}
+
+/** @brief The time when the frontend locks (or gives up), in microseconds */
+static uint64_t dvb_emu_lock_time(dvb_emu_adapter_t *adapter)
+{
+	return adapter->tune_time+(uint64_t)dvb_emu_p.lock_delay*1000;
+}
+
+static fe_status_t dvb_emu_status(dvb_emu_adapter_t *adapter, uint64_t now)
+{
+	fe_status_t status;
+
+	if(!adapter->tuned)
+		return 0;
+	if(now>=dvb_emu_lock_time(adapter))
+	{
+		if(dvb_emu_p.lock)
+			return FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI | FE_HAS_SYNC | FE_HAS_LOCK;
+		status=FE_HAS_SIGNAL;
+		if(adapter->oneshot)
+			status|=FE_TIMEDOUT;
+		return status;
+	}
+	status=FE_HAS_SIGNAL;
+	if(now>=adapter->tune_time+(uint64_t)dvb_emu_p.lock_delay*500)
+		status|=FE_HAS_CARRIER;
+	return status;
+}
+
+/** @brief The time (in ms) before the next status change, -1 if none */
+static int dvb_emu_next_change(dvb_emu_adapter_t *adapter, uint64_t now)
+{
+	uint64_t next;
+
+	if(!adapter->tuned)
+		return -1;
+	next=adapter->tune_time+(uint64_t)dvb_emu_p.lock_delay*500;
+	if(next<=now)
+		next=dvb_emu_lock_time(adapter);
+	if(next<=now)
+		return -1;
+	return (next-now+999)/1000;
+}
+
+static void dvb_emu_tune(dvb_emu_adapter_t *adapter)
+{
+	adapter->tuned=1;
+	adapter->tune_time=get_time();
+	adapter->event_status=0;
+	adapter->bytes_served=0;
+	log_message( log_module,  MSG_DEBUG, "Tuning, frequency %u, the frontend %s in %d ms\n",
+			adapter->feparams.frequency, dvb_emu_p.lock ? "locks" : "gives up", dvb_emu_p.lock_delay);
+}
+
+/** @brief A value of the signal profile with its random variation */
+static double dvb_emu_signal(dvb_emu_adapter_t *adapter, double value)
+{
+	return value+dvb_emu_p.variation*(2.0*rand_r(&adapter->seed)/RAND_MAX-1.0);
+}
+
+/** @brief The error counters since the lock */
+static void dvb_emu_counters(dvb_emu_adapter_t *adapter, uint64_t now, uint64_t *bits, uint64_t *error_bits, uint64_t *blocks, uint64_t *error_blocks)
+{
+	double seconds;
+	double rate;
+
+	*bits=*error_bits=*blocks=*error_blocks=0;
+	if(!(dvb_emu_status(adapter, now) & FE_HAS_LOCK))
+		return;
+	seconds=(now-dvb_emu_lock_time(adapter))/1000000.0;
+	rate=dvb_emu_p.bitrate ? dvb_emu_p.bitrate*1000.0 : DVB_EMU_DEFAULT_RATE;
+	*bits=rate*seconds;
+	*error_bits=*bits*dvb_emu_p.ber;
+	*blocks=*bits/(TS_PACKET_SIZE*8);
+	*error_blocks=dvb_emu_p.ucb_rate*seconds;
+}
+
+#if DVB_API_VERSION >= 5
+static void dvb_emu_get_property(dvb_emu_adapter_t *adapter, struct dtv_property *prop, uint64_t now)
+{
+	uint64_t bits, error_bits, blocks, error_blocks;
+	int locked=dvb_emu_status(adapter, now) & FE_HAS_LOCK;
+
+	dvb_emu_counters(adapter, now, &bits, &error_bits, &blocks, &error_blocks);
+	switch(prop->cmd)
+	{
+	case DTV_API_VERSION:
+		prop->u.data=(DVB_API_VERSION<<8) | DVB_API_VERSION_MINOR;
+		break;
+	case DTV_DELIVERY_SYSTEM:
+		prop->u.data=adapter->delivery_system;
+		break;
+#ifdef DTV_STAT_SIGNAL_STRENGTH
+	case DTV_STAT_SIGNAL_STRENGTH:
+		prop->u.st.len=1;
+		prop->u.st.stat[0].scale=adapter->tuned ? FE_SCALE_DECIBEL : FE_SCALE_NOT_AVAILABLE;
+		prop->u.st.stat[0].svalue=dvb_emu_signal(adapter, dvb_emu_p.strength)*1000;
+		break;
+	case DTV_STAT_CNR:
+		prop->u.st.len=1;
+		prop->u.st.stat[0].scale=locked ? FE_SCALE_DECIBEL : FE_SCALE_NOT_AVAILABLE;
+		prop->u.st.stat[0].svalue=dvb_emu_signal(adapter, dvb_emu_p.cnr)*1000;
+		break;
+	case DTV_STAT_PRE_ERROR_BIT_COUNT:
+	case DTV_STAT_POST_ERROR_BIT_COUNT:
+		prop->u.st.len=1;
+		prop->u.st.stat[0].scale=locked ? FE_SCALE_COUNTER : FE_SCALE_NOT_AVAILABLE;
+		prop->u.st.stat[0].uvalue=prop->cmd==DTV_STAT_PRE_ERROR_BIT_COUNT ? error_bits : 0;
+		break;
+	case DTV_STAT_PRE_TOTAL_BIT_COUNT:
+	case DTV_STAT_POST_TOTAL_BIT_COUNT:
+		prop->u.st.len=1;
+		prop->u.st.stat[0].scale=locked ? FE_SCALE_COUNTER : FE_SCALE_NOT_AVAILABLE;
+		prop->u.st.stat[0].uvalue=bits;
+		break;
+	case DTV_STAT_ERROR_BLOCK_COUNT:
+		prop->u.st.len=1;
+		prop->u.st.stat[0].scale=locked ? FE_SCALE_COUNTER : FE_SCALE_NOT_AVAILABLE;
+		prop->u.st.stat[0].uvalue=error_blocks;
+		break;
+	case DTV_STAT_TOTAL_BLOCK_COUNT:
+		prop->u.st.len=1;
+		prop->u.st.stat[0].scale=locked ? FE_SCALE_COUNTER : FE_SCALE_NOT_AVAILABLE;
+		prop->u.st.stat[0].uvalue=blocks;
+		break;
+#endif
+	default:
+		//We give back what was set (the parameters found are the parameters asked)
+		if(prop->cmd<DVB_EMU_MAX_PROPS)
+			prop->u.data=adapter->props[prop->cmd];
+		else
+			prop->u.data=0;
+		break;
+	}
+}
+#endif
+
+static int dvb_emu_frontend_ioctl(dvb_emu_adapter_t *adapter, unsigned long request, void *arg)
+{
+	uint64_t now=get_time();
+	uint64_t bits, error_bits, blocks, error_blocks;
+	double value;
+
+	switch(request)
+	{
+	case FE_GET_INFO:
+	{
+		struct dvb_frontend_info *fe_info=arg;
+		memset(fe_info, 0, sizeof(struct dvb_frontend_info));
+		snprintf(fe_info->name, sizeof(fe_info->name), "DVBZAP emulated frontend");
+		fe_info->type=adapter->fe_type;
+		if(adapter->fe_type==FE_QPSK)
+		{
+			fe_info->frequency_min=950000;
+			fe_info->frequency_max=2150000;
+		}
+		else
+		{
+			fe_info->frequency_min=47000000;
+			fe_info->frequency_max=862000000;
+		}
+		fe_info->symbol_rate_min=1000000;
+		fe_info->symbol_rate_max=45000000;
+		fe_info->caps=FE_CAN_INVERSION_AUTO | FE_CAN_FEC_AUTO | FE_CAN_QAM_AUTO |
+				FE_CAN_TRANSMISSION_MODE_AUTO | FE_CAN_GUARD_INTERVAL_AUTO | FE_CAN_HIERARCHY_AUTO;
+		return 0;
+	}
+	case FE_READ_STATUS:
+		*(fe_status_t *)arg=dvb_emu_status(adapter, now);
+		return 0;
+	case FE_GET_EVENT:
+	{
+		struct dvb_frontend_event *event=arg;
+		fe_status_t status=dvb_emu_status(adapter, now);
+		if(status==adapter->event_status)
+		{
+			errno=EWOULDBLOCK;
+			return -1;
+		}
+		adapter->event_status=status;
+		event->status=status;
+		event->parameters=adapter->feparams;
+		return 0;
+	}
+	case FE_SET_FRONTEND:
+		adapter->feparams=*(struct dvb_frontend_parameters *)arg;
+		dvb_emu_tune(adapter);
+		return 0;
+	case FE_GET_FRONTEND:
+		*(struct dvb_frontend_parameters *)arg=adapter->feparams;
+		return 0;
+#if DVB_API_VERSION >= 5
+	case FE_SET_PROPERTY:
+	{
+		struct dtv_properties *cmdseq=arg;
+		for(unsigned int i=0;i<cmdseq->num;i++)
+		{
+			struct dtv_property *prop=&cmdseq->props[i];
+			if(prop->cmd==DTV_CLEAR)
+				memset(adapter->props, 0, sizeof(adapter->props));
+			else if(prop->cmd==DTV_TUNE)
+			{
+				adapter->feparams.frequency=adapter->props[DTV_FREQUENCY];
+				dvb_emu_tune(adapter);
+			}
+			else if(prop->cmd==DTV_DELIVERY_SYSTEM)
+				dvb_emu_set_delivery_system(adapter, prop->u.data);
+			if(prop->cmd<DVB_EMU_MAX_PROPS)
+				adapter->props[prop->cmd]=prop->u.data;
+		}
+		return 0;
+	}
+	case FE_GET_PROPERTY:
+	{
+		struct dtv_properties *cmdseq=arg;
+		for(unsigned int i=0;i<cmdseq->num;i++)
+			dvb_emu_get_property(adapter, &cmdseq->props[i], now);
+		return 0;
+	}
+#endif
+	case FE_READ_SIGNAL_STRENGTH:
+		//-100 dBm to -20 dBm on the full scale
+		value=(dvb_emu_signal(adapter, dvb_emu_p.strength)+100.0)*65535/80;
+		*(uint16_t *)arg=adapter->tuned ? (value<0 ? 0 : (value>65535 ? 65535 : value)) : 0;
+		return 0;
+	case FE_READ_SNR:
+		//A relative value on 16 bits, as dvbzap reads it : 0 dB to 40 dB on the full scale
+		value=dvb_emu_signal(adapter, dvb_emu_p.cnr)*65535/40;
+		*(uint16_t *)arg=(dvb_emu_status(adapter, now) & FE_HAS_LOCK) && value>0 ? (value>65535 ? 65535 : value) : 0;
+		return 0;
+	case FE_READ_BER:
+		dvb_emu_counters(adapter, now, &bits, &error_bits, &blocks, &error_blocks);
+		*(uint32_t *)arg=error_bits;
+		return 0;
+	case FE_READ_UNCORRECTED_BLOCKS:
+		dvb_emu_counters(adapter, now, &bits, &error_bits, &blocks, &error_blocks);
+		*(uint32_t *)arg=error_blocks;
+		return 0;
+	case FE_SET_FRONTEND_TUNE_MODE:
+		adapter->oneshot=((unsigned long)arg & FE_TUNE_MODE_ONESHOT) ? 1 : 0;
+		return 0;
+	case FE_SET_TONE:
+	case FE_SET_VOLTAGE:
+	case FE_ENABLE_HIGH_LNB_VOLTAGE:
+	case FE_DISEQC_SEND_MASTER_CMD:
+	case FE_DISEQC_SEND_BURST:
+	case FE_DISEQC_RESET_OVERLOAD:
+		log_message( log_module,  MSG_FLOOD, "SEC command 0x%lx\n", request);
+		return 0;
+	default:
+		errno=ENOTTY;
+		return -1;
+	}
+}
+
+static int dvb_emu_add_pid(dvb_emu_fd_t *emu_fd, uint16_t pid)
+{
+	uint16_t *pids;
+
+	if(pid>8192)
+	{
+		errno=EINVAL;
+		return -1;
+	}
+	//Like the hardware, we run out of filters
+	if(dvb_emu_p.max_filters && emu_fd->adapter->num_filters>=dvb_emu_p.max_filters)
+	{
+		errno=EBUSY;
+		return -1;
+	}
+	pids=realloc(emu_fd->pids, (emu_fd->num_pids+1)*sizeof(uint16_t));
+	if(pids==NULL)
+	{
+		errno=ENOMEM;
+		return -1;
+	}
+	emu_fd->pids=pids;
+	emu_fd->pids[emu_fd->num_pids++]=pid;
+	if(emu_fd->output==DMX_OUT_TS_TAP)
+		emu_fd->adapter->pid_filters[pid]++;
+	emu_fd->adapter->num_filters++;
+	return 0;
+}
+
+static void dvb_emu_remove_pid(dvb_emu_fd_t *emu_fd, uint16_t pid)
+{
+	for(int i=0;i<emu_fd->num_pids;i++)
+		if(emu_fd->pids[i]==pid)
+		{
+			if(emu_fd->output==DMX_OUT_TS_TAP)
+				emu_fd->adapter->pid_filters[pid]--;
+			emu_fd->adapter->num_filters--;
+			emu_fd->pids[i]=emu_fd->pids[--emu_fd->num_pids];
+			return;
+		}
+}
+
+static void dvb_emu_remove_pids(dvb_emu_fd_t *emu_fd)
+{
+	for(int i=0;i<emu_fd->num_pids && emu_fd->output==DMX_OUT_TS_TAP;i++)
+		emu_fd->adapter->pid_filters[emu_fd->pids[i]]--;
+	emu_fd->adapter->num_filters-=emu_fd->num_pids;
+	emu_fd->num_pids=0;
+}
+
+static int dvb_emu_demux_ioctl(dvb_emu_fd_t *emu_fd, unsigned long request, void *arg)
+{
+	switch(request)
+	{
+	case DMX_SET_PES_FILTER:
+		dvb_emu_remove_pids(emu_fd);
+		emu_fd->output=((struct dmx_pes_filter_params *)arg)->output;
+		return dvb_emu_add_pid(emu_fd, ((struct dmx_pes_filter_params *)arg)->pid);
+#ifdef DMX_ADD_PID
+	case DMX_ADD_PID:
+		//Like the kernel, only the filters with DMX_OUT_TSDEMUX_TAP can have several PIDs
+		if(!emu_fd->num_pids || emu_fd->output!=DMX_OUT_TSDEMUX_TAP)
+		{
+			errno=EINVAL;
+			return -1;
+		}
+		return dvb_emu_add_pid(emu_fd, *(uint16_t *)arg);
+	case DMX_REMOVE_PID:
+		dvb_emu_remove_pid(emu_fd, *(uint16_t *)arg);
+		return 0;
+#endif
+	case DMX_START:
+	case DMX_SET_BUFFER_SIZE:
+		return 0;
+	case DMX_STOP:
+		dvb_emu_remove_pids(emu_fd);
+		return 0;
+	default:
+		errno=ENOTTY;
+		return -1;
+	}
+}
+
+/** @brief The pseudo ioctl, the requests on emulated descriptors are answered by the emulated adapter
+ *
+ */
+int dvb_ioctl(int fd, unsigned long request, ...)
+{
+	va_list args;
+	void *arg;
+	dvb_emu_fd_t *emu_fd;
+	int ret;
+
+	va_start(args, request);
+	arg=va_arg(args, void *);
+	va_end(args);
+
+	if(fd<0 || fd>=DVB_EMU_MAX_FD || (emu_fd=dvb_emu_fds[fd])==NULL)
+		return ioctl(fd, request, arg);
+
+	pthread_mutex_lock(&emu_fd->adapter->lock);
+	if(emu_fd->type==DVB_EMU_FRONTEND)
+		ret=dvb_emu_frontend_ioctl(emu_fd->adapter, request, arg);
+	else if(emu_fd->type==DVB_EMU_DEMUX)
+		ret=dvb_emu_demux_ioctl(emu_fd, request, arg);
+	else
+	{
+		errno=ENOTTY;
+		ret=-1;
+	}
+	pthread_mutex_unlock(&emu_fd->adapter->lock);
+	return ret;
+}
+
+/** @brief Is the PID given by this demux descriptor ? */
+static int dvb_emu_demux_has_pid(dvb_emu_fd_t *demux, int pid)
+{
+	for(int i=0;i<demux->num_pids;i++)
+		if(demux->pids[i]==pid || demux->pids[i]==8192)
+			return 1;
+	return 0;
+}
+
+/** @brief Read the file and keep the packets of the filtered PIDs
+ *
+ * @param demux the demux descriptor read (DMX_OUT_TSDEMUX_TAP), NULL for the dvr
+ * @param len the number of bytes of the file to read
+ * @return the number of bytes copied to dest
+ */
+static int dvb_emu_read_file(dvb_emu_adapter_t *adapter, dvb_emu_fd_t *demux, unsigned char *dest, int len)
+{
+	unsigned char buffer[TS_PACKET_SIZE*64];
+	int copied=0;
+	int bytes_read;
+	int pid;
+	int i;
+
+	while(len>=TS_PACKET_SIZE)
+	{
+		bytes_read=read(adapter->ts_fd, buffer, len<(int)sizeof(buffer) ? len : (int)sizeof(buffer));
+		if(bytes_read<TS_PACKET_SIZE)
+		{
+			if(bytes_read<0 || !dvb_emu_p.loop)
+				break;
+			//End of the file, we start again
+			if(lseek(adapter->ts_fd, 0, SEEK_SET)<0)
+				break;
+			continue;
+		}
+		len-=bytes_read;
+		adapter->bytes_served+=bytes_read;
+		i=0;
+		while(i+TS_PACKET_SIZE<=bytes_read)
+		{
+			if(buffer[i]!=0x47)
+			{
+				i++;
+				continue;
+			}
+			pid=((buffer[i+1] & 0x1f) << 8) | buffer[i+2];
+			if(demux ? dvb_emu_demux_has_pid(demux, pid) : (adapter->pid_filters[8192] || adapter->pid_filters[pid]))
+			{
+				memcpy(dest+copied, buffer+i, TS_PACKET_SIZE);
+				copied+=TS_PACKET_SIZE;
+			}
+			i+=TS_PACKET_SIZE;
+		}
+		//We keep the file aligned on the packets
+		if(i<bytes_read)
+			lseek(adapter->ts_fd, i-bytes_read, SEEK_CUR);
+	}
+	return copied;
+}
+
+/** @brief Read from the emulated dvr or demux descriptor (see dvb_emu_read_file)
+ *
+ * Like the real dvr, nothing is given before the lock. With a bitrate, waits
+ * at most DVB_EMU_MAX_WAIT ms for data and returns EOVERFLOW if the reader is
+ * too slow.
+ */
+static ssize_t dvb_emu_dvr_read(dvb_emu_adapter_t *adapter, dvb_emu_fd_t *demux, unsigned char *buf, size_t count)
+{
+	uint64_t now;
+	uint64_t available;
+	int64_t wait;
+	ssize_t copied;
+	int len;
+
+	if(count>INT32_MAX)
+		count=INT32_MAX;
+	pthread_mutex_lock(&adapter->lock);
+	now=get_time();
+	if(!(dvb_emu_status(adapter, now) & FE_HAS_LOCK))
+	{
+		wait=adapter->tuned && dvb_emu_p.lock ? (int64_t)(dvb_emu_lock_time(adapter)-now) : DVB_EMU_MAX_WAIT*1000;
+		pthread_mutex_unlock(&adapter->lock);
+		if(wait>DVB_EMU_MAX_WAIT*1000)
+			wait=DVB_EMU_MAX_WAIT*1000;
+		usleep(wait);
+		errno=EAGAIN;
+		return -1;
+	}
+	len=count;
+	if(dvb_emu_p.bitrate)
+	{
+		available=(now-dvb_emu_lock_time(adapter))*dvb_emu_p.bitrate/8000;
+		if(available<adapter->bytes_served+TS_PACKET_SIZE)
+		{
+			//We wait for the next packet
+			wait=(adapter->bytes_served+TS_PACKET_SIZE)*8000/dvb_emu_p.bitrate;
+			wait-=now-dvb_emu_lock_time(adapter);
+			pthread_mutex_unlock(&adapter->lock);
+			usleep(wait<DVB_EMU_MAX_WAIT*1000 ? wait : DVB_EMU_MAX_WAIT*1000);
+			errno=EAGAIN;
+			return -1;
+		}
+		available-=adapter->bytes_served;
+		if(available>DVB_EMU_DVR_BUFFER_SIZE)
+		{
+			//The reader was too slow, the data older than the buffer is lost
+			adapter->bytes_served+=available-DVB_EMU_DVR_BUFFER_SIZE;
+			pthread_mutex_unlock(&adapter->lock);
+			errno=EOVERFLOW;
+			return -1;
+		}
+		if(available<(uint64_t)len)
+			len=available;
+	}
+	len-=len%TS_PACKET_SIZE;
+	if(dvb_emu_p.overflow && !(++adapter->num_reads % dvb_emu_p.overflow))
+	{
+		//Simulated overflow : the data is lost
+		dvb_emu_read_file(adapter, demux, buf, len);
+		pthread_mutex_unlock(&adapter->lock);
+		errno=EOVERFLOW;
+		return -1;
+	}
+	copied=dvb_emu_read_file(adapter, demux, buf, len);
+	pthread_mutex_unlock(&adapter->lock);
+	if(!copied)
+	{
+		errno=EAGAIN;
+		return -1;
+	}
+	return copied;
+}
+
+/** @brief The pseudo read, the emulated dvr (or a demux descriptor with DMX_OUT_TSDEMUX_TAP) serves the TS file */
+ssize_t dvb_read(int fd, void *buf, size_t count)
+{
+	dvb_emu_fd_t *emu_fd;
+
+	if(fd<0 || fd>=DVB_EMU_MAX_FD || (emu_fd=dvb_emu_fds[fd])==NULL)
+		return read(fd, buf, count);
+	if(emu_fd->type==DVB_EMU_DEMUX && emu_fd->output==DMX_OUT_TSDEMUX_TAP)
+		return dvb_emu_dvr_read(emu_fd->adapter, emu_fd, buf, count);
+	if(emu_fd->type!=DVB_EMU_DVR)
+	{
+		errno=EINVAL;
+		return -1;
+	}
+	return dvb_emu_dvr_read(emu_fd->adapter, NULL, buf, count);
+}
+
+/** @brief The pseudo poll, an emulated frontend has an event (POLLPRI) when its status changes
+ *
+ */
+int dvb_poll(struct pollfd *pfds, nfds_t nfds, int timeout)
+{
+	dvb_emu_fd_t *emu_fd;
+	dvb_emu_adapter_t *adapter;
+	uint64_t now;
+	int event=0;
+	int wait;
+	int ret;
+
+	if(!dvb_emu_num_fds)
+		return poll(pfds, nfds, timeout);
+
+	//We do not wait more than the next status change of the emulated frontends
+	now=get_time();
+	for(nfds_t i=0;i<nfds;i++)
+	{
+		if(pfds[i].fd<0 || pfds[i].fd>=DVB_EMU_MAX_FD || (emu_fd=dvb_emu_fds[pfds[i].fd])==NULL || emu_fd->type!=DVB_EMU_FRONTEND)
+			continue;
+		adapter=emu_fd->adapter;
+		pthread_mutex_lock(&adapter->lock);
+		if(dvb_emu_status(adapter, now)!=adapter->event_status)
+			event=1;
+		else if((wait=dvb_emu_next_change(adapter, now))>=0 && (timeout<0 || wait<timeout))
+			timeout=wait;
+		pthread_mutex_unlock(&adapter->lock);
+	}
+	ret=poll(pfds, nfds, event ? 0 : timeout);
+	if(ret<0)
+		return ret;
+
+	ret=0;
+	now=get_time();
+	for(nfds_t i=0;i<nfds;i++)
+	{
+		if(pfds[i].fd>=0 && pfds[i].fd<DVB_EMU_MAX_FD && (emu_fd=dvb_emu_fds[pfds[i].fd])!=NULL && emu_fd->type==DVB_EMU_FRONTEND)
+		{
+			adapter=emu_fd->adapter;
+			pthread_mutex_lock(&adapter->lock);
+			pfds[i].revents=(dvb_emu_status(adapter, now)!=adapter->event_status) ? (pfds[i].events & POLLPRI) : 0;
+			pthread_mutex_unlock(&adapter->lock);
+		}
+		if(pfds[i].revents)
+			ret++;
+	}
+	return ret;
+}
+
+/** @brief The pseudo close, releases the emulated device */
+int dvb_close(int fd)
+{
+	dvb_emu_fd_t *emu_fd;
+
+	if(fd>=0 && fd<DVB_EMU_MAX_FD && (emu_fd=dvb_emu_fds[fd])!=NULL)
+	{
+		pthread_mutex_lock(&dvb_emu_mutex);
+		pthread_mutex_lock(&emu_fd->adapter->lock);
+		dvb_emu_remove_pids(emu_fd);
+		pthread_mutex_unlock(&emu_fd->adapter->lock);
+		dvb_emu_put_adapter(emu_fd->adapter);
+		dvb_emu_fds[fd]=NULL;
+		dvb_emu_num_fds--;
+		pthread_mutex_unlock(&dvb_emu_mutex);
+		free(emu_fd->pids);
+		free(emu_fd);
+	}
+	return close(fd);
+}
@@ -0,0 +1,95 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/** @file
+ * @brief Device backend : the real DVB devices or an emulated adapter
+ *
+ * All the accesses to the frontend, demux and dvr file descriptors go through
+ * dvb_ioctl, dvb_read, dvb_poll and dvb_close. When the card path starts with
+ * DVB_EMU_PREFIX the devices are emulated : the frontend locks after a
+ * configurable delay with a configurable signal, and the dvr serves a TS file
+ * with the demux PID filters applied.
+ */
+
+#ifndef _DVB_EMU_H
+#define _DVB_EMU_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/poll.h>
+#include <linux/dvb/frontend.h>
+#include <linux/dvb/version.h>
+
+/** The card path prefix selecting the emulated adapter, followed by the TS file */
+#define DVB_EMU_PREFIX "emu:"
+/** The file descriptors above this limit cannot be emulated */
+#define DVB_EMU_MAX_FD 65536
+
+enum
+{
+	DVB_EMU_FRONTEND=1,
+	DVB_EMU_DEMUX,
+	DVB_EMU_DVR,
+};
+
+/** @brief The parameters of the emulated adapters */
+typedef struct dvb_emu_p_t{
+  /** The frontend type (FE_QPSK, FE_OFDM, FE_QAM, FE_ATSC) */
+  fe_type_t fe_type;
+  /** Does the frontend lock ? */
+  int lock;
+  /** The time to lock, in ms */
+  int lock_delay;
+  /** The signal strength, in dBm */
+  double strength;
+  /** The carrier to noise ratio, in dB */
+  double cnr;
+  /** The random variation of the strength and of the CNR, in dB */
+  double variation;
+  /** The bit error rate before the outer code */
+  double ber;
+  /** The number of uncorrected blocks per second */
+  int ucb_rate;
+  /** The bitrate of the transport stream in kbit/s, 0 for as fast as possible */
+  int bitrate;
+  /** Simulate a DVR buffer overflow every N reads, 0 for never */
+  int overflow;
+  /** Do we restart the file at the end ? */
+  int loop;
+  /** The number of hardware PID filters of the demux, 0 for no limit */
+  int max_filters;
+}dvb_emu_p_t;
+
+int read_dvb_emu_configuration(dvb_emu_p_t *dvb_emu_p, char *substring);
+
+int dvb_emu_path(const char *path);
+int dvb_emu_open(const char *base_path, int tuner, int type);
+
+int dvb_ioctl(int fd, unsigned long request, ...);
+ssize_t dvb_read(int fd, void *buf, size_t count);
+int dvb_poll(struct pollfd *pfds, nfds_t nfds, int timeout);
+int dvb_close(int fd);
+
+#endif
@@ -130,12 +130,16 @@
 #include "scam_decsa.h"
 #endif
 #include "ts.h"
+#include "decap.h"
+#include "bbframe.h"
+#include "crc32.h"
 #include "errors.h"
 #include "autoconf.h"
 #include "sap.h"
 #include "rewrite.h"
 #include "unicast_http.h"
 #include "rtp.h"
+#include "zap.h"
 #include "log.h"
 
 #if defined __UCLIBC__ || defined ANDROID
@@ -169,6 +173,7 @@ int dont_send_scrambled=0;
 
 //logging
 extern log_params_t log_params;
+extern dvb_emu_p_t dvb_emu_p;
 
 // prototypes
 static void SignalHandler (int signum);//below
@@ -177,8 +182,6 @@ void init_multicast_v(multi_p_t *multi_p); //in multicast.c
 
 void chan_new_pmt(unsigned char *ts_packet, mumu_chan_p_t *chan_p, int pid);
 
-int processt2(unsigned char* input_buf, unsigned int input_buf_offset, unsigned char* output_buf, unsigned int output_buf_offset, unsigned int output_buf_size, uint8_t plpId);
-
 int
 main (int argc, char *argv[])
 {
@@ -192,6 +195,11 @@ main (int argc, char *argv[])
 	pthread_t monitorthread=0;
 	card_thread_parameters_t cardthreadparams;
 	memset(&cardthreadparams,0,sizeof(card_thread_parameters_t));
+	monitor_parameters_t monitor_thread_params;
+	memset(&monitor_thread_params,0,sizeof(monitor_parameters_t));
+	strength_parameters_t strengthparams;
+	memset(&strengthparams,0,sizeof(strength_parameters_t));
+	pthread_mutex_init(&strengthparams.stats_lock,NULL);
 
 	//Channel information
 	mumu_chan_p_t chan_p;
@@ -223,6 +231,15 @@ main (int argc, char *argv[])
 	init_tune_v(&tune_p);
 	card_tuned=&tune_p.card_tuned;
 
+	//zap server
+	zap_server_p_t zap_server_p;
+	init_zap_server_v(&zap_server_p);
+
+	//tuning of several adapters at once
+	zap_multi_p_t zap_multi_p;
+	init_zap_multi_v(&zap_multi_p);
+	tune_p_t *c_tune_p=&tune_p;
+
 #ifdef ENABLE_CAM_SUPPORT
 	//CAM (Conditionnal Access Modules : for scrambled channels)
 	cam_p_t cam_p;
@@ -260,6 +277,7 @@ main (int argc, char *argv[])
 	char filename_pid[DEFAULT_PATH_LEN]=PIDFILE_PATH;
 
 	int server_id = 0; /** The server id for the template %server */
+	int stream = 0; /** Do we stream the channels once tuned ? */
 
 	int iRet;
 
@@ -269,12 +287,22 @@ main (int argc, char *argv[])
 	int ScramblingControl;
 	int continuity_counter;
 
+	//The packets given to the channels
+	unsigned char *packets=NULL;
+	int num_packets;
+	int poll_ret;
+	ts_meta_t ts_meta;
+	memset (&ts_meta, 0, sizeof (ts_meta_t));
+
 	/** The buffer for the card */
 	card_buffer_t card_buffer;
 	memset (&card_buffer, 0, sizeof (card_buffer_t));
 	card_buffer.dvr_buffer_size=DEFAULT_TS_BUFFER_SIZE;
 	card_buffer.max_thread_buffer_size=DEFAULT_THREAD_BUFFER_SIZE;
-	unsigned int t2mi_buf_size = 0;
+	card_buffer.sw_filter=&fds.sw_filter;
+	ts_framer_init(&card_buffer.framer);
+	int tr101290_pid_timeout=TR101290_DEFAULT_PID_TIMEOUT;
+	crc32_init();
 	/** List of mandatory pids */
 	uint8_t mandatory_pid[MAX_MANDATORY_PID_NUMBER];
 
@@ -302,7 +330,8 @@ main (int argc, char *argv[])
 			&server_id,
 			&no_daemon,
 			&dump_filename,
-			&listingcards);
+			&listingcards,
+			&zap_server_p.server);
 
 
 	//List the detected cards
@@ -343,6 +372,9 @@ main (int argc, char *argv[])
 	int send_packet=0;
 	char current_line[CONF_LINELEN];
 	char *substring=NULL;
+	//The end of the numbers read and the inner stream of the input
+	char *end;
+	long decap_stream;
 	char delimiteurs[] = CONFIG_FILE_SEPARATOR;
 	/******************************************************/
 	// config file displaying
@@ -407,7 +439,7 @@ if (conf_filename != NULL)
 			//If nothing in the substring we avoid the segfault in the next line
 			if(substring == NULL)
 				continue;
-			if(strcmp (substring, "new_channel") )
+			if(strcmp (substring, "new_channel") && strcmp (substring, "new_adapter"))
 				continue;
 		}
 		//commentary
@@ -429,7 +461,7 @@ if (conf_filename != NULL)
 		else
 			c_chan=&chan_p.channels[ichan];
 
-		if((iRet=read_tuning_configuration(&tune_p, substring))) //Read the line concerning the tuning parameters
+		if((iRet=read_tuning_configuration(c_tune_p, substring))) //Read the line concerning the tuning parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
@@ -478,10 +510,27 @@ if (conf_filename != NULL)
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
+		else if((iRet=read_zap_server_configuration(&zap_server_p, substring))) //Read the line concerning the zap server parameters
+		{
+			if(iRet==-1)
+				exit(ERROR_CONF);
+		}
+		else if((iRet=read_dvb_emu_configuration(&dvb_emu_p, substring))) //Read the line concerning the emulated adapter
+		{
+			if(iRet==-1)
+				exit(ERROR_CONF);
+		}
+		else if (!strcmp (substring, "new_adapter"))
+		{
+			c_tune_p=zap_multi_new_block(&zap_multi_p, &tune_p);
+			if(c_tune_p==NULL)
+				exit(ERROR_CONF);
+		}
 		else if (!strcmp (substring, "new_channel"))
 		{
 			ichan++;
 			chan_p.channels[ichan].channel_ready=ALMOST_READY;
+			chan_p.channels[ichan].decap_stream=-1;
 			log_message( log_module, MSG_INFO,"New channel, current number %d", ichan);
 		}
 		else if (!strcmp (substring, "timeout_no_diff"))
@@ -518,6 +567,11 @@ if (conf_filename != NULL)
 			if (chan_p.psi_tables_filtering == PSI_TABLES_FILTERING_PAT_CAT_ONLY)
 				log_message( log_module,  MSG_INFO, "You have enabled PSI tables filtering, only PAT and CAT will be send\n");
 		}
+		else if (!strcmp (substring, "stream"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			stream = atoi (substring);
+		}
 		else if (!strcmp (substring, "dvr_buffer_size"))
 		{
 			substring = strtok (NULL, delimiteurs);
@@ -545,6 +599,65 @@ if (conf_filename != NULL)
 			substring = strtok (NULL, delimiteurs);
 			card_buffer.max_thread_buffer_size = atoi (substring);
 		}
+		else if (!strcmp (substring, "ts_lock_packets"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer.framer.lock_packets = atoi (substring);
+			if(card_buffer.framer.lock_packets<2 || card_buffer.framer.lock_packets>TS_FRAMER_MAX_LOCK_PACKETS)
+			{
+				log_message( log_module,  MSG_WARN,
+						"ts_lock_packets must be between 2 and %d, forced to %d\n", TS_FRAMER_MAX_LOCK_PACKETS, TS_FRAMER_DEFAULT_LOCK_PACKETS);
+				card_buffer.framer.lock_packets = TS_FRAMER_DEFAULT_LOCK_PACKETS;
+			}
+		}
+		else if (!strcmp (substring, "pid_stats"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			if(atoi (substring) && card_buffer.pid_stats==NULL)
+			{
+				card_buffer.pid_stats=pid_stats_new();
+				if(card_buffer.pid_stats==NULL)
+					exit(ERROR_MEMORY);
+			}
+		}
+		else if (!strcmp (substring, "pcr_stats"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			if(atoi (substring) && card_buffer.pcr_stats==NULL)
+			{
+				card_buffer.pcr_stats=pcr_stats_new(&chan_p);
+				if(card_buffer.pcr_stats==NULL)
+					exit(ERROR_MEMORY);
+			}
+		}
+		else if (!strcmp (substring, "tr101290"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			if(atoi (substring) && card_buffer.tr101290==NULL)
+			{
+				card_buffer.tr101290=tr101290_new(&chan_p);
+				if(card_buffer.tr101290==NULL)
+					exit(ERROR_MEMORY);
+			}
+		}
+		else if (!strcmp (substring, "tr101290_pid_timeout"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			tr101290_pid_timeout = atoi (substring);
+			if(tr101290_pid_timeout<=0)
+			{
+				log_message( log_module,  MSG_WARN,
+						"tr101290_pid_timeout must be positive, forced to %d\n", TR101290_DEFAULT_PID_TIMEOUT);
+				tr101290_pid_timeout = TR101290_DEFAULT_PID_TIMEOUT;
+			}
+		}
+		else if (!strcmp (substring, "max_hw_filters"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			fds.max_hw_filters = atoi (substring);
+			if(fds.max_hw_filters<0)
+				fds.max_hw_filters=0;
+		}
 		else if ((!strcmp (substring, "service_id")) || (!strcmp (substring, "ts_id")))
 		{
 			if(!strcmp (substring, "ts_id"))
@@ -611,6 +724,23 @@ if (conf_filename != NULL)
 			}
 			MU_F(c_chan->pid_i.pmt_pid)=F_USER;
 		}
+		else if (!strcmp (substring, "pcr_pid"))
+		{
+			if ( c_chan == NULL)
+			{
+				log_message( log_module,  MSG_ERROR,
+						"pcr_pid : You have to start a channel first (using new_channel)\n");
+				return -1;
+			}
+			substring = strtok (NULL, delimiteurs);
+			c_chan->pid_i.pcr_pid = atoi (substring);
+			if (c_chan->pid_i.pcr_pid < 1 || c_chan->pid_i.pcr_pid > 8190){
+				log_message( log_module,  MSG_ERROR,
+						"Configuration issue in pcr_pid, given PID : %d\n",
+						c_chan->pid_i.pcr_pid);
+				return -1;
+			}
+		}
 		else if (!strcmp (substring, "name"))
 		{
 			if ( c_chan == NULL)
@@ -631,6 +761,33 @@ if (conf_filename != NULL)
 			if (strlen (substring) >= MAX_NAME_LEN - 1)
 				log_message( log_module,  MSG_WARN,"Channel name too long\n");
 		}
+		else if (!strcmp (substring, "null_packets"))
+		{
+			if ( c_chan == NULL)
+			{
+				log_message( log_module,  MSG_ERROR,
+						"null_packets : You have to start a channel first (using new_channel)\n");
+				exit(ERROR_CONF);
+			}
+			substring = strtok (NULL, delimiteurs);
+			if (!strcmp (substring, "keep"))
+				c_chan->null_packets = NULL_PACKETS_KEEP;
+			else if (!strcmp (substring, "drop"))
+				c_chan->null_packets = NULL_PACKETS_DROP;
+			else if (!strcmp (substring, "marker"))
+				c_chan->null_packets = NULL_PACKETS_MARKER;
+			else
+			{
+				log_message( log_module,  MSG_ERROR,
+						"Config issue : %s null_packets must be keep, drop or marker\n", conf_filename);
+				exit(ERROR_CONF);
+			}
+		}
+		else if (!strcmp (substring, "null_reinsert"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer.framer.null_reinsert = atoi (substring);
+		}
 		else if (!strcmp (substring, "server_id"))
 		{
 			substring = strtok (NULL, delimiteurs);
@@ -654,18 +811,72 @@ if (conf_filename != NULL)
 		else if (!strcmp (substring, "t2mi_pid"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			chan_p.t2mi_pid = atoi (substring);
-			log_message(log_module,MSG_INFO,"Demuxing T2-MI stream on pid %d as input\n", chan_p.t2mi_pid);
-			if(chan_p.t2mi_pid < 1 || chan_p.t2mi_pid > 8192)
+			if(chan_p.decap_type != DECAP_NONE && chan_p.decap_type != DECAP_T2MI)
+			{
+				log_message( log_module,  MSG_ERROR,
+						"Config issue : %s only one decapsulation (t2mi_pid or bbframe_pid) can be used\n", conf_filename);
+				exit(ERROR_CONF);
+			}
+			chan_p.decap_type = DECAP_T2MI;
+			chan_p.decap_pid = atoi (substring);
+			log_message(log_module,MSG_INFO,"Demuxing T2-MI stream on pid %d as input\n", chan_p.decap_pid);
+			if(chan_p.decap_pid < 1 || chan_p.decap_pid > 8192)
 			{
 				log_message(log_module,MSG_WARN,"wrong t2mi pid, forced to 4096\n");
-				chan_p.t2mi_pid=4096;
+				chan_p.decap_pid=4096;
 			}
 		}
-		else if (!strcmp (substring, "t2mi_plp"))
+		else if (!strcmp (substring, "bbframe_pid"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			chan_p.t2mi_plp = atoi (substring);
+			if(chan_p.decap_type != DECAP_NONE && chan_p.decap_type != DECAP_BBFRAME)
+			{
+				log_message( log_module,  MSG_ERROR,
+						"Config issue : %s only one decapsulation (t2mi_pid or bbframe_pid) can be used\n", conf_filename);
+				exit(ERROR_CONF);
+			}
+			chan_p.decap_type = DECAP_BBFRAME;
+			chan_p.decap_pid = atoi (substring);
+			if(chan_p.decap_pid < 1 || chan_p.decap_pid > 8191)
+			{
+				log_message(log_module,MSG_WARN,"wrong BBFrame pid, forced to %d\n", BBFRAME_DEFAULT_PID);
+				chan_p.decap_pid=BBFRAME_DEFAULT_PID;
+			}
+			log_message(log_module,MSG_INFO,"Demuxing DVB-S2 baseband frames on pid %d as input\n", chan_p.decap_pid);
+		}
+		else if (!strcmp (substring, "t2mi_plp") || !strcmp (substring, "bbframe_isi"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			if (!strcmp (substring, "all"))
+				chan_p.decap_all_streams = 1;
+			else
+			{
+				decap_stream = strtol (substring, &end, 10);
+				if(end == substring || *end || decap_stream < 0 || decap_stream > 255)
+				{
+					log_message( log_module,  MSG_ERROR,
+							"Config issue : %s the PLP or ISI must be all or between 0 and 255\n", conf_filename);
+					exit(ERROR_CONF);
+				}
+				chan_p.decap_stream = decap_stream;
+			}
+		}
+		else if (!strcmp (substring, "plp") || !strcmp (substring, "isi"))
+		{
+			if ( c_chan == NULL)
+			{
+				log_message( log_module,  MSG_ERROR,
+						"%s : You have to start a channel first (using new_channel)\n", substring);
+				exit(ERROR_CONF);
+			}
+			substring = strtok (NULL, delimiteurs);
+			c_chan->decap_stream = strtol (substring, &end, 10);
+			if(end == substring || *end || c_chan->decap_stream < 0 || c_chan->decap_stream > 255)
+			{
+				log_message( log_module,  MSG_ERROR,
+						"Config issue : %s the PLP or ISI must be between 0 and 255\n", conf_filename);
+				exit(ERROR_CONF);
+			}
 		}
 
 		else
@@ -728,13 +939,6 @@ if (conf_filename != NULL)
 		}
 	}
 
-	if(chan_p.t2mi_pid > 0 && card_buffer.dvr_buffer_size < 20)
-	{
-		log_message( log_module,  MSG_WARN,
-				"Warning : You set a DVR buffer size too low to accept T2-MI frames, I increase your dvr_buffer_size to 20 ...\n");
-		card_buffer.dvr_buffer_size=20;
-	}
-
 	if(card_buffer.max_thread_buffer_size<card_buffer.dvr_buffer_size)
 	{
 		log_message( log_module,  MSG_WARN,
@@ -742,9 +946,29 @@ if (conf_filename != NULL)
 		card_buffer.max_thread_buffer_size=card_buffer.dvr_buffer_size;
 	}
 
+	if(card_buffer.tr101290)
+		card_buffer.tr101290->pid_timeout=tr101290_pid_timeout*1000000ULL;
+
+	if(chan_p.decap_type != DECAP_NONE)
+	{
+		card_buffer.decap=decap_new(chan_p.decap_type, chan_p.decap_pid, chan_p.decap_all_streams);
+		if(card_buffer.decap==NULL)
+			exit(ERROR_MEMORY);
+		if(!chan_p.decap_all_streams && decap_add_stream(card_buffer.decap, chan_p.decap_stream)==NULL)
+			exit(ERROR_MEMORY);
+		for(int i=0;i<=ichan;i++)
+		{
+			if(chan_p.channels[i].decap_stream<0)
+				chan_p.channels[i].decap_stream=chan_p.decap_stream;
+			else if(decap_add_stream(card_buffer.decap, chan_p.channels[i].decap_stream)==NULL)
+				exit(ERROR_CONF);
+		}
+	}
+
 
 
-	//Template for the card dev path
+	//Template for the card dev path, the zap server keep it for the other cards
+	strcpy(zap_server_p.card_dev_path,tune_p.card_dev_path);
 	char number[10];
 	sprintf(number,"%d",tune_p.card);
 	int l=sizeof(tune_p.card_dev_path);
@@ -791,6 +1015,7 @@ if (conf_filename != NULL)
 	// + 1 Because of the new syntax
 	pthread_mutex_lock(&chan_p.lock);
 	chan_p.number_of_channels = ichan+1;
+	pid_dispatch_build(&chan_p);
 	pthread_mutex_unlock(&chan_p.lock);
 
 	//We disable things depending on multicast if multicast is suppressed
@@ -887,6 +1112,28 @@ if (conf_filename != NULL)
 		signal (SIGUSR2, SIG_IGN);
 	if (signal (SIGHUP, SignalHandler) == SIG_IGN)
 		signal (SIGHUP, SIG_IGN);
+	if(zap_multi_p.num_blocks && !zap_server_p.server)
+	{
+		//Each adapter is tuned by its own thread with its own deadline
+		iRet=zap_multi_run(&zap_multi_p);
+		zap_multi_free(&zap_multi_p);
+		if(iRet)
+			set_interrupted(iRet<<8);
+		goto mumudvb_close_goto;
+	}
+	if(zap_server_p.server)
+	{
+		if(zap_multi_p.num_blocks)
+			log_message( log_module,  MSG_WARN, "The new_adapter blocks are not used by the zap server\n");
+		zap_multi_free(&zap_multi_p);
+		//The frontends stay open, the tuning timeout is handled for each request
+		iRet=zap_server_run(&zap_server_p, &tune_p);
+		zap_server_close(&zap_server_p);
+		if(iRet)
+			set_interrupted(iRet<<8);
+		goto mumudvb_close_goto;
+	}
+
 	// alarm for tuning timeout
 	if(tune_p.tuning_timeout)
 	{
@@ -951,22 +1198,218 @@ if (conf_filename != NULL)
 		log_message( log_module,  MSG_INFO, "Tuning issue, card %d\n", tune_p.card);
 		// we close the file descriptors
 		close_card_fd(&fds);
-		set_interrupted(ERROR_TUNE<<8);
+		if(iRet==TUNE_NO_LOCK)
+			set_interrupted(ERROR_NO_LOCK<<8);
+		else
+			set_interrupted(ERROR_TUNE<<8);
 		goto mumudvb_close_goto;
 	}
-	log_message( log_module,  MSG_INFO, "Card %d, tuner %d tuned\n", tune_p.card, tune_p.tuner);
+	log_message( log_module,  MSG_INFO, "Card %d, tuner %d tuned in %.1f ms\n", tune_p.card, tune_p.tuner, tune_p.lock_time/1000.0);
 	tune_p.card_tuned = 1;
 
+	if(!stream)
+	{
 		close_card_fd(&fds);
 		log_message( log_module, MSG_INFO, "The pid will be written in %s", filename_pid);
 
 
 		goto mumudvb_close_goto;
+	}
+
+	/******************************************************/
+	// Streaming of the channels
+	/******************************************************/
+	gettimeofday (&tv, (struct timezone *) NULL);
+	real_start_time = tv.tv_sec;
+	now = 0;
+
+	//The signals stopping the streaming, we close cleanly
+	if (signal (SIGINT, SignalHandler) == SIG_IGN)
+		signal (SIGINT, SIG_IGN);
+	if (signal (SIGTERM, SignalHandler) == SIG_IGN)
+		signal (SIGTERM, SIG_IGN);
+	if (signal (SIGPIPE, SignalHandler) == SIG_IGN)
+		signal (SIGPIPE, SIG_IGN);
+
+	for (int ichan = 0; ichan < chan_p.number_of_channels; ichan++)
+		if(mumu_init_chan(&chan_p.channels[ichan])<0)
+			goto mumudvb_close_goto;
+	//mumu_init_chan can add the PMT PID
+	pthread_mutex_lock(&chan_p.lock);
+	pid_dispatch_build(&chan_p);
+	pthread_mutex_unlock(&chan_p.lock);
+
+	if(init_sap(&sap_p, multi_p))
+	{
+		set_interrupted(ERROR_MEMORY<<8);
+		goto mumudvb_close_goto;
+	}
+
+	//The HTTP master connection
+	if(unic_p.unicast)
+	{
+		log_message( log_module,  MSG_INFO,"Unicast : We open the Master http socket for address %s:%d\n",unic_p.ipOut, unic_p.portOut);
+		unicast_create_listening_socket(UNICAST_MASTER, -1, unic_p.ipOut, unic_p.portOut, &unic_p.sIn, &unic_p.socketIn, &unic_p);
+	}
+
+	//The multicast sockets and the HTTP connections of the channels
+	update_chan_net(&chan_p, &auto_p, &multi_p, &unic_p, server_id, tune_p.card, tune_p.tuner);
+
+	//The file descriptor giving the packets
+	fds.pfds=malloc(sizeof(struct pollfd));
+	if (fds.pfds==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		set_interrupted(ERROR_MEMORY<<8);
+		goto mumudvb_close_goto;
+	}
+	fds.pfds[0].fd = fds.fd_frontend;
+	fds.pfds[0].events = POLLIN | POLLPRI;
+	fds.pfds[0].revents = 0;
+	fds.pfdsnum=1;
+
+	//With a file, all the packets are read. Otherwise we ask the card for the PIDs of the channels
+	if(!strlen(tune_p.read_file_path))
+	{
+		pthread_mutex_lock(&chan_p.lock);
+		//update_chan_filters only looks for the PIDs above the mandatory ones
+		for (int ichan = 0; ichan < chan_p.number_of_channels; ichan++)
+			for (int ipid = 0; ipid < chan_p.channels[ichan].pid_i.num_pids; ipid++)
+				chan_p.asked_pid[chan_p.channels[ichan].pid_i.pids[ipid]]=PID_ASKED;
+		pthread_mutex_unlock(&chan_p.lock);
+		update_chan_filters(&chan_p, tune_p.card_dev_path, tune_p.tuner, &fds);
+	}
+
+	strengthparams.tune_p=&tune_p;
+	strengthparams.fds=&fds;
+	//The statistics counted by card_read, given by the HTTP monitor
+	strengthparams.pid_stats=card_buffer.pid_stats;
+	strengthparams.tr101290=card_buffer.tr101290;
+	strengthparams.pcr_stats=card_buffer.pcr_stats;
+	//The signal statistics (there is no frontend with a file)
+	if(!strlen(tune_p.read_file_path))
+	{
+		if(pthread_create(&signalpowerthread, NULL, show_power_func, &strengthparams))
+		{
+			log_message( log_module, MSG_ERROR,"Cannot start the signal statistics thread : %s\n",strerror(errno));
+			signalpowerthread=0;
+		}
+	}
+
+	//The monitoring thread : traffic, SAP, up/down channels, timeouts
+	monitor_thread_params.wait_time=10;
+	monitor_thread_params.auto_p=&auto_p;
+	monitor_thread_params.sap_p=&sap_p;
+	monitor_thread_params.chan_p=&chan_p;
+	monitor_thread_params.multi_p=&multi_p;
+	monitor_thread_params.unicast_vars=&unic_p;
+	monitor_thread_params.tune_p=&tune_p;
+	monitor_thread_params.fds=&fds;
+	monitor_thread_params.stats_infos=&stats_infos;
+	monitor_thread_params.scam_vars_v=scam_vars_ptr;
+	monitor_thread_params.server_id=server_id;
+	monitor_thread_params.filename_channels_not_streamed=filename_channels_not_streamed;
+	monitor_thread_params.filename_channels_streamed=filename_channels_streamed;
+	monitor_thread_params.pid_stats=card_buffer.pid_stats;
+	if(pthread_create(&monitorthread, NULL, monitor_func, &monitor_thread_params))
+	{
+		log_message( log_module, MSG_ERROR,"Cannot start the monitor thread : %s\n",strerror(errno));
+		monitorthread=0;
+		set_interrupted(ERROR_GENERIC<<8);
+		goto mumudvb_close_goto;
+	}
+
+	//The packets are read by a thread in a ring, or directly in the reading buffer
+	if(card_buffer.threaded_read)
+	{
+		if(card_ring_init(&card_buffer.ring, card_buffer.max_thread_buffer_size)<0)
+		{
+			set_interrupted(ERROR_MEMORY<<8);
+			goto mumudvb_close_goto;
+		}
+		cardthreadparams.fds=&fds;
+		cardthreadparams.card_buffer=&card_buffer;
+		cardthreadparams.threadshutdown=0;
+		if(pthread_create(&cardthread, NULL, read_card_thread_func, &cardthreadparams))
+		{
+			log_message( log_module, MSG_ERROR,"Cannot start the card reading thread : %s\n",strerror(errno));
+			set_interrupted(ERROR_GENERIC<<8);
+			goto mumudvb_close_goto;
+		}
+		cardthreadparams.thread_running=1;
+	}
+	else
+	{
+		card_buffer.reading_buffer=malloc(TS_PACKET_SIZE*card_buffer.dvr_buffer_size);
+		if(card_buffer.reading_buffer==NULL)
+		{
+			log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			set_interrupted(ERROR_MEMORY<<8);
+			goto mumudvb_close_goto;
+		}
+	}
+
+	log_message( log_module,  MSG_INFO, "Streaming %d channels\n", chan_p.number_of_channels);
+	while(!get_interrupted())
+	{
+		num_packets=0;
+		if(card_buffer.threaded_read)
+		{
+			//The ring is given back once the packets are sent
+			if(card_ring_wait(&card_buffer.ring, DVB_POLL_TIMEOUT))
+				num_packets=card_ring_peek(&card_buffer.ring, &packets);
+		}
+		else
+		{
+			poll_ret=mumudvb_poll(fds.pfds, fds.pfdsnum, DVB_POLL_TIMEOUT);
+			if(poll_ret<0)
+			{
+				set_interrupted(-poll_ret);
+				break;
+			}
+			if(poll_ret && (fds.pfds[0].revents & (POLLIN | POLLPRI)))
+				num_packets=card_read(fds.pfds[0].fd, card_buffer.reading_buffer, &card_buffer)/TS_PACKET_SIZE;
+			packets=card_buffer.reading_buffer;
+		}
+
+		if(num_packets)
+		{
+			stats_infos.stats_num_packets_received+=num_packets;
+			stats_infos.stats_num_reads++;
+			//The headers are decoded once for all the channels
+			if(!card_buffer.decap && ts_meta_decode(&ts_meta, packets, num_packets)<0)
+				set_interrupted(ERROR_MEMORY<<8);
+			pthread_mutex_lock(&chan_p.lock);
+			if(card_buffer.decap)
+				dispatch_decap_packets(&chan_p, card_buffer.decap, packets, num_packets, &unic_p, scam_vars_ptr);
+			else
+				dispatch_packets(&chan_p, packets, &ts_meta, &unic_p, scam_vars_ptr);
+			pthread_mutex_unlock(&chan_p.lock);
+			if(card_buffer.threaded_read)
+				card_ring_release(&card_buffer.ring, num_packets);
+		}
+
+		//The HTTP connections
+		if(unic_p.unicast && mumudvb_poll(unic_p.pfds, unic_p.pfdsnum, 0)>0)
+		{
+			pthread_mutex_lock(&chan_p.lock);
+			unicast_handle_fd_event(&unic_p, chan_p.channels, chan_p.number_of_channels, &strengthparams,
+					&auto_p, cam_p_ptr, scam_vars_ptr, rewrite_vars.eit_packets);
+			pthread_mutex_unlock(&chan_p.lock);
+		}
+	}
+	ts_meta_free(&ts_meta);
 
 	mumudvb_close_goto:
+	//The reading thread is stopped before its ring is freed
+	if(cardthreadparams.thread_running)
+	{
+		cardthreadparams.threadshutdown=1;
+		pthread_join(cardthread, NULL);
+	}
 	//If the thread is not started, we don't send the nonexistent address of monitor_thread_params
 	return mumudvb_close(no_daemon,
-					NULL,
+					monitorthread ? &monitor_thread_params : NULL,
 					&rewrite_vars,
 					&auto_p,
 					&unic_p,
@@ -47,6 +47,7 @@ enum
     ERROR_CAM,
     ERROR_GENERIC,
     ERROR_NO_CAM_INIT,
+    ERROR_NO_LOCK,
   };
 
 #endif
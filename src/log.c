@@ -975,6 +975,7 @@ void usage (char *name)
 			"-x, --lnb_lof_standard : config lnb_lof_standard\n"
 			"-v, --lnb_lof_low      : config lnb_lof_low\n"
 			"-b, --lnb_lof_high     : config lnb_lof_high\n"
+			"-S, --server : Keep the frontends open and wait for zap requests on a UNIX socket\n"
 			"-q           : Less verbose\n"
 			"-h, --help   : Help\n"
 			"\n", name);
@@ -87,6 +87,22 @@ int read_multicast_configuration(multi_p_t *multi_p, mumudvb_channel_t *c_chan,
     substring = strtok (NULL, delimiteurs);
     multi_p->auto_join = atoi (substring);
   }
+  else if (!strcmp (substring, "multicast_batch"))
+  {
+    substring = strtok (NULL, delimiteurs);
+    multi_p->batch = atoi (substring);
+  }
+  else if (!strcmp (substring, "multicast_gso"))
+  {
+    substring = strtok (NULL, delimiteurs);
+    multi_p->gso = atoi (substring);
+    if(multi_p->gso<0 || multi_p->gso>UDP_GSO_MAX_SEGMENTS)
+    {
+      log_message( log_module,  MSG_ERROR,
+                   "multicast_gso : the number of datagrams must be between 0 and %d\n", UDP_GSO_MAX_SEGMENTS);
+      return -1;
+    }
+  }
   else if (!strcmp (substring, "ip"))
   {
 	if ( c_chan == NULL)
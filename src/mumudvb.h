@@ -34,6 +34,10 @@
 
 #include "network.h"  //for the sockaddr
 #include "ts.h"
+#include "ts_framer.h"
+#include "pid_stats.h"
+#include "tr101290.h"
+#include "pcr_stats.h"
 #include "config.h"
 #include <pthread.h>
 #include <net/if.h>
@@ -87,6 +91,9 @@
 /**Default Maximum Number of TS packets in the thread buffer*/
 #define DEFAULT_THREAD_BUFFER_SIZE 5000
 
+/** The size of a cache line, to keep apart the data written by different threads */
+#define CACHE_LINE_SIZE 64
+
 #define ALARM_TIME_TIMEOUT 60
 #define ALARM_TIME_TIMEOUT_NO_DIFF 600
 
@@ -156,6 +163,15 @@ typedef enum option_status {
 	OPTION_ON
 } option_status_t;
 
+/** What a channel does with the null packets */
+typedef enum null_packets {
+	NULL_PACKETS_KEEP,
+	/** The null packets are not sent */
+	NULL_PACKETS_DROP,
+	/** The null packets are not sent, a marker allows the receiver to reinsert them */
+	NULL_PACKETS_MARKER
+} null_packets_t;
+
 /** Enum to tell if a channel parameter is user set or autodetected, to avoid erasing of user set params*/
 typedef enum mumu_f {
 	F_UNDEF,
@@ -201,16 +217,43 @@ enum
 	PID_EMM
 };
 
+/**@brief The PIDs kept when the card gives the full TS (software PID filtering)*/
+typedef struct pid_sw_filter_t{
+	/** Is the software filtering active ? */
+	int active;
+	/** Does the card give the whole TS : the PID 8192 filtered in hardware or the software filtering active */
+	int whole_ts;
+	/** One bit per PID */
+	uint64_t bitmap[8192/64];
+}pid_sw_filter_t;
+
+/** @brief Do we keep this PID ? */
+static inline int pid_sw_filter_test(const pid_sw_filter_t *sw_filter, uint16_t pid)
+{
+	return (sw_filter->bitmap[pid>>6]>>(pid&63))&1;
+}
+
 /**@brief file descriptors*/
 typedef struct {
 	/** the dvb dvr*/
 	int fd_dvr;
 	/** the dvb frontend*/
 	int fd_frontend;
-	/** demuxer file descriptors */
+	/** demuxer file descriptors, one per pid (old kernels without DMX_ADD_PID)*/
 	int fd_demuxer[8193];
-	/** poll file descriptors */
-	struct pollfd *pfds;	//  DVR device
+	/** demuxer file descriptor shared by all the pids (DMX_ADD_PID)*/
+	int fd_demux;
+	/** The number of pids filtered by fd_demux */
+	int demux_num_pids;
+	/** Do we use one demuxer file descriptor per pid ? */
+	int demux_per_pid;
+	/** The maximum number of hardware filters, 0 for the card limit */
+	int max_hw_filters;
+	/** The hardware filters are exhausted : the card gives the full TS and the PIDs are filtered by sw_filter */
+	int full_ts;
+	pid_sw_filter_t sw_filter;
+	/** poll file descriptors, pfds[0] is the file descriptor giving the packets (see card_data_fd) */
+	struct pollfd *pfds;	//  DVR device or shared demuxer
 	int pfdsnum;
 }fds_t;
 
@@ -238,15 +281,34 @@ typedef struct {
 }ring_buffer_t;  
 #endif
 
+/**@brief Single producer / single consumer ring of TS packets, from the card reading thread to the main loop
+ *
+ * head is only written by the reading thread and tail by the consumer, each one on
+ * its own cache line. The consumer only blocks (on the eventfd) when the ring is empty.
+ */
+typedef struct card_ring_t{
+	/** The packet slots (size*TS_PACKET_SIZE bytes)*/
+	unsigned char *packets;
+	/** The number of slots, a power of two*/
+	unsigned int size;
+	/** The eventfd waking up the consumer */
+	int efd;
+	/** The next slot written by the reading thread (free running counter)*/
+	unsigned int head __attribute__((aligned(CACHE_LINE_SIZE)));
+	/** The number of packets dropped because the ring was full*/
+	uint64_t dropped_packets;
+	/** The next slot read by the consumer (free running counter)*/
+	unsigned int tail __attribute__((aligned(CACHE_LINE_SIZE)));
+	/** Is the consumer waiting on the eventfd ? */
+	int consumer_waiting;
+}card_ring_t;
+
 /**@brief Structure containing the card buffers*/
 typedef struct card_buffer_t{
-	/** The two buffers (we put from the card with one, we read from the other one)*/
-	unsigned char *buffer1,*buffer2;
-	int actual_read_buffer;
-	/**The pointer to the reading buffer*/
+	/**The pointer to the reading buffer (not threaded read)*/
 	unsigned char *reading_buffer;
-	/**The pointer to the writing buffer*/
-	unsigned char *writing_buffer;
+	/** The ring filled by the reading thread (threaded read)*/
+	card_ring_t ring;
 	/** The maximum number of packets in the buffer from DVR*/
 	int dvr_buffer_size;
 	/** The position in the DVR buffer */
@@ -255,17 +317,26 @@ typedef struct card_buffer_t{
 	int bytes_read;
 	/** Do the read is made using a thread */
 	int threaded_read;
-	/** The thread data buffer */
-	int bytes_in_write_buffer;
-	int write_buffer_size; /** @todo put a size for each buffer*/
 	/** The number of partial packets received*/
 	int partial_packet_number;
 	/** The number of overflow errors*/
 	int overflow_number;
 	/**The maximum size of the thread buffer (in packets)*/
 	int max_thread_buffer_size;
-	/* t2-mi demux buffer */
-	unsigned char *t2mi_buffer;
+	/** The software PID filter applied to the packets read (full TS), can be NULL */
+	pid_sw_filter_t *sw_filter;
+	/** The number of packets dropped by the software PID filter */
+	uint64_t sw_filtered_packets;
+	/** The framer giving aligned packets */
+	ts_framer_t framer;
+	/** The statistics of each PID, NULL if disabled */
+	pid_stats_t *pid_stats;
+	/** The TR 101 290 analyzer, NULL if disabled */
+	tr101290_t *tr101290;
+	/** The PCR tracking of each program, NULL if disabled */
+	pcr_stats_t *pcr_stats;
+	/** The decapsulation of the TS carried in a PID (T2-MI, BBFrame), NULL if none */
+	struct decap_t *decap;
 }card_buffer_t;
 
 
@@ -430,6 +501,15 @@ typedef struct mumu_chan_t{
 	unsigned char buf[MAX_UDP_SIZE];
 	/**number of bytes actually in the buffer*/
 	int nb_bytes;
+	/** What we do with the null packets */
+	null_packets_t null_packets;
+	/** Marker mode : the null packets dropped before each packet of the buffer, and since the last one */
+	uint16_t null_counts[MAX_UDP_SIZE/TS_PACKET_SIZE+1];
+	int null_run;
+	/** Marker mode : the buffer needs a marker */
+	int null_marker;
+	/** The inner stream of the channel (the PLP or the ISI) when the input is decapsulated, -1 for the default one */
+	int decap_stream;
 	/**The data sent to this channel*/
 	long sent_data;
 	/** The packet number for rtp*/
@@ -453,6 +533,11 @@ typedef struct mumu_chan_t{
 	struct sockaddr_in6 sOut6;
 	/**The multicast output socket*/
 	int socketOut6;
+	/** The batches the multicast datagrams are queued in, NULL to send them at once */
+	udp_batch_t *udp_batch4;
+	udp_batch_t *udp_batch6;
+	/** The buffer the multicast datagrams are sent from with UDP segmentation offload, NULL if not used */
+	udp_gso_t *udp_gso;
 
 
 	/**Unicast clients*/
@@ -531,6 +616,10 @@ typedef struct multi_p_t{
 	char iface6[IF_NAMESIZE+1];
 	/** num mpeg packets in one sent packet */
 	unsigned char num_pack;
+	/** Do we send the multicast datagrams of all the channels with sendmmsg ? */
+	int batch;
+	/** The number of datagrams of a channel sent in one call with UDP segmentation offload, 0 to not use it */
+	int gso;
 }multi_p_t;
 
 /** No PSI tables filtering */
@@ -541,6 +630,23 @@ typedef struct multi_p_t{
 #define PSI_TABLES_FILTERING_PAT_ONLY 2
 
 /** structure containing the channels and the asked pids information*/
+/** @brief A channel streaming a PID, with the index of the PID in the channel */
+typedef struct pid_dispatch_entry_t{
+	uint16_t channel;
+	uint16_t pid_index;
+}pid_dispatch_entry_t;
+
+/** @brief The channels streaming each PID
+ * The entries of the PID p are entries[start[p]] to entries[start[p+1]-1]. The
+ * channels streaming the full TS (PID 8192) are only in the entries of 8192.
+ */
+typedef struct pid_dispatch_t{
+	uint32_t start[8194];
+	pid_dispatch_entry_t *entries;
+	/** The number of entries allocated */
+	int entries_size;
+}pid_dispatch_t;
+
 typedef struct mumu_chan_p_t{
 	/** Protects all the members, including most of the channels (see the documentation
 	 * for mumudvb_channel_t for details).
@@ -560,9 +666,19 @@ typedef struct mumu_chan_p_t{
 	/** The number of TS discontinuities per PID **/
 	int16_t continuity_counter_pid[8193]; //on 16 bits for storing the initial -1
 	uint8_t check_cc;
-	/** t2mi demux parameters **/
-	int t2mi_pid;
-	uint8_t t2mi_plp;
+	/** The decapsulation of the input : the type (DECAP_T2MI, DECAP_BBFRAME) and the PID carrying the frames */
+	int decap_type;
+	int decap_pid;
+	/** The default inner stream (PLP or ISI) */
+	uint8_t decap_stream;
+	/** Do we extract all the inner streams ? */
+	int decap_all_streams;
+	/** The PID dispatch table, rebuilt when the PIDs of the channels change. The packet
+	 * path and the rebuild both hold the lock */
+	pid_dispatch_t dispatch;
+	/** The batches of multicast datagrams of the channels, one socket per family, NULL if not used */
+	udp_batch_t *udp_batch4;
+	udp_batch_t *udp_batch6;
 }mumu_chan_p_t;
 
 
@@ -577,6 +693,8 @@ typedef struct monitor_parameters_t{
 	struct tune_p_t *tune_p;
 	fds_t *fds;
 	struct stats_infos_t *stats_infos;
+	/** The statistics of each PID, NULL if disabled */
+	pid_stats_t *pid_stats;
 	void *scam_vars_v;
 	int server_id;
 	char *filename_channels_not_streamed;
@@ -594,11 +712,6 @@ typedef struct mumu_string_t{
 
 #define EMPTY_STRING {NULL,0}
 
-/** global scope variables for T2-MI processiong **/
-extern bool t2mi_active;
-extern bool t2mi_first;
-extern int t2_partial_size;
-
 int mumu_string_append(mumu_string_t *string, const char *psz_format, ...);
 void mumu_free_string(mumu_string_t *string);
 
@@ -608,12 +721,23 @@ char *mumu_string_replace(char *source, int *length, int can_realloc, char *tore
 int string_comput(char *string);
 uint64_t get_time(void);
 void buffer_func (mumudvb_channel_t *channel, unsigned char *ts_packet, struct unicast_parameters_t *unicast_vars, void *scam_vars_v);
+void buffer_func_pid (mumudvb_channel_t *channel, unsigned char *ts_packet, int curr_pid, struct unicast_parameters_t *unicast_vars, void *scam_vars_v);
+void dispatch_packet (mumu_chan_p_t *chan_p, unsigned char *ts_packet, struct unicast_parameters_t *unicast_vars, void *scam_vars_v);
+void dispatch_packets (mumu_chan_p_t *chan_p, unsigned char *buf, const ts_meta_t *meta, struct unicast_parameters_t *unicast_vars, void *scam_vars_v);
+void dispatch_stream_packets (mumu_chan_p_t *chan_p, int stream, unsigned char *buf, int len, struct unicast_parameters_t *unicast_vars, void *scam_vars_v);
+void dispatch_flush (mumu_chan_p_t *chan_p);
+void dispatch_decap_packets (mumu_chan_p_t *chan_p, struct decap_t *decap, unsigned char *buf, int num_packets, struct unicast_parameters_t *unicast_vars, void *scam_vars_v);
 void send_func(mumudvb_channel_t *channel, uint64_t now_time, struct unicast_parameters_t *unicast_vars);
+int channel_drop_null(mumudvb_channel_t *channel, int pid);
+void channel_buffer_add(mumudvb_channel_t *channel, const unsigned char *ts_packet);
+int channel_buffer_full(mumudvb_channel_t *channel);
 
 int mumu_init_chan(mumudvb_channel_t *chan);
 void chan_update_CAM(mumu_chan_p_t *chan_p, struct auto_p_t *auto_p,  void *scam_vars_v);
 void update_chan_net(mumu_chan_p_t *chan_p, struct auto_p_t *auto_p, multi_p_t *multi_p, struct unicast_parameters_t *unicast_vars, int server_id, int card, int tuner);
 void update_chan_filters(mumu_chan_p_t *chan_p, char *card_base_path, int tuner, fds_t *fds);
+int pid_dispatch_build(mumu_chan_p_t *chan_p);
+void pid_dispatch_free(mumu_chan_p_t *chan_p);
 long int mumu_timing();
 
 /** Sets the interrupted flag if value != 0 and it is not already set.
@@ -31,6 +31,7 @@
 #include "log.h"
 #include "errors.h"
 #include "dvb.h"
+#include "decap.h"
 #include "rtp.h"
 #include "unicast_http.h"
 
@@ -40,6 +41,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <unistd.h>
 #include "scam_common.h"
 
 
@@ -117,6 +119,8 @@ void chan_pmt_need_update( mumudvb_channel_t *chan, unsigned char *buf)
 			{
 				return;
 			}
+			if(!chan->pmt_need_update)
+				ts_section_cache_flush(chan->pmt_packet);
 			chan->pmt_need_update=1;
 		}
 	}
@@ -258,6 +262,53 @@ void chan_update_CAM(mumu_chan_p_t *chan_p, auto_p_t *auto_p,  void *scam_vars_v
 
 
 
+/** @brief The batch of multicast datagrams of a family, the socket is opened with the first channel
+ * @return NULL on error, the datagrams of the channel are then sent at once
+ */
+static udp_batch_t *chan_batch_get(udp_batch_t **batch, int family, mumudvb_channel_t *channel, multi_p_t *multi_p)
+{
+	struct sockaddr_in sOut4;
+	struct sockaddr_in6 sOut6;
+	int fd;
+
+	if(*batch!=NULL)
+		return *batch;
+	//The socket has the options of the channel sockets, the destination is given for each datagram
+	if(family==AF_INET)
+		fd=makesocket(channel->ip4Out, channel->portOut, multi_p->ttl, multi_p->iface4, &sOut4);
+	else
+		fd=makesocket6(channel->ip6Out, channel->portOut, multi_p->ttl, multi_p->iface6, &sOut6);
+	if(fd<0)
+		return NULL;
+	*batch=udp_batch_new(fd, family);
+	if(*batch==NULL)
+	{
+		close(fd);
+		return NULL;
+	}
+	log_message( log_module, MSG_INFO,"The multicast IPv%d datagrams are sent in batches\n", family==AF_INET6 ? 6 : 4);
+	return *batch;
+}
+
+/** @brief The GSO buffer of a channel, sending to its multicast sockets
+ * @return NULL if the kernel does not support UDP segmentation, the datagrams of the channel are then sent as before
+ */
+static udp_gso_t *chan_gso_new(mumudvb_channel_t *channel, multi_p_t *multi_p)
+{
+	udp_gso_t *gso;
+
+	gso=udp_gso_new(multi_p->gso);
+	if(gso==NULL)
+		return NULL;
+	if((channel->socketOut4>0 && udp_gso_add_dest(gso, channel->socketOut4, (struct sockaddr *) &channel->sOut4, sizeof(channel->sOut4))) ||
+			(channel->socketOut6>0 && udp_gso_add_dest(gso, channel->socketOut6, (struct sockaddr *) &channel->sOut6, sizeof(channel->sOut6))))
+	{
+		udp_gso_free(gso);
+		return NULL;
+	}
+	return gso;
+}
+
 /** @brief Set the networking for the channels almost ready
  */
 void update_chan_net(mumu_chan_p_t *chan_p, auto_p_t *auto_p, multi_p_t *multi_p, unicast_parameters_t *unicast_vars, int server_id, int card, int tuner)
@@ -437,6 +488,25 @@ void update_chan_net(mumu_chan_p_t *chan_p, auto_p_t *auto_p, multi_p_t *multi_p
 								multi_p->iface6,
 								&chan_p->channels[ichan].sOut6);
 		}
+		//The channels descrambled by software are paced by their send thread, they are not batched
+		if(multi_p->gso>1 && chan_p->channels[ichan].udp_gso==NULL
+				&& (chan_p->channels[ichan].socketOut4>0 || chan_p->channels[ichan].socketOut6>0)
+#ifdef ENABLE_SCAM_SUPPORT
+				&& !chan_p->channels[ichan].scam_support
+#endif
+				)
+			chan_p->channels[ichan].udp_gso=chan_gso_new(&chan_p->channels[ichan], multi_p);
+		if(multi_p->batch && chan_p->channels[ichan].udp_gso==NULL
+#ifdef ENABLE_SCAM_SUPPORT
+				&& !chan_p->channels[ichan].scam_support
+#endif
+				)
+		{
+			if(chan_p->channels[ichan].socketOut4>0)
+				chan_p->channels[ichan].udp_batch4=chan_batch_get(&chan_p->udp_batch4, AF_INET, &chan_p->channels[ichan], multi_p);
+			if(chan_p->channels[ichan].socketOut6>0)
+				chan_p->channels[ichan].udp_batch6=chan_batch_get(&chan_p->udp_batch6, AF_INET6, &chan_p->channels[ichan], multi_p);
+		}
 
 		/******************************************************/
 		//   SCAM START PART
@@ -483,21 +553,20 @@ void update_chan_filters(mumu_chan_p_t *chan_p, char *card_base_path, int tuner,
 			}
 	}
 
-	// T2-MI source pid may not belong to any streamed pid, force it.
-	if (chan_p->t2mi_pid > 0) {
-	    asked_pid[chan_p->t2mi_pid]=PID_ASKED;
+	// The PID carrying the decapsulated TS may not belong to any streamed pid, force it.
+	if (chan_p->decap_type != DECAP_NONE) {
+	    asked_pid[chan_p->decap_pid]=PID_ASKED;
 	}
 
 	//Now we compare with the ones for the channels
 	for (int ipid = MAX_MANDATORY_PID_NUMBER; ipid < 8193; ipid++)
 	{
 		//Now we have the PIDs we look for those who disappeared
-		if(chan_p->asked_pid[ipid]==PID_ASKED && asked_pid[ipid]!=PID_ASKED && ipid != PSIP_PID)
+		if((chan_p->asked_pid[ipid]==PID_ASKED || chan_p->asked_pid[ipid]==PID_FILTERED) && asked_pid[ipid]!=PID_ASKED && ipid != PSIP_PID)
 		{
 			log_message( log_module,  MSG_INFO, "Update : PID %d does not belong to any channel anymore, we close the filter",
 					ipid);
-			close(fds->fd_demuxer[ipid]);
-			fds->fd_demuxer[ipid]=0;
+			remove_filter(ipid, fds);
 			chan_p->asked_pid[ipid]=PID_NOT_ASKED;
 		}
 		//And we look for the PIDs who are now asked
@@ -514,49 +583,110 @@ void update_chan_filters(mumu_chan_p_t *chan_p, char *card_base_path, int tuner,
 	}
 	log_message( log_module, MSG_DETAIL,"Open the new filters");
 	// we open the file descriptors
-	if (create_card_fd (card_base_path, tuner, chan_p->asked_pid, fds) < 0)
+	if (open_card_filters (card_base_path, tuner, chan_p->asked_pid, fds) < 0)
 	{
 		log_message( log_module, MSG_ERROR,"ERROR : CANNOT open the new descriptors. Some channels will probably not work");
 	}
-	set_filters(chan_p->asked_pid, fds);
+	pid_dispatch_build(chan_p);
 
 	pthread_mutex_unlock(&chan_p->lock);
 }
 
 
 
+/** @brief The PID of the channel sent by the dispatch table, -1 if it is not in the table
+ * The channels streaming the full TS (PID 8192) are only in the entries of 8192
+ */
+static int pid_dispatch_pid(mumudvb_channel_t *channel, int ipid, int full_ts)
+{
+	int pid=channel->pid_i.pids[ipid];
 
+	if(pid<0 || pid>8192 || (full_ts && pid!=8192))
+		return -1;
+	return pid;
+}
 
+/** @brief Does the channel stream the full TS (PID 8192) ? */
+static int pid_dispatch_full_ts(mumudvb_channel_t *channel)
+{
+	for (int ipid = 0; ipid < channel->pid_i.num_pids; ipid++)
+		if(channel->pid_i.pids[ipid]==8192)
+			return 1;
+	return 0;
+}
 
+/** @brief Build the PID dispatch table from the PIDs of the channels
+ * The table is rebuilt in place : the chan_p lock has to be held, the packet path
+ * (dispatch_packets, dispatch_decap_packets) holds it as well.
+ * @return -1 on error (the previous table is kept)
+ */
+int pid_dispatch_build(mumu_chan_p_t *chan_p)
+{
+	pid_dispatch_t *dispatch=&chan_p->dispatch;
+	pid_dispatch_entry_t *entries;
+	mumudvb_channel_t *channel;
+	uint32_t *count;
+	int num_entries=0;
+	int full_ts;
+	int pid;
+
+	//The size first, the previous table is kept if we cannot allocate the new one
+	for (int ichan = 0; ichan < chan_p->number_of_channels; ichan++)
+	{
+		channel=&chan_p->channels[ichan];
+		full_ts=pid_dispatch_full_ts(channel);
+		for (int ipid = 0; ipid < channel->pid_i.num_pids; ipid++)
+			if(pid_dispatch_pid(channel, ipid, full_ts)>=0)
+				num_entries++;
+	}
+	if(num_entries>dispatch->entries_size)
+	{
+		entries=realloc(dispatch->entries, num_entries*sizeof(pid_dispatch_entry_t));
+		if(entries==NULL)
+		{
+			log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			return -1;
+		}
+		dispatch->entries=entries;
+		dispatch->entries_size=num_entries;
+	}
+	//We count the channels of each PID in start[pid+1]
+	count=dispatch->start+1;
+	memset(dispatch->start, 0, sizeof(dispatch->start));
+	for (int ichan = 0; ichan < chan_p->number_of_channels; ichan++)
+	{
+		channel=&chan_p->channels[ichan];
+		full_ts=pid_dispatch_full_ts(channel);
+		for (int ipid = 0; ipid < channel->pid_i.num_pids; ipid++)
+			if((pid=pid_dispatch_pid(channel, ipid, full_ts))>=0)
+				count[pid]++;
+	}
+	//start[pid] is now the beginning of the entries of pid, it is used as the write position
+	for (pid = 1; pid < 8194; pid++)
+		dispatch->start[pid]+=dispatch->start[pid-1];
+	for (int ichan = 0; ichan < chan_p->number_of_channels; ichan++)
+	{
+		channel=&chan_p->channels[ichan];
+		full_ts=pid_dispatch_full_ts(channel);
+		for (int ipid = 0; ipid < channel->pid_i.num_pids; ipid++)
+		{
+			if((pid=pid_dispatch_pid(channel, ipid, full_ts))<0)
+				continue;
+			dispatch->entries[dispatch->start[pid]].channel=ichan;
+			dispatch->entries[dispatch->start[pid]].pid_index=ipid;
+			dispatch->start[pid]++;
+		}
+	}
+	//start[pid] is now the end of the entries of pid, ie the beginning of pid+1
+	memmove(dispatch->start+1, dispatch->start, 8193*sizeof(uint32_t));
+	dispatch->start[0]=0;
+	log_message( log_module, MSG_DEBUG,"PID dispatch table rebuilt, %d entries\n", num_entries);
+	return 0;
+}
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+/** @brief Free the PID dispatch table */
+void pid_dispatch_free(mumu_chan_p_t *chan_p)
+{
+	free(chan_p->dispatch.entries);
+	memset(&chan_p->dispatch, 0, sizeof(pid_dispatch_t));
+}
@@ -31,6 +31,7 @@
 #include "log.h"
 #include "errors.h"
 #include "rtp.h"
+#include "decap.h"
 #include "unicast_http.h"
 
 #include <sys/poll.h>
@@ -305,10 +306,130 @@ uint64_t get_time(void) {
 /** @brief function for buffering demultiplexed data.
  */
 void buffer_func (mumudvb_channel_t *channel, unsigned char *ts_packet, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
+{
+	int pid;			/** pid of the current mpeg2 packet */
+	int curr_pid;
+
+	pid = ((ts_packet[1] & 0x1f) << 8) | (ts_packet[2]);
+	for (curr_pid = 0; (curr_pid < channel->pid_i.num_pids); curr_pid++)
+		if ((channel->pid_i.pids[curr_pid] == pid) || (channel->pid_i.pids[curr_pid] == 8192)) //We can stream whole transponder using 8192
+			break;
+	buffer_func_pid(channel, ts_packet, curr_pid < channel->pid_i.num_pids ? curr_pid : -1, unicast_vars, scam_vars_v);
+}
+
+/** @brief Send the packet to the channels streaming the PID
+ * @param stream the inner stream of the packet when the input is decapsulated, -1 otherwise
+ */
+static void dispatch_pid (mumu_chan_p_t *chan_p, pid_dispatch_t *dispatch, unsigned char *ts_packet, int pid, int stream, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
+{
+	pid_dispatch_entry_t *entry;
+	mumudvb_channel_t *channel;
+	uint32_t i;
+
+	for(i=dispatch->start[pid];i<dispatch->start[pid+1];i++)
+	{
+		entry=&dispatch->entries[i];
+		channel=&chan_p->channels[entry->channel];
+		if(channel->channel_ready>=READY && (stream<0 || channel->decap_stream==stream))
+			buffer_func_pid(channel, ts_packet, entry->pid_index, unicast_vars, scam_vars_v);
+	}
+	//The channels streaming the whole transponder
+	for(i=dispatch->start[8192];i<dispatch->start[8193];i++)
+	{
+		entry=&dispatch->entries[i];
+		channel=&chan_p->channels[entry->channel];
+		if(channel->channel_ready>=READY && (stream<0 || channel->decap_stream==stream))
+			buffer_func_pid(channel, ts_packet, entry->pid_index, unicast_vars, scam_vars_v);
+	}
+}
+
+/** @brief Send the packet to the channels streaming its PID, using the dispatch table
+ * The chan_p lock has to be held
+ */
+void dispatch_packet (mumu_chan_p_t *chan_p, unsigned char *ts_packet, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
+{
+	dispatch_pid(chan_p, &chan_p->dispatch, ts_packet, ((ts_packet[1] & 0x1f) << 8) | (ts_packet[2]), -1, unicast_vars, scam_vars_v);
+}
+
+/** @brief Send a buffer of packets to the channels, with the headers decoded by ts_meta_decode
+ * If asked, the packets with the transport error bit are dropped
+ * The chan_p lock has to be held
+ */
+void dispatch_packets (mumu_chan_p_t *chan_p, unsigned char *buf, const ts_meta_t *meta, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
+{
+	for(int i=0;i<meta->num_packets;i++)
+	{
+		if(chan_p->filter_transport_error && (meta->flags[i] & TS_META_TEI))
+			continue;
+		dispatch_pid(chan_p, &chan_p->dispatch, buf+i*TS_PACKET_SIZE, meta->pid[i], -1, unicast_vars, scam_vars_v);
+	}
+	dispatch_flush(chan_p);
+}
+
+/** @brief Send the multicast datagrams queued by the channels
+ * Called at the end of each read cycle, dispatch_packets and dispatch_decap_packets do it
+ */
+void dispatch_flush (mumu_chan_p_t *chan_p)
+{
+	for(int ichan=0;ichan<chan_p->number_of_channels;ichan++)
+		if(chan_p->channels[ichan].udp_gso)
+			udp_gso_flush(chan_p->channels[ichan].udp_gso);
+	if(chan_p->udp_batch4)
+		udp_batch_flush(chan_p->udp_batch4);
+	if(chan_p->udp_batch6)
+		udp_batch_flush(chan_p->udp_batch6);
+}
+
+/** @brief Send the TS of an inner stream to the channels of this stream
+ * @param buf the packets, len bytes
+ */
+void dispatch_stream_packets (mumu_chan_p_t *chan_p, int stream, unsigned char *buf, int len, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
+{
+	unsigned char *ts_packet;
+
+	for(int i=0;i+TS_PACKET_SIZE<=len;i+=TS_PACKET_SIZE)
+	{
+		ts_packet=buf+i;
+		if(chan_p->filter_transport_error && (ts_packet[1] & 0x80))
+			continue;
+		dispatch_pid(chan_p, &chan_p->dispatch, ts_packet, ((ts_packet[1] & 0x1f) << 8) | (ts_packet[2]), stream, unicast_vars, scam_vars_v);
+	}
+}
+
+/** @brief The parameters of dispatch_decap_flush */
+typedef struct dispatch_decap_arg_t{
+	mumu_chan_p_t *chan_p;
+	struct unicast_parameters_t *unicast_vars;
+	void *scam_vars_v;
+}dispatch_decap_arg_t;
+
+static void dispatch_decap_flush(void *arg, int id, unsigned char *buf, int len)
+{
+	dispatch_decap_arg_t *params=(dispatch_decap_arg_t *)arg;
+
+	dispatch_stream_packets(params->chan_p, id, buf, len, params->unicast_vars, params->scam_vars_v);
+}
+
+/** @brief Decapsulate the packets read from the card and send the inner streams to their channels
+ * Called by the streaming loop in place of dispatch_packets when the input is decapsulated
+ * The chan_p lock has to be held
+ * @param buf the packets, num_packets * 188 bytes
+ */
+void dispatch_decap_packets (mumu_chan_p_t *chan_p, struct decap_t *decap, unsigned char *buf, int num_packets, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
+{
+	dispatch_decap_arg_t params={chan_p, unicast_vars, scam_vars_v};
+
+	decap_process(decap, buf, num_packets, dispatch_decap_flush, &params);
+	dispatch_flush(chan_p);
+}
+
+/** @brief Fill the channel buffer with the packet and send it when full
+ * @param curr_pid the index of the packet PID in the channel pids, -1 if it is not a PID of the channel
+ */
+void buffer_func_pid (mumudvb_channel_t *channel, unsigned char *ts_packet, int curr_pid, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
 {
 	int pid;			/** pid of the current mpeg2 packet */
 	int ScramblingControl;
-	int curr_pid = 0;
 	int send_packet = 0;
 	extern int dont_send_scrambled;
 
@@ -337,35 +458,31 @@ void buffer_func (mumudvb_channel_t *channel, unsigned char *ts_packet, struct u
 
 		pid = ((ts_packet[1] & 0x1f) << 8) | (ts_packet[2]);
 		ScramblingControl = (ts_packet[3] & 0xc0) >> 6;
-		pthread_mutex_lock(&channel->stats_lock);
-		for (curr_pid = 0; (curr_pid < channel->pid_i.num_pids); curr_pid++)
-			if ((channel->pid_i.pids[curr_pid] == pid) || (channel->pid_i.pids[curr_pid] == 8192)) //We can stream whole transponder using 8192
-			{
-				if ((ScramblingControl>0) && (pid != channel->pid_i.pmt_pid) )
-					channel->num_scrambled_packets++;
+		if (curr_pid >= 0)
+		{
+			pthread_mutex_lock(&channel->stats_lock);
+			if ((ScramblingControl>0) && (pid != channel->pid_i.pmt_pid) )
+				channel->num_scrambled_packets++;
 
-				//check if the PID is scrambled for determining its state
-				if (ScramblingControl>0) channel->pid_i.pids_num_scrambled_packets[curr_pid]++;
+			//check if the PID is scrambled for determining its state
+			if (ScramblingControl>0) channel->pid_i.pids_num_scrambled_packets[curr_pid]++;
 
-				//we don't count the PMT pid for up channels
-				if (pid != channel->pid_i.pmt_pid)
-					channel->num_packet++;
-				break;
-			}
-		pthread_mutex_unlock(&channel->stats_lock);
+			//we don't count the PMT pid for up channels
+			if (pid != channel->pid_i.pmt_pid)
+				channel->num_packet++;
+			pthread_mutex_unlock(&channel->stats_lock);
+		}
 		//avoid sending of scrambled channels if we asked to
 		send_packet=1;
 		if(dont_send_scrambled && (ScramblingControl>0)&& (channel->pid_i.pmt_pid) )
 			send_packet=0;
+		if(channel_drop_null(channel, pid))
+			send_packet=0;
 
-		if (send_packet) {
-			// we fill the channel buffer
-			memcpy(channel->buf + channel->nb_bytes, ts_packet, TS_PACKET_SIZE);
-			channel->nb_bytes += TS_PACKET_SIZE;
-		}
+		if (send_packet)
+			channel_buffer_add(channel, ts_packet);
 		//The buffer is full, we send it
-		if ((!channel->rtp && ((channel->nb_bytes + TS_PACKET_SIZE) > MAX_UDP_SIZE))
-				||(channel->rtp && ((channel->nb_bytes + RTP_HEADER_LEN + TS_PACKET_SIZE) > MAX_UDP_SIZE))) {
+		if (channel_buffer_full(channel)) {
 			now_time=get_time();
 			send_func(channel, now_time, unicast_vars);
 		}
@@ -376,10 +493,71 @@ void buffer_func (mumudvb_channel_t *channel, unsigned char *ts_packet, struct u
 }
 
 
+/** @brief Drop the null packets if the channel does not send them
+ * In marker mode the null packets dropped are counted for the marker
+ *
+ * @return 1 if the packet is dropped
+ */
+int channel_drop_null(mumudvb_channel_t *channel, int pid)
+{
+	if(pid!=TS_NULL_PID || channel->null_packets==NULL_PACKETS_KEEP)
+		return 0;
+	if(channel->null_packets==NULL_PACKETS_MARKER)
+	{
+		if(channel->null_run<TS_NULL_MARKER_MAX_RUN)
+			channel->null_run++;
+		channel->null_marker=1;
+	}
+	return 1;
+}
+
+/** @brief Fill the channel buffer with the packet */
+void channel_buffer_add(mumudvb_channel_t *channel, const unsigned char *ts_packet)
+{
+	if(channel->null_packets==NULL_PACKETS_MARKER)
+	{
+		channel->null_counts[channel->nb_bytes/TS_PACKET_SIZE]=channel->null_run;
+		channel->null_run=0;
+	}
+	memcpy(channel->buf + channel->nb_bytes, ts_packet, TS_PACKET_SIZE);
+	channel->nb_bytes += TS_PACKET_SIZE;
+}
+
+/** @brief Is there no room for another packet (and the null packet marker if needed) ? */
+int channel_buffer_full(mumudvb_channel_t *channel)
+{
+	int len=channel->nb_bytes + TS_PACKET_SIZE;
+
+	if(channel->rtp)
+		len+=RTP_HEADER_LEN;
+	if(channel->null_marker)
+		len+=TS_PACKET_SIZE;
+	return len > MAX_UDP_SIZE;
+}
+
+/** @brief Put the null packet marker before the packets of the buffer
+ * The buffer has room for it (channel_buffer_full)
+ */
+static void channel_null_marker(mumudvb_channel_t *channel)
+{
+	int num=channel->nb_bytes/TS_PACKET_SIZE;
+
+	//The null packets after the last packet
+	channel->null_counts[num]=channel->null_run;
+	memmove(channel->buf + TS_PACKET_SIZE, channel->buf, channel->nb_bytes);
+	ts_null_marker_build(channel->buf, channel->null_counts, num+1);
+	channel->nb_bytes += TS_PACKET_SIZE;
+	channel->null_run=0;
+	channel->null_marker=0;
+}
+
 /** @brief function for sending demultiplexed data.
  */
 void send_func (mumudvb_channel_t *channel, uint64_t now_time, struct unicast_parameters_t *unicast_vars)
 {
+	if(channel->null_marker)
+		channel_null_marker(channel);
+
 	//For bandwith measurement (traffic)
 	pthread_mutex_lock(&channel->stats_lock);
 	channel->sent_data+=channel->nb_bytes+20+8; // IP=20 bytes header and UDP=8 bytes header
@@ -405,16 +583,26 @@ void send_func (mumudvb_channel_t *channel, uint64_t now_time, struct unicast_pa
 				data=channel->buf;
 				data_len=channel->nb_bytes;
 			}
-			if(channel->socketOut4)
-				sendudp (channel->socketOut4,
-						&channel->sOut4,
-						data,
-						data_len);
-			if(channel->socketOut6)
-				sendudp6 (channel->socketOut6,
-						&channel->sOut6,
-						data,
-						data_len);
+			//The GSO buffer sends to both families
+			if(channel->udp_gso)
+				udp_gso_add(channel->udp_gso, data, data_len);
+			else
+			{
+				if(channel->udp_batch4)
+					udp_batch_add(channel->udp_batch4, (struct sockaddr *) &channel->sOut4, sizeof(channel->sOut4), data, data_len);
+				else if(channel->socketOut4)
+					sendudp (channel->socketOut4,
+							&channel->sOut4,
+							data,
+							data_len);
+				if(channel->udp_batch6)
+					udp_batch_add(channel->udp_batch6, (struct sockaddr *) &channel->sOut6, sizeof(channel->sOut6), data, data_len);
+				else if(channel->socketOut6)
+					sendudp6 (channel->socketOut6,
+							&channel->sOut6,
+							data,
+							data_len);
+			}
 		}
 	/*********** UNICAST **************/
 	unicast_data_send(channel, unicast_vars);
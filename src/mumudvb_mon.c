@@ -49,6 +49,7 @@
 #include "scam_decsa.h"
 #endif
 #include "ts.h"
+#include "decap.h"
 #include "errors.h"
 #include "autoconf.h"
 #include "sap.h"
@@ -78,9 +79,9 @@ extern int tuning_no_diff;
 
 
 
-void parse_cmd_line(int argc, char *argv[],char *(*conf_filename),tune_p_t *tune_p,stats_infos_t *stats_infos,int *server_id, int *no_daemon,char **dump_filename, int *listingcards)
+void parse_cmd_line(int argc, char *argv[],char *(*conf_filename),tune_p_t *tune_p,stats_infos_t *stats_infos,int *server_id, int *no_daemon,char **dump_filename, int *listingcards, int *zap_server)
 {
-	static char short_options[] = "c:a:hlhq";//q;//c:sdthvql";//;
+	static char short_options[] = "c:a:hlhqS";//q;//c:sdthvql";//;
 	static struct option long_options[] = {
 			{"freq", required_argument, NULL, 'f'},
 			{"pol", required_argument, NULL, 'p'},
@@ -97,6 +98,7 @@ void parse_cmd_line(int argc, char *argv[],char *(*conf_filename),tune_p_t *tune
 			{"config", required_argument, NULL, 'c'},
 			{"list-cards", no_argument, NULL, 'l'},
 			{"card", required_argument, NULL, 'a'},
+			{"server", no_argument, NULL, 'S'},
 //			{"signal", no_argument, NULL, 's'},
 //			{"traffic", no_argument, NULL, 't'},
 //			{"server_id", required_argument, NULL, 'i'},
@@ -193,6 +195,9 @@ void parse_cmd_line(int argc, char *argv[],char *(*conf_filename),tune_p_t *tune
 		case 'l':
 			*listingcards=1;
 			break;
+		case 'S':
+			*zap_server=1;
+			break;
 //		case 'z':
 //			*dump_filename = (char *) malloc (strlen (optarg) + 1);
 //			if (!*dump_filename)
@@ -282,9 +287,17 @@ int mumudvb_close(int no_daemon,
 	{
 		log_message(log_module,MSG_DEBUG,"Card reading Thread closing\n");
 		cardthreadparams->threadshutdown=1;
-		pthread_mutex_destroy(&cardthreadparams->carddatamutex);
-		pthread_cond_destroy(&cardthreadparams->threadcond);
+		if(card_buffer->ring.dropped_packets)
+			log_message(log_module,MSG_INFO,"The card reading thread dropped %llu packets (buffer full)\n",
+					(unsigned long long) card_buffer->ring.dropped_packets);
 	}
+	if(card_buffer->framer.resync_number)
+		log_message(log_module,MSG_INFO,"The TS sync was lost %llu times, %llu bytes skipped\n",
+				(unsigned long long) card_buffer->framer.resync_number,
+				(unsigned long long) card_buffer->framer.skipped_bytes);
+	if(card_buffer->sw_filtered_packets)
+		log_message(log_module,MSG_DEBUG,"%llu packets of the full TS were dropped by the software PID filter\n",
+				(unsigned long long) card_buffer->sw_filtered_packets);
 	//We shutdown the monitoring thread
 	if(*monitorthread)
 	{
@@ -303,10 +316,15 @@ int mumudvb_close(int no_daemon,
 
 	for (curr_channel = 0; curr_channel < chan_p->number_of_channels; curr_channel++)
 	{
+		//The datagrams left are sent before the sockets are closed
+		udp_gso_free(chan_p->channels[curr_channel].udp_gso);
+		chan_p->channels[curr_channel].udp_gso=NULL;
 		if(chan_p->channels[curr_channel].socketOut4>0)
 			close (chan_p->channels[curr_channel].socketOut4);
 		if(chan_p->channels[curr_channel].socketOut6>0)
 			close (chan_p->channels[curr_channel].socketOut6);
+		chan_p->channels[curr_channel].udp_batch4=NULL;
+		chan_p->channels[curr_channel].udp_batch6=NULL;
 		if(chan_p->channels[curr_channel].socketIn>0)
 			close (chan_p->channels[curr_channel].socketIn);
 		//Free the channel structures
@@ -430,15 +448,27 @@ int mumudvb_close(int no_daemon,
 
 	/*free packet buffers*/
 	if (card_buffer->threaded_read) {
-    	    if (card_buffer->buffer1) free(card_buffer->buffer1);
-    	    if (card_buffer->buffer2) free(card_buffer->buffer2);
+    	    card_ring_free(&card_buffer->ring);
     	} else {
     	    if (card_buffer->reading_buffer) free(card_buffer->reading_buffer);
     	}
 
-        if (chan_p->t2mi_pid > 0) {
-    	    if (card_buffer->t2mi_buffer) free(card_buffer->t2mi_buffer);
-        }
+	decap_log_totals(card_buffer->decap);
+	decap_free(card_buffer->decap);
+	card_buffer->decap=NULL;
+	ts_framer_free(&card_buffer->framer);
+	pid_stats_free(card_buffer->pid_stats);
+	card_buffer->pid_stats=NULL;
+	tr101290_log_totals(card_buffer->tr101290);
+	tr101290_free(card_buffer->tr101290);
+	card_buffer->tr101290=NULL;
+	pcr_stats_free(card_buffer->pcr_stats);
+	card_buffer->pcr_stats=NULL;
+	pid_dispatch_free(chan_p);
+	udp_batch_free(chan_p->udp_batch4);
+	chan_p->udp_batch4=NULL;
+	udp_batch_free(chan_p->udp_batch6);
+	chan_p->udp_batch6=NULL;
 
 	/*free the file descriptors*/
 	if(fds->pfds) {
@@ -574,6 +604,12 @@ void *monitor_func(void* arg)
 			}
 		}
 
+		/*******************************************/
+		/* merge the statistics of each PID        */
+		/*******************************************/
+		if(params->pid_stats)
+			pid_stats_merge(params->pid_stats, monitor_now);
+
 		/*******************************************/
 		/*show the bandwidth measurement            */
 		/*******************************************/
@@ -51,7 +51,8 @@ void parse_cmd_line(int argc, char **argv,
 		int *server_id,
 		int *no_daemon,
 		char **dump_filename,
-		int *listingcards);
+		int *listingcards,
+		int *zap_server);
 
 
 
@@ -29,6 +29,7 @@
  * @brief Networking functions
  */
 
+#define _GNU_SOURCE		//for sendmmsg
 #include "network.h"
 #include "errors.h"
 #include <string.h>
@@ -37,6 +38,14 @@
 #include "log.h"
 #include <net/if.h>
 #include <unistd.h>
+#include <netinet/udp.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
 
 
 static char *log_module="Network: ";
@@ -69,6 +78,282 @@ sendudp6 (int fd, struct sockaddr_in6 *sSockAddr, unsigned char *data, int len)
 
 
 
+/** @brief Allocate a batch of datagrams sent on the socket fd
+ * @param family AF_INET or AF_INET6
+ * @return NULL on error
+ */
+udp_batch_t *udp_batch_new(int fd, int family)
+{
+	udp_batch_t *batch;
+
+	batch=calloc(1, sizeof(udp_batch_t));
+	if(batch!=NULL)
+		batch->msgs=calloc(UDP_BATCH_SIZE, sizeof(struct mmsghdr));
+	if(batch==NULL || batch->msgs==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		free(batch);
+		return NULL;
+	}
+	batch->fd=fd;
+	batch->family=family;
+	for(int i=0;i<UDP_BATCH_SIZE;i++)
+	{
+		batch->iov[i].iov_base=batch->data[i];
+		batch->msgs[i].msg_hdr.msg_iov=&batch->iov[i];
+		batch->msgs[i].msg_hdr.msg_iovlen=1;
+		batch->msgs[i].msg_hdr.msg_name=&batch->addr[i];
+	}
+	return batch;
+}
+
+/** @brief Send the datagrams left, log the statistics and close the socket */
+void udp_batch_free(udp_batch_t *batch)
+{
+	if(batch==NULL)
+		return;
+	udp_batch_flush(batch);
+	log_message( log_module,  MSG_DETAIL, "IPv%d : %llu datagrams sent with %llu calls, %llu not sent\n",
+			batch->family==AF_INET6 ? 6 : 4,
+			(unsigned long long) batch->sent, (unsigned long long) batch->calls,
+			(unsigned long long) batch->errors);
+	if(batch->fd>0)
+		close(batch->fd);
+	free(batch->msgs);
+	free(batch);
+}
+
+/** @brief Count a datagram not sent, the errors are logged at most every UDP_BATCH_LOG_INTERVAL seconds */
+static void udp_batch_error(udp_batch_t *batch, int err)
+{
+	time_t now_time=time(NULL);
+
+	batch->errors++;
+	batch->errors_logged++;
+	batch->last_errno=err;
+	if(now_time-batch->last_log<UDP_BATCH_LOG_INTERVAL)
+		return;
+	log_message( log_module,  MSG_WARN, "IPv%d : %llu datagrams not sent, last error : %s\n",
+			batch->family==AF_INET6 ? 6 : 4,
+			(unsigned long long) batch->errors_logged, strerror(err));
+	batch->errors_logged=0;
+	batch->last_log=now_time;
+}
+
+/** @brief Send the datagrams queued */
+void udp_batch_flush(udp_batch_t *batch)
+{
+	int done=0, ret;
+
+	while(done<batch->num)
+	{
+		ret=sendmmsg(batch->fd, batch->msgs+done, batch->num-done, 0);
+		batch->calls++;
+		if(ret<0)
+		{
+			if(errno==EINTR)
+				continue;
+			//The first datagram failed, we skip it
+			udp_batch_error(batch, errno);
+			done++;
+			continue;
+		}
+		batch->sent+=ret;
+		done+=ret;
+	}
+	batch->num=0;
+}
+
+/** @brief Queue a datagram, the batch is sent when it is full */
+void udp_batch_add(udp_batch_t *batch, const struct sockaddr *addr, socklen_t addr_len, const unsigned char *data, int len)
+{
+	struct msghdr *hdr;
+
+	if(len>UDP_BATCH_MAX_LEN || addr_len>sizeof(struct sockaddr_in6))
+	{
+		//Too big to be queued, sent at once after the ones queued to keep the order
+		udp_batch_flush(batch);
+		batch->calls++;
+		if(sendto(batch->fd, data, len, 0, addr, addr_len)<0)
+			udp_batch_error(batch, errno);
+		else
+			batch->sent++;
+		return;
+	}
+	hdr=&batch->msgs[batch->num].msg_hdr;
+	memcpy(batch->data[batch->num], data, len);
+	batch->iov[batch->num].iov_len=len;
+	memcpy(&batch->addr[batch->num], addr, addr_len);
+	hdr->msg_namelen=addr_len;
+	batch->num++;
+	if(batch->num==UDP_BATCH_SIZE)
+		udp_batch_flush(batch);
+}
+
+
+
+/** @brief Allocate the GSO buffer of a channel
+ * @param max_segments the number of datagrams of a send
+ * @return NULL on error
+ */
+udp_gso_t *udp_gso_new(int max_segments)
+{
+	udp_gso_t *gso;
+
+	gso=calloc(1, sizeof(udp_gso_t));
+	if(gso==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	if(max_segments>UDP_GSO_MAX_SEGMENTS)
+		max_segments=UDP_GSO_MAX_SEGMENTS;
+	gso->max_segments=max_segments;
+	return gso;
+}
+
+/** @brief Send the datagrams left and log the statistics, the sockets are closed by their owner */
+void udp_gso_free(udp_gso_t *gso)
+{
+	if(gso==NULL)
+		return;
+	udp_gso_flush(gso);
+	log_message( log_module,  MSG_DEBUG, "GSO : %llu datagrams sent with %llu calls, %llu not sent\n",
+			(unsigned long long) gso->sent, (unsigned long long) gso->calls,
+			(unsigned long long) gso->errors);
+	free(gso);
+}
+
+/** @brief Add a destination of the datagrams
+ * @return -1 if the kernel does not support UDP_SEGMENT on this socket
+ */
+int udp_gso_add_dest(udp_gso_t *gso, int fd, const struct sockaddr *addr, socklen_t addr_len)
+{
+	static int unsupported_logged=0;
+	int gso_size;
+	socklen_t opt_len=sizeof(gso_size);
+
+	if(gso->num_dests==2 || addr_len>sizeof(struct sockaddr_in6))
+		return -1;
+	//Linux 4.18 and later know this option
+	if(getsockopt(fd, SOL_UDP, UDP_SEGMENT, &gso_size, &opt_len)<0)
+	{
+		if(!unsupported_logged)
+			log_message( log_module,  MSG_WARN, "UDP segmentation offload not supported : %s, the datagrams are sent one by one\n", strerror(errno));
+		unsupported_logged=1;
+		return -1;
+	}
+	gso->fd[gso->num_dests]=fd;
+	memcpy(&gso->addr[gso->num_dests], addr, addr_len);
+	gso->addr_len[gso->num_dests]=addr_len;
+	gso->num_dests++;
+	return 0;
+}
+
+/** @brief Count the datagrams not sent, the errors are logged at most every UDP_BATCH_LOG_INTERVAL seconds */
+static void udp_gso_error(udp_gso_t *gso, int err, int num)
+{
+	time_t now_time=time(NULL);
+
+	gso->errors+=num;
+	gso->errors_logged+=num;
+	gso->last_errno=err;
+	if(now_time-gso->last_log<UDP_BATCH_LOG_INTERVAL)
+		return;
+	log_message( log_module,  MSG_WARN, "GSO : %llu datagrams not sent, last error : %s\n",
+			(unsigned long long) gso->errors_logged, strerror(err));
+	gso->errors_logged=0;
+	gso->last_log=now_time;
+}
+
+/** @brief Send the datagrams queued to a destination, in one call if the kernel accepts */
+static void udp_gso_send(udp_gso_t *gso, int dest)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	int len, ret;
+
+	if(!gso->disabled && gso->num>1)
+	{
+		iov.iov_base=gso->data;
+		iov.iov_len=gso->len;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name=&gso->addr[dest];
+		msg.msg_namelen=gso->addr_len[dest];
+		msg.msg_iov=&iov;
+		msg.msg_iovlen=1;
+		memset(control, 0, sizeof(control));
+		msg.msg_control=control;
+		msg.msg_controllen=sizeof(control);
+		cmsg=CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level=SOL_UDP;
+		cmsg->cmsg_type=UDP_SEGMENT;
+		cmsg->cmsg_len=CMSG_LEN(sizeof(uint16_t));
+		*((uint16_t *) CMSG_DATA(cmsg))=gso->segment_size;
+		do
+		{
+			ret=sendmsg(gso->fd[dest], &msg, 0);
+			gso->calls++;
+		}while(ret<0 && errno==EINTR);
+		if(ret>=0)
+		{
+			gso->sent+=gso->num;
+			return;
+		}
+		//The route cannot segment (no checksum offload for example), we send the datagrams one by one from now
+		if(errno!=EIO && errno!=EINVAL && errno!=EOPNOTSUPP && errno!=ENOPROTOOPT)
+		{
+			udp_gso_error(gso, errno, gso->num);
+			return;
+		}
+		log_message( log_module,  MSG_WARN, "UDP segmentation refused : %s, the datagrams are sent one by one\n", strerror(errno));
+		gso->disabled=1;
+	}
+	for(int offset=0;offset<gso->len;offset+=gso->segment_size)
+	{
+		len=gso->len-offset;
+		if(len>gso->segment_size)
+			len=gso->segment_size;
+		gso->calls++;
+		if(sendto(gso->fd[dest], gso->data+offset, len, 0, (struct sockaddr *) &gso->addr[dest], gso->addr_len[dest])<0)
+			udp_gso_error(gso, errno, 1);
+		else
+			gso->sent++;
+	}
+}
+
+/** @brief Send the datagrams queued to all the destinations */
+void udp_gso_flush(udp_gso_t *gso)
+{
+	if(gso->num==0)
+		return;
+	for(int i=0;i<gso->num_dests;i++)
+		udp_gso_send(gso, i);
+	gso->num=0;
+	gso->len=0;
+}
+
+/** @brief Queue a datagram, the datagrams are sent when the buffer is full
+ * The datagrams queued before are sent first if this one cannot follow them in the same send :
+ * bigger than them, after a shorter one or too much data.
+ */
+void udp_gso_add(udp_gso_t *gso, const unsigned char *data, int len)
+{
+	if(gso->num &&
+			(len>gso->segment_size || gso->len!=gso->num*gso->segment_size || gso->len+len>UDP_GSO_MAX_LEN))
+		udp_gso_flush(gso);
+	if(gso->num==0)
+		gso->segment_size=len;
+	memcpy(gso->data+gso->len, data, len);
+	gso->len+=len;
+	gso->num++;
+	if(gso->num>=gso->max_segments)
+		udp_gso_flush(gso);
+}
+
+
 /** @brief create a sender socket.
  *
  * Create a socket for sending data, the socket is multicast, udp, with the options REUSE_ADDR et MULTICAST_LOOP set to 1
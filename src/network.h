@@ -39,11 +39,80 @@
 #include <syslog.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/uio.h>
 
 
 /** The default time to live*/
 #define DEFAULT_TTL		2
 
+/** The number of datagrams sent by one sendmmsg */
+#define UDP_BATCH_SIZE		64
+/** The biggest datagram queued, the bigger ones are sent at once */
+#define UDP_BATCH_MAX_LEN	1500
+/** The minimum time between two logs of the send errors, in seconds */
+#define UDP_BATCH_LOG_INTERVAL	10
+
+/** @brief The datagrams waiting to be sent with sendmmsg on one socket
+ * The datagrams are copied, the caller can reuse its buffer at once
+ */
+typedef struct udp_batch_t{
+  /** The socket, shared by all the destinations of this family */
+  int fd;
+  int family;
+  /** The datagrams queued, msgs has UDP_BATCH_SIZE entries */
+  int num;
+  struct mmsghdr *msgs;
+  struct iovec iov[UDP_BATCH_SIZE];
+  struct sockaddr_in6 addr[UDP_BATCH_SIZE];
+  unsigned char data[UDP_BATCH_SIZE][UDP_BATCH_MAX_LEN];
+  /** The number of datagrams sent, of sendmmsg calls and of datagrams not sent */
+  uint64_t sent;
+  uint64_t calls;
+  uint64_t errors;
+  /** The errors since the last log, the last one and the time of this log */
+  uint64_t errors_logged;
+  int last_errno;
+  time_t last_log;
+}udp_batch_t;
+
+/** The most datagrams sent by one UDP_SEGMENT send (the kernel limit) */
+#define UDP_GSO_MAX_SEGMENTS	64
+/** The most bytes sent by one UDP_SEGMENT send : the biggest IPv4 UDP payload */
+#define UDP_GSO_MAX_LEN		65507
+
+/** @brief The datagrams of a channel sent together with UDP generic segmentation offload
+ * The datagrams are put one after the other in a big buffer, given to the kernel in one
+ * send with the UDP_SEGMENT size : the kernel or the NIC cuts it in the same datagrams.
+ * All the datagrams of a send have the same size, except the last one which can be shorter.
+ */
+typedef struct udp_gso_t{
+  /** The number of datagrams of a send */
+  int max_segments;
+  /** The size of the datagrams queued */
+  int segment_size;
+  /** The datagrams queued and their length */
+  int num;
+  int len;
+  /** The kernel or the route refused UDP_SEGMENT, the datagrams are sent one by one */
+  int disabled;
+  /** The destinations : the IPv4 and the IPv6 multicast groups */
+  int num_dests;
+  int fd[2];
+  struct sockaddr_in6 addr[2];
+  socklen_t addr_len[2];
+  /** The number of datagrams sent, of send calls and of datagrams not sent */
+  uint64_t sent;
+  uint64_t calls;
+  uint64_t errors;
+  /** The errors since the last log, the last one and the time of this log */
+  uint64_t errors_logged;
+  int last_errno;
+  time_t last_log;
+  unsigned char data[UDP_GSO_MAX_LEN];
+}udp_gso_t;
+
 
 int makeclientsocket (char *szAddr, unsigned short port, int TTL, char *iface, struct sockaddr_in *sSockAddr);
 void sendudp (int fd, struct sockaddr_in *sSockAddr, unsigned char *data, int len);
@@ -52,6 +121,15 @@ int makeTCPclientsocket (char *szAddr, unsigned short port, struct sockaddr_in *
 int makeclientsocket6 (char *szAddr, unsigned short port, int TTL, char *iface, struct sockaddr_in6 *sSockAddr);
 void sendudp6 (int fd, struct sockaddr_in6 *sSockAddr, unsigned char *data, int len);
 int makesocket6 (char *szAddr, unsigned short port, int TTL, char *iface, struct sockaddr_in6 *sSockAddr);
+udp_batch_t *udp_batch_new(int fd, int family);
+void udp_batch_free(udp_batch_t *batch);
+void udp_batch_add(udp_batch_t *batch, const struct sockaddr *addr, socklen_t addr_len, const unsigned char *data, int len);
+void udp_batch_flush(udp_batch_t *batch);
+udp_gso_t *udp_gso_new(int max_segments);
+void udp_gso_free(udp_gso_t *gso);
+int udp_gso_add_dest(udp_gso_t *gso, int fd, const struct sockaddr *addr, socklen_t addr_len);
+void udp_gso_add(udp_gso_t *gso, const unsigned char *data, int len);
+void udp_gso_flush(udp_gso_t *gso);
 
 #endif
 
@@ -0,0 +1,286 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief Bitrate and jitter of each program, measured with its PCR
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "pcr_stats.h"
+#include "mumudvb.h"
+#include "log.h"
+
+static char *log_module="PCR stats: ";
+
+/** @brief Allocate the PCR tracking
+ * @return NULL on error
+ */
+pcr_stats_t *pcr_stats_new(mumu_chan_p_t *chan_p)
+{
+	pcr_stats_t *pcr_stats;
+
+	pcr_stats=calloc(1, sizeof(pcr_stats_t));
+	if(pcr_stats==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	pcr_stats->programs=calloc(MAX_CHANNELS, sizeof(pcr_program_t));
+	if(pcr_stats->programs==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		free(pcr_stats);
+		return NULL;
+	}
+	pthread_mutex_init(&pcr_stats->lock, NULL);
+	pcr_stats->chan_p=chan_p;
+	for(int i=0;i<MAX_CHANNELS;i++)
+		pcr_stats->programs[i].pcr_pid=-1;
+	return pcr_stats;
+}
+
+void pcr_stats_free(pcr_stats_t *pcr_stats)
+{
+	if(pcr_stats==NULL)
+		return;
+	pthread_mutex_destroy(&pcr_stats->lock);
+	free(pcr_stats->pid_programs);
+	free(pcr_stats->programs);
+	free(pcr_stats);
+}
+
+/** @brief The PIDs of a program : its PIDs and its PCR PID, the invalid ones are -1 */
+static int pcr_stats_program_pids(pid_i_t *pid_i, int *pids)
+{
+	int num=0;
+
+	for(int j=0;j<pid_i->num_pids;j++)
+		pids[num++]=pid_i->pids[j];
+	pids[num++]=pid_i->pcr_pid;
+	for(int j=0;j<num;j++)
+	{
+		if(pids[j]<=0 || pids[j]>=PCR_STATS_PIDS-1)
+			pids[j]=-1;
+		//The PCR PID is often in the PIDs of the program
+		for(int k=0;k<j && pids[j]>=0;k++)
+			if(pids[k]==pids[j])
+				pids[j]=-1;
+	}
+	return num;
+}
+
+/** @brief Follow the changes of the channels : the PIDs of each program and its PCR PID
+ * A PID shared by several programs (often the PCR PID) is counted in each of them.
+ * The channels are read with the chan_p lock held, the caller must not hold it
+ */
+static void pcr_stats_refresh(pcr_stats_t *pcr_stats)
+{
+	mumu_chan_p_t *chan_p=pcr_stats->chan_p;
+	pcr_program_t *program;
+	pid_i_t *pid_i;
+	int16_t *pid_programs;
+	uint32_t *count;
+	int pids[MAX_PIDS+1];
+	int num_channels, num_pids, num_entries, pid;
+
+	pthread_mutex_lock(&chan_p->lock);
+	num_channels=chan_p->number_of_channels;
+	//The size first, the previous PIDs are kept if we cannot allocate the new ones
+	num_entries=0;
+	for(int i=0;i<num_channels;i++)
+	{
+		num_pids=pcr_stats_program_pids(&chan_p->channels[i].pid_i, pids);
+		for(int j=0;j<num_pids;j++)
+			if(pids[j]>=0)
+				num_entries++;
+	}
+	if(num_entries>pcr_stats->pid_programs_size)
+	{
+		pid_programs=realloc(pcr_stats->pid_programs, num_entries*sizeof(int16_t));
+		if(pid_programs==NULL)
+		{
+			log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			pthread_mutex_unlock(&chan_p->lock);
+			return;
+		}
+		pcr_stats->pid_programs=pid_programs;
+		pcr_stats->pid_programs_size=num_entries;
+	}
+	//We count the programs of each PID in pid_start[pid+1]
+	count=pcr_stats->pid_start+1;
+	memset(pcr_stats->pid_start, 0, sizeof(pcr_stats->pid_start));
+	for(int i=0;i<num_channels;i++)
+	{
+		num_pids=pcr_stats_program_pids(&chan_p->channels[i].pid_i, pids);
+		for(int j=0;j<num_pids;j++)
+			if(pids[j]>=0)
+				count[pids[j]]++;
+	}
+	//pid_start[pid] is now the beginning of the programs of pid, used as the write position
+	for(pid=1;pid<=PCR_STATS_PIDS;pid++)
+		pcr_stats->pid_start[pid]+=pcr_stats->pid_start[pid-1];
+	pthread_mutex_lock(&pcr_stats->lock);
+	for(int i=0;i<num_channels;i++)
+	{
+		program=&pcr_stats->programs[i];
+		pid_i=&chan_p->channels[i].pid_i;
+		if(program->pcr_pid!=pid_i->pcr_pid || program->service_id!=chan_p->channels[i].service_id)
+		{
+			//Another PCR or another service, the tracking starts again
+			memset(program, 0, sizeof(pcr_program_t));
+			program->pcr_pid=pid_i->pcr_pid;
+			program->service_id=chan_p->channels[i].service_id;
+		}
+		snprintf(program->name, PCR_STATS_NAME_LEN, "%s", chan_p->channels[i].name);
+		num_pids=pcr_stats_program_pids(pid_i, pids);
+		for(int j=0;j<num_pids;j++)
+			if(pids[j]>=0)
+				pcr_stats->pid_programs[pcr_stats->pid_start[pids[j]]++]=i;
+	}
+	//pid_start[pid] is now the end of the programs of pid, ie the beginning of pid+1
+	memmove(pcr_stats->pid_start+1, pcr_stats->pid_start, PCR_STATS_PIDS*sizeof(uint32_t));
+	pcr_stats->pid_start[0]=0;
+	pcr_stats->num_programs=num_channels;
+	pthread_mutex_unlock(&pcr_stats->lock);
+	pthread_mutex_unlock(&chan_p->lock);
+}
+
+/** @brief Start a new sample at the current PCR */
+static void pcr_stats_window_start(pcr_program_t *program, uint64_t now)
+{
+	program->window_ticks=0;
+	program->window_packets=0;
+	program->window_mux_packets=0;
+	program->window_full_ts=1;
+	program->ref_arrival=now;
+	program->offset_min=program->offset_max=0;
+}
+
+/** @brief Handle a PCR of a program
+ *
+ * @param now the arrival time of the packet, in us
+ */
+static void pcr_stats_pcr(pcr_stats_t *pcr_stats, pcr_program_t *program, const unsigned char *ts_packet, uint64_t now, int full_ts)
+{
+	pcr_sample_t *sample;
+	uint64_t pcr, delta;
+	int discontinuity;
+	double seconds, offset;
+
+	if(!ts_get_pcr(ts_packet, &pcr, &discontinuity))
+		return;
+	delta=(pcr+TS_PCR_MAX-program->last_pcr)%TS_PCR_MAX;
+	if(!program->pcr_seen || discontinuity || delta>PCR_STATS_MAX_GAP)
+		pcr_stats_window_start(program, now);
+	else
+	{
+		program->window_ticks+=delta;
+		program->window_packets+=program->packets-program->last_packets;
+		program->window_mux_packets+=pcr_stats->position-program->last_position;
+		program->window_full_ts&=full_ts;
+		//The arrival time against the PCR, since the start of the sample
+		offset=(double)(now-program->ref_arrival)-program->window_ticks/(TS_PCR_HZ/1000000.0);
+		if(offset<program->offset_min)
+			program->offset_min=offset;
+		if(offset>program->offset_max)
+			program->offset_max=offset;
+		if(program->window_ticks>=PCR_STATS_WINDOW)
+		{
+			seconds=(double)program->window_ticks/TS_PCR_HZ;
+			pthread_mutex_lock(&pcr_stats->lock);
+			sample=&program->history[program->history_pos];
+			sample->time=(now-pcr_stats->start_time)/1000000.0;
+			sample->bitrate=program->window_packets*(TS_PACKET_SIZE*8/1000.0)/seconds;
+			sample->mux_bitrate=program->window_full_ts ? program->window_mux_packets*(TS_PACKET_SIZE*8/1000.0)/seconds : 0;
+			sample->jitter=program->offset_max-program->offset_min;
+			program->history_pos=(program->history_pos+1)%PCR_STATS_HISTORY;
+			if(program->history_num<PCR_STATS_HISTORY)
+				program->history_num++;
+			pthread_mutex_unlock(&pcr_stats->lock);
+			pcr_stats_window_start(program, now);
+		}
+	}
+	program->pcr_seen=1;
+	program->last_pcr=pcr;
+	program->last_packets=program->packets;
+	program->last_position=pcr_stats->position;
+}
+
+/** @brief Count the packets read from the card and follow the PCR
+ * Called by the thread reading the card only, on the whole TS read (before the software filter),
+ * without the chan_p lock (see pcr_stats_refresh)
+ * The packets of a read arrived since the previous read, the arrival time of each
+ * packet is interpolated by its position in the buffer
+ *
+ * @param buffer the aligned 188 bytes packets
+ * @param len the length of the buffer
+ * @param full_ts is the whole TS read ? (for the bitrate of the TS)
+ */
+void pcr_stats_count(pcr_stats_t *pcr_stats, const unsigned char *buffer, int len, int full_ts)
+{
+	uint64_t now=get_time();
+	uint64_t read_start, arrival;
+	const unsigned char *ts_packet;
+	pcr_program_t *program;
+	int num_packets=len/TS_PACKET_SIZE;
+	int pid;
+
+	if(!pcr_stats->start_time)
+		pcr_stats->start_time=now;
+	if(now-pcr_stats->last_refresh>=PCR_STATS_REFRESH)
+	{
+		pcr_stats_refresh(pcr_stats);
+		pcr_stats->last_refresh=now;
+	}
+	//After a long pause (no data), the packets are taken as arrived at the read
+	if(pcr_stats->last_read && now-pcr_stats->last_read<PCR_STATS_MAX_READ_GAP)
+		read_start=pcr_stats->last_read;
+	else
+		read_start=now;
+	pcr_stats->last_read=now;
+	for(int i=0;i<num_packets;i++)
+	{
+		ts_packet=buffer+i*TS_PACKET_SIZE;
+		pcr_stats->position++;
+		pid=((ts_packet[1] & 0x1f) << 8) | ts_packet[2];
+		for(uint32_t j=pcr_stats->pid_start[pid];j<pcr_stats->pid_start[pid+1];j++)
+		{
+			program=&pcr_stats->programs[pcr_stats->pid_programs[j]];
+			program->packets++;
+			//The header of a packet with a transport error cannot be trusted
+			if(pid==program->pcr_pid && !(ts_packet[1] & 0x80))
+			{
+				arrival=read_start+(now-read_start)*(i+1)/num_packets;
+				pcr_stats_pcr(pcr_stats, program, ts_packet, arrival, full_ts);
+			}
+		}
+	}
+}
@@ -0,0 +1,130 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief Bitrate and jitter of each program, measured with its PCR
+ *
+ * The thread reading the card follows the PCR of each service (pid_i.pcr_pid).
+ * Between two PCR it counts the packets of the service and of the whole TS :
+ * the bitrates are given by the PCR time, not by the time of the reads, which
+ * comes in bursts. The jitter is the peak to peak variation of the arrival time
+ * of the PCR packets against the PCR, the arrival time of a packet being
+ * interpolated by its position in the read. One sample is kept per second of PCR in
+ * a fixed size history.
+ */
+
+#ifndef _PCR_STATS_H
+#define _PCR_STATS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ts.h"
+
+/** The number of PIDs */
+#define PCR_STATS_PIDS 8192
+/** The number of samples kept for each program */
+#define PCR_STATS_HISTORY 60
+/** The length of a sample, in 27 MHz units (1 s) */
+#define PCR_STATS_WINDOW TS_PCR_HZ
+/** The maximum interval between two PCR, above the sample starts again (100 ms) */
+#define PCR_STATS_MAX_GAP (TS_PCR_HZ/10)
+/** The maximum interval between two reads for the interpolation of the arrival times, in us */
+#define PCR_STATS_MAX_READ_GAP 100000
+/** The interval between two updates of the PIDs of the programs, in us */
+#define PCR_STATS_REFRESH 1000000
+/** The maximum length of the service names kept */
+#define PCR_STATS_NAME_LEN 128
+
+/** @brief A sample of a program */
+typedef struct pcr_sample_t{
+  /** The arrival time of the last PCR of the sample, in s from the start */
+  double time;
+  /** The bitrate of the whole TS, in kbit/s, 0 if the whole TS is not read */
+  float mux_bitrate;
+  /** The bitrate of the service, in kbit/s */
+  float bitrate;
+  /** The peak to peak PCR jitter, in us */
+  float jitter;
+}pcr_sample_t;
+
+/** @brief The PCR tracking of a program */
+typedef struct pcr_program_t{
+  /** The PCR PID and the service followed, -1 if none */
+  int pcr_pid;
+  int service_id;
+  /** The packets of the service read */
+  uint64_t packets;
+  /** The last PCR, the number of packets of the service and of the TS at this PCR */
+  int pcr_seen;
+  uint64_t last_pcr;
+  uint64_t last_packets;
+  uint64_t last_position;
+  /** The current sample : its length in 27 MHz units and its packets */
+  uint64_t window_ticks;
+  uint64_t window_packets;
+  uint64_t window_mux_packets;
+  int window_full_ts;
+  /** The arrival time of the first PCR of the sample, in us, and the extreme
+   * offsets between the arrival times and the PCR since, in us */
+  uint64_t ref_arrival;
+  double offset_min;
+  double offset_max;
+  /** The fields below are protected by the lock of pcr_stats_t */
+  char name[PCR_STATS_NAME_LEN];
+  /** The samples, history_pos is the next one written */
+  pcr_sample_t history[PCR_STATS_HISTORY];
+  int history_pos;
+  int history_num;
+}pcr_program_t;
+
+/** @brief The PCR tracking of all the programs */
+typedef struct pcr_stats_t{
+  /** The channels, for the PIDs of each program */
+  struct mumu_chan_p_t *chan_p;
+  /** The programs of each PID are pid_programs[pid_start[pid]] to pid_programs[pid_start[pid+1]-1] */
+  uint32_t pid_start[PCR_STATS_PIDS+1];
+  int16_t *pid_programs;
+  /** The number of entries allocated in pid_programs */
+  int pid_programs_size;
+  /** The programs, one per channel */
+  pcr_program_t *programs;
+  /** The number of packets of the TS read */
+  uint64_t position;
+  /** The time of the previous read, in us */
+  uint64_t last_read;
+  uint64_t start_time;
+  uint64_t last_refresh;
+  /** The lock on the samples, the names and num_programs */
+  pthread_mutex_t lock;
+  int num_programs;
+}pcr_stats_t;
+
+pcr_stats_t *pcr_stats_new(struct mumu_chan_p_t *chan_p);
+void pcr_stats_free(pcr_stats_t *pcr_stats);
+void pcr_stats_count(pcr_stats_t *pcr_stats, const unsigned char *buffer, int len, int full_ts);
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief Statistics for each PID of the transport stream
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "pid_stats.h"
+#include "mumudvb.h"
+#include "log.h"
+
+static char *log_module="PID stats: ";
+
+/** @brief Allocate the statistics
+ * @return NULL on error
+ */
+pid_stats_t *pid_stats_new(void)
+{
+	pid_stats_t *pid_stats;
+
+	pid_stats=calloc(1, sizeof(pid_stats_t));
+	if(pid_stats==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	pthread_mutex_init(&pid_stats->lock, NULL);
+	return pid_stats;
+}
+
+void pid_stats_free(pid_stats_t *pid_stats)
+{
+	if(pid_stats==NULL)
+		return;
+	pthread_mutex_destroy(&pid_stats->lock);
+	free(pid_stats);
+}
+
+/** @brief Increment a counter read by the monitor thread
+ * There is only one writer : an atomic load and store are enough, without a locked add
+ */
+#define PID_STATS_INC(counter) __atomic_store_n(&(counter), __atomic_load_n(&(counter), __ATOMIC_RELAXED)+1, __ATOMIC_RELAXED)
+
+/** @brief Count the packets read from the card
+ * Called by the thread reading the card only, there is no lock : the counters are
+ * written with atomic stores, the monitor thread reads them with atomic loads
+ *
+ * @param buffer the aligned 188 bytes packets
+ * @param len the length of the buffer
+ */
+void pid_stats_count(pid_stats_t *pid_stats, const unsigned char *buffer, int len)
+{
+	pid_counters_t *counters=&pid_stats->counters;
+	const unsigned char *ts_packet;
+	uint16_t pid;
+
+	for(int pos=0;pos+TS_PACKET_SIZE<=len;pos+=TS_PACKET_SIZE)
+	{
+		ts_packet=buffer+pos;
+		pid=((ts_packet[1] & 0x1f) << 8) | ts_packet[2];
+		PID_STATS_INC(counters->packets[pid]);
+		if(ts_packet[3] & 0xc0)
+			PID_STATS_INC(counters->scrambled[pid]);
+		//The header of a packet with a transport error cannot be trusted
+		if(ts_packet[1] & 0x80)
+		{
+			PID_STATS_INC(counters->tei[pid]);
+			continue;
+		}
+		if(ts_cc_check(&pid_stats->last_cc[pid], ts_packet))
+			PID_STATS_INC(counters->cc_errors[pid]);
+	}
+}
+
+/** @brief Merge the counters of the thread reading the card and compute the bitrates
+ * Called by the monitor thread
+ *
+ * @param now the time, in s
+ */
+void pid_stats_merge(pid_stats_t *pid_stats, double now)
+{
+	const pid_counters_t *counters=&pid_stats->counters;
+	int oldest;
+	double interval;
+
+	pthread_mutex_lock(&pid_stats->lock);
+	//The counters are read while the other thread writes them, each value is
+	//read at once, the merged values can only be a few packets late
+	for(int pid=0;pid<PID_STATS_PIDS;pid++)
+	{
+		pid_stats->merged.packets[pid]=__atomic_load_n(&counters->packets[pid], __ATOMIC_RELAXED);
+		pid_stats->merged.scrambled[pid]=__atomic_load_n(&counters->scrambled[pid], __ATOMIC_RELAXED);
+		pid_stats->merged.cc_errors[pid]=__atomic_load_n(&counters->cc_errors[pid], __ATOMIC_RELAXED);
+		pid_stats->merged.tei[pid]=__atomic_load_n(&counters->tei[pid], __ATOMIC_RELAXED);
+		pid_stats->window_packets[pid_stats->window_pos][pid]=pid_stats->merged.packets[pid];
+	}
+	pid_stats->window_time[pid_stats->window_pos]=now;
+	if(pid_stats->window_num<PID_STATS_WINDOW)
+		pid_stats->window_num++;
+	oldest=(pid_stats->window_pos+PID_STATS_WINDOW+1-pid_stats->window_num)%PID_STATS_WINDOW;
+	interval=now-pid_stats->window_time[oldest];
+	pid_stats->window_length=interval;
+	for(int pid=0;pid<PID_STATS_PIDS;pid++)
+	{
+		if(interval>0)
+			pid_stats->bitrate[pid]=(uint32_t)(pid_stats->window_packets[pid_stats->window_pos][pid]-pid_stats->window_packets[oldest][pid])
+				*(TS_PACKET_SIZE*8/1000.0)/interval;
+		else
+			pid_stats->bitrate[pid]=0;
+	}
+	pid_stats->window_pos=(pid_stats->window_pos+1)%PID_STATS_WINDOW;
+	pthread_mutex_unlock(&pid_stats->lock);
+}
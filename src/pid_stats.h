@@ -0,0 +1,81 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief Statistics for each PID of the transport stream
+ *
+ * The thread reading the card counts the packets, the continuity errors, the
+ * transport errors and the scrambled packets of each PID in plain counters.
+ * The monitor thread merges them periodically and computes the bitrate over a
+ * sliding window, the HTTP server gives the merged values.
+ */
+
+#ifndef _PID_STATS_H
+#define _PID_STATS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/** The number of PIDs */
+#define PID_STATS_PIDS 8192
+/** The number of samples of the sliding window for the bitrate */
+#define PID_STATS_WINDOW 10
+
+/** @brief The counters of each PID */
+typedef struct pid_counters_t{
+  uint64_t packets[PID_STATS_PIDS];
+  uint64_t scrambled[PID_STATS_PIDS];
+  uint32_t cc_errors[PID_STATS_PIDS];
+  uint32_t tei[PID_STATS_PIDS];
+}pid_counters_t;
+
+/** @brief The statistics of each PID */
+typedef struct pid_stats_t{
+  /** The counters, written only by the thread reading the card */
+  pid_counters_t counters;
+  /** The continuity counter state of each PID (ts_cc_check) */
+  uint8_t last_cc[PID_STATS_PIDS];
+  /** The lock on the fields below, written by the monitor thread */
+  pthread_mutex_t lock;
+  /** The counters merged by the monitor thread */
+  pid_counters_t merged;
+  /** The number of packets at each sample of the window, window_pos is the next one written */
+  uint32_t window_packets[PID_STATS_WINDOW][PID_STATS_PIDS];
+  double window_time[PID_STATS_WINDOW];
+  int window_pos;
+  int window_num;
+  /** The bitrate of each PID over the window, in kbit/s */
+  float bitrate[PID_STATS_PIDS];
+  /** The length of the window, in s */
+  double window_length;
+}pid_stats_t;
+
+pid_stats_t *pid_stats_new(void);
+void pid_stats_free(pid_stats_t *pid_stats);
+void pid_stats_count(pid_stats_t *pid_stats, const unsigned char *buffer, int len);
+void pid_stats_merge(pid_stats_t *pid_stats, double now);
+
+#endif
@@ -65,8 +65,11 @@ typedef struct eit_packet_t{
 	int sections_stored[256];
 	/**Do the full EIT is ok ?*/
 	int full_eit_ok;
+	/** Protects the stored sections, read by the HTTP monitoring. A new section is
+	 * switched under the lock, the old one is freed after */
+	pthread_mutex_t sections_lock;
 	/** The Complete EIT PID  for each section*/
-	mumudvb_ts_packet_t* full_eit_sections[MAX_EIT_SECTIONS];
+	mumudvb_section_t* full_eit_sections[MAX_EIT_SECTIONS];
 	/** The continuity counter of the sent EIT*/
 	int continuity_counter;
 	/** Pointer to the next one */
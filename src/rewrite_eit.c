@@ -104,16 +104,27 @@ uint8_t eit_next_table_id(uint8_t table_id)
 
 void eit_free_packet_contents(eit_packet_t *eit_packet)
 {
-	//free the different packets
+	mumudvb_section_t *sections[MAX_EIT_SECTIONS];
+
+	pthread_mutex_lock(&eit_packet->sections_lock);
+	memcpy(sections, eit_packet->full_eit_sections, sizeof(sections));
+	//we don't break the chained list and keep the lock
+	eit_packet->service_id=0;
+	eit_packet->table_id=0;
+	eit_packet->version=0;
+	eit_packet->needs_update=0;
+	eit_packet->need_others=0;
+	eit_packet->last_section_number=0;
+	memset(eit_packet->sections_stored, 0, sizeof(eit_packet->sections_stored));
+	eit_packet->full_eit_ok=0;
+	memset(eit_packet->full_eit_sections, 0, sizeof(eit_packet->full_eit_sections));
+	eit_packet->continuity_counter=0;
+	pthread_mutex_unlock(&eit_packet->sections_lock);
+
+	//free the different packets, no reader can see them anymore
 	for(int i=0;i<MAX_EIT_SECTIONS;i++)
-		if(eit_packet->full_eit_sections[i]!=NULL)
-			free(eit_packet->full_eit_sections[i]);
-
-	//we don't break the chained list
-	eit_packet_t *next;
-	next=eit_packet->next;
-	memset (eit_packet, 0, sizeof( eit_packet_t));//we clear it
-	eit_packet->next=next;
+		if(sections[i]!=NULL)
+			free(sections[i]);
 }
 
 
@@ -125,6 +136,7 @@ void eit_free_packet_contents(eit_packet_t *eit_packet)
 eit_packet_t *eit_new_packet(rewrite_parameters_t *rewrite_vars, int sid, uint8_t table_id)
 {
 	eit_packet_t *actual_eit=rewrite_vars->eit_packets;
+	eit_packet_t *new_eit;
 
 	//go to the last one or return the already found
 	while(actual_eit && actual_eit->next!=NULL)
@@ -137,24 +149,21 @@ eit_packet_t *eit_new_packet(rewrite_parameters_t *rewrite_vars, int sid, uint8_
 	log_message( log_module, MSG_FLOOD,"EIT Stored before allocation sid %d table id 0x%02x",sid,table_id);
 	eit_show_stored(rewrite_vars);
 
-	if(actual_eit==NULL)
-	{
-		rewrite_vars->eit_packets=calloc(1,sizeof(eit_packet_t));
-		actual_eit=rewrite_vars->eit_packets;
-	}
-	else
-	{
-		actual_eit->next=calloc(1,sizeof(eit_packet_t));
-		actual_eit=actual_eit->next;
-	}
-
-	if(actual_eit==NULL)
+	new_eit=calloc(1,sizeof(eit_packet_t));
+	if(new_eit==NULL)
 	{
 		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
 		return NULL;
 	}
+	pthread_mutex_init(&new_eit->sections_lock,NULL);
+
+	//The list is read by the HTTP monitoring, the new EIT is linked once initialised
+	if(actual_eit==NULL)
+		__atomic_store_n(&rewrite_vars->eit_packets, new_eit, __ATOMIC_RELEASE);
+	else
+		__atomic_store_n(&actual_eit->next, new_eit, __ATOMIC_RELEASE);
 
-	return actual_eit;
+	return new_eit;
 
 }
 
@@ -249,9 +258,14 @@ int eit_need_update(rewrite_parameters_t *rewrite_vars, unsigned char *buf, int
 void eit_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars)
 {
 	eit_t       *eit=NULL;
+	mumudvb_section_t *section, *old_section;
 	/*Check the version before getting the full packet*/
 	if(!rewrite_vars->eit_needs_update)
+	{
 		rewrite_vars->eit_needs_update=eit_need_update(rewrite_vars,ts_packet,1);
+		if(rewrite_vars->eit_needs_update)
+			ts_section_cache_flush(rewrite_vars->full_eit);
+	}
 
 	/*We need to update the full packet, we download it*/
 	if(rewrite_vars->eit_needs_update )
@@ -286,23 +300,29 @@ void eit_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_
 				eit_free_packet_contents(eit_packet);
 			}
 
+			/*We've got the FULL EIT packet*/
+			//we copy the data to a new section, the full EIT is only valid until the next section
+			section=malloc(sizeof(mumudvb_section_t)+rewrite_vars->full_eit->len_full);
+			if(section==NULL)
+			{
+				log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+				break;
+			}
+			section->len_full=rewrite_vars->full_eit->len_full;
+			memcpy(section->data_full, rewrite_vars->full_eit->data_full, section->len_full);
+			//The HTTP monitoring reads the sections with the lock held, the old one is freed after the switch
+			pthread_mutex_lock(&eit_packet->sections_lock);
 			eit_packet->last_section_number = eit->last_section_number;
 			eit_packet->version=eit->version_number;
 			eit_packet->service_id = HILO(eit->service_id);
 			eit_packet->table_id = eit->table_id;
 			eit_packet->full_eit_ok=1;
-			/*We've got the FULL EIT packet*/
-			//we copy the data to the right section
-			if(eit_packet->full_eit_sections[eit->section_number]==NULL)
-				eit_packet->full_eit_sections[eit->section_number]=calloc(1,sizeof(mumudvb_ts_packet_t));
-			if(eit_packet->full_eit_sections[eit->section_number]==NULL)
-			{
-				log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-				break;
-			}
-			memcpy(eit_packet->full_eit_sections[eit->section_number], rewrite_vars->full_eit,sizeof( mumudvb_ts_packet_t));
+			old_section=eit_packet->full_eit_sections[eit->section_number];
+			eit_packet->full_eit_sections[eit->section_number]=section;
 			//We store that we saw this section number
 			eit_packet->sections_stored[eit->section_number]=1;
+			pthread_mutex_unlock(&eit_packet->sections_lock);
+			free(old_section);
 			log_message( log_module, MSG_DETAIL,"Full EIT updated. sid %d section number %d, last_section_number %d\n",
 					eit_packet->service_id,
 					eit->section_number,
@@ -387,7 +407,7 @@ void eit_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters
 	}
 
 	//ok we send this!
-	mumudvb_ts_packet_t *pkt_to_send;
+	mumudvb_section_t *pkt_to_send;
 	int data_left_to_send,sent;
 	unsigned char send_buf[TS_PACKET_SIZE];
 	ts_header=(ts_header_t *)send_buf;
@@ -39,7 +39,7 @@
 #include "log.h"
 #include <stdint.h>
 
-extern uint32_t       crc32_table[256];
+#include "crc32.h"
 static char *log_module="PAT Rewrite: ";
 
 /** @brief, tell if the pat have a newer version than the one recorded actually
@@ -191,10 +191,7 @@ int pat_channel_rewrite(rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *c
 	//CRC32 calculation inspired by the xine project
 	//Now we must adjust the CRC32
 	//we compute the CRC32
-	crc32=0xffffffff;
-	for(i = 0; i < new_section_length-1; i++) {
-		crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ buf_dest[i+TS_HEADER_LEN])&0xff];
-	}
+	crc32=crc32_mpeg(CRC32_INIT, buf_dest+TS_HEADER_LEN, new_section_length-1);
 
 
 	//We write the CRC32 to the buffer
@@ -227,6 +224,8 @@ void pat_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_
 	if(!rewrite_vars->pat_needs_update)
 	{
 		rewrite_vars->pat_needs_update=pat_need_update(rewrite_vars,ts_packet);
+		if(rewrite_vars->pat_needs_update)
+			ts_section_cache_flush(rewrite_vars->full_pat);
 	}
 	/*We need to update the full packet, we download it*/
 	if(rewrite_vars->pat_needs_update)
@@ -39,7 +39,7 @@
 #include "log.h"
 #include <stdint.h>
 
-extern uint32_t       crc32_table[256];
+#include "crc32.h"
 
 static char *log_module="SDT rewrite: ";
 
@@ -184,6 +184,7 @@ int sdt_channel_rewrite(rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *c
 	log_message( log_module, MSG_DEBUG,"table id 0x%x \n", sdt->table_id);
 	if(sdt->table_id!=0x42)
 	{
+		ts_section_cache_flush(rewrite_vars->full_sdt);
 		rewrite_vars->sdt_needs_update=1;
 		log_message( log_module, MSG_DETAIL,"We didn't got the good SDT (wrong table id 0x%x) we search for a new one",sdt->table_id);
 		return 0;
@@ -278,11 +279,7 @@ int sdt_channel_rewrite(rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *c
 	//CRC32 calculation inspired by the xine project
 	//Now we must adjust the CRC32
 	//we compute the CRC32
-	crc32=0xffffffff;
-	int i;
-	for(i = 0; i < new_section_length-1; i++) {
-		crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ buf_dest[i+TS_HEADER_LEN])&0xff];
-	}
+	crc32=crc32_mpeg(CRC32_INIT, buf_dest+TS_HEADER_LEN, new_section_length-1);
 
 
 	//We write the CRC32 to the buffer
@@ -342,6 +339,7 @@ int sdt_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_t
 		{
 			//We clear the section numbers seen
 			memset(&rewrite_vars->sdt_section_numbers_seen,0,sizeof(rewrite_vars->sdt_section_numbers_seen));
+			ts_section_cache_flush(rewrite_vars->full_sdt);
 		}
 	}
 	/*We need to update the full packet, we download it*/
@@ -360,6 +358,7 @@ int sdt_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_t
 			}
 			else if(sdt->table_id!=0x42)
 			{
+				ts_section_cache_flush(rewrite_vars->full_sdt);
 				rewrite_vars->sdt_needs_update=1;
 				log_message( log_module, MSG_DEBUG,"We didn't got the good SDT (wrong table id) we search for a new one\n");
 				break;
@@ -35,7 +35,7 @@
 #include <stdlib.h>
 #include "log.h"
 
-extern uint32_t       crc32_table[256];
+#include "crc32.h"
 static char *log_module="SAP: ";
 
 int sap_add_program(mumudvb_channel_t *channel, sap_p_t *sap_p, mumudvb_sap_message_t *sap_message4, mumudvb_sap_message_t *sap_message6, multi_p_t multi_p);
@@ -345,23 +345,16 @@ int sap_update(mumudvb_channel_t *channel, sap_p_t *sap_p, int curr_channel, mul
 
 	//we compute the CRC32 of the message in order to generate a hash
 	unsigned long crc32;
-	int i;
-	crc32=0xffffffff;
 	if(channel->socketOut4)
 	{
-		for(i = 0; i < sap_message4->len-1; i++) {
-			crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ sap_message4->buf[i])&0xff];
-		}
+		crc32=crc32_mpeg(CRC32_INIT, sap_message4->buf, sap_message4->len-1);
 		//Hash of SAP message : we use the CRC32 that we merge onto 16bits
 		sap_message4->buf[2]=(((crc32>>24) & 0xff)+((crc32>>16) & 0xff)) & 0xff;
 		sap_message4->buf[3]=(((crc32>>8) & 0xff)+(crc32 & 0xff)) & 0xff;
 	}
-	crc32=0xffffffff;
 	if(channel->socketOut6)
 	{
-		for(i = 0; i < sap_message6->len-1; i++) {
-			crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ sap_message6->buf[i])&0xff];
-		}
+		crc32=crc32_mpeg(CRC32_INIT, sap_message6->buf, sap_message6->len-1);
 		//Hash of SAP message : we use the CRC32 that we merge onto 16bits
 		sap_message6->buf[2]=(((crc32>>24) & 0xff)+((crc32>>16) & 0xff)) & 0xff;
 		sap_message6->buf[3]=(((crc32>>8) & 0xff)+(crc32 & 0xff)) & 0xff;
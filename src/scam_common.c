@@ -311,6 +311,8 @@ void scam_new_packet(int pid, mumudvb_channel_t *actual_channel)
 			if(check_pmt_service_id(actual_channel->pmt_packet, actual_channel))
 			{
 				pthread_mutex_lock(&actual_channel->scam_pmt_packet->packetmutex);
+				//This copy is not reassembled, the PMT is kept at the start of its ring
+				actual_channel->scam_pmt_packet->data_full = actual_channel->scam_pmt_packet->buffer_full;
 				actual_channel->scam_pmt_packet->len_full = actual_channel->pmt_packet->len_full;
 				memcpy(actual_channel->scam_pmt_packet->data_full, actual_channel->pmt_packet->data_full, actual_channel->pmt_packet->len_full);
 				pthread_mutex_unlock(&actual_channel->scam_pmt_packet->packetmutex);
@@ -63,25 +63,7 @@ static char *log_module="SCAM_DECSA: ";
  *
  */
 unsigned char ts_packet_get_payload_offset(unsigned char *ts_packet) {
-  if (ts_packet[0] != 0x47)
-  return 0;
-
-  unsigned char adapt_field   = (ts_packet[3] &~ 0xDF) >> 5; // 11x11111
-  unsigned char payload_field = (ts_packet[3] &~ 0xEF) >> 4; // 111x1111
-
-  if (!payload_field) // No payload
-    return 0;
-
-  if (adapt_field) {
-    unsigned char adapt_len = ts_packet[4];
-
-    if (adapt_len > 182) //validity check
-      return 0;
-
-    return 4 + 1 + adapt_len; // ts header + adapt_field_len_byte + adapt_field_len
-  } else {
-    return 4; // No adaptation, data starts directly after TS header
-  }
+  return ts_payload_offset(ts_packet);
 }
 
 
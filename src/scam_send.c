@@ -140,12 +140,11 @@ void *sendthread_func(void* arg)
     send_packet=1;
     if(dont_send_scrambled && (ScramblingControl>0)&& (channel->pid_i.pmt_pid) )
       send_packet=0;
+    if(channel_drop_null(channel, pid))
+      send_packet=0;
 
-    if (send_packet) {
-      // we fill the channel buffer
-      memcpy(channel->buf + channel->nb_bytes, channel->ring_buf->data+TS_PACKET_SIZE*channel->ring_buf->read_send_idx, TS_PACKET_SIZE);
-      channel->nb_bytes += TS_PACKET_SIZE;
-    }
+    if (send_packet)
+      channel_buffer_add(channel, channel->ring_buf->data+TS_PACKET_SIZE*channel->ring_buf->read_send_idx);
     ++channel->ring_buf->read_send_idx;
     channel->ring_buf->read_send_idx&=(channel->ring_buffer_size -1);
 
@@ -153,8 +152,7 @@ void *sendthread_func(void* arg)
     pthread_mutex_unlock(&channel->ring_buf->lock);
 
     //The buffer is full, we send it
-    if ((!channel->rtp && ((channel->nb_bytes + TS_PACKET_SIZE) > MAX_UDP_SIZE))
-      ||(channel->rtp && ((channel->nb_bytes + RTP_HEADER_LEN + TS_PACKET_SIZE) > MAX_UDP_SIZE)))
+    if (channel_buffer_full(channel))
     {
       send_func(channel, send_time, unicast_vars);
     }
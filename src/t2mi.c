@@ -29,167 +29,189 @@
  * @brief T2-MI stream support
  */
 
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
 
-#include "mumudvb.h"
+#include "t2mi.h"
 #include "log.h"
-#include <stdint.h>
 
 static char *log_module = "T2MI: ";
 
-bool t2mi_active=false;
-bool t2mi_first=true;
-int t2_partial_size=0;
+static void *t2mi_new_ctx(void);
+static void t2mi_free_ctx(void *ctx);
+static void t2mi_reset_ctx(void *ctx);
+static void t2mi_process(decap_t *decap, const unsigned char *ts_packet);
+
+const decap_ops_t t2mi_decap_ops={
+	.name="T2-MI",
+	.max_frame_packets=T2MI_MAX_FRAME_PACKETS,
+	.new_ctx=t2mi_new_ctx,
+	.free_ctx=t2mi_free_ctx,
+	.reset_ctx=t2mi_reset_ctx,
+	.process=t2mi_process,
+};
+
+/** @brief Allocate the state of a T2-MI decapsulator
+ * @return NULL on error
+ */
+static void *t2mi_new_ctx(void)
+{
+	t2mi_ctx_t *ctx;
+
+	ctx=calloc(1, sizeof(t2mi_ctx_t));
+	if(ctx==NULL)
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	return ctx;
+}
+
+static void t2mi_free_ctx(void *ctx)
+{
+	free(ctx);
+}
+
+/** @brief Drop the T2-MI packet being filled, only the bytes used are cleared */
+static void t2mi_clear(t2mi_ctx_t *ctx)
+{
+	memset(ctx->packet, 0, ctx->packet_pos);
+	ctx->packet_pos=0;
+	ctx->active=0;
+}
 
-int t2packetpos=0;
-char t2packet[TS_PACKET_SIZE*349]; /* will fit Maximal T2 payload + header */
+/** @brief Start again, e.g. after a discontinuity of the input */
+static void t2mi_reset_ctx(void *ctx)
+{
+	t2mi_clear((t2mi_ctx_t *)ctx);
+}
 
-/* rewritten by [anp/hsw], original code taken from https://github.com/newspaperman/t2-mi */
-int processt2(unsigned char* input_buf, unsigned int input_buf_offset, unsigned char* output_buf, unsigned int output_buf_offset, unsigned int output_buf_size, uint8_t plpId) {
+/** @brief Add bytes to the T2-MI packet
+ * @return -1 if the packet is too big, it is dropped
+ */
+static int t2mi_append(t2mi_ctx_t *ctx, const unsigned char *buf, unsigned int len)
+{
+	if(ctx->packet_pos+len > T2MI_PACKET_SIZE)
+	{
+		log_message(log_module, MSG_DEBUG, "T2-MI packet too big, dropped\n");
+		t2mi_clear(ctx);
+		return -1;
+	}
+	memcpy(ctx->packet+ctx->packet_pos, buf, len);
+	ctx->packet_pos+=len;
+	return 0;
+}
 
+/** @brief Extract the TS packets of a complete T2-MI packet to the stream of its PLP
+ * The TS packet cut at the end of the data field is kept in the stream and
+ * completed by the next baseband frame of this PLP
+ */
+static void t2mi_extract(decap_t *decap, t2mi_ctx_t *ctx)
+{
+	const unsigned char *t2packet=ctx->packet;
+	decap_stream_t *stream;
+	unsigned int syncd, upl, dnp, copy_pos, size;
+
+	/* select source PLP */
+	stream=decap_frame_stream(decap, t2packet[7]);
+	if(stream==NULL)
+		return;
+
+	/* Sync distance (bits) in the BB header then points to the first CRC-8 present in the data field */
+	syncd = (t2packet[16] << 8) + t2packet[17];
+	syncd >>= 3;
+
+	/* end of the data field : data field length (bits) after the 19 bytes of headers */
+	upl = (t2packet[13] << 8) + t2packet[14];
+	upl >>= 3;
+	upl+=19;
+
+	/* Deleted Null Packet byte after each packet */
+	dnp=(t2packet[9]&0x4) ? 1 : 0;
+
+	if(syncd==0x1FFF) { /* maximal sync value (in bytes) : no packet starts in the data field */
+		log_message(log_module, MSG_DEBUG, "sync value 0x1FFF!\n");
+		if(upl > 19)
+			decap_stream_resume(stream, &t2packet[19], upl-19);
+		return;
+	}
+
+	/* the end of the packet cut by the previous frame */
+	if(syncd > dnp)
+		decap_stream_resume(stream, &t2packet[19], syncd-dnp);
+
+	/* copy T2-MI packet payload to output, add sync bytes */
+	for(copy_pos=19+syncd; copy_pos < upl; copy_pos+=(187+dnp)) {
+		size=upl-copy_pos;
+		if(size>187)
+			size=187;
+		decap_stream_packet(stream, &t2packet[copy_pos], size);
+	}
+}
+
+/** @brief Give a TS packet of the T2-MI PID to the decapsulator
+ * rewritten by [anp/hsw], original code taken from https://github.com/newspaperman/t2-mi
+ */
+static void t2mi_process(decap_t *decap, const unsigned char *ts_packet)
+{
+	t2mi_ctx_t *ctx=(t2mi_ctx_t *)decap->ctx;
 	unsigned int payload_start_offset=0;
-	output_buf+=output_buf_offset;
 
 	/* lookup for adaptation field control bits in TS input stream */
-        switch(((input_buf[input_buf_offset + 3])&0x30)>>4) {
-    	    case 0x03:	/* 11b = adaptation field followed by payload */
-		/* number of bytes in AF, following this byte */
-                payload_start_offset=(uint8_t)(input_buf[input_buf_offset + 4]) + 1;
-                if(payload_start_offset > 183) {
-            		log_message(log_module, MSG_DEBUG, "wrong AF len in input stream: %d\n", payload_start_offset);
-                        return 0;
-                }
-            break;
-
-            case 0x02:	/* 10b = adaptation field only, no payload */
-                return 0;
-            break;
-
-            case 0x00:	/* 00b = reserved! */
-            	log_message(log_module, MSG_DEBUG, "wrong AF (00) in input stream, accepting as ordinary packet\n");
-            break;
-            
-            default: /* -Wswitch-default */
-            break;
+	switch((ts_packet[3]&0x30)>>4) {
+		case 0x03:	/* 11b = adaptation field followed by payload */
+			/* number of bytes in AF, following this byte */
+			payload_start_offset=ts_packet[4] + 1;
+			if(payload_start_offset > 183) {
+				log_message(log_module, MSG_DEBUG, "wrong AF len in input stream: %d\n", payload_start_offset);
+				return;
+			}
+			break;
+
+		case 0x02:	/* 10b = adaptation field only, no payload */
+			return;
+
+		case 0x00:	/* 00b = reserved! */
+			log_message(log_module, MSG_DEBUG, "wrong AF (00) in input stream, accepting as ordinary packet\n");
+			break;
+
+		default: /* -Wswitch-default */
+			break;
 	}
 
 	/* source buffer pointer to beginning of payload in packet */
-        unsigned char* buf = input_buf + input_buf_offset + 4 + payload_start_offset;
-        unsigned int len = TS_PACKET_SIZE - 4 - payload_start_offset;
-
-        unsigned int output_bytes=0;
+	const unsigned char* buf = ts_packet + 4 + payload_start_offset;
+	unsigned int len = TS_PACKET_SIZE - 4 - payload_start_offset;
 
 	/* check for payload unit start indicator */
-        if((((input_buf[input_buf_offset + 1])&0x40)>>4)==0x04) {
-                unsigned int offset=1;
-                offset+=(uint8_t)(buf[0]);
-                if(t2mi_active) {
-                        if( 1 < offset && offset < 184) {
-                                memcpy(&t2packet[t2packetpos],&buf[1],offset-1);
-                        } else if (offset >= 184) {
-            			log_message(log_module, MSG_DEBUG, "invalid payload offset: %u\n", offset);
-            			return 0;
-                        }
-                        
-			/* select source PLP */
-                        if(t2packet[7]==plpId) {
-                    		/* extract TS packet from T2-MI payload */
-				/* Sync distance (bits) in the BB header then points to the first CRC-8 present in the data field */
-                                unsigned int syncd = ((uint8_t)(t2packet[16]) << 8) + (uint8_t)(t2packet[17]);
-                                syncd >>= 3;
-
-				/* user packet len (bits) = sync byte + payload, CRC-8 of payload replaces next sync byte */
-                                unsigned int upl = ((uint8_t)(t2packet[13]) << 8) + (uint8_t)(t2packet[14]);
-                                upl >>= 3;
-                                upl+=19;
-
-                                unsigned int dnp=0;
-
-                                if(t2packet[9]&0x4) {
-                        	    dnp=1; // Deleted Null Packet
-                        	}
-                                if(syncd==0x1FFF ) { /* maximal sync value (in bytes) */
-            				log_message(log_module, MSG_DEBUG, "sync value 0x1FFF!\n");
-					unsigned int maxsync = upl - 19;
-                                        if (output_buf_offset + output_bytes + maxsync > output_buf_size) {
-	                            		log_message(log_module, MSG_DETAIL, "position (max sync) out of buffer bounds: %u + %u + %u > %u\n",
-	                            								    output_buf_offset, output_bytes, maxsync, output_buf_size);
-	                                	goto t2_copy_end;
-                                        }
-                                        else if (upl > 19) {
-                                                memcpy(output_buf + output_bytes, &t2packet[19], maxsync);
-                                                output_bytes+=maxsync;
-                                        }
-
-                                } else {
-                                        if (!t2mi_first && syncd > 0) {
-                                    	    unsigned int syncd_size = syncd - dnp;
-                                            if (syncd_size > (sizeof(t2packet)-19) || output_buf_offset + output_bytes + syncd_size > output_buf_size) {
-	                                	    log_message(log_module, MSG_DETAIL, "position (syncd) out of buffer bounds: %u + %u + %u > %u\n",
-	                                							    output_buf_offset, output_bytes, syncd_size, output_buf_size);
-	                                	    goto t2_copy_end;
-                                            }
-                                            memcpy(output_buf + output_bytes, &t2packet[19], syncd_size);
-                                            output_bytes+=syncd_size;
-                                        }
-
-					/* detect unaligned packet in buffer */
-                                        unsigned int output_part = (output_buf_offset + output_bytes) % TS_PACKET_SIZE;
-                                        if (output_part > 0) {
-                                    	    log_message(log_module, MSG_DETAIL, "unaligned packet in buffer pos %u/%u\n", output_buf_offset, output_bytes);
-                                    	    output_bytes -= output_part; /* drop packet; TODO: check if we can add padding instead of dropping */
-                                        }
-
-                                        t2mi_first=false;
-                                        unsigned int t2_copy_pos=19+syncd;
-
-                                        /* copy T2-MI packet payload to output, add sync bytes */
-                                        for(; t2_copy_pos < upl - 187; t2_copy_pos+=(187+dnp)) {
-                                    		/* fullsize TS frame */
-                                                if (t2_copy_pos > ((sizeof(t2packet) - 187)) || output_buf_offset + output_bytes + TS_PACKET_SIZE > output_buf_size) {
-                                        	    log_message(log_module, MSG_DETAIL, "position (full TS) out of buffer bounds: in %u, out %u + %u + %u > %u\n",
-                                        							    t2_copy_pos, output_buf_offset, output_bytes, TS_PACKET_SIZE, output_buf_size);
-                                        	    goto t2_copy_end;
-                                                }
-                                                output_buf[output_bytes] = TS_SYNC_BYTE;
-                                                output_bytes++;
-                                                memcpy(output_buf + output_bytes, &t2packet[t2_copy_pos], 187);
-                                                output_bytes+=187;
-                                        }
-                                        if(t2_copy_pos < upl )  {
-                                    		/* partial TS frame, we will fill rest of frame at next call */
-                                    		unsigned int part_size = upl - t2_copy_pos;
-                                                if (t2_copy_pos > (sizeof(t2packet)-(part_size+1)) || output_buf_offset + output_bytes + part_size + 1 > output_buf_size) {
-                                        	    log_message(log_module, MSG_DETAIL, "position (part TS) out of buffer bounds: in %u, out %u + %u + %u > %u\n",
-                                        							    t2_copy_pos, output_buf_offset, output_bytes, part_size + 1, output_buf_size);
-                                        	    goto t2_copy_end;
-                                                }
-                                                output_buf[output_bytes] = TS_SYNC_BYTE;
-                                                output_bytes++;
-                                                memcpy(output_buf + output_bytes, &t2packet[t2_copy_pos], part_size);
-                                                output_bytes+=part_size;
-                                        }
-                                }
-                                t2_copy_end: ; /* exit to prevent output buffer overflow in case of invalid pointers recieved in input stream */
-                        }
-                        t2mi_active=false;
-                        memset(&t2packet, 0, sizeof(t2packet)); // end of processing t2-mi packet, clear it
-                }
-
-                if((buf[offset])==0x0) { //Baseband Frame
+	if(ts_packet[1]&0x40) {
+		unsigned int offset=1;
+		offset+=buf[0];
+		if (offset >= 184) {
+			log_message(log_module, MSG_DEBUG, "invalid payload offset: %u\n", offset);
+			return;
+		}
+		if(ctx->active) {
+			if(1 < offset)
+				t2mi_append(ctx, &buf[1], offset-1);
+			//The header is needed to read the packet
+			if(ctx->active && ctx->packet_pos>=19)
+				t2mi_extract(decap, ctx);
+			/* end of processing t2-mi packet, clear it */
+			t2mi_clear(ctx);
+		}
+
+		if(buf[offset]==0x0) { //Baseband Frame
 			/*	TODO: padding
 				pad (pad_len bits) shall be filled with between 0 and 7 bits of padding such that the T2-MI packet is always an integer
-				number of bytes in length, i.e. payload_len+pad_len shall be a multiple of 8. Each padding bit shall have the value 0. 
+				number of bytes in length, i.e. payload_len+pad_len shall be a multiple of 8. Each padding bit shall have the value 0.
 			*/
-                        if(len > offset) {
-                                memcpy(t2packet,&buf[offset],len-offset);
-                                t2packetpos=len-offset;
-                                t2mi_active=true;
-                        }
-                }
-        } else if(t2mi_active) {
-                memcpy(t2packet+t2packetpos,buf,len);
-                t2packetpos+=len;
-        }
-        return output_bytes;
+			if(len > offset) {
+				t2mi_append(ctx, &buf[offset], len-offset);
+				ctx->active=1;
+			}
+		}
+	} else if(ctx->active) {
+		t2mi_append(ctx, buf, len);
+	}
 }
+
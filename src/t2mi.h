@@ -0,0 +1,60 @@
+/* 
+ * MuMuDVB - Stream a DVB transport stream.
+ * Based on dvbstream by (C) Dave Chapman <dave@dchapman.com> 2001, 2002.
+ * 
+ * (C) 2004-2013 Brice DUBOST
+ * 
+ * The latest version can be found at http://mumudvb.net
+ * 
+ * Copyright notice:
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief T2-MI stream support
+ *
+ * The T2-MI decapsulator rebuilds the T2-MI packets carried on a PID and gives
+ * the TS of the baseband frames of each PLP to the stream of this PLP (see
+ * decap.h). The T2-MI packets are parsed once whatever the number of PLPs
+ * extracted.
+ */
+
+#ifndef _T2MI_H
+#define _T2MI_H
+
+#include <stdint.h>
+
+#include "decap.h"
+
+/** The size of the T2-MI packet buffer, will fit the maximal T2 payload + header */
+#define T2MI_PACKET_SIZE (TS_PACKET_SIZE*349)
+/** The maximum number of TS packets given by one baseband frame */
+#define T2MI_MAX_FRAME_PACKETS (8192/187+2)
+
+/** @brief The state of a T2-MI decapsulator */
+typedef struct t2mi_ctx_t{
+  /** Are we filling a T2-MI packet ? */
+  int active;
+  /** The length of the T2-MI packet, the bytes above are 0 */
+  unsigned int packet_pos;
+  unsigned char packet[T2MI_PACKET_SIZE];
+}t2mi_ctx_t;
+
+extern const decap_ops_t t2mi_decap_ops;
+
+#endif
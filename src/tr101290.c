@@ -0,0 +1,445 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief ETSI TR 101 290 priority 1 and 2 analyzer
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "tr101290.h"
+#include "mumudvb.h"
+#include "log.h"
+
+static char *log_module="TR 101 290: ";
+
+const char *tr101290_names[TR101290_NUM_INDICATORS]={
+		[TR101290_TS_SYNC_LOSS]="TS_sync_loss",
+		[TR101290_PAT_ERROR]="PAT_error",
+		[TR101290_CC_ERROR]="Continuity_count_error",
+		[TR101290_PMT_ERROR]="PMT_error",
+		[TR101290_PID_ERROR]="PID_error",
+		[TR101290_TRANSPORT_ERROR]="Transport_error",
+		[TR101290_CRC_ERROR]="CRC_error",
+		[TR101290_PCR_REPETITION_ERROR]="PCR_repetition_error",
+		[TR101290_PCR_DISCONTINUITY_ERROR]="PCR_discontinuity_indicator_error",
+		[TR101290_PCR_ACCURACY_ERROR]="PCR_accuracy_error",
+};
+
+/** The PSI/SI PIDs with a CRC32 : PAT, CAT, NIT, SDT/BAT, EIT, TDT/TOT */
+static const int tr101290_psi_pids[]={0, 1, 16, 17, 18, 20};
+
+/** The indicators for the whole TS, the events are not given per service */
+#define TR101290_TS_INDICATOR(i) ((i)==TR101290_TS_SYNC_LOSS || (i)==TR101290_PAT_ERROR)
+
+/** The bits of timed_out */
+#define TR101290_TIMEOUT_TABLE 0x01
+#define TR101290_TIMEOUT_PID   0x02
+
+/** @brief Allocate the section reassembly of a PID
+ * @return 0 on success
+ */
+static int tr101290_section_alloc(tr101290_t *tr101290, int pid)
+{
+	mumudvb_ts_packet_t *section;
+
+	if(tr101290->sections[pid])
+		return 0;
+	section=calloc(1, sizeof(mumudvb_ts_packet_t));
+	if(section==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return -1;
+	}
+	pthread_mutex_init(&section->packetmutex, NULL);
+	//The analyzer checks the CRC32 of all the sections
+	section->no_section_cache=1;
+	tr101290->sections[pid]=section;
+	return 0;
+}
+
+/** @brief Allocate the analyzer
+ * @return NULL on error
+ */
+tr101290_t *tr101290_new(mumu_chan_p_t *chan_p)
+{
+	tr101290_t *tr101290;
+
+	tr101290=calloc(1, sizeof(tr101290_t));
+	if(tr101290==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	tr101290->services=calloc(MAX_CHANNELS, sizeof(tr101290_service_t));
+	if(tr101290->services==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		free(tr101290);
+		return NULL;
+	}
+	pthread_mutex_init(&tr101290->lock, NULL);
+	tr101290->chan_p=chan_p;
+	tr101290->pid_timeout=TR101290_DEFAULT_PID_TIMEOUT*1000000ULL;
+	tr101290->pids[0].flags=TR101290_PID_PAT;
+	for(unsigned int i=0;i<sizeof(tr101290_psi_pids)/sizeof(tr101290_psi_pids[0]);i++)
+	{
+		if(i)
+			tr101290->pids[tr101290_psi_pids[i]].flags=TR101290_PID_PSI;
+		if(tr101290_section_alloc(tr101290, tr101290_psi_pids[i]))
+		{
+			tr101290_free(tr101290);
+			return NULL;
+		}
+	}
+	return tr101290;
+}
+
+void tr101290_free(tr101290_t *tr101290)
+{
+	if(tr101290==NULL)
+		return;
+	for(int pid=0;pid<TR101290_PIDS;pid++)
+	{
+		if(tr101290->sections[pid])
+		{
+			pthread_mutex_destroy(&tr101290->sections[pid]->packetmutex);
+			free(tr101290->sections[pid]);
+		}
+	}
+	pthread_mutex_destroy(&tr101290->lock);
+	free(tr101290->services);
+	free(tr101290);
+}
+
+/** @brief Check the PCR of a packet : repetition, discontinuity and accuracy
+ *
+ * The accuracy compares the PCR with the value expected from its position in the
+ * TS, at the bitrate measured since the reference PCR
+ */
+static void tr101290_pcr(tr101290_pid_t *pid_s, const unsigned char *ts_packet, uint64_t position, int full_ts)
+{
+	uint64_t pcr, delta, ref_delta;
+	int discontinuity;
+	double expected;
+
+	if(!ts_get_pcr(ts_packet, &pcr, &discontinuity))
+		return;
+	if(pid_s->pcr_seen && !discontinuity)
+	{
+		delta=(pcr+TS_PCR_MAX-pid_s->last_pcr)%TS_PCR_MAX;
+		//A jump back gives a delta near TS_PCR_MAX
+		if(delta>TR101290_PCR_DISCONTINUITY)
+		{
+			pid_s->errors[TR101290_PCR_DISCONTINUITY_ERROR]++;
+			discontinuity=1;
+		}
+		else
+		{
+			//The bitrate measured across a gap would be wrong, the reference starts again
+			if(delta>TR101290_PCR_REPETITION)
+			{
+				pid_s->errors[TR101290_PCR_REPETITION_ERROR]++;
+				discontinuity=1;
+			}
+			ref_delta=(pid_s->last_pcr+TS_PCR_MAX-pid_s->ref_pcr)%TS_PCR_MAX;
+			if(full_ts && ref_delta>=TR101290_PCR_BASELINE && pid_s->last_pcr_pos>pid_s->ref_pcr_pos)
+			{
+				expected=(double)(position-pid_s->last_pcr_pos)*ref_delta/(pid_s->last_pcr_pos-pid_s->ref_pcr_pos);
+				if(fabs(delta-expected)>TR101290_PCR_ACCURACY)
+					pid_s->errors[TR101290_PCR_ACCURACY_ERROR]++;
+			}
+		}
+	}
+	if(!pid_s->pcr_seen || discontinuity)
+	{
+		pid_s->ref_pcr=pcr;
+		pid_s->ref_pcr_pos=position;
+	}
+	pid_s->last_pcr=pcr;
+	pid_s->last_pcr_pos=position;
+	pid_s->pcr_seen=1;
+}
+
+/** @brief Reassemble the sections of a PSI/SI PID and check the PAT and the PMT */
+static void tr101290_section(tr101290_t *tr101290, int pid, unsigned char *ts_packet, uint64_t now)
+{
+	tr101290_pid_t *pid_s=&tr101290->pids[pid];
+	mumudvb_ts_packet_t *section=tr101290->sections[pid];
+	int table_id;
+
+	//The PAT and the PMT must not be scrambled
+	if(ts_packet[3] & 0xc0)
+	{
+		if(pid_s->flags & TR101290_PID_PAT)
+			pid_s->errors[TR101290_PAT_ERROR]++;
+		else if(pid_s->flags & TR101290_PID_PMT)
+			pid_s->errors[TR101290_PMT_ERROR]++;
+		return;
+	}
+	if(section==NULL)
+		return;
+	while(get_ts_packet(ts_packet, section))
+	{
+		ts_packet=NULL;
+		table_id=section->data_full[0];
+		if(pid_s->flags & TR101290_PID_PAT)
+		{
+			if(table_id==0x00)
+				pid_s->last_section=now;
+			else
+				pid_s->errors[TR101290_PAT_ERROR]++;
+		}
+		else if((pid_s->flags & TR101290_PID_PMT) && table_id==0x02)
+			pid_s->last_section=now;
+	}
+}
+
+/** @brief The errors of a PID for an indicator */
+static uint64_t tr101290_pid_errors(tr101290_t *tr101290, int pid, int indicator)
+{
+	if(indicator==TR101290_CRC_ERROR)
+		return tr101290->sections[pid] ? tr101290->sections[pid]->crc32_errors : 0;
+	return tr101290->pids[pid].errors[indicator];
+}
+
+/** @brief Count an error when a PID or a table is missing for too long, once per absence */
+static void tr101290_timeout(tr101290_pid_t *pid_s, int expired, int bit, int indicator)
+{
+	if(expired)
+	{
+		if(!(pid_s->timed_out & bit))
+			pid_s->errors[indicator]++;
+		pid_s->timed_out|=bit;
+	}
+	else
+		pid_s->timed_out&=~bit;
+}
+
+/** @brief Log the new errors of a service or of the TS, at most once per TR101290_EVENT_INTERVAL */
+static void tr101290_event(tr101290_service_t *service, int ts, uint64_t now)
+{
+	int logged=0;
+
+	if(now-service->last_event<TR101290_EVENT_INTERVAL)
+		return;
+	for(int i=0;i<TR101290_NUM_INDICATORS;i++)
+	{
+		if(TR101290_TS_INDICATOR(i)!=ts || service->errors[i]==service->errors_event[i])
+			continue;
+		if(ts)
+			log_message( log_module, MSG_WARN, "TS : %s : %llu new error(s), total %llu\n",
+					tr101290_names[i], (unsigned long long) (service->errors[i]-service->errors_event[i]),
+					(unsigned long long) service->errors[i]);
+		else
+			log_message( log_module, MSG_WARN, "Service \"%s\" (id %d) : %s : %llu new error(s), total %llu\n",
+					service->name, service->service_id, tr101290_names[i],
+					(unsigned long long) (service->errors[i]-service->errors_event[i]),
+					(unsigned long long) service->errors[i]);
+		service->errors_event[i]=service->errors[i];
+		logged=1;
+	}
+	if(logged)
+		service->last_event=now;
+}
+
+/** @brief The periodic check : PIDs of the services, missing PIDs and tables, errors of each service and events
+ * The channels are read with the chan_p lock held, the caller must not hold it
+ */
+static void tr101290_check(tr101290_t *tr101290, uint64_t now)
+{
+	mumu_chan_p_t *chan_p=tr101290->chan_p;
+	tr101290_pid_t *pids=tr101290->pids;
+	tr101290_service_t *service;
+	pid_i_t *pid_i;
+	int service_pids[MAX_PIDS+2];
+	int num_service_pids, num_channels, pid, i, j, k;
+
+	//The PIDs of the services can change with the autoconfiguration
+	pthread_mutex_lock(&chan_p->lock);
+	for(pid=0;pid<TR101290_PIDS;pid++)
+		pids[pid].flags&=~(TR101290_PID_PMT|TR101290_PID_PCR|TR101290_PID_SERVICE);
+	num_channels=chan_p->number_of_channels;
+	for(i=0;i<num_channels;i++)
+	{
+		pid_i=&chan_p->channels[i].pid_i;
+		if(pid_i->pmt_pid>0 && pid_i->pmt_pid<TR101290_PIDS-1 && !tr101290_section_alloc(tr101290, pid_i->pmt_pid))
+		{
+			pids[pid_i->pmt_pid].flags|=TR101290_PID_PMT;
+			//The PMT is expected from the time the service is known
+			if(!pids[pid_i->pmt_pid].last_section)
+				pids[pid_i->pmt_pid].last_section=now;
+		}
+		if(pid_i->pcr_pid>0 && pid_i->pcr_pid<TR101290_PIDS-1)
+			pids[pid_i->pcr_pid].flags|=TR101290_PID_PCR;
+		for(j=0;j<pid_i->num_pids;j++)
+		{
+			pid=pid_i->pids[j];
+			if(pid<0 || pid>=TR101290_PIDS-1)
+				continue;
+			pids[pid].flags|=TR101290_PID_SERVICE;
+			if(!pids[pid].last_seen)
+				pids[pid].last_seen=now;
+		}
+	}
+
+	//The missing PIDs and tables
+	tr101290_timeout(&pids[0], now-pids[0].last_section>TR101290_PAT_PMT_TIMEOUT, TR101290_TIMEOUT_TABLE, TR101290_PAT_ERROR);
+	for(pid=1;pid<TR101290_PIDS;pid++)
+	{
+		if(pids[pid].flags & TR101290_PID_PMT)
+			tr101290_timeout(&pids[pid], now-pids[pid].last_section>TR101290_PAT_PMT_TIMEOUT, TR101290_TIMEOUT_TABLE, TR101290_PMT_ERROR);
+		if(pids[pid].flags & TR101290_PID_SERVICE)
+			tr101290_timeout(&pids[pid], now-pids[pid].last_seen>tr101290->pid_timeout, TR101290_TIMEOUT_PID, TR101290_PID_ERROR);
+	}
+
+	pthread_mutex_lock(&tr101290->lock);
+	//The errors of the whole TS
+	memset(tr101290->ts_errors, 0, sizeof(tr101290->ts_errors));
+	for(pid=0;pid<TR101290_PIDS;pid++)
+		for(k=0;k<TR101290_NUM_INDICATORS;k++)
+			tr101290->ts_errors[k]+=tr101290_pid_errors(tr101290, pid, k);
+	tr101290->ts_errors[TR101290_TS_SYNC_LOSS]=tr101290->sync_loss;
+
+	//The errors of each service : the errors of the whole TS and of its PIDs
+	for(i=0;i<num_channels;i++)
+	{
+		service=&tr101290->services[i];
+		pid_i=&chan_p->channels[i].pid_i;
+		if(service->service_id!=chan_p->channels[i].service_id)
+		{
+			//Another service, the events start again
+			memset(service, 0, sizeof(tr101290_service_t));
+			service->service_id=chan_p->channels[i].service_id;
+		}
+		snprintf(service->name, TR101290_NAME_LEN, "%s", chan_p->channels[i].name);
+		num_service_pids=0;
+		for(j=0;j<pid_i->num_pids;j++)
+			service_pids[num_service_pids++]=pid_i->pids[j];
+		service_pids[num_service_pids++]=pid_i->pmt_pid;
+		service_pids[num_service_pids++]=pid_i->pcr_pid;
+		memset(service->errors, 0, sizeof(service->errors));
+		service->errors[TR101290_TS_SYNC_LOSS]=tr101290->sync_loss;
+		service->errors[TR101290_PAT_ERROR]=pids[0].errors[TR101290_PAT_ERROR];
+		//The PAT is a table of every service
+		service->errors[TR101290_CRC_ERROR]=tr101290_pid_errors(tr101290, 0, TR101290_CRC_ERROR);
+		for(j=0;j<num_service_pids;j++)
+		{
+			pid=service_pids[j];
+			if(pid<=0 || pid>=TR101290_PIDS-1)
+				continue;
+			//The PMT and the PCR PIDs are often in the PIDs of the service
+			for(k=0;k<j && service_pids[k]!=pid;k++);
+			if(k<j)
+				continue;
+			for(k=0;k<TR101290_NUM_INDICATORS;k++)
+				if(!TR101290_TS_INDICATOR(k))
+					service->errors[k]+=tr101290_pid_errors(tr101290, pid, k);
+		}
+	}
+	tr101290->num_services=num_channels;
+	pthread_mutex_unlock(&tr101290->lock);
+	pthread_mutex_unlock(&chan_p->lock);
+
+	//The events, the errors of the whole TS are given once, not for each service
+	for(i=0;i<num_channels;i++)
+		tr101290_event(&tr101290->services[i], 0, now);
+	memcpy(tr101290->ts_event.errors, tr101290->ts_errors, sizeof(tr101290->ts_errors));
+	tr101290_event(&tr101290->ts_event, 1, now);
+}
+
+/** @brief Analyze the packets read from the card
+ * Called by the thread reading the card only, on the whole TS read (before the software filter),
+ * without the chan_p lock (see tr101290_check)
+ *
+ * @param buffer the aligned 188 bytes packets
+ * @param len the length of the buffer
+ * @param resync_number the number of sync losses of the framer
+ * @param full_ts is the whole TS read ? (for the PCR accuracy)
+ */
+void tr101290_process(tr101290_t *tr101290, unsigned char *buffer, int len, uint64_t resync_number, int full_ts)
+{
+	uint64_t now=get_time();
+	unsigned char *ts_packet;
+	tr101290_pid_t *pid_s;
+	int pid;
+
+	if(!tr101290->start_time)
+	{
+		tr101290->start_time=tr101290->last_check=now;
+		tr101290->pids[0].last_section=now;
+		tr101290->resync_number=resync_number;
+	}
+	if(resync_number!=tr101290->resync_number)
+	{
+		tr101290->sync_loss+=resync_number-tr101290->resync_number;
+		tr101290->resync_number=resync_number;
+	}
+	for(int pos=0;pos+TS_PACKET_SIZE<=len;pos+=TS_PACKET_SIZE)
+	{
+		ts_packet=buffer+pos;
+		pid=((ts_packet[1] & 0x1f) << 8) | ts_packet[2];
+		pid_s=&tr101290->pids[pid];
+		pid_s->last_seen=now;
+		tr101290->position++;
+		//The header of a packet with a transport error cannot be trusted
+		if(ts_packet[1] & 0x80)
+		{
+			pid_s->errors[TR101290_TRANSPORT_ERROR]++;
+			continue;
+		}
+		if(ts_cc_check(&pid_s->last_cc, ts_packet))
+			pid_s->errors[TR101290_CC_ERROR]++;
+		if(!pid_s->flags)
+			continue;
+		if(pid_s->flags & TR101290_PID_PCR)
+			tr101290_pcr(pid_s, ts_packet, tr101290->position, full_ts);
+		if(pid_s->flags & (TR101290_PID_PAT|TR101290_PID_PSI|TR101290_PID_PMT))
+			tr101290_section(tr101290, pid, ts_packet, now);
+	}
+	if(now-tr101290->last_check>=TR101290_CHECK_INTERVAL)
+	{
+		tr101290_check(tr101290, now);
+		tr101290->last_check=now;
+	}
+}
+
+/** @brief Log the errors of the whole TS */
+void tr101290_log_totals(tr101290_t *tr101290)
+{
+	if(tr101290==NULL)
+		return;
+	log_message( log_module, MSG_INFO, "Errors of the TS :\n");
+	pthread_mutex_lock(&tr101290->lock);
+	for(int i=0;i<TR101290_NUM_INDICATORS;i++)
+		log_message( log_module, MSG_INFO, "\t%s : %llu\n", tr101290_names[i], (unsigned long long) tr101290->ts_errors[i]);
+	pthread_mutex_unlock(&tr101290->lock);
+}
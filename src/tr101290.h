@@ -0,0 +1,155 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+
+/** @file
+ * @brief ETSI TR 101 290 priority 1 and 2 analyzer
+ *
+ * The thread reading the card checks each packet of the whole TS, before the
+ * software filter : continuity, transport errors, PCR repetition, discontinuity
+ * and accuracy, and reassembles the PSI/SI sections to check their CRC32 and
+ * the PAT and PMT. A periodic check finds the missing PIDs and tables, counts
+ * the errors of each service and logs an event for each new error.
+ */
+
+#ifndef _TR101290_H
+#define _TR101290_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ts.h"
+
+/** The number of PIDs */
+#define TR101290_PIDS 8192
+/** The maximum interval between two PAT or two PMT sections, in us */
+#define TR101290_PAT_PMT_TIMEOUT 500000
+/** The default maximum interval between two packets of a PID of a service, in s */
+#define TR101290_DEFAULT_PID_TIMEOUT 5
+/** The maximum interval between two PCR, in 27 MHz units (40 ms) */
+#define TR101290_PCR_REPETITION (TS_PCR_HZ/25)
+/** The maximum interval between two PCR before a discontinuity error, in 27 MHz units (100 ms) */
+#define TR101290_PCR_DISCONTINUITY (TS_PCR_HZ/10)
+/** The maximum PCR inaccuracy, in 27 MHz units (500 ns) */
+#define TR101290_PCR_ACCURACY 13.5
+/** The minimum interval between the reference PCR and a PCR for the accuracy check, in 27 MHz units (1 s) */
+#define TR101290_PCR_BASELINE TS_PCR_HZ
+/** The interval between two checks, in us */
+#define TR101290_CHECK_INTERVAL 100000
+/** The minimum interval between two events for the same error and the same service, in us */
+#define TR101290_EVENT_INTERVAL 1000000
+/** The maximum length of the service names kept */
+#define TR101290_NAME_LEN 128
+
+/** @brief The TR 101 290 indicators */
+enum tr101290_indicator
+{
+	TR101290_TS_SYNC_LOSS,
+	TR101290_PAT_ERROR,
+	TR101290_CC_ERROR,
+	TR101290_PMT_ERROR,
+	TR101290_PID_ERROR,
+	TR101290_TRANSPORT_ERROR,
+	TR101290_CRC_ERROR,
+	TR101290_PCR_REPETITION_ERROR,
+	TR101290_PCR_DISCONTINUITY_ERROR,
+	TR101290_PCR_ACCURACY_ERROR,
+	TR101290_NUM_INDICATORS
+};
+
+/** The flags of a PID */
+#define TR101290_PID_PAT     0x01
+#define TR101290_PID_PSI     0x02
+#define TR101290_PID_PMT     0x04
+#define TR101290_PID_PCR     0x08
+#define TR101290_PID_SERVICE 0x10
+
+/** @brief The state and the errors of a PID, written by the thread reading the card */
+typedef struct tr101290_pid_t{
+  /** The errors found for each indicator */
+  uint32_t errors[TR101290_NUM_INDICATORS];
+  /** The time of the last packet, of the last PAT or PMT section, in us */
+  uint64_t last_seen;
+  uint64_t last_section;
+  /** The last PCR and the position of its packet in the TS */
+  uint64_t last_pcr;
+  uint64_t last_pcr_pos;
+  /** The reference for the PCR accuracy, reset on a discontinuity */
+  uint64_t ref_pcr;
+  uint64_t ref_pcr_pos;
+  /** The continuity counter state (ts_cc_check) */
+  uint8_t last_cc;
+  /** TR101290_PID_* */
+  uint8_t flags;
+  /** Is the PID or its table missing, the error is counted once */
+  uint8_t timed_out;
+  uint8_t pcr_seen;
+}tr101290_pid_t;
+
+/** @brief The errors of a service, given by the periodic check */
+typedef struct tr101290_service_t{
+  char name[TR101290_NAME_LEN];
+  int service_id;
+  uint64_t errors[TR101290_NUM_INDICATORS];
+  /** The errors at the last event */
+  uint64_t errors_event[TR101290_NUM_INDICATORS];
+  uint64_t last_event;
+}tr101290_service_t;
+
+/** @brief The analyzer */
+typedef struct tr101290_t{
+  /** The channels, for the PIDs of each service */
+  struct mumu_chan_p_t *chan_p;
+  /** The maximum interval between two packets of a PID of a service, in us */
+  uint64_t pid_timeout;
+  /** The state of each PID */
+  tr101290_pid_t pids[TR101290_PIDS];
+  /** The section reassembly of the PSI/SI PIDs, allocated when needed */
+  mumudvb_ts_packet_t *sections[TR101290_PIDS];
+  /** The number of packets read */
+  uint64_t position;
+  /** The number of sync losses seen */
+  uint64_t sync_loss;
+  uint64_t resync_number;
+  uint64_t start_time;
+  uint64_t last_check;
+  /** The lock on the fields below, written by the periodic check */
+  pthread_mutex_t lock;
+  /** The errors of the whole TS */
+  uint64_t ts_errors[TR101290_NUM_INDICATORS];
+  /** The errors of the whole TS at the last event */
+  tr101290_service_t ts_event;
+  tr101290_service_t *services;
+  int num_services;
+}tr101290_t;
+
+extern const char *tr101290_names[TR101290_NUM_INDICATORS];
+
+tr101290_t *tr101290_new(struct mumu_chan_p_t *chan_p);
+void tr101290_free(tr101290_t *tr101290);
+void tr101290_process(tr101290_t *tr101290, unsigned char *buffer, int len, uint64_t resync_number, int full_ts);
+void tr101290_log_totals(tr101290_t *tr101290);
+
+#endif
@@ -27,13 +27,14 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #include "ts.h"
 #include "mumudvb.h"
 #include "log.h"
 
-#include <stdint.h>
-extern uint32_t       crc32_table[256];
+#include "crc32.h"
 static char *log_module="TS: ";
 
 
@@ -49,6 +50,77 @@ int  ts_partial_full(mumudvb_ts_packet_t *ts_packet);
 void add_ts_packet_data(unsigned char *buf, mumudvb_ts_packet_t *pkt, int data_left, int start_flag, int pid, int cc);
 
 
+/** @brief Decode the headers of a buffer of TS packets
+ * The arrays of meta are enlarged if needed
+ *
+ * @param meta the decoded headers
+ * @param buf the packets
+ * @param num_packets the number of packets in buf
+ * @return -1 on memory error
+ */
+int ts_meta_decode(ts_meta_t *meta, const unsigned char *buf, int num_packets)
+{
+	unsigned char *arrays;
+
+	if(num_packets>meta->size)
+	{
+		//One allocation for all the arrays, the PIDs first for the alignment
+		arrays=realloc(meta->pid, num_packets*(sizeof(uint16_t)+5));
+		if(arrays==NULL)
+		{
+			log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			meta->num_packets=0;
+			return -1;
+		}
+		meta->size=num_packets;
+		meta->pid=(uint16_t *)arrays;
+		meta->cc=arrays+num_packets*sizeof(uint16_t);
+		meta->flags=meta->cc+num_packets;
+		meta->afc=meta->flags+num_packets;
+		meta->scrambling=meta->afc+num_packets;
+		meta->payload_offset=meta->scrambling+num_packets;
+	}
+	for(int i=0;i<num_packets;i++)
+		meta->payload_offset[i]=ts_decode_header(buf+i*TS_PACKET_SIZE,
+				&meta->pid[i], &meta->cc[i], &meta->flags[i], &meta->afc[i], &meta->scrambling[i]);
+	meta->num_packets=num_packets;
+	return 0;
+}
+
+/** @brief Free the arrays of the decoded headers */
+void ts_meta_free(ts_meta_t *meta)
+{
+	free(meta->pid);
+	memset(meta, 0, sizeof(ts_meta_t));
+}
+
+/** @brief Give the oldest full section, if any, in data_full
+ * The section given before is released, there is no copy
+ */
+static int ts_pop_full(mumudvb_ts_packet_t *pkt)
+{
+	int released;
+
+	if(pkt->full_number <= 0)
+		return 0;
+	if(pkt->full_given)
+	{
+		released=pkt->full_offsets[pkt->full_first];
+		pkt->full_first=(pkt->full_first+1)%FULL_SLOTS;
+		//The oldest packet is now at the start of the ring
+		if(pkt->full_offsets[pkt->full_first]<released)
+			pkt->full_wrapped=0;
+	}
+	log_message( log_module,  MSG_FLOOD, "Full packet left: %d, we give length %d\n",
+				pkt->full_number,
+				pkt->full_lengths[pkt->full_first]);
+	pkt->data_full=pkt->buffer_full+pkt->full_offsets[pkt->full_first];
+	pkt->len_full=pkt->full_lengths[pkt->full_first];
+	pkt->full_given=1;
+	pkt->full_number--;
+	return 1;
+}
+
 /** @brief This function will join the 188 bytes packet until the PMT/PAT/SDT/EIT/... is full
  * Once it's full we check the CRC32 and say if it's ok or not
  * There is two important mpeg2-ts fields to do that
@@ -58,6 +130,9 @@ void add_ts_packet_data(unsigned char *buf, mumudvb_ts_packet_t *pkt, int data_l
  * When a packet is splitted in 188 bytes packets, there must be no other PID between two sub packets
  *
  * Return 1 when there is one packet full and OK
+ * The packet is not copied, data_full points to it in the ring of the full packets
+ * and stays valid until the next full packet is given. The clients keeping it longer
+ * have to copy it.
  *
  * @param buf : the received buffer from the card
  * @param ts_packet : the packet to be completed
@@ -65,98 +140,50 @@ void add_ts_packet_data(unsigned char *buf, mumudvb_ts_packet_t *pkt, int data_l
 int get_ts_packet(unsigned char *buf, mumudvb_ts_packet_t *pkt)
 {
 	int packet_avail=0;
-	//see doc/diagrams/TS_packet_getting_all_cases.pdf for documentation
-	pthread_mutex_lock(&pkt->packetmutex);
-	//We check if there is already a full packet, in this case we remove one
-	//and give it to the client
-	if(pkt->full_number > 0)
-	{
-		log_message( log_module,  MSG_FLOOD, "Full packet left: %d, we copy length %d\n",
-					pkt->full_number,
-					pkt->full_lengths[0]);
-		//we copy the length
-		pkt->len_full= pkt->full_lengths[0];
-		//we copy the data
-		memcpy(pkt->data_full,pkt->buffer_full,pkt->len_full);
-		pkt->full_number--;
-		//We update the size of the buffer
-		pkt->full_buffer_len-=pkt->len_full;
-		//if there is one packet left, shift the packets left
-		if(pkt->full_number > 0)
-		{
-			log_message( log_module,  MSG_FLOOD, "Removed size %d, next size: %d\n",pkt->len_full, pkt->full_lengths[1]);
-			//We move the data inside the buffer full
-			memmove(pkt->buffer_full,pkt->buffer_full+pkt->len_full,pkt->full_buffer_len);
-			//we update the lengths of the full packets
-			memmove(pkt->full_lengths,pkt->full_lengths+1,(MAX_FULL_PACKETS-1)*sizeof(int));
-
-		}
-		packet_avail=1;
-	}
+	uint16_t buf_pid;
+	uint8_t cc, flags, afc, scrambling;
+	//the current packet position
+	int offset;
 
 	//This function can be called with a NULL buffer in order to POP the packets from the stack
 	if(buf==NULL)
-	{
-		pthread_mutex_unlock(&pkt->packetmutex);
-		return packet_avail;
-	}
+		return ts_pop_full(pkt);
 
-	ts_header_t *header;
-	//mapping of the buffer onto the TS header
-	header=(ts_header_t *)buf;
-	int buf_pid;
-	buf_pid=HILO(header->pid);
-
-	//the current packet position
-	int offset;
-	//delta used to remove TS HEADER
-	offset = TS_HEADER_LEN-1;
+	//see doc/diagrams/TS_packet_getting_all_cases.pdf for documentation
+	packet_avail=ts_pop_full(pkt);
 
+	offset=ts_decode_header(buf, &buf_pid, &cc, &flags, &afc, &scrambling);
 
 	log_message(log_module, MSG_FLOOD, "General information PID %d adaptation_field_control %d payload_unit_start_indicator %d continuity_counter %d\n",
 			buf_pid,
-			header->adaptation_field_control,
-			header->payload_unit_start_indicator,
-			header->continuity_counter);
+			afc,
+			(flags & TS_META_PUSI) ? 1 : 0,
+			cc);
 
-	//we skip the adaptation field
-	//Sometimes there is some more data in the header, the adaptation field say it
-	if (header->adaptation_field_control & 0x2)
+	if(!offset)
 	{
-		log_message( log_module,  MSG_DEBUG, "Read TS : Adaptation field \n");
-		offset += buf[offset] ;        // add adapt.field.len
-		offset += 1; // plus one for adaptation length byte
-		//we check if the adapt.field.len is valid
-		if(offset>=TS_PACKET_SIZE)
-		{
+		if(flags & TS_META_INVALID)
 			log_message( log_module,  MSG_DEBUG, "Invalid adapt.field.len \n");
-			pthread_mutex_unlock(&pkt->packetmutex);
-			return (pkt->full_number > 0);
-		}
+		else
+			log_message( log_module,  MSG_DEBUG, "adaptation_field_control %d ie no payload\n", afc);
+		return (pkt->full_number > 0);
 	}
-	else if (header->adaptation_field_control & 0x1)
+	if (afc == 1)
 	{
 		if (buf[offset]==0x00 && buf[offset+1]==0x00 && buf[offset+2]==0x01)
 		{
 			// -- PES/PS
 			//tspid->id   = buf[j+3];
 			log_message( log_module,  MSG_FLOOD, "#PES/PS ----- We ignore \n");
-			pthread_mutex_unlock(&pkt->packetmutex);
 			return (pkt->full_number > 0);
 		}
 	}
-	if (header->adaptation_field_control == 2)
-	{
-		log_message( log_module,  MSG_DEBUG, "adaptation_field_control 2\n");
-		pthread_mutex_unlock(&pkt->packetmutex);
-		return (pkt->full_number > 0);
-	}
 
 
 	//We are now at the beginning of the Transport stream packet, we check if there is a pointer field
 	//the pointer fields tells if there is the end of the previous packet before the beginning of a new one
 	//and how long is this data
-	if(header->payload_unit_start_indicator) //There is AT LEAST one packet beginning here
+	if(flags & TS_META_PUSI) //There is AT LEAST one packet beginning here
 	{
 		//Pointer field
 		//This is an 8-bit field whose value shall be the number of bytes, immediately following the pointer_field
@@ -175,25 +202,23 @@ int get_ts_packet(unsigned char *buf, mumudvb_ts_packet_t *pkt)
 			{
 				log_message(log_module, MSG_DETAIL, "Pointer field too big 0x%02x, packet dropped\n",pointer_field);
 				pkt->status_partial=EMPTY;
-				pthread_mutex_unlock(&pkt->packetmutex);
 				return (pkt->full_number > 0);
 			}
 			//We append the data of the ending packet
-			add_ts_packet_data(buf+offset, pkt, pointer_field, NO_START, buf_pid, header->continuity_counter);
+			add_ts_packet_data(buf+offset, pkt, pointer_field, NO_START, buf_pid, cc);
 		}
 		//we skip the pointer field_data
 		offset+=pointer_field;
 		//We add the data of the new packet
-		add_ts_packet_data(buf+offset, pkt,TS_PACKET_SIZE-offset , START_TS, buf_pid, header->continuity_counter);
+		add_ts_packet_data(buf+offset, pkt,TS_PACKET_SIZE-offset , START_TS, buf_pid, cc);
 	}
 	else
 		//It's a continuing packet
 	{
 		//We append the data of the ending packet
-		add_ts_packet_data(buf+offset, pkt,TS_PACKET_SIZE-offset , NO_START, buf_pid ,header->continuity_counter);
+		add_ts_packet_data(buf+offset, pkt,TS_PACKET_SIZE-offset , NO_START, buf_pid ,cc);
 	}
 
-	pthread_mutex_unlock(&pkt->packetmutex);
 	return packet_avail;
 }
 
@@ -223,11 +248,69 @@ void log_ts_packet_start(mumudvb_ts_packet_t *pkt)
 }
 
 
+/** @brief The identifier of the full partial section in the cache
+ * @return 0 if the section cannot be cached (no version and CRC32)
+ */
+static int ts_section_cache_key(mumudvb_ts_packet_t *pkt, ts_section_cache_t *key)
+{
+	const unsigned char *data=pkt->data_partial;
+	tbl_h_t *tbl_struct=(tbl_h_t *)data;
+	int len=pkt->len_partial;
+
+	//Only the long sections have a version and a CRC32
+	if(!tbl_struct->section_syntax_indicator || len<(int)sizeof(tbl_h_t)+4)
+		return 0;
+	memset(key, 0, sizeof(ts_section_cache_t));
+	key->crc32=((uint32_t)data[len-4]<<24)|((uint32_t)data[len-3]<<16)|((uint32_t)data[len-2]<<8)|data[len-1];
+	key->table_id_extension=HILO(tbl_struct->transport_stream_id);
+	key->table_id=tbl_struct->table_id;
+	key->section_number=tbl_struct->section_number;
+	key->version=tbl_struct->version_number;
+	key->valid=1;
+	return 1;
+}
+
+/** @brief Look for the full partial section in the cache of the sections given
+ * The section is recognized by its header and its CRC32, before the CRC32 check
+ *
+ * @param entry : the cache entry for this section, NULL if the section cannot be cached
+ * @return 1 if the same section was already given
+ */
+static int ts_section_cache_hit(mumudvb_ts_packet_t *pkt, ts_section_cache_t **entry)
+{
+	ts_section_cache_t key;
+	uint32_t hash;
+
+	*entry=NULL;
+	if(!ts_section_cache_key(pkt, &key))
+		return 0;
+	//A section replaces the previous version of the same section
+	hash=((uint32_t)key.table_id<<24 | (uint32_t)key.table_id_extension<<8 | key.section_number)*0x9e3779b1u;
+	*entry=&pkt->section_cache[hash>>(32-SECTION_CACHE_BITS)];
+	return !memcmp(*entry, &key, sizeof(ts_section_cache_t));
+}
+
+/** @brief Remember the full partial section, its CRC32 is valid */
+static void ts_section_cache_store(mumudvb_ts_packet_t *pkt, ts_section_cache_t *entry)
+{
+	ts_section_cache_key(pkt, entry);
+}
+
+/** @brief Forget the sections given
+ * To be called when the client starts waiting for a section, so the sections
+ * identical to the ones given before are given again
+ */
+void ts_section_cache_flush(mumudvb_ts_packet_t *pkt)
+{
+	memset(pkt->section_cache, 0, sizeof(pkt->section_cache));
+}
+
 /** @brief This function will add data to the current partial section
  * see doc/diagrams/TS_add_data_all_cases.pdf for documentation
  */
 void add_ts_packet_data(unsigned char *buf, mumudvb_ts_packet_t *pkt, int data_left, int start_flag, int pid, int cc)
 {
+	ts_section_cache_t *cache_entry;
 	int copy_len;
 	//We see if there is the start of a new section
 	if(start_flag == START_TS || start_flag == START_SECTION)
@@ -375,9 +458,19 @@ void add_ts_packet_data(unsigned char *buf, mumudvb_ts_packet_t *pkt, int data_l
 		//We check if the packet is full
 		if(ts_partial_full(pkt))
 		{
-			//The partial packet is full, we check the CRC32
-			if(ts_check_crc32(pkt))
+			//The partial packet is full, if it was already given we drop it, otherwise we check the CRC32
+			cache_entry=NULL;
+			if(!pkt->no_section_cache && ts_section_cache_hit(pkt, &cache_entry))
+			{
+				pkt->len_partial=0;
+				pkt->status_partial=EMPTY;
+			}
+			else if(ts_check_crc32(pkt))
+			{
+				if(cache_entry)
+					ts_section_cache_store(pkt, cache_entry);
 				ts_move_part_to_full(pkt); //Everything is perfect, the packet full is ok
+			}
 		}
 
 		//If there is still data, a new section could begin, we call recursively
@@ -390,28 +483,64 @@ void add_ts_packet_data(unsigned char *buf, mumudvb_ts_packet_t *pkt, int data_l
 }
 
 
+/** @brief Find the room for a full packet in the ring
+ *
+ * @return the offset in buffer_full, -1 if the ring is full
+ */
+static int ts_full_alloc(mumudvb_ts_packet_t *pkt, int len)
+{
+	int used=pkt->full_number+pkt->full_given;
+	//The start of the oldest packet
+	int read;
+
+	if(!used)
+	{
+		pkt->full_write=0;
+		pkt->full_wrapped=0;
+		return 0;
+	}
+	read=pkt->full_offsets[pkt->full_first];
+	if(pkt->full_wrapped)
+		return (pkt->full_write+len<=read) ? pkt->full_write : -1;
+	if(pkt->full_write+len<=FULL_BUFFER_SIZE)
+		return pkt->full_write;
+	//We go back to the start of the ring
+	if(len<=read)
+	{
+		pkt->full_wrapped=1;
+		return 0;
+	}
+	return -1;
+}
+
 /** @brief move the partial packet to the full packet */
 void ts_move_part_to_full(mumudvb_ts_packet_t *pkt)
 {
+	int offset, slot;
+
 	//append the data
 	if(pkt->full_number>=MAX_FULL_PACKETS)
 	{
 		log_message(log_module, MSG_WARN, "Too many full packets, we skip one size %d",pkt->len_partial);
 		return;
 	}
-	if((pkt->full_buffer_len+pkt->len_partial)>=FULL_BUFFER_SIZE)
+	offset=ts_full_alloc(pkt, pkt->len_partial);
+	if(offset<0)
 	{
-		log_message(log_module, MSG_WARN, "Too much data, in full packets (%d), dropping TS buffers",pkt->full_buffer_len);
-		/* unrecoverable error, restart TS processing */
-		pkt->full_buffer_len=0;
+		log_message(log_module, MSG_WARN, "Too much data, in full packets (%d), dropping TS buffers",pkt->full_number);
+		/* unrecoverable error, restart TS processing, we keep only the packet given */
 		pkt->full_number=0;
+		pkt->full_wrapped=0;
+		pkt->full_write=pkt->full_given ? pkt->full_offsets[pkt->full_first]+pkt->full_lengths[pkt->full_first] : 0;
 		pkt->len_partial=0;
 		pkt->status_partial=EMPTY;
 		return;
 	}
-	memcpy(pkt->buffer_full+pkt->full_buffer_len,pkt->data_partial,pkt->len_partial);
-	pkt->full_buffer_len+=pkt->len_partial;
-	pkt->full_lengths[pkt->full_number]=pkt->len_partial;
+	slot=(pkt->full_first+pkt->full_given+pkt->full_number)%FULL_SLOTS;
+	memcpy(pkt->buffer_full+offset,pkt->data_partial,pkt->len_partial);
+	pkt->full_offsets[slot]=offset;
+	pkt->full_lengths[slot]=pkt->len_partial;
+	pkt->full_write=offset+pkt->len_partial;
 	pkt->full_number++;
 	log_message(log_module, MSG_FLOOD, "New full packet len %d. There's now %d full packet%c\n",pkt->len_partial,pkt->full_number,pkt->full_number>1?'s':' ');
 	//we don't copy it to the full, it will be popped at the next call of get_ts_packet
@@ -430,8 +559,7 @@ void ts_move_part_to_full(mumudvb_ts_packet_t *pkt)
  */
 int ts_check_raw_crc32(unsigned char *data)
 {
-	int i,len;
-	uint32_t crc32;
+	int len;
 	tbl_h_t *tbl_struct;
 	tbl_struct=(tbl_h_t *)data;
 
@@ -443,15 +571,8 @@ int ts_check_raw_crc32(unsigned char *data)
 	len=HILO(tbl_struct->section_length)+BYTES_BFR_SEC_LEN;
 
 	//CRC32 calculation
-	//Test of the crc32
-	crc32=0xffffffff;
-	//we compute the CRC32
-	//we have two ways: either we compute until the end and it should be 0
-	//either we exclude the 4 last bits and in should be equal to the 4 last bits
-	for(i = 0; i < len; i++) {
-		crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ data[i])&0xff];
-	}
-	return (crc32 == 0);
+	//we compute the CRC32 until the end, with the CRC32 included it should be 0
+	return (crc32_mpeg(CRC32_INIT, data, len) == 0);
 }
 
 /**@brief Checking of the CRC32
@@ -465,6 +586,7 @@ int ts_check_crc32( mumudvb_ts_packet_t *packet)
 	{
 		log_message( log_module,  MSG_DETAIL,"\tpacket BAD CRC32 PID : %d\n", packet->pid);
 		//Bad CRC32
+		packet->crc32_errors++;
 		packet->status_partial=EMPTY;
 		packet->len_partial=0;
 		return 0;
@@ -500,45 +622,32 @@ int ts_partial_full( mumudvb_ts_packet_t *packet)
  */
 unsigned char *get_ts_begin(unsigned char *buf)
 {
-	ts_header_t *header;
+	uint16_t pid;
+	uint8_t cc, flags, afc, scrambling;
 	int delta;
-	//mapping of the buffer onto the TS header
-	header=(ts_header_t *)buf;
-	//delta used to remove TS HEADER
-	delta = TS_HEADER_LEN-1;
-	//Sometimes there is some more data in the header, the adaptation field say it
-	if (header->adaptation_field_control & 0x2)
+
+	//delta is the beginning of the payload, after the TS header and the adaptation field
+	delta=ts_decode_header(buf, &pid, &cc, &flags, &afc, &scrambling);
+	if(!delta)
 	{
-		log_message( log_module,  MSG_DEBUG, "Read TS : Adaptation field, len %d \n",buf[delta]);
-		if((TS_PACKET_SIZE-delta-buf[delta])<0)
-		{
-			log_message(log_module, MSG_DETAIL, "Adaptation field too big 0x%02x, packet dropped\n",buf[delta]);
-			return NULL;
-		}
-		delta += buf[delta];        // add adapt.field.len
-		delta += 1; // plus one for adaptation length byte
+		if(flags & TS_META_INVALID)
+			log_message(log_module, MSG_DETAIL, "Invalid packet or adaptation field too big 0x%02x, packet dropped\n",buf[TS_HEADER_LEN-1]);
+		else
+			log_message( log_module,  MSG_DEBUG, "adaptation_field_control %d ie no payload\n", afc);
+		return NULL;
 	}
-	if (header->adaptation_field_control & 0x1) //There is a payload
+	if (buf[delta]==0x00 && buf[delta+1]==0x00 && buf[delta+2]==0x01)
 	{
-		if (buf[delta]==0x00 && buf[delta+1]==0x00 && buf[delta+2]==0x01)
-		{
-			// -- PES/PS
-			//tspid->id   = buf[j+3];
-			log_message( log_module,  MSG_FLOOD, "#PES/PS ----- We ignore \n");
-			return NULL;
-		}
+		// -- PES/PS
+		//tspid->id   = buf[j+3];
+		log_message( log_module,  MSG_FLOOD, "#PES/PS ----- We ignore \n");
+		return NULL;
 	}
 
-	if (header->adaptation_field_control == 3)
+	if (afc == 3)
 		log_message( log_module,  MSG_DEBUG, "adaptation_field_control 3\n");
 
-	if ((header->adaptation_field_control == 2)||(header->adaptation_field_control == 0))
-	{
-		log_message( log_module,  MSG_DEBUG, "adaptation_field_control %d ie no payload\n", header->adaptation_field_control);
-		return NULL;
-	}
-
-	if(header->payload_unit_start_indicator) //It's the beginning of a new packet
+	if(flags & TS_META_PUSI) //It's the beginning of a new packet
 	{
 		int pointer_field=*(buf+delta);
 		delta++;
@@ -49,6 +49,9 @@
 //               www.satmania.com
 
 #define TS_HEADER_LEN 5
+//Also in mumudvb.h, for the inline functions below
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
 #define HILO(x) (x##_hi << 8 | x##_lo)
 
 #define BCDHI(x) (((x)>> 4) & 0x0f)
@@ -787,30 +790,62 @@ typedef enum packet_status {
 //A section is at least 8 bytes long + one descriptor 3 bytes + CRC32 4 bytes
 //it's a total of 15bytes / section
 #define MAX_FULL_PACKETS 15
-//A minimum is MAX_TS_SIZE + TS_PACKET_SIZE
+//The ring of full sections holds the section given to the client (MAX_TS_SIZE)
+//and the sections waiting, a minimum is MAX_TS_SIZE + TS_PACKET_SIZE
 //Just to add flexibility on how to write the code I take some margin
-#define FULL_BUFFER_SIZE 2*MAX_TS_SIZE
+#define FULL_BUFFER_SIZE 3*MAX_TS_SIZE
+//The slots of the ring : the section given and the sections waiting
+#define FULL_SLOTS (MAX_FULL_PACKETS+1)
+//The number of sections remembered to drop the repetitions
+#define SECTION_CACHE_BITS 6
+#define SECTION_CACHE_SIZE (1<<SECTION_CACHE_BITS)
+
+/**@brief A section already given, identified by its header and its CRC32
+ * The repeated sections are dropped for the autoconfiguration, the rewrites and the
+ * EIT of the HTTP server. None of them runs in the streaming loop of dvbzap yet : its
+ * only reader of sections, the TR 101 290 check, needs all of them (no_section_cache),
+ * so the cache does not take effect in this program
+ */
+typedef struct {
+  uint32_t crc32;
+  uint16_t table_id_extension;
+  uint8_t table_id;
+  uint8_t section_number;
+  uint8_t version;
+  /** Is the entry used ? */
+  uint8_t valid;
+}ts_section_cache_t;
 
 
 /**@brief structure for the build of a ts packet
   Since a packet can be finished and another one starts in the same
   elementary TS packet, there is two packets in this structure
 
+  The full sections are kept in a ring, get_ts_packet gives a pointer to the
+  section in the ring without copy. The reassembly is done by the thread reading
+  the card and doesn't lock, packetmutex protects the copies shared with other threads.
  */
 typedef struct {
-  /** the buffer for the packet full (empty or contains a valid full packet)*/
-  unsigned char data_full[MAX_TS_SIZE];
+  /** the full packet given by get_ts_packet, it stays valid until the next full packet is given */
+  unsigned char *data_full;
   /** the length of the data contained in data_full */
   int len_full;
 
   //starting from here, these variables MUSN'T be accessed outside ts.c
-  /** The number of full packets */
+  /** The number of full packets waiting */
   int full_number;
-  /** The lengths of the full packets */
-  int full_lengths[MAX_FULL_PACKETS];
-  /** The amount of data in the full buffer */
-  int full_buffer_len;
-  /** The buffer containing the full packets */
+  /** Is the oldest slot the packet given in data_full ? */
+  int full_given;
+  /** The oldest slot of the ring */
+  int full_first;
+  /** The offsets and the lengths of the full packets in buffer_full */
+  int full_offsets[FULL_SLOTS];
+  int full_lengths[FULL_SLOTS];
+  /** Where the next full packet is written in buffer_full */
+  int full_write;
+  /** Did the write position go back to the start of buffer_full, before the oldest packet ? */
+  int full_wrapped;
+  /** The ring containing the full packets, a packet is never split at the end */
   unsigned char buffer_full[FULL_BUFFER_SIZE];
   /** the buffer for the partial packet (never valid, shouldn't be accessed by funtions other than get_ts_packet)*/
   unsigned char data_partial[MAX_TS_SIZE];
@@ -820,6 +855,12 @@ typedef struct {
   int expected_len_partial;
   /** The packet status*/
   packet_status_t status_partial;
+  /** The sections already given, the identical sections are dropped before the CRC32 check */
+  ts_section_cache_t section_cache[SECTION_CACHE_SIZE];
+  /** Do we give all the sections, even the repeated ones ? */
+  int no_section_cache;
+  /** The number of sections with a bad CRC32 */
+  uint32_t crc32_errors;
   /**The PID of the packet*/
   int pid;
   /**the countinuity counter, incremented in each packet*/
@@ -829,8 +870,133 @@ typedef struct {
   pthread_mutex_t packetmutex;
 }mumudvb_ts_packet_t;
 
+/**@brief A copy of a full packet, kept when the next packets are given */
+typedef struct {
+  /** the length of the data contained in data_full */
+  int len_full;
+  unsigned char data_full[];
+}mumudvb_section_t;
+
+
+/** The flags of a packet in the decoded headers */
+enum
+{
+	/** payload_unit_start_indicator */
+	TS_META_PUSI=0x01,
+	/** transport_error_indicator */
+	TS_META_TEI=0x02,
+	/** No sync byte or adaptation field too long */
+	TS_META_INVALID=0x04,
+};
+
+/**@brief The headers of a buffer of TS packets, decoded in one pass (one array per field)
+ * Only dispatch_packets reads these arrays : the statistics and the checks run on the
+ * packets before they are decoded, and the decapsulation is given the packets instead
+ * (the headers are not decoded then), they parse the headers themselves
+ */
+typedef struct ts_meta_t{
+  /** The number of packets decoded */
+  int num_packets;
+  /** The number of packets the arrays can hold */
+  int size;
+  uint16_t *pid;
+  uint8_t *cc;
+  uint8_t *flags;
+  /** adaptation_field_control */
+  uint8_t *afc;
+  /** transport_scrambling_control */
+  uint8_t *scrambling;
+  /** The offset of the payload in the packet, 0 if there is no payload or the packet is invalid */
+  uint8_t *payload_offset;
+}ts_meta_t;
+
+int ts_meta_decode(ts_meta_t *meta, const unsigned char *buf, int num_packets);
+void ts_meta_free(ts_meta_t *meta);
+
+/** @brief Decode the header of one TS packet
+ * This is the only place where the TS headers are parsed and validated
+ *
+ * @return the offset of the payload, 0 if there is no payload or the packet is invalid
+ */
+static inline int ts_decode_header(const unsigned char *buf, uint16_t *pid, uint8_t *cc, uint8_t *flags, uint8_t *afc, uint8_t *scrambling)
+{
+	uint32_t header=((uint32_t)buf[0]<<24)|((uint32_t)buf[1]<<16)|((uint32_t)buf[2]<<8)|buf[3];
+	int offset;
+	int invalid;
+
+	*pid=(header>>8)&0x1fff;
+	*cc=header&0x0f;
+	*afc=(header>>4)&0x03;
+	*scrambling=(header>>6)&0x03;
+	//we skip the adaptation field and its length byte
+	offset=TS_HEADER_LEN-1+((*afc&0x2) ? buf[TS_HEADER_LEN-1]+1 : 0);
+	invalid=((header>>24)!=TS_SYNC_BYTE) | (offset>TS_PACKET_SIZE);
+	*flags=((header>>22)&1)*TS_META_PUSI | ((header>>23)&1)*TS_META_TEI | invalid*TS_META_INVALID;
+	return ((*afc&0x1) && offset<TS_PACKET_SIZE && !invalid) ? offset : 0;
+}
+
+/** @brief The offset of the payload of a TS packet, 0 if there is no payload or the packet is invalid
+ */
+static inline int ts_payload_offset(const unsigned char *buf)
+{
+	uint16_t pid;
+	uint8_t cc, flags, afc, scrambling;
+	return ts_decode_header(buf, &pid, &cc, &flags, &afc, &scrambling);
+}
+
+/** The continuity counter state of a PID has TS_CC_SEEN set after the first packet */
+#define TS_CC_SEEN 0x10
+
+/** @brief Check the continuity counter of a packet and update the state of its PID
+ * The packets without payload, the null packets, the packets sent twice and the
+ * discontinuity_indicator are not errors
+ *
+ * @param last_cc the state of the PID, 0 before the first packet
+ * @return 1 if there is a continuity error
+ */
+static inline int ts_cc_check(uint8_t *last_cc, const unsigned char *ts_packet)
+{
+	uint8_t cc, last;
+	int pid=((ts_packet[1] & 0x1f) << 8) | ts_packet[2];
+
+	//The continuity counter is incremented only by the packets with a payload
+	if(pid==8191 || !(ts_packet[3] & 0x10))
+		return 0;
+	cc=ts_packet[3] & 0x0f;
+	last=*last_cc;
+	*last_cc=TS_CC_SEEN | cc;
+	if(!(last & TS_CC_SEEN))
+		return 0;
+	//discontinuity_indicator set in the adaptation field
+	if((ts_packet[3] & 0x20) && ts_packet[4] && (ts_packet[5] & 0x80))
+		return 0;
+	return cc!=((last+1) & 0x0f) && cc!=(last & 0x0f);
+}
+
+/** The frequency of the PCR */
+#define TS_PCR_HZ 27000000ULL
+/** The PCR wraps at 2^33 * 300 */
+#define TS_PCR_MAX ((1ULL<<33)*300)
+
+/** @brief Read the PCR of a packet, in 27 MHz units
+ *
+ * @param discontinuity set to the discontinuity_indicator of the packet
+ * @return 1 if the packet has a PCR
+ */
+static inline int ts_get_pcr(const unsigned char *ts_packet, uint64_t *pcr, int *discontinuity)
+{
+	//adaptation field with at least the flags and the PCR, and PCR_flag
+	if(!(ts_packet[3] & 0x20) || ts_packet[4]<7 || !(ts_packet[5] & 0x10))
+		return 0;
+	*pcr=(((uint64_t)ts_packet[6]<<25) | ((uint64_t)ts_packet[7]<<17) | ((uint64_t)ts_packet[8]<<9) |
+			((uint64_t)ts_packet[9]<<1) | (ts_packet[10]>>7))*300 +
+			(((ts_packet[10] & 0x01)<<8) | ts_packet[11]);
+	*discontinuity=(ts_packet[5] & 0x80) ? 1 : 0;
+	return 1;
+}
 
 int get_ts_packet(unsigned char *, mumudvb_ts_packet_t *);
+void ts_section_cache_flush(mumudvb_ts_packet_t *pkt);
 
 unsigned char *get_ts_begin(unsigned char *buf);
 
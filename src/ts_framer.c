@@ -0,0 +1,401 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/** @file
+ * @brief TS framer : finds the packets in the data read from the card or from a file
+ *
+ * When the stream is aligned 188 bytes packets (the usual case with a card),
+ * ts_framer_fast only checks the sync bytes in the buffer read. Otherwise the
+ * data goes to the framer buffer and ts_framer_frame gives the aligned packets.
+ * The search of the sync byte uses SSE2 or AVX2 when available.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define TS_FRAMER_AVX2
+#endif
+
+#include "ts_framer.h"
+#include "mumudvb.h"
+#include "log.h"
+
+static char *log_module="Framer: ";
+
+/** The M2TS packets (192 bytes) start with a 4 bytes time stamp */
+#define TS_FRAMER_M2TS_SIZE 192
+#define TS_FRAMER_M2TS_HEADER 4
+
+/** The packet sizes we try, in this order */
+static const int ts_framer_sizes[]={TS_PACKET_SIZE, TS_FRAMER_M2TS_SIZE, TS_FRAMER_MAX_PACKET_SIZE};
+#define TS_FRAMER_NUM_SIZES (int)(sizeof(ts_framer_sizes)/sizeof(ts_framer_sizes[0]))
+
+/** @brief Find the first sync byte, return len if there is none */
+static int find_sync_c(const unsigned char *buffer, int len)
+{
+	const unsigned char *sync=memchr(buffer, TS_SYNC_BYTE, len);
+	return sync ? sync-buffer : len;
+}
+
+#if defined(__SSE2__)
+static int find_sync_sse2(const unsigned char *buffer, int len)
+{
+	const __m128i sync=_mm_set1_epi8(TS_SYNC_BYTE);
+	int i=0;
+	int mask;
+
+	for(;i+16<=len;i+=16)
+	{
+		mask=_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buffer+i)), sync));
+		if(mask)
+			return i+__builtin_ctz(mask);
+	}
+	for(;i<len;i++)
+		if(buffer[i]==TS_SYNC_BYTE)
+			return i;
+	return len;
+}
+#endif
+
+#ifdef TS_FRAMER_AVX2
+__attribute__((target("avx2")))
+static int find_sync_avx2(const unsigned char *buffer, int len)
+{
+	const __m256i sync=_mm256_set1_epi8(TS_SYNC_BYTE);
+	int i=0;
+	unsigned int mask;
+
+	for(;i+32<=len;i+=32)
+	{
+		mask=_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(buffer+i)), sync));
+		if(mask)
+			return i+__builtin_ctz(mask);
+	}
+	for(;i<len;i++)
+		if(buffer[i]==TS_SYNC_BYTE)
+			return i;
+	return len;
+}
+#endif
+
+static int (*find_sync)(const unsigned char *buffer, int len)=find_sync_c;
+
+/** @brief Initialize the framer, choose the sync search for this CPU */
+void ts_framer_init(ts_framer_t *framer)
+{
+	memset(framer, 0, sizeof(ts_framer_t));
+	framer->lock_packets=TS_FRAMER_DEFAULT_LOCK_PACKETS;
+#if defined(__SSE2__)
+	find_sync=find_sync_sse2;
+#endif
+#ifdef TS_FRAMER_AVX2
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		find_sync=find_sync_avx2;
+#endif
+}
+
+/** @brief Free the framer buffer */
+void ts_framer_free(ts_framer_t *framer)
+{
+	free(framer->buffer);
+	framer->buffer=NULL;
+	framer->buffer_len=framer->buffer_size=0;
+}
+
+/** @brief Check the packets read directly in the destination buffer
+ * Used when the framer is locked on 188 bytes packets with no pending data
+ *
+ * @return the number of bytes of valid packets at the start of the buffer, the
+ * remaining data has to be given to the framer (ts_framer_reserve and ts_framer_frame)
+ */
+int ts_framer_fast(ts_framer_t *framer, unsigned char *buffer, int len)
+{
+	int pos;
+
+	if(!framer->locked || framer->packet_size!=TS_PACKET_SIZE || framer->buffer_len)
+		return 0;
+	for(pos=0;pos+TS_PACKET_SIZE<=len;pos+=TS_PACKET_SIZE)
+		if(buffer[pos]!=TS_SYNC_BYTE)
+			break;
+	return pos;
+}
+
+/** @brief Get room for len bytes at the end of the framer buffer
+ * The caller writes the data and adds its length to buffer_len
+ *
+ * @return the pointer where to write, NULL on error
+ */
+unsigned char *ts_framer_reserve(ts_framer_t *framer, int len)
+{
+	unsigned char *buffer;
+
+	if(framer->buffer_len+len > framer->buffer_size)
+	{
+		buffer=realloc(framer->buffer, framer->buffer_len+len);
+		if(buffer==NULL)
+		{
+			log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			return NULL;
+		}
+		framer->buffer=buffer;
+		framer->buffer_size=framer->buffer_len+len;
+	}
+	return framer->buffer+framer->buffer_len;
+}
+
+/** @brief Look for the lock from pos
+ *
+ * @return the position of the sync byte of the first packet, -1 if there is no lock
+ * in the buffer. *keep is the position from where the data has to be kept to
+ * look again when we have more data.
+ */
+static int ts_framer_lock(ts_framer_t *framer, int pos, int *keep)
+{
+	const unsigned char *buffer=framer->buffer;
+	int len=framer->buffer_len;
+	int start=pos;
+	int need_more;
+	int size, k;
+
+	while(pos<len)
+	{
+		pos+=find_sync(buffer+pos, len-pos);
+		if(pos>=len)
+			break;
+		need_more=0;
+		for(int i=-1;i<TS_FRAMER_NUM_SIZES;i++)
+		{
+			//We try the previous size first
+			if(i<0)
+				size=framer->packet_size;
+			else
+				size=ts_framer_sizes[i];
+			if(!size || (i>=0 && size==framer->packet_size))
+				continue;
+			if(pos+(framer->lock_packets-1)*size+TS_PACKET_SIZE > len)
+			{
+				need_more=1;
+				continue;
+			}
+			for(k=1;k<framer->lock_packets;k++)
+				if(buffer[pos+k*size]!=TS_SYNC_BYTE)
+					break;
+			if(k==framer->lock_packets)
+			{
+				if(!framer->packet_size)
+					log_message( log_module,  MSG_DEBUG, "Locked on %d bytes packets\n", size);
+				else if(size!=framer->packet_size)
+					log_message( log_module,  MSG_INFO, "The packet size changed, locked on %d bytes packets\n", size);
+				framer->packet_size=size;
+				framer->sync_offset=(size==TS_FRAMER_M2TS_SIZE)?TS_FRAMER_M2TS_HEADER:0;
+				return pos;
+			}
+		}
+		if(need_more)
+		{
+			//We keep the time stamp if it is a M2TS packet
+			*keep=(pos-start>TS_FRAMER_M2TS_HEADER) ? pos-TS_FRAMER_M2TS_HEADER : start;
+			return -1;
+		}
+		pos++;
+	}
+	*keep=len;
+	return -1;
+}
+
+/** @brief Write a null packet */
+void ts_null_packet(unsigned char *ts_packet)
+{
+	ts_packet[0]=TS_SYNC_BYTE;
+	ts_packet[1]=TS_NULL_PID>>8;
+	ts_packet[2]=TS_NULL_PID&0xff;
+	//payload only
+	ts_packet[3]=0x10;
+	memset(ts_packet+4, 0xff, TS_PACKET_SIZE-4);
+}
+
+/** @brief Write a null packet marker
+ * A receiver not knowing the markers sees a null packet
+ *
+ * @param counts the null packets removed before each packet following the marker, then after the last one
+ * @param num the number of counts, at most TS_NULL_MARKER_MAX
+ */
+void ts_null_marker_build(unsigned char *ts_packet, const uint16_t *counts, int num)
+{
+	unsigned char *payload=ts_packet+4;
+
+	ts_null_packet(ts_packet);
+	memcpy(payload, TS_NULL_MARKER_MAGIC, TS_NULL_MARKER_MAGIC_LEN);
+	payload[TS_NULL_MARKER_MAGIC_LEN]=num;
+	for(int i=0;i<num;i++)
+	{
+		payload[TS_NULL_MARKER_MAGIC_LEN+1+2*i]=counts[i]>>8;
+		payload[TS_NULL_MARKER_MAGIC_LEN+2+2*i]=counts[i]&0xff;
+	}
+}
+
+/** @brief Read a null packet marker
+ * @return 1 if the packet is a marker
+ */
+int ts_null_marker_parse(const unsigned char *ts_packet, uint16_t *counts, int *num)
+{
+	const unsigned char *payload=ts_packet+4;
+	int n;
+
+	if((((ts_packet[1] & 0x1f) << 8) | ts_packet[2])!=TS_NULL_PID || (ts_packet[3] & 0x30)!=0x10 ||
+			memcmp(payload, TS_NULL_MARKER_MAGIC, TS_NULL_MARKER_MAGIC_LEN))
+		return 0;
+	n=payload[TS_NULL_MARKER_MAGIC_LEN];
+	if(n<1 || n>TS_NULL_MARKER_MAX)
+		return 0;
+	for(int i=0;i<n;i++)
+		counts[i]=(payload[TS_NULL_MARKER_MAGIC_LEN+1+2*i]<<8) | payload[TS_NULL_MARKER_MAGIC_LEN+2+2*i];
+	*num=n;
+	return 1;
+}
+
+enum
+{
+	TS_FRAMER_COPY,
+	TS_FRAMER_SKIP,
+	TS_FRAMER_NULLS_FIRST,
+};
+
+/** @brief Follow the null packet markers
+ *
+ * @return TS_FRAMER_SKIP for a marker, TS_FRAMER_NULLS_FIRST if null packets have to be
+ * given before the packet, TS_FRAMER_COPY otherwise
+ */
+static int ts_framer_reinsert(ts_framer_t *framer, const unsigned char *ts_packet)
+{
+	if(ts_null_marker_parse(ts_packet, framer->null_counts, &framer->null_num))
+	{
+		framer->null_index=0;
+		framer->null_before_done=0;
+		//No packet described, only null packets
+		if(framer->null_num==1)
+			framer->null_pending=framer->null_counts[0];
+		return TS_FRAMER_SKIP;
+	}
+	//A packet not described by the last marker
+	if(framer->null_index>=framer->null_num-1)
+		return TS_FRAMER_COPY;
+	if(!framer->null_before_done)
+	{
+		framer->null_before_done=1;
+		framer->null_pending=framer->null_counts[framer->null_index];
+		if(framer->null_pending)
+			return TS_FRAMER_NULLS_FIRST;
+	}
+	framer->null_before_done=0;
+	framer->null_index++;
+	//The null packets after the last packet described
+	if(framer->null_index==framer->null_num-1)
+		framer->null_pending=framer->null_counts[framer->null_index];
+	return TS_FRAMER_COPY;
+}
+
+/** @brief Give the aligned 188 bytes packets found in the framer buffer
+ *
+ * @param dest_buffer the buffer for the packets
+ * @param max_packets the maximum number of packets given
+ * @return the number of packets given
+ */
+int ts_framer_frame(ts_framer_t *framer, unsigned char *dest_buffer, int max_packets)
+{
+	const unsigned char *buffer=framer->buffer;
+	int len=framer->buffer_len;
+	int num_packets=0;
+	//The start of the current packet (before the M2TS time stamp)
+	int pos=0;
+	int lock_pos, keep=0;
+	int reinsert;
+
+	while(num_packets<max_packets)
+	{
+		if(framer->null_pending)
+		{
+			ts_null_packet(dest_buffer+num_packets*TS_PACKET_SIZE);
+			framer->null_pending--;
+			num_packets++;
+			continue;
+		}
+		if(!framer->locked)
+		{
+			lock_pos=ts_framer_lock(framer, pos, &keep);
+			if(lock_pos<0)
+			{
+				framer->skipped_bytes+=keep-pos;
+				pos=keep;
+				break;
+			}
+			//The time stamp of the first packet is not in the buffer, we start at the next one
+			if(lock_pos-pos < framer->sync_offset)
+				lock_pos+=framer->packet_size;
+			framer->skipped_bytes+=lock_pos-framer->sync_offset-pos;
+			pos=lock_pos-framer->sync_offset;
+			framer->locked=1;
+		}
+		//We wait for the whole packet, so the next one starts in the buffer
+		if(pos+framer->packet_size > len)
+			break;
+		if(buffer[pos+framer->sync_offset]!=TS_SYNC_BYTE)
+		{
+			//Sync lost
+			log_message( log_module,  MSG_DEBUG, "Sync lost, looking for the packets again\n");
+			framer->resync_number++;
+			framer->locked=0;
+			continue;
+		}
+		if(framer->null_reinsert)
+		{
+			reinsert=ts_framer_reinsert(framer, buffer+pos+framer->sync_offset);
+			if(reinsert==TS_FRAMER_NULLS_FIRST)
+				continue;
+			if(reinsert==TS_FRAMER_SKIP)
+			{
+				pos+=framer->packet_size;
+				continue;
+			}
+		}
+		memcpy(dest_buffer+num_packets*TS_PACKET_SIZE, buffer+pos+framer->sync_offset, TS_PACKET_SIZE);
+		num_packets++;
+		pos+=framer->packet_size;
+	}
+	//We keep the data not framed
+	framer->buffer_len=len-pos;
+	if(framer->buffer_len && pos)
+		memmove(framer->buffer, framer->buffer+pos, framer->buffer_len);
+	return num_packets;
+}
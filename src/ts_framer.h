@@ -0,0 +1,102 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/** @file
+ * @brief TS framer : finds the packets in the data read from the card or from a file
+ *
+ * The framer looks for the sync byte, confirms the lock on several consecutive
+ * packets, detects the packet size (188, 192 for M2TS, 204 with Reed-Solomon
+ * bytes) and gives aligned 188 bytes packets. If the sync is lost (corrupt or
+ * missing bytes), it locks again on the next valid packets.
+ *
+ * The framer can also reinsert the null packets removed by a sender in marker
+ * mode : the marker is a null packet given before the packets of a datagram,
+ * with the number of null packets removed before each of them.
+ */
+
+#ifndef _TS_FRAMER_H
+#define _TS_FRAMER_H
+
+#include <stdint.h>
+
+#define TS_SYNC_BYTE 0x47
+/** The number of consecutive packets needed to confirm the lock */
+#define TS_FRAMER_DEFAULT_LOCK_PACKETS 5
+#define TS_FRAMER_MAX_LOCK_PACKETS 32
+/** The biggest packet size : 188 bytes + 16 Reed-Solomon bytes */
+#define TS_FRAMER_MAX_PACKET_SIZE 204
+
+/** The null packets */
+#define TS_NULL_PID 8191
+/** The start of the payload of a null packet marker */
+#define TS_NULL_MARKER_MAGIC "DZNM"
+#define TS_NULL_MARKER_MAGIC_LEN 4
+/** The maximum number of counts of a marker (the packets described and the null packets after them) */
+#define TS_NULL_MARKER_MAX 64
+/** The maximum number of null packets of a count */
+#define TS_NULL_MARKER_MAX_RUN 0xffff
+
+/** @brief The state of the framer */
+typedef struct ts_framer_t{
+  /** The number of consecutive packets needed to confirm the lock */
+  int lock_packets;
+  /** Are we locked on the stream ? */
+  int locked;
+  /** The size of the packets in the stream (188, 192 or 204), 0 before the first lock */
+  int packet_size;
+  /** The offset of the sync byte in a packet (4 for M2TS) */
+  int sync_offset;
+  /** The bytes not yet framed */
+  unsigned char *buffer;
+  int buffer_len;
+  int buffer_size;
+  /** The number of times the sync was lost */
+  uint64_t resync_number;
+  /** The number of bytes thrown while looking for the sync */
+  uint64_t skipped_bytes;
+  /** Do we reinsert the null packets described by the markers ? */
+  int null_reinsert;
+  /** The counts of the last marker : the null packets before each packet it
+   * describes, then the null packets after them */
+  uint16_t null_counts[TS_NULL_MARKER_MAX];
+  int null_num;
+  /** The next packet described by the marker */
+  int null_index;
+  /** Were the null packets before the next packet given ? */
+  int null_before_done;
+  /** The null packets still to give */
+  int null_pending;
+}ts_framer_t;
+
+void ts_framer_init(ts_framer_t *framer);
+void ts_framer_free(ts_framer_t *framer);
+int ts_framer_fast(ts_framer_t *framer, unsigned char *buffer, int len);
+unsigned char *ts_framer_reserve(ts_framer_t *framer, int len);
+int ts_framer_frame(ts_framer_t *framer, unsigned char *dest_buffer, int max_packets);
+void ts_null_packet(unsigned char *ts_packet);
+void ts_null_marker_build(unsigned char *ts_packet, const uint16_t *counts, int num);
+int ts_null_marker_parse(const unsigned char *ts_packet, uint16_t *counts, int *num);
+
+#endif
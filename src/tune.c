@@ -65,6 +65,9 @@ void init_tune_v(tune_p_t *tune_p)
 				.card_dev_path=DVB_DEV_PATH,
 				.card_tuned = 0,
 				.tuning_timeout = ALARM_TIME_TIMEOUT,
+				.lock_timeout = 0,
+				.tune_mode_oneshot = 0,
+				.lock_time = 0,
 				.freq = 0,
 				.srate = 0,
 				.pol = 0,
@@ -81,9 +84,11 @@ void init_tune_v(tune_p_t *tune_p)
 				.switch_type = 'C',
 				.diseqc_repeat = 0,
 				.diseqc_time = 15,
+				.diseqc_cache = 0,
 				.modulation_set = 0,
 				.display_strenght = 0,
 				.check_status = 1,
+				.stats_interval = FE_STATS_DEFAULT_INTERVAL,
 				.strengththreadshutdown = 0,
 				.HP_CodeRate = HP_CODERATE_DEFAULT,//cf tune.h
 				.LP_CodeRate = LP_CODERATE_DEFAULT,
@@ -97,11 +102,14 @@ void init_tune_v(tune_p_t *tune_p)
 				.isdbt_sound_broadcasting = -1, //AUTO If need to configure please request
 				.isdbt_sb_subchanel_id = -1, //AUTO If need to configure please request
 				.isdbt_layer = 0, //Undef
-				.inversion = INVERSION_AUTO,
 #endif
+				.inversion = INVERSION_AUTO,
 	#if DVB_API_VERSION >= 5
 				.delivery_system=SYS_UNDEFINED,
 				.rolloff=ROLLOFF_35,
+				.pilot=PILOT_AUTO,
+				.tune_cache=0,
+				.tune_cache_timeout=TUNE_CACHE_DEFAULT_TIMEOUT,
 	#endif
 	#if STREAM_ID
 				.stream_id = 0,
@@ -261,6 +269,16 @@ int read_tuning_configuration(tune_p_t *tuneparams, char *substring)
 		substring = strtok (NULL, delimiteurs);
 		tuneparams->check_status = atoi (substring);
 	}
+	else if (!strcmp (substring, "stats_interval"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		tuneparams->stats_interval = atoi (substring);
+		if(tuneparams->stats_interval<FE_STATS_MIN_INTERVAL)
+		{
+			tuneparams->stats_interval=FE_STATS_MIN_INTERVAL;
+			log_message( log_module, MSG_WARN,"Sorry the minimum interval for the signal statistics is %d ms\n",FE_STATS_MIN_INTERVAL);
+		}
+	}
 	else if (!strcmp (substring, "tuner"))
 	{
 		substring = strtok (NULL, delimiteurs);
@@ -577,6 +595,28 @@ int read_tuning_configuration(tune_p_t *tuneparams, char *substring)
 		substring = strtok (NULL, delimiteurs);	//we extract the substring
 		tuneparams->tuning_timeout = atoi (substring);
 	}
+	else if (!strcmp (substring, "lock_timeout"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		tuneparams->lock_timeout = atoi (substring);
+	}
+#if DVB_API_VERSION >= 5
+	else if (!strcmp (substring, "tune_cache"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		tuneparams->tune_cache = atoi (substring);
+	}
+	else if (!strcmp (substring, "tune_cache_timeout"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		tuneparams->tune_cache_timeout = atoi (substring);
+	}
+#endif
+	else if (!strcmp (substring, "tune_mode_oneshot"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		tuneparams->tune_mode_oneshot = atoi (substring);
+	}
 	else if (!strcmp (substring, "switch_type"))
 	{
 		substring = strtok (NULL, delimiteurs);
@@ -623,6 +663,11 @@ int read_tuning_configuration(tune_p_t *tuneparams, char *substring)
 			tuneparams->diseqc_time=15;
 		}
 	}
+	else if (!strcmp (substring, "diseqc_cache"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		tuneparams->diseqc_cache = atoi (substring);
+	}
 	else if (!strcmp (substring, "stream_id"))
 	{
 #ifdef STREAM_ID
@@ -765,6 +810,184 @@ static inline void msleep(uint32_t msec)
 	while (nanosleep(&req, &req));
 }
 
+/** The kind of messages we remember for the switches */
+enum
+{
+	SEC_MSG_COMMITTED=0,
+	SEC_MSG_UNCOMMITTED,
+	SEC_MSG_UNICABLE,
+	SEC_MSG_NUM,
+};
+
+/** @brief The state we left the satellite equipment (LNB, switches) of an adapter in */
+typedef struct sec_state_t{
+	int card;
+	int tuner;
+	/** Do we keep the state in a file (diseqc_cache=2) ?*/
+	int use_file;
+	/** The LNB voltage (-1 : unknown) */
+	int voltage;
+	/** The 22kHz tone (-1 : unknown) */
+	int tone;
+	/** The last message sent to each kind of switch */
+	struct {
+		int len;
+		uint8_t msg[6];
+		int burst;
+	}msgs[SEC_MSG_NUM];
+}sec_state_t;
+
+/** The state of the adapters, shared by the tuning threads */
+static sec_state_t sec_states[MAX_SEC_STATES];
+static int num_sec_states=0;
+static pthread_mutex_t sec_states_lock=PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Forget the state, everything will be sent again */
+static void sec_state_reset(sec_state_t *sec_state)
+{
+	sec_state->voltage=-1;
+	sec_state->tone=-1;
+	memset(sec_state->msgs, 0, sizeof(sec_state->msgs));
+}
+
+/** @brief Write the state in the state file (diseqc_cache=2)*/
+static void sec_state_save(sec_state_t *sec_state)
+{
+	char filename[DEFAULT_PATH_LEN];
+	FILE *state_file;
+
+	if(sec_state==NULL || !sec_state->use_file)
+		return;
+	snprintf(filename, DEFAULT_PATH_LEN, SEC_STATE_PATH, sec_state->card, sec_state->tuner);
+	state_file=fopen(filename, "w");
+	if(state_file==NULL)
+	{
+		log_message( log_module,  MSG_DETAIL, "Cannot write %s : %s\n", filename, strerror(errno));
+		return;
+	}
+	fprintf(state_file, "%d %d", sec_state->voltage, sec_state->tone);
+	for(int i=0;i<SEC_MSG_NUM;i++)
+		fprintf(state_file, " %d %d %02x %02x %02x %02x %02x %02x", sec_state->msgs[i].len, sec_state->msgs[i].burst,
+				sec_state->msgs[i].msg[0], sec_state->msgs[i].msg[1], sec_state->msgs[i].msg[2],
+				sec_state->msgs[i].msg[3], sec_state->msgs[i].msg[4], sec_state->msgs[i].msg[5]);
+	fprintf(state_file, "\n");
+	fclose(state_file);
+}
+
+/** @brief Read the state from the state file (diseqc_cache=2)*/
+static void sec_state_load(sec_state_t *sec_state)
+{
+	char filename[DEFAULT_PATH_LEN];
+	FILE *state_file;
+	int ok;
+
+	snprintf(filename, DEFAULT_PATH_LEN, SEC_STATE_PATH, sec_state->card, sec_state->tuner);
+	state_file=fopen(filename, "r");
+	if(state_file==NULL)
+		return;
+	ok=(fscanf(state_file, "%d %d", &sec_state->voltage, &sec_state->tone)==2);
+	for(int i=0;ok && i<SEC_MSG_NUM;i++)
+		ok=(fscanf(state_file, " %d %d %hhx %hhx %hhx %hhx %hhx %hhx", &sec_state->msgs[i].len, &sec_state->msgs[i].burst,
+				&sec_state->msgs[i].msg[0], &sec_state->msgs[i].msg[1], &sec_state->msgs[i].msg[2],
+				&sec_state->msgs[i].msg[3], &sec_state->msgs[i].msg[4], &sec_state->msgs[i].msg[5])==8);
+	fclose(state_file);
+	if(!ok)
+	{
+		log_message( log_module,  MSG_WARN, "Invalid switch state file %s, ignored\n", filename);
+		sec_state_reset(sec_state);
+	}
+	else
+		log_message( log_module,  MSG_DEBUG, "Switch state read from %s\n", filename);
+}
+
+/** @brief Get the state of the satellite equipment of an adapter
+ *
+ * @return NULL if the state is not cached (diseqc_cache=0)
+ */
+static sec_state_t *sec_state_get(tune_p_t *tuneparams)
+{
+	sec_state_t *sec_state=NULL;
+
+	if(!tuneparams->diseqc_cache)
+		return NULL;
+	pthread_mutex_lock(&sec_states_lock);
+	for(int i=0;i<num_sec_states;i++)
+		if(sec_states[i].card==tuneparams->card && sec_states[i].tuner==tuneparams->tuner)
+			sec_state=&sec_states[i];
+	if(sec_state==NULL && num_sec_states<MAX_SEC_STATES)
+	{
+		sec_state=&sec_states[num_sec_states++];
+		sec_state->card=tuneparams->card;
+		sec_state->tuner=tuneparams->tuner;
+		sec_state_reset(sec_state);
+		sec_state->use_file=(tuneparams->diseqc_cache==2);
+		if(sec_state->use_file)
+			sec_state_load(sec_state);
+	}
+	pthread_mutex_unlock(&sec_states_lock);
+	return sec_state;
+}
+
+/** @brief Was this message the last one sent to the switch ? */
+static int sec_state_same_msg(sec_state_t *sec_state, int kind, struct dvb_diseqc_master_cmd *cmd, int burst)
+{
+	if(sec_state==NULL)
+		return 0;
+	return sec_state->msgs[kind].len==cmd->msg_len &&
+			sec_state->msgs[kind].burst==burst &&
+			!memcmp(sec_state->msgs[kind].msg, cmd->msg, cmd->msg_len);
+}
+
+/** @brief Remember the last message sent to the switch */
+static void sec_state_set_msg(sec_state_t *sec_state, int kind, struct dvb_diseqc_master_cmd *cmd, int burst)
+{
+	if(sec_state==NULL)
+		return;
+	sec_state->msgs[kind].len=cmd->msg_len;
+	sec_state->msgs[kind].burst=burst;
+	memcpy(sec_state->msgs[kind].msg, cmd->msg, sizeof(sec_state->msgs[kind].msg));
+}
+
+/** @brief Set the LNB voltage if it is not already the good one
+ *
+ * @return 1 if the voltage was changed, 0 if not, -1 on error
+ */
+static int sec_state_set_voltage(int fd, sec_state_t *sec_state, fe_sec_voltage_t voltage)
+{
+	if(sec_state!=NULL && sec_state->voltage==(int)voltage)
+		return 0;
+	if(dvb_ioctl(fd, FE_SET_VOLTAGE, voltage) < 0)
+	{
+		log_message( log_module,  MSG_WARN, "problem to set the LNB voltage\n");
+		if(sec_state!=NULL)
+			sec_state_reset(sec_state);
+		return -1;
+	}
+	if(sec_state!=NULL)
+		sec_state->voltage=voltage;
+	return 1;
+}
+
+/** @brief Set the 22kHz tone if it is not already the good one
+ *
+ * @return 1 if the tone was changed, 0 if not, -1 on error
+ */
+static int sec_state_set_tone(int fd, sec_state_t *sec_state, fe_sec_tone_mode_t tone)
+{
+	if(sec_state!=NULL && sec_state->tone==(int)tone)
+		return 0;
+	if(dvb_ioctl(fd, FE_SET_TONE, tone) < 0)
+	{
+		log_message( log_module,  MSG_WARN, "problem to set the 22kHz tone\n");
+		if(sec_state!=NULL)
+			sec_state_reset(sec_state);
+		return -1;
+	}
+	if(sec_state!=NULL)
+		sec_state->tone=tone;
+	return 1;
+}
+
 /** @brief Send a diseqc message
  *
  * As defined in the DiseqC norm, we stop the 22kHz tone, 
@@ -776,14 +999,14 @@ static int diseqc_send_msg(int fd, fe_sec_voltage_t v, struct diseqc_cmd **cmd,
 {
 	int err, wait = (*cmd)->wait;
 
-	if((err = ioctl(fd, FE_SET_TONE, SEC_TONE_OFF)))
+	if((err = dvb_ioctl(fd, FE_SET_TONE, SEC_TONE_OFF)))
 	{
 		log_message( log_module,  MSG_WARN, "problem Setting the Tone OFF\n");
 		return -1;
 	}
 	log_message( log_module,  MSG_INFO, "DISEQC: Setting Tone OFF\n");
 	
-	if((err = ioctl(fd, FE_SET_VOLTAGE, v)))
+	if((err = dvb_ioctl(fd, FE_SET_VOLTAGE, v)))
 	{
 		log_message( log_module,  MSG_WARN, "problem Setting the Voltage\n");
 		return -1;
@@ -793,7 +1016,7 @@ static int diseqc_send_msg(int fd, fe_sec_voltage_t v, struct diseqc_cmd **cmd,
 	
 	while (*cmd) {
 
-		if ((err = ioctl(fd, FE_DISEQC_SEND_MASTER_CMD, &(*cmd)->cmd)))
+		if ((err = dvb_ioctl(fd, FE_DISEQC_SEND_MASTER_CMD, &(*cmd)->cmd)))
 		{ log_message( log_module,  MSG_WARN, "problem sending the DiseqC message\n");
 			return -1;
 		}
@@ -802,14 +1025,14 @@ static int diseqc_send_msg(int fd, fe_sec_voltage_t v, struct diseqc_cmd **cmd,
 		cmd++;
 	}
 
-	if ((err = ioctl(fd, FE_DISEQC_SEND_BURST, b)))
+	if ((err = dvb_ioctl(fd, FE_DISEQC_SEND_BURST, b)))
 		{	log_message( log_module,  MSG_WARN, "problem sending the Tone Burst\n");
 			return err;
 		}
 	log_message( log_module,  MSG_INFO, "DISEQC: Send BURST and wait %d ms\n",wait);
 	msleep(wait);
 		
-	if(ioctl(fd, FE_SET_TONE, t) < 0)
+	if(dvb_ioctl(fd, FE_SET_TONE, t) < 0)
 		{	log_message( log_module,  MSG_WARN, "problem Setting the Tone back\n");
 			return -1;
 		}
@@ -830,14 +1053,14 @@ static int unicable_send_msg(int fd, struct diseqc_cmd **cmd)
 {
 	int err;
 
-	if((err = ioctl(fd, FE_SET_TONE, SEC_TONE_OFF)))
+	if((err = dvb_ioctl(fd, FE_SET_TONE, SEC_TONE_OFF)))
 	{
 		log_message( log_module,  MSG_WARN, "problem Setting the Tone OFF\n");
 		return -1;
 	}
 	log_message( log_module,  MSG_INFO, "UNICABLE: Setting Tone OFF\n");
 
-	if((err = ioctl(fd, FE_SET_VOLTAGE, SEC_VOLTAGE_18)))
+	if((err = dvb_ioctl(fd, FE_SET_VOLTAGE, SEC_VOLTAGE_18)))
 	{
 		log_message( log_module,  MSG_WARN, "problem Setting the Voltage\n");
 		return -1;
@@ -847,7 +1070,7 @@ static int unicable_send_msg(int fd, struct diseqc_cmd **cmd)
 	
 	while (*cmd) {
 
-		if ((err = ioctl(fd, FE_DISEQC_SEND_MASTER_CMD, &(*cmd)->cmd)))
+		if ((err = dvb_ioctl(fd, FE_DISEQC_SEND_MASTER_CMD, &(*cmd)->cmd)))
 		{ log_message( log_module,  MSG_WARN, "problem sending the DiseqC message\n");
 			return -1;
 		}
@@ -856,7 +1079,7 @@ static int unicable_send_msg(int fd, struct diseqc_cmd **cmd)
 		cmd++;
 	}
 
-	if(ioctl(fd, FE_SET_VOLTAGE, SEC_VOLTAGE_13) < 0)
+	if(dvb_ioctl(fd, FE_SET_VOLTAGE, SEC_VOLTAGE_13) < 0)
 	{	log_message( log_module,  MSG_WARN, "problem Setting the Voltage back\n");
 			return -1;
 	}
@@ -884,15 +1107,15 @@ static int unicable_send_msg(int fd, struct diseqc_cmd **cmd)
  * @param lnb_voltage_off : if one, force the 13/18V voltage to be 0 independantly of polarization
  * @param diseqc_repeat : 1 : repeat message, 0 : no repetition
  * @param diseqc_time : ms-wait after commands
- * @param fefrequency : transponder frequency
- * @param uni_freq : unicable frequency
+ * @param sec_state : the state we left the switch in, NULL if not cached
 */
-static int do_diseqc(int fd, unsigned char sat_no,  int switch_no,  char switch_type, int pol_v_r, int hi_lo, int lnb_voltage_off, int diseqc_repeat,int diseqc_time)
+static int do_diseqc(int fd, unsigned char sat_no,  int switch_no,  char switch_type, int pol_v_r, int hi_lo, int lnb_voltage_off, int diseqc_repeat,int diseqc_time, sec_state_t *sec_state)
 {
 
 	fe_sec_voltage_t lnb_voltage;
+	fe_sec_mini_cmd_t burst;
 	struct diseqc_cmd *cmd[2] = { NULL, NULL };
-	int ret;
+	int ret, kind, changed_voltage, changed_tone;
 
 
 	//Compute the lnb voltage : 0 if we asked, of 13V for vertical and circular right, 18 for horizontal and circular left
@@ -966,15 +1189,40 @@ static int do_diseqc(int fd, unsigned char sat_no,  int switch_no,  char switch_
 				cmd[0]->cmd.msg[0],cmd[0]->cmd.msg[1],cmd[0]->cmd.msg[2],cmd[0]->cmd.msg[3],cmd[0]->cmd.msg[4],cmd[0]->cmd.msg[5],
 				cmd[0]->cmd.msg_len);
 
+		burst=((sat_no) % 2) ? SEC_MINI_B : SEC_MINI_A;
+		kind=(switch_type=='U') ? SEC_MSG_UNCOMMITTED : SEC_MSG_COMMITTED;
+		//The switch is already on the good input, we only change the voltage and the tone if needed
+		if(sec_state_same_msg(sec_state, kind, &cmd[0]->cmd, burst))
+		{
+			free(cmd[0]);
+			log_message( log_module,  MSG_INFO, "DISEQC: switch already set, message not sent\n");
+			if((changed_voltage=sec_state_set_voltage(fd, sec_state, lnb_voltage)) < 0)
+				return -1;
+			if((changed_tone=sec_state_set_tone(fd, sec_state, hi_lo ? SEC_TONE_ON : SEC_TONE_OFF)) < 0)
+				return -1;
+			if(changed_voltage || changed_tone)
+			{
+				msleep(diseqc_time);
+				sec_state_save(sec_state);
+			}
+			return 0;
+		}
+
 		// sending DISEQC CMD
 		log_message( log_module,  MSG_INFO, "Sending DISEQC\n");
 		ret = diseqc_send_msg(fd,
 				lnb_voltage,
 				cmd,
 				hi_lo ? SEC_TONE_ON : SEC_TONE_OFF,
-				((sat_no) % 2) ? SEC_MINI_B : SEC_MINI_A);
+				burst);
 
 		if(ret) log_message( log_module,  MSG_WARN, "problem sending the DiseqC message or setting tone/voltage\n");
+		else if(sec_state!=NULL)
+		{
+			sec_state->voltage=lnb_voltage;
+			sec_state->tone=hi_lo ? SEC_TONE_ON : SEC_TONE_OFF;
+			sec_state_set_msg(sec_state, kind, &cmd[0]->cmd, burst);
+		}
 	
 		// re-sending DISEQC CMD if configured: diseqc_repeat
 		if (diseqc_repeat)
@@ -991,28 +1239,29 @@ static int do_diseqc(int fd, unsigned char sat_no,  int switch_no,  char switch_
 				lnb_voltage,
 				cmd,
 				hi_lo ? SEC_TONE_ON : SEC_TONE_OFF,
-				((sat_no) % 2) ? SEC_MINI_B : SEC_MINI_A);
+				burst);
 		}
 
 		if(ret) log_message( log_module,  MSG_WARN, "problem repeating the DiseqC message or setting tone/voltage\n");
-	
+		//We don't know in which state the switch is
+		if(ret && sec_state!=NULL)
+			sec_state_reset(sec_state);
+		sec_state_save(sec_state);
+
 		free(cmd[0]);
 		return ret;
 	}
 	else 	//only tone and voltage
 	{
-		if(ioctl(fd, FE_SET_VOLTAGE, lnb_voltage) < 0)
-		{
-			log_message( log_module,  MSG_WARN, "problem to set the LNB voltage\n");
+		if((changed_voltage=sec_state_set_voltage(fd, sec_state, lnb_voltage)) < 0)
 			return -1;
-		}
-
-		if(ioctl(fd, FE_SET_TONE, (hi_lo ? SEC_TONE_ON : SEC_TONE_OFF)) < 0)
-		{
-			log_message( log_module,  MSG_WARN, "problem to set the 22kHz tone\n");
+		if((changed_tone=sec_state_set_tone(fd, sec_state, hi_lo ? SEC_TONE_ON : SEC_TONE_OFF)) < 0)
 			return -1;
+		if(changed_voltage || changed_tone)
+		{
+			msleep(diseqc_time);
+			sec_state_save(sec_state);
 		}
-		msleep(diseqc_time);
 		return 0;
 	}
 }
@@ -1034,8 +1283,9 @@ static int do_diseqc(int fd, unsigned char sat_no,  int switch_no,  char switch_
  * @param diseqc_time : ms-wait after commands
  * @param fefrequency : transponder frequency
  * @param uni_freq : unicable frequency
+ * @param sec_state : the state we left the switch in, NULL if not cached
  */
-static int do_unicable(int fd, unsigned char sat_no,  int switch_no,  int pin_no, char switch_type, int pol_v_r, int hi_lo, int diseqc_repeat,int diseqc_time, uint32_t *fefrequency, uint32_t uni_freq)
+static int do_unicable(int fd, unsigned char sat_no,  int switch_no,  int pin_no, char switch_type, int pol_v_r, int hi_lo, int diseqc_repeat,int diseqc_time, uint32_t *fefrequency, uint32_t uni_freq, sec_state_t *sec_state)
 {
 
 	struct diseqc_cmd *cmd[2] = { NULL, NULL };
@@ -1191,9 +1441,26 @@ static int do_unicable(int fd, unsigned char sat_no,  int switch_no,  int pin_no
 			cmd[0]->cmd.msg[0],cmd[0]->cmd.msg[1],cmd[0]->cmd.msg[2],cmd[0]->cmd.msg[3],cmd[0]->cmd.msg[4],cmd[0]->cmd.msg[5],
 			cmd[0]->cmd.msg_len);
 
+	//The same user band was already set to this frequency, the LNB is still on it
+	if(sec_state_same_msg(sec_state, SEC_MSG_UNICABLE, &cmd[0]->cmd, 0) &&
+			sec_state->voltage==SEC_VOLTAGE_13 && sec_state->tone==SEC_TONE_OFF)
+	{
+		log_message( log_module,  MSG_INFO, "UNICABLE: user band already set, message not sent\n");
+		free(cmd[0]);
+		return 0;
+	}
+	//The state is known again only if everything succeed
+	if(sec_state!=NULL)
+		sec_state_reset(sec_state);
 	// sending UNICABLE CMD
 	ret = unicable_send_msg(fd, cmd);
 	if(ret) log_message( log_module,  MSG_WARN, "problem sending the Unicable message or setting tone/voltage\n");
+	else if(sec_state!=NULL)
+	{
+		sec_state->voltage=SEC_VOLTAGE_13;
+		sec_state->tone=SEC_TONE_OFF;
+		sec_state_set_msg(sec_state, SEC_MSG_UNICABLE, &cmd[0]->cmd, 0);
+	}
 		
 	// re-sending UNICABLE CMD if requested using diseqc_repeat
 	if (diseqc_repeat)
@@ -1207,51 +1474,109 @@ static int do_unicable(int fd, unsigned char sat_no,  int switch_no,  int pin_no
 			cmd[0]->cmd.msg_len);
 		ret = unicable_send_msg(fd, cmd);
 	}
-	if(ret) log_message( log_module,  MSG_WARN, "problem repeating the Unicable message or setting tone/voltage\n");		
+	if(ret) log_message( log_module,  MSG_WARN, "problem repeating the Unicable message or setting tone/voltage\n");
+	if(ret && sec_state!=NULL)
+		sec_state_reset(sec_state);
+	sec_state_save(sec_state);
+	
 		
 	free(cmd[0]);
 	return ret;
 }
 
 
-/** @brief Check the status of the card
-
+/** @brief Wait for the lock of the card
+ *
+ * The status changes are reported by the frontend as events, we wait for them with poll
+ * instead of sleeping. FE_READ_STATUS is still done at each wake up for the drivers
+ * which do not send events.
+ *
+ * @param tuneparams the tuning parameters, the time to lock is stored in it
+ * @param tune_time the time (get_time) when the tuning was asked
+ * @param timeout give up if the card is not locked after this time (in ms, 0 : wait forever)
+ * @return 0 if locked, TUNE_NO_LOCK if not locked before the deadline, -1 on error
  */
-int check_status(int fd_frontend,int type,uint32_t lo_frequency, int display_strength)
+int check_status(int fd_frontend, tune_p_t *tuneparams, int type, uint32_t lo_frequency, uint64_t tune_time, int timeout)
 {
 	int32_t strength;
-	fe_status_t festatus;
+	fe_status_t festatus=0;
+	struct dvb_frontend_event event;
+	struct pollfd pfd;
+	uint64_t now_time, last_display=0;
+	int wait_time;
 	//We keep the old tuning compatibility just in case, as the new one should work it is done via the configure
 
 	struct dvb_frontend_parameters parameters;
 
-	do
+	pfd.fd=fd_frontend;
+	pfd.events=POLLPRI;
+	tuneparams->lock_time=0;
+	while(1)
 	{
-		log_message( log_module, MSG_DETAIL, "polling....\n");
-		if (ioctl(fd_frontend, FE_READ_STATUS, &festatus) < 0){
-			if (errno == EINTR) {
-				continue;
+		//We empty the event queue, the last event gives the current status
+		while(1)
+		{
+			if(dvb_ioctl(fd_frontend, FE_GET_EVENT, &event) < 0)
+			{
+				if(errno == EOVERFLOW) //Some events were lost, the next ones are still there
+					continue;
+				break;
+			}
+			festatus=event.status;
+			if(festatus & FE_HAS_LOCK)
+				break;
+		}
+		if(!(festatus & FE_HAS_LOCK))
+		{
+			if (dvb_ioctl(fd_frontend, FE_READ_STATUS, &festatus) < 0){
+				if (errno != EINTR) {
+					log_message( log_module,  MSG_ERROR, "FE_READ_STATUS %s\n", strerror(errno));
+					return -1;
+				}
 			}
-			log_message( log_module,  MSG_ERROR, "FE_READ_STATUS %s\n", strerror(errno));
-			return -1;
 		}
-		print_status(festatus);
-		if(display_strength)
+		now_time=get_time();
+		if(festatus & FE_HAS_LOCK)
+			break;
+		if(tuneparams->display_strenght && (now_time-last_display)>=1000000)
 		{
+			last_display=now_time;
+			print_status(festatus);
 			strength=0;
-			if(ioctl(fd_frontend,FE_READ_SIGNAL_STRENGTH,&strength) >= 0)
+			if(dvb_ioctl(fd_frontend,FE_READ_SIGNAL_STRENGTH,&strength) >= 0)
 				log_message( log_module,  MSG_INFO, "Strength: %10d\n",strength);
 			strength=0;
-			if(ioctl(fd_frontend,FE_READ_SNR,&strength) >= 0)
+			if(dvb_ioctl(fd_frontend,FE_READ_SNR,&strength) >= 0)
 				log_message( log_module,  MSG_INFO, "SNR: %10d\n",strength);
 		}
-		sleep(1);
-	} while ((festatus & (FE_HAS_LOCK))==0);
+		//In one shot mode the frontend tells us when it gives up
+		if(tuneparams->tune_mode_oneshot && (festatus & FE_TIMEDOUT))
+		{
+			log_message( log_module,  MSG_INFO, "The frontend gave up after %.1f ms\n", (now_time-tune_time)/1000.0);
+			break;
+		}
+		wait_time=FE_EVENT_POLL_TIMEOUT;
+		if(timeout)
+		{
+			if(now_time-tune_time >= (uint64_t)timeout*1000)
+				break;
+			if((tune_time+(uint64_t)timeout*1000-now_time)/1000 < (uint64_t)wait_time)
+				wait_time=(tune_time+(uint64_t)timeout*1000-now_time)/1000+1;
+		}
+		if(dvb_poll(&pfd, 1, wait_time) < 0 && errno != EINTR)
+		{
+			log_message( log_module,  MSG_ERROR, "poll on the frontend : %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	print_status(festatus);
 
 	if (festatus & FE_HAS_LOCK) {
 		int status;
+		tuneparams->lock_time=now_time-tune_time;
+		log_message( log_module,  MSG_INFO, "Time to lock: %.1f ms\n", tuneparams->lock_time/1000.0);
 		do {
-			status = ioctl(fd_frontend, FE_GET_FRONTEND, &parameters);
+			status = dvb_ioctl(fd_frontend, FE_GET_FRONTEND, &parameters);
 		} while (status == -1 && errno == EINTR);
 
 		if (status < 0) {
@@ -1284,19 +1609,19 @@ int check_status(int fd_frontend,int type,uint32_t lo_frequency, int display_str
 		}
 
 		strength=0;
-		if(ioctl(fd_frontend,FE_READ_BER,&strength) >= 0)
+		if(dvb_ioctl(fd_frontend,FE_READ_BER,&strength) >= 0)
 			log_message( log_module,  MSG_INFO, "Bit error rate: %d\n",strength);
 
 		strength=0;
-		if(ioctl(fd_frontend,FE_READ_SIGNAL_STRENGTH,&strength) >= 0)
+		if(dvb_ioctl(fd_frontend,FE_READ_SIGNAL_STRENGTH,&strength) >= 0)
 			log_message( log_module,  MSG_INFO, "Signal strength: %d\n",strength);
 
 		strength=0;
-		if(ioctl(fd_frontend,FE_READ_SNR,&strength) >= 0)
+		if(dvb_ioctl(fd_frontend,FE_READ_SNR,&strength) >= 0)
 			log_message( log_module,  MSG_INFO, "SNR: %d\n",strength);
 	} else {
-		log_message( log_module,  MSG_ERROR, "Not able to lock to the signal on the given frequency\n");
-		return -1;
+		log_message( log_module,  MSG_ERROR, "Not able to lock to the signal on the given frequency after %.1f ms\n", (now_time-tune_time)/1000.0);
+		return TUNE_NO_LOCK;
 	}
 
 
@@ -1331,13 +1656,13 @@ int change_delivery_system(fe_delivery_system_t delivery_system,int fd_frontend)
 	dvb_deliv[0].cmd = DTV_DELIVERY_SYSTEM;
 	dvb_deliv[0].u.data = delivery_system;
 
-	if ((ioctl(fd_frontend, FE_SET_PROPERTY, &cmdclear)) == -1) {
+	if ((dvb_ioctl(fd_frontend, FE_SET_PROPERTY, &cmdclear)) == -1) {
 		log_message( log_module,  MSG_ERROR,"FE_SET_PROPERTY clear failed : %s\n", strerror(errno));
 		set_interrupted(ERROR_TUNE<<8);
 		return -1;
 	}
 
-	if ((ioctl(fd_frontend, FE_SET_PROPERTY, &cmddeliv)) == -1) {
+	if ((dvb_ioctl(fd_frontend, FE_SET_PROPERTY, &cmddeliv)) == -1) {
 		log_message( log_module,  MSG_ERROR,"FE_SET_PROPERTY failed : %s\n", strerror(errno));
 		set_interrupted(ERROR_TUNE<<8);
 		return -1;
@@ -1349,65 +1674,336 @@ int change_delivery_system(fe_delivery_system_t delivery_system,int fd_frontend)
 
 }
 
-/** @brief Tune the card
+/** @brief Send the tuning parameters to the frontend
  *
+ * DVB API v5 (FE_SET_PROPERTY) is used if the delivery system is defined, FE_SET_FRONTEND otherwise
  */
-int tune_it(int fd_frontend, tune_p_t *tuneparams)
+static int tune_set_frontend(int fd_frontend, tune_p_t *tuneparams, struct dvb_frontend_parameters *feparams, int dvbt_bandwidth)
 {
-	int res, hi_lo, dfd;
-	struct dvb_frontend_parameters feparams;
-	struct dvb_frontend_info fe_info;
-	uint32_t lo_frequency=0;
 	struct dvb_frontend_event event;
-	int dvbt_bandwidth=0;
-
-	//no warning
-	memset(&feparams, 0, sizeof (struct dvb_frontend_parameters));
-	hi_lo = 0;
 
-	res = ioctl(fd_frontend,FE_GET_INFO, &fe_info);
-	if (res < 0){
-		log_message( log_module,  MSG_ERROR, "FE_GET_INFO: %s \n", strerror(errno));
-		return -1;
+	/* The tuning of the card*/
+	while(1)  {
+		if (dvb_ioctl(fd_frontend, FE_GET_EVENT, &event) < 0 && errno != EOVERFLOW)	//EMPTY THE EVENT QUEUE
+			break;
 	}
 
-	/** @todo here check the capabilities of the card*/
+	//One shot mode : the frontend does not search around the frequency (zigzag) and reports FE_TIMEDOUT
+	//The mode is always set : the frontend keeps the last mode asked, possibly by another program
+	if (dvb_ioctl(fd_frontend, FE_SET_FRONTEND_TUNE_MODE, tuneparams->tune_mode_oneshot ? FE_TUNE_MODE_ONESHOT : 0) < 0 && tuneparams->tune_mode_oneshot)
+		log_message( log_module,  MSG_WARN, "FE_SET_FRONTEND_TUNE_MODE : %s, the frontend will use the normal tuning mode\n", strerror(errno));
 
-	log_message( log_module,  MSG_INFO, "Using DVB card \"%s\" tuner %d\n",fe_info.name, tuneparams->tuner);
+	//If we support DVB API version 5 we check if the delivery system was defined
+#if DVB_API_VERSION >= 5
+	if(tuneparams->delivery_system==SYS_UNDEFINED)
+#else
+		if(1)
+#endif
+		{
+			if (dvb_ioctl(fd_frontend,FE_SET_FRONTEND,feparams) < 0) {
+				log_message( log_module,  MSG_ERROR, "ERROR tuning channel : %s \n", strerror(errno));
+				set_interrupted(ERROR_TUNE<<8);
+				return -1;
+			}
+		}
+#if DVB_API_VERSION >= 5
+		else
+		{
+			/*  Memo : S2API Commands
+    DTV_UNDEFINED            DTV_TUNE                 DTV_CLEAR               
+    DTV_FREQUENCY            DTV_MODULATION           DTV_BANDWIDTH_HZ        
+    DTV_INVERSION            DTV_DISEQC_MASTER        DTV_SYMBOL_RATE         
+    DTV_INNER_FEC            DTV_VOLTAGE              DTV_TONE                
+    DTV_PILOT                DTV_ROLLOFF              DTV_DISEQC_SLAVE_REPLY  
+    DTV_FE_CAPABILITY_COUNT  DTV_FE_CAPABILITY        DTV_DELIVERY_SYSTEM     
+    DTV_API_VERSION          DTV_API_VERSION          DTV_CODE_RATE_HP        
+    DTV_CODE_RATE_LP         DTV_GUARD_INTERVAL       DTV_TRANSMISSION_MODE   
+    DTV_HIERARCHY 
+			 */
+			//DVB api version 5 and delivery system defined, we do DVB-API-5 tuning
+			log_message( log_module,  MSG_INFO, "Tuning With DVB-API version 5. delivery system : %d\n",tuneparams->delivery_system);
 
-	// Save the frontend name for easy identification
-	snprintf(tuneparams->fe_name, 256, "%s", fe_info.name);
+#ifdef STREAM_ID
+			int tune_stream_id;
+			tune_stream_id = tuneparams->stream_id;
+			if( tuneparams->pls_code )
+				tune_stream_id = tuneparams->stream_id+((tuneparams->pls_code & 0x3FFFF)<<8);
+			if( tuneparams->pls_type == PLS_GOLD)
+				tune_stream_id = tune_stream_id | ( 1<<26 );
+			if(tuneparams->stream_id || tune_stream_id)
+				log_message( log_module,  MSG_INFO,  "Stream_id = %d, stream id with PLS parameters %d",tuneparams->stream_id, tune_stream_id);
+#endif
 
-	tuneparams->fe_type=fe_info.type;
-	feparams.inversion=INVERSION_AUTO;
+			struct dtv_property pclear[] = {
+					{ .cmd = DTV_CLEAR,},
+			};
+			struct dtv_properties cmdclear = {
+					.num = 1,
+					.props = pclear
+			};
+			struct dtv_properties *cmdseq;
+			int commandnum =0;
 
+			cmdseq = (struct dtv_properties*) calloc(1, sizeof(*cmdseq));
+			if (!cmdseq)
+			{
+				log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+				return -1;
+			}
 
-	// see if we need to change the frontend type. @todo : mix between DVB APIv3 and V5
-#if DVB_API_VERSION >= 5
-	int change_deliv=0;
-	switch(fe_info.type) {
-	case FE_OFDM: //DVB-T
-		if((tuneparams->delivery_system!=SYS_UNDEFINED)&&(tuneparams->delivery_system!=SYS_DVBT)
-#if ISDBT
-				&&(tuneparams->delivery_system!=SYS_ISDBT)
+			cmdseq->props = (struct dtv_property*) calloc(MAX_CMDSEQ_PROPS_NUM, sizeof(*(cmdseq->props)));
+			if (!(cmdseq->props))
+			{
+				free(cmdseq);
+				log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+				return -1;
+			}
+			if((tuneparams->delivery_system==SYS_DVBS)||(tuneparams->delivery_system==SYS_DVBS2))
+			{
+				cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
+				cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
+				cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
+				cmdseq->props[commandnum++].u.data = feparams->frequency;
+				cmdseq->props[commandnum].cmd      = DTV_MODULATION;
+				cmdseq->props[commandnum++].u.data = tuneparams->modulation;
+				cmdseq->props[commandnum].cmd      = DTV_SYMBOL_RATE;
+				cmdseq->props[commandnum++].u.data = tuneparams->srate;
+				cmdseq->props[commandnum].cmd      = DTV_INNER_FEC;
+				cmdseq->props[commandnum++].u.data = tuneparams->HP_CodeRate;
+				cmdseq->props[commandnum].cmd      = DTV_INVERSION;
+				cmdseq->props[commandnum++].u.data = tuneparams->inversion;
+				cmdseq->props[commandnum].cmd      = DTV_ROLLOFF;
+				cmdseq->props[commandnum++].u.data = tuneparams->rolloff;
+				cmdseq->props[commandnum].cmd      = DTV_PILOT;
+				cmdseq->props[commandnum++].u.data = tuneparams->pilot;
+				
+#ifdef STREAM_ID
+				if(tuneparams->stream_id)
+				{
+					cmdseq->props[commandnum].cmd      = DTV_STREAM_ID;
+					cmdseq->props[commandnum++].u.data = tune_stream_id;
+				}
 #endif
+				cmdseq->props[commandnum++].cmd    = DTV_TUNE;
+			}
+			else if((tuneparams->delivery_system==SYS_DVBT)
 #ifdef DVBT2
-				&&(tuneparams->delivery_system!=SYS_DVBT2))
+					||(tuneparams->delivery_system==SYS_DVBT2))
 #else
-		)
+			)
 #endif
 		{
-			log_message( log_module,  MSG_WARN, "The delivery system does not fit with the card frontend type (DVB-T/T2 ISDBT).");
-			change_deliv=1;
-		}
-		break;
-case FE_QPSK: //DVB-S
-	if((tuneparams->delivery_system!=SYS_UNDEFINED)&&(tuneparams->delivery_system!=SYS_DVBS)&&(tuneparams->delivery_system!=SYS_DVBS2))
-	{
-		log_message( log_module,  MSG_WARN, "The delivery system does not fit with the card frontend type (DVB-S).\n");
-		change_deliv=1;
-	}
-	break;
+			cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
+			cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
+			cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
+			cmdseq->props[commandnum++].u.data = feparams->frequency;
+			cmdseq->props[commandnum].cmd      = DTV_BANDWIDTH_HZ;
+			cmdseq->props[commandnum++].u.data = dvbt_bandwidth;
+			cmdseq->props[commandnum].cmd      = DTV_CODE_RATE_HP;
+			cmdseq->props[commandnum++].u.data = tuneparams->HP_CodeRate;
+			cmdseq->props[commandnum].cmd      = DTV_CODE_RATE_LP;
+			cmdseq->props[commandnum++].u.data = tuneparams->LP_CodeRate;
+			cmdseq->props[commandnum].cmd      = DTV_MODULATION;
+			cmdseq->props[commandnum++].u.data = tuneparams->modulation;
+			cmdseq->props[commandnum].cmd      = DTV_GUARD_INTERVAL;
+			cmdseq->props[commandnum++].u.data = tuneparams->guardInterval;
+			cmdseq->props[commandnum].cmd      = DTV_TRANSMISSION_MODE;
+			cmdseq->props[commandnum++].u.data = tuneparams->TransmissionMode;
+			cmdseq->props[commandnum].cmd      = DTV_HIERARCHY;
+			cmdseq->props[commandnum++].u.data = tuneparams->hier;
+#ifdef STREAM_ID
+			if(tuneparams->stream_id)
+			{
+				cmdseq->props[commandnum].cmd      = DTV_STREAM_ID;
+				cmdseq->props[commandnum++].u.data = tune_stream_id;
+			}
+#endif
+			cmdseq->props[commandnum++].cmd    = DTV_TUNE;
+		}
+#if ISDBT
+		else if((tuneparams->delivery_system==SYS_ISDBT))
+		{
+			int isdbt_partial_reception = 0;
+
+			if(tuneparams->isdbt_layer)
+			{
+				if(tuneparams->isdbt_layer & ISDBT_LAYER_A)
+					log_message( log_module,  MSG_INFO, "ISDBT Layer A enabled");
+				if(tuneparams->isdbt_layer & ISDBT_LAYER_B)
+					log_message( log_module,  MSG_INFO, "ISDBT Layer B enabled");
+				if(tuneparams->isdbt_layer & ISDBT_LAYER_C)
+					log_message( log_module,  MSG_INFO, "ISDBT Layer C enabled");
+				if(tuneparams->isdbt_layer != ISDBT_LAYER_ALL)
+					isdbt_partial_reception = 1;
+			}
+			else
+				tuneparams->isdbt_layer = ISDBT_LAYER_ALL;
+			log_message( log_module,  MSG_INFO,  "IDSBT tuning");
+
+
+			cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
+			cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_DELIVERY_SYSTEM %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
+			cmdseq->props[commandnum++].u.data = feparams->frequency;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_FREQUENCY %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_ISDBT_PARTIAL_RECEPTION;
+			cmdseq->props[commandnum++].u.data = isdbt_partial_reception;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_PARTIAL_RECEPTION %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_ISDBT_SOUND_BROADCASTING;
+			cmdseq->props[commandnum++].u.data = 0;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_SOUND_BROADCASTING %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_ISDBT_LAYER_ENABLED;
+			cmdseq->props[commandnum++].u.data = tuneparams->isdbt_layer;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_LAYER_ENABLED %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_BANDWIDTH_HZ;//https://www.linuxtv.org/downloads/v4l-dvb-apis-old/frontend-properties.html
+			cmdseq->props[commandnum++].u.data = 6000000; //1) For ISDB-T it should be always 6000000Hz (6MHz)
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_BANDWIDTH_HZ %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_INVERSION;
+			cmdseq->props[commandnum++].u.data = INVERSION_AUTO;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_INVERSION %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_GUARD_INTERVAL;
+			cmdseq->props[commandnum++].u.data = GUARD_INTERVAL_AUTO;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_GUARD_INTERVAL %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_TRANSMISSION_MODE;
+			cmdseq->props[commandnum++].u.data = TRANSMISSION_MODE_AUTO;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_TRANSMISSION_MODE %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_ISDBT_SB_SUBCHANNEL_ID;
+			cmdseq->props[commandnum++].u.data = 0;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_SB_SUBCHANNEL_ID %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_ISDBT_SB_SEGMENT_IDX;
+			cmdseq->props[commandnum++].u.data = 0;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_SB_SEGMENT_IDX %d ",cmdseq->props[commandnum-1].u.data);
+			cmdseq->props[commandnum].cmd      = DTV_ISDBT_SB_SEGMENT_COUNT;
+			cmdseq->props[commandnum++].u.data = 0;
+			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_SB_SEGMENT_COUNT %d ",cmdseq->props[commandnum-1].u.data);
+
+			cmdseq->props[commandnum++].cmd    = DTV_TUNE;
+		}
+#endif
+		else if((tuneparams->delivery_system==SYS_DVBC_ANNEX_AC)||(tuneparams->delivery_system==SYS_DVBC_ANNEX_B))
+		{
+			cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
+			cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
+			cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
+			cmdseq->props[commandnum++].u.data = feparams->frequency;
+			cmdseq->props[commandnum].cmd      = DTV_MODULATION;
+			cmdseq->props[commandnum++].u.data = tuneparams->modulation;
+			cmdseq->props[commandnum].cmd      = DTV_SYMBOL_RATE;
+			cmdseq->props[commandnum++].u.data = tuneparams->srate;
+			cmdseq->props[commandnum].cmd      = DTV_INVERSION;
+			cmdseq->props[commandnum++].u.data = INVERSION_OFF;
+			cmdseq->props[commandnum].cmd      = DTV_INNER_FEC;
+			cmdseq->props[commandnum++].u.data = tuneparams->HP_CodeRate;
+			cmdseq->props[commandnum++].cmd    = DTV_TUNE;
+		}
+		else if(tuneparams->delivery_system==SYS_ATSC)
+		{
+			cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
+			cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
+			cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
+			cmdseq->props[commandnum++].u.data = feparams->frequency;
+			cmdseq->props[commandnum].cmd      = DTV_MODULATION;
+			cmdseq->props[commandnum++].u.data = tuneparams->modulation;
+			cmdseq->props[commandnum++].cmd    = DTV_TUNE;
+		}
+		else
+		{
+			log_message( log_module,  MSG_ERROR, "Unsupported delivery system. Try tuning using DVB API 3 (do not set delivery_system). And please contact so it can be implemented.\n");
+			set_interrupted(ERROR_TUNE<<8);
+			free(cmdseq->props);
+			free(cmdseq);
+			return -1;
+		}
+
+		cmdseq->num = commandnum;
+		if ((dvb_ioctl(fd_frontend, FE_SET_PROPERTY, &cmdclear)) == -1) {
+			log_message( log_module,  MSG_ERROR,"FE_SET_PROPERTY clear failed : %s\n", strerror(errno));
+			set_interrupted(ERROR_TUNE<<8);
+			free(cmdseq->props);
+			free(cmdseq);
+			return -1;
+		}
+
+		if ((dvb_ioctl(fd_frontend, FE_SET_PROPERTY, cmdseq)) == -1) {
+			log_message( log_module,  MSG_ERROR,"FE_SET_PROPERTY failed : %s\n", strerror(errno));
+			set_interrupted(ERROR_TUNE<<8);
+			free(cmdseq->props);
+			free(cmdseq);
+			return -1;
+		}
+		free(cmdseq->props);
+		free(cmdseq);
+
+		}
+#endif
+	return 0;
+}
+
+/** @brief Tune the card
+ *
+ */
+int tune_it(int fd_frontend, tune_p_t *tuneparams)
+{
+	int res, hi_lo, dfd;
+	struct dvb_frontend_parameters feparams;
+	struct dvb_frontend_info fe_info;
+	uint32_t lo_frequency=0;
+	int dvbt_bandwidth=0;
+	uint64_t tune_time;
+	int lock_timeout;
+	sec_state_t *sec_state;
+#if DVB_API_VERSION >= 5
+	tune_cache_entry_t cache_entry;
+#endif
+
+	//no warning
+	memset(&feparams, 0, sizeof (struct dvb_frontend_parameters));
+	hi_lo = 0;
+
+	res = dvb_ioctl(fd_frontend,FE_GET_INFO, &fe_info);
+	if (res < 0){
+		log_message( log_module,  MSG_ERROR, "FE_GET_INFO: %s \n", strerror(errno));
+		return -1;
+	}
+
+	/** @todo here check the capabilities of the card*/
+
+	log_message( log_module,  MSG_INFO, "Using DVB card \"%s\" tuner %d\n",fe_info.name, tuneparams->tuner);
+
+	// Save the frontend name for easy identification
+	snprintf(tuneparams->fe_name, 256, "%s", fe_info.name);
+
+	tuneparams->fe_type=fe_info.type;
+	feparams.inversion=INVERSION_AUTO;
+
+
+	// see if we need to change the frontend type. @todo : mix between DVB APIv3 and V5
+#if DVB_API_VERSION >= 5
+	int change_deliv=0;
+	switch(fe_info.type) {
+	case FE_OFDM: //DVB-T
+		if((tuneparams->delivery_system!=SYS_UNDEFINED)&&(tuneparams->delivery_system!=SYS_DVBT)
+#if ISDBT
+				&&(tuneparams->delivery_system!=SYS_ISDBT)
+#endif
+#ifdef DVBT2
+				&&(tuneparams->delivery_system!=SYS_DVBT2))
+#else
+		)
+#endif
+		{
+			log_message( log_module,  MSG_WARN, "The delivery system does not fit with the card frontend type (DVB-T/T2 ISDBT).");
+			change_deliv=1;
+		}
+		break;
+case FE_QPSK: //DVB-S
+	if((tuneparams->delivery_system!=SYS_UNDEFINED)&&(tuneparams->delivery_system!=SYS_DVBS)&&(tuneparams->delivery_system!=SYS_DVBS2))
+	{
+		log_message( log_module,  MSG_WARN, "The delivery system does not fit with the card frontend type (DVB-S).\n");
+		change_deliv=1;
+	}
+	break;
 case FE_QAM: //DVB-C
 	if((tuneparams->delivery_system!=SYS_UNDEFINED)&&(tuneparams->delivery_system!=SYS_DVBC_ANNEX_AC)&&(tuneparams->delivery_system!=SYS_DVBC_ANNEX_B))
 	{
@@ -1432,7 +2028,7 @@ default:
 		if(change_delivery_system(tuneparams->delivery_system,fd_frontend))
 			return -1;
 		//get new info
-		if ( (res = ioctl(fd_frontend,FE_GET_INFO, &fe_info) < 0)){
+		if ( (res = dvb_ioctl(fd_frontend,FE_GET_INFO, &fe_info) < 0)){
 			log_message( log_module,  MSG_ERROR, "FE_GET_INFO: %s \n", strerror(errno));
 			return -1;
 		}
@@ -1511,6 +2107,7 @@ default:
 			feparams.u.qpsk.symbol_rate=tuneparams->srate;
 			feparams.u.qpsk.fec_inner=tuneparams->HP_CodeRate;
 			dfd = fd_frontend;
+			sec_state = sec_state_get(tuneparams);
 
 			// Test whether it is a unicable switch - existing unicable frequency
 			if(tuneparams->uni_freq > 0)
@@ -1526,7 +2123,8 @@ default:
 						tuneparams->diseqc_repeat,
 						tuneparams->diseqc_time,
 						&feparams.frequency,
-						tuneparams->uni_freq) == 0)
+						tuneparams->uni_freq,
+						sec_state) == 0)
 					log_message( log_module,  MSG_INFO, "UNICABLE SETTING SUCCEEDED\n");
 				else  
 				{
@@ -1551,7 +2149,8 @@ default:
 							hi_lo,
 							tuneparams->lnb_voltage_off,
 							tuneparams->diseqc_repeat,
-							tuneparams->diseqc_time) == 0)
+							tuneparams->diseqc_time,
+							sec_state) == 0)
 						log_message( log_module,  MSG_INFO, "DISEQC SETTING SUCCEEDED\n");
 					else  
 					{
@@ -1569,7 +2168,8 @@ default:
 						hi_lo,
 						tuneparams->lnb_voltage_off,
 						tuneparams->diseqc_repeat,
-						tuneparams->diseqc_time) == 0)
+						tuneparams->diseqc_time,
+						sec_state) == 0)
 					log_message( log_module,  MSG_INFO, "DISEQC SETTING SUCCEEDED - Frequency: %d\n", feparams.frequency);
 				else  
 				{
@@ -1611,255 +2211,40 @@ default:
 	usleep(100000);
 
 
-	/* The tuning of the card*/
-	while(1)  {
-		if (ioctl(fd_frontend, FE_GET_EVENT, &event) < 0)	//EMPTY THE EVENT QUEUE
-			break;
-	}
+	//The deadline for the lock, by default the tuning timeout
+	if(tuneparams->lock_timeout)
+		lock_timeout=tuneparams->lock_timeout;
+	else
+		lock_timeout=tuneparams->tuning_timeout*1000;
+	//The alarm of the tuning timeout, armed by main before the frontend open, would exit
+	//before check_status : the lock deadline is now the only one
+	alarm(0);
 
-	//If we support DVB API version 5 we check if the delivery system was defined
+	/* The tuning of the card*/
+	tune_time=get_time();
 #if DVB_API_VERSION >= 5
-	if(tuneparams->delivery_system==SYS_UNDEFINED)
-#else
-		if(1)
+	//We try first the parameters found by the frontend the last time we tuned this transponder
+	if(tuneparams->tune_cache && (tuneparams->delivery_system!=SYS_UNDEFINED) && !tune_cache_get(tuneparams, &cache_entry))
+	{
+		tune_p_t cached_params=*tuneparams;
+		int cached_bandwidth=dvbt_bandwidth;
+		log_message( log_module,  MSG_INFO, "Tuning with the cached parameters\n");
+		tune_cache_apply(&cache_entry, &cached_params, &cached_bandwidth);
+		if(tune_set_frontend(fd_frontend, &cached_params, &feparams, cached_bandwidth) < 0)
+			return -1;
+		res=check_status(fd_frontend,tuneparams,fe_info.type,lo_frequency,tune_time,
+				(lock_timeout && lock_timeout<tuneparams->tune_cache_timeout) ? lock_timeout : tuneparams->tune_cache_timeout);
+		if(res!=TUNE_NO_LOCK)
+			return res;
+		log_message( log_module,  MSG_INFO, "No lock with the cached parameters, tuning with the configured ones\n");
+	}
 #endif
-		{
-			if (ioctl(fd_frontend,FE_SET_FRONTEND,&feparams) < 0) {
-				log_message( log_module,  MSG_ERROR, "ERROR tuning channel : %s \n", strerror(errno));
-				set_interrupted(ERROR_TUNE<<8);
-				return -1;
-			}
-		}
+	if(tune_set_frontend(fd_frontend, tuneparams, &feparams, dvbt_bandwidth) < 0)
+		return -1;
+	res=check_status(fd_frontend,tuneparams,fe_info.type,lo_frequency,tune_time,lock_timeout);
 #if DVB_API_VERSION >= 5
-		else
-		{
-			/*  Memo : S2API Commands
-    DTV_UNDEFINED            DTV_TUNE                 DTV_CLEAR               
-    DTV_FREQUENCY            DTV_MODULATION           DTV_BANDWIDTH_HZ        
-    DTV_INVERSION            DTV_DISEQC_MASTER        DTV_SYMBOL_RATE         
-    DTV_INNER_FEC            DTV_VOLTAGE              DTV_TONE                
-    DTV_PILOT                DTV_ROLLOFF              DTV_DISEQC_SLAVE_REPLY  
-    DTV_FE_CAPABILITY_COUNT  DTV_FE_CAPABILITY        DTV_DELIVERY_SYSTEM     
-    DTV_API_VERSION          DTV_API_VERSION          DTV_CODE_RATE_HP        
-    DTV_CODE_RATE_LP         DTV_GUARD_INTERVAL       DTV_TRANSMISSION_MODE   
-    DTV_HIERARCHY 
-			 */
-			//DVB api version 5 and delivery system defined, we do DVB-API-5 tuning
-			log_message( log_module,  MSG_INFO, "Tuning With DVB-API version 5. delivery system : %d\n",tuneparams->delivery_system);
-
-#ifdef STREAM_ID
-			int tune_stream_id;
-			tune_stream_id = tuneparams->stream_id;
-			if( tuneparams->pls_code )
-				tune_stream_id = tuneparams->stream_id+((tuneparams->pls_code & 0x3FFFF)<<8);
-			if( tuneparams->pls_type == PLS_GOLD)
-				tune_stream_id = tune_stream_id | ( 1<<26 );
-			if(tuneparams->stream_id || tune_stream_id)
-				log_message( log_module,  MSG_INFO,  "Stream_id = %d, stream id with PLS parameters %d",tuneparams->stream_id, tune_stream_id);
-#endif
-
-			struct dtv_property pclear[] = {
-					{ .cmd = DTV_CLEAR,},
-			};
-			struct dtv_properties cmdclear = {
-					.num = 1,
-					.props = pclear
-			};
-			struct dtv_properties *cmdseq;
-			int commandnum =0;
-
-			cmdseq = (struct dtv_properties*) calloc(1, sizeof(*cmdseq));
-			if (!cmdseq)
-			{
-				log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-				return -1;
-			}
-
-			cmdseq->props = (struct dtv_property*) calloc(MAX_CMDSEQ_PROPS_NUM, sizeof(*(cmdseq->props)));
-			if (!(cmdseq->props))
-			{
-				free(cmdseq);
-				log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-				return -1;
-			}
-			if((tuneparams->delivery_system==SYS_DVBS)||(tuneparams->delivery_system==SYS_DVBS2))
-			{
-				cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
-				cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
-				cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
-				cmdseq->props[commandnum++].u.data = feparams.frequency;
-				cmdseq->props[commandnum].cmd      = DTV_MODULATION;
-				cmdseq->props[commandnum++].u.data = tuneparams->modulation;
-				cmdseq->props[commandnum].cmd      = DTV_SYMBOL_RATE;
-				cmdseq->props[commandnum++].u.data = tuneparams->srate;
-				cmdseq->props[commandnum].cmd      = DTV_INNER_FEC;
-				cmdseq->props[commandnum++].u.data = tuneparams->HP_CodeRate;
-				cmdseq->props[commandnum].cmd      = DTV_INVERSION;
-				cmdseq->props[commandnum++].u.data = INVERSION_AUTO;
-				cmdseq->props[commandnum].cmd      = DTV_ROLLOFF;
-				cmdseq->props[commandnum++].u.data = tuneparams->rolloff;
-				cmdseq->props[commandnum].cmd      = DTV_PILOT;
-				cmdseq->props[commandnum++].u.data = PILOT_AUTO;
-				
-#ifdef STREAM_ID
-				if(tuneparams->stream_id)
-				{
-					cmdseq->props[commandnum].cmd      = DTV_STREAM_ID;
-					cmdseq->props[commandnum++].u.data = tune_stream_id;
-				}
-#endif
-				cmdseq->props[commandnum++].cmd    = DTV_TUNE;
-			}
-			else if((tuneparams->delivery_system==SYS_DVBT)
-#ifdef DVBT2
-					||(tuneparams->delivery_system==SYS_DVBT2))
-#else
-			)
-#endif
-		{
-			cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
-			cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
-			cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
-			cmdseq->props[commandnum++].u.data = feparams.frequency;
-			cmdseq->props[commandnum].cmd      = DTV_BANDWIDTH_HZ;
-			cmdseq->props[commandnum++].u.data = dvbt_bandwidth;
-			cmdseq->props[commandnum].cmd      = DTV_CODE_RATE_HP;
-			cmdseq->props[commandnum++].u.data = tuneparams->HP_CodeRate;
-			cmdseq->props[commandnum].cmd      = DTV_CODE_RATE_LP;
-			cmdseq->props[commandnum++].u.data = tuneparams->LP_CodeRate;
-			cmdseq->props[commandnum].cmd      = DTV_MODULATION;
-			cmdseq->props[commandnum++].u.data = tuneparams->modulation;
-			cmdseq->props[commandnum].cmd      = DTV_GUARD_INTERVAL;
-			cmdseq->props[commandnum++].u.data = tuneparams->guardInterval;
-			cmdseq->props[commandnum].cmd      = DTV_TRANSMISSION_MODE;
-			cmdseq->props[commandnum++].u.data = tuneparams->TransmissionMode;
-			cmdseq->props[commandnum].cmd      = DTV_HIERARCHY;
-			cmdseq->props[commandnum++].u.data = tuneparams->hier;
-#ifdef STREAM_ID
-			if(tuneparams->stream_id)
-			{
-				cmdseq->props[commandnum].cmd      = DTV_STREAM_ID;
-				cmdseq->props[commandnum++].u.data = tune_stream_id;
-			}
-#endif
-			cmdseq->props[commandnum++].cmd    = DTV_TUNE;
-		}
-#if ISDBT
-		else if((tuneparams->delivery_system==SYS_ISDBT))
-		{
-			int isdbt_partial_reception = 0;
-
-			if(tuneparams->isdbt_layer)
-			{
-				if(tuneparams->isdbt_layer & ISDBT_LAYER_A)
-					log_message( log_module,  MSG_INFO, "ISDBT Layer A enabled");
-				if(tuneparams->isdbt_layer & ISDBT_LAYER_B)
-					log_message( log_module,  MSG_INFO, "ISDBT Layer B enabled");
-				if(tuneparams->isdbt_layer & ISDBT_LAYER_C)
-					log_message( log_module,  MSG_INFO, "ISDBT Layer C enabled");
-				if(tuneparams->isdbt_layer != ISDBT_LAYER_ALL)
-					isdbt_partial_reception = 1;
-			}
-			else
-				tuneparams->isdbt_layer = ISDBT_LAYER_ALL;
-			log_message( log_module,  MSG_INFO,  "IDSBT tuning");
-
-
-			cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
-			cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_DELIVERY_SYSTEM %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
-			cmdseq->props[commandnum++].u.data = feparams.frequency;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_FREQUENCY %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_ISDBT_PARTIAL_RECEPTION;
-			cmdseq->props[commandnum++].u.data = isdbt_partial_reception;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_PARTIAL_RECEPTION %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_ISDBT_SOUND_BROADCASTING;
-			cmdseq->props[commandnum++].u.data = 0;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_SOUND_BROADCASTING %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_ISDBT_LAYER_ENABLED;
-			cmdseq->props[commandnum++].u.data = tuneparams->isdbt_layer;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_LAYER_ENABLED %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_BANDWIDTH_HZ;//https://www.linuxtv.org/downloads/v4l-dvb-apis-old/frontend-properties.html
-			cmdseq->props[commandnum++].u.data = 6000000; //1) For ISDB-T it should be always 6000000Hz (6MHz)
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_BANDWIDTH_HZ %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_INVERSION;
-			cmdseq->props[commandnum++].u.data = INVERSION_AUTO;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_INVERSION %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_GUARD_INTERVAL;
-			cmdseq->props[commandnum++].u.data = GUARD_INTERVAL_AUTO;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_GUARD_INTERVAL %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_TRANSMISSION_MODE;
-			cmdseq->props[commandnum++].u.data = TRANSMISSION_MODE_AUTO;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_TRANSMISSION_MODE %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_ISDBT_SB_SUBCHANNEL_ID;
-			cmdseq->props[commandnum++].u.data = 0;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_SB_SUBCHANNEL_ID %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_ISDBT_SB_SEGMENT_IDX;
-			cmdseq->props[commandnum++].u.data = 0;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_SB_SEGMENT_IDX %d ",cmdseq->props[commandnum-1].u.data);
-			cmdseq->props[commandnum].cmd      = DTV_ISDBT_SB_SEGMENT_COUNT;
-			cmdseq->props[commandnum++].u.data = 0;
-			log_message( log_module,  MSG_DEBUG,  "IDSBT tuning DTV_ISDBT_SB_SEGMENT_COUNT %d ",cmdseq->props[commandnum-1].u.data);
-
-			cmdseq->props[commandnum++].cmd    = DTV_TUNE;
-		}
-#endif
-		else if((tuneparams->delivery_system==SYS_DVBC_ANNEX_AC)||(tuneparams->delivery_system==SYS_DVBC_ANNEX_B))
-		{
-			cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
-			cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
-			cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
-			cmdseq->props[commandnum++].u.data = feparams.frequency;
-			cmdseq->props[commandnum].cmd      = DTV_MODULATION;
-			cmdseq->props[commandnum++].u.data = tuneparams->modulation;
-			cmdseq->props[commandnum].cmd      = DTV_SYMBOL_RATE;
-			cmdseq->props[commandnum++].u.data = tuneparams->srate;
-			cmdseq->props[commandnum].cmd      = DTV_INVERSION;
-			cmdseq->props[commandnum++].u.data = INVERSION_OFF;
-			cmdseq->props[commandnum].cmd      = DTV_INNER_FEC;
-			cmdseq->props[commandnum++].u.data = tuneparams->HP_CodeRate;
-			cmdseq->props[commandnum++].cmd    = DTV_TUNE;
-		}
-		else if(tuneparams->delivery_system==SYS_ATSC)
-		{
-			cmdseq->props[commandnum].cmd      = DTV_DELIVERY_SYSTEM;
-			cmdseq->props[commandnum++].u.data = tuneparams->delivery_system;
-			cmdseq->props[commandnum].cmd      = DTV_FREQUENCY;
-			cmdseq->props[commandnum++].u.data = feparams.frequency;
-			cmdseq->props[commandnum].cmd      = DTV_MODULATION;
-			cmdseq->props[commandnum++].u.data = tuneparams->modulation;
-			cmdseq->props[commandnum++].cmd    = DTV_TUNE;
-		}
-		else
-		{
-			log_message( log_module,  MSG_ERROR, "Unsupported delivery system. Try tuning using DVB API 3 (do not set delivery_system). And please contact so it can be implemented.\n");
-			set_interrupted(ERROR_TUNE<<8);
-			free(cmdseq->props);
-			free(cmdseq);
-			return -1;
-		}
-
-		cmdseq->num = commandnum;
-		if ((ioctl(fd_frontend, FE_SET_PROPERTY, &cmdclear)) == -1) {
-			log_message( log_module,  MSG_ERROR,"FE_SET_PROPERTY clear failed : %s\n", strerror(errno));
-			set_interrupted(ERROR_TUNE<<8);
-			free(cmdseq->props);
-			free(cmdseq);
-			return -1;
-		}
-
-		if ((ioctl(fd_frontend, FE_SET_PROPERTY, cmdseq)) == -1) {
-			log_message( log_module,  MSG_ERROR,"FE_SET_PROPERTY failed : %s\n", strerror(errno));
-			set_interrupted(ERROR_TUNE<<8);
-			free(cmdseq->props);
-			free(cmdseq);
-			return -1;
-		}
-		free(cmdseq->props);
-		free(cmdseq);
-
-		}
+	if(!res && tuneparams->tune_cache && (tuneparams->delivery_system!=SYS_UNDEFINED))
+		tune_cache_store(fd_frontend, tuneparams);
 #endif
-	return(check_status(fd_frontend,fe_info.type,lo_frequency,tuneparams->display_strenght));
+	return res;
 }
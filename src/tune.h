@@ -78,6 +78,29 @@
 #define MAX_CMDSEQ_PROPS_NUM 12
 #endif
 
+/** The maximum time (ms) we wait for a frontend event before reading the status again */
+#define FE_EVENT_POLL_TIMEOUT 100
+
+/** Returned by tune_it when the card did not lock before the deadline */
+#define TUNE_NO_LOCK -2
+
+/** The default interval between two samples of the signal statistics (ms) */
+#define FE_STATS_DEFAULT_INTERVAL 2000
+/** The minimum interval between two samples of the signal statistics (ms) */
+#define FE_STATS_MIN_INTERVAL 50
+
+/** The file where the state of the switch is kept (diseqc_cache=2) */
+#define SEC_STATE_PATH "/var/run/mumudvb/sec_state_adapter%d_tuner%d"
+/** The maximum number of adapters for which we remember the switch state */
+#define MAX_SEC_STATES 64
+
+/** The file where the parameters found by the frontend are kept */
+#define TUNE_CACHE_PATH "/var/run/mumudvb/tune_cache_adapter%d_tuner%d"
+/** The maximum number of transponders in the cache of one adapter */
+#define TUNE_CACHE_MAX_ENTRIES 256
+/** The default time (ms) we give to the cached parameters to lock */
+#define TUNE_CACHE_DEFAULT_TIMEOUT 300
+
 
 /*Do we support stream_id ?*/
 #undef STREAM_ID
@@ -126,6 +149,12 @@ typedef struct tune_p_t{
   int card_tuned;
   /**The timeout for tuninh the card*/
   int tuning_timeout;
+  /** The deadline for the lock of the card in ms (0 : tuning_timeout) */
+  int lock_timeout;
+  /** Do we use the one shot tune mode of the frontend (no zigzag) ?*/
+  int tune_mode_oneshot;
+  /** The time it took to lock the card in us (0 if not locked) */
+  uint64_t lock_time;
   /** the frequency (in MHz for dvb-s in kHz, MHz or Hz for all others) */
   double freq;
   /** The symbol rate (QPSK and QAM modulation ie cable and satellite) in symbols per second*/
@@ -156,6 +185,9 @@ typedef struct tune_p_t{
   int diseqc_repeat;
   /** Wait (ms) for DiseQC messages ? */
   int diseqc_time;
+  /** Do we skip the DiseQC/Unicable messages when the switch is already set ?
+   * 0 : no, 1 : we remember the state in the process, 2 : we also keep it in a state file */
+  int diseqc_cache;
   /** The frequency for SCR/unicable */
   uint32_t uni_freq;
   /** The kind of modulation */
@@ -180,6 +212,8 @@ typedef struct tune_p_t{
   int display_strenght;
   /** do we periodically check the status of the card ?*/
   int check_status;
+  /** The interval between two samples of the signal statistics, in ms */
+  int stats_interval;
   /**shutdown the thread for display strength */
   volatile int strengththreadshutdown;
   /**The frontend type*/
@@ -192,6 +226,12 @@ typedef struct tune_p_t{
   fe_delivery_system_t delivery_system;
   /** Rolloff (For DVB-S and DVB-S2)*/
   fe_rolloff_t rolloff;
+  /** Pilot (For DVB-S2)*/
+  fe_pilot_t pilot;
+  /** Do we use the tuning parameters cache ? */
+  int tune_cache;
+  /** The time (ms) we give to the cached parameters to lock */
+  int tune_cache_timeout;
 #endif
 #if STREAM_ID
   /** The substream id */
@@ -219,12 +259,48 @@ typedef struct tune_p_t{
 
 }tune_p_t;
 
+#if DVB_API_VERSION >= 5
+/** @brief The parameters found by the frontend for a transponder */
+typedef struct tune_cache_entry_t{
+  /** The frequency, as given in the configuration, x1000 */
+  uint64_t freq;
+  /** The polarisation (0 if not satellite) */
+  int pol;
+  /** The symbol rate */
+  unsigned int srate;
+  /** The delivery system */
+  int delivery_system;
+  /** The substream id */
+  int stream_id;
+  /** The satellite number */
+  int sat_number;
+  /** The switch input */
+  int switch_no;
+  //The parameters read back after the lock
+  int modulation;
+  int fec;
+  int fec_lp;
+  int rolloff;
+  int pilot;
+  int inversion;
+  int guard_interval;
+  int transmission_mode;
+  int hierarchy;
+  uint32_t bandwidth;
+}tune_cache_entry_t;
+
+int tune_cache_get(tune_p_t *tuneparams, tune_cache_entry_t *entry);
+void tune_cache_apply(tune_cache_entry_t *entry, tune_p_t *tuneparams, int *dvbt_bandwidth);
+int tune_cache_store(int fd_frontend, tune_p_t *tuneparams);
+#endif
+
 
 
 
 
 void init_tune_v(tune_p_t *);
 int tune_it(int, tune_p_t *);
+int check_status(int fd_frontend, tune_p_t *tuneparams, int type, uint32_t lo_frequency, uint64_t tune_time, int timeout);
 int read_tuning_configuration(tune_p_t *, char *);
 void print_status(fe_status_t festatus);
 
@@ -0,0 +1,257 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/** @file
+ * @brief Cache of the tuning parameters found by the frontend
+ *
+ * When the configuration leaves FEC, modulation, rolloff, pilot etc. to AUTO, the
+ * demodulator has to search them at each tuning. Once locked, we read back the
+ * parameters it found and keep them in a file per adapter. The next time we tune
+ * the same transponder we try these parameters first, during a short time.
+ *
+ * The file contains one transponder per line :
+ * freq pol srate delivery_system stream_id sat_number switch_no modulation fec fec_lp rolloff pilot inversion guard_interval transmission_mode hierarchy bandwidth
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/ioctl.h>
+
+#include "tune.h"
+#include "mumudvb.h"
+#include "log.h"
+#include "dvb_emu.h"
+
+static char *log_module="Tune cache: ";
+
+#if DVB_API_VERSION >= 5
+
+/** @brief Fill the key of the cache entry from the tuning parameters */
+static void tune_cache_key(tune_p_t *tuneparams, tune_cache_entry_t *entry)
+{
+	memset(entry, 0, sizeof(tune_cache_entry_t));
+	entry->freq=llround(tuneparams->freq*1000);
+	entry->pol=tuneparams->pol;
+	entry->srate=tuneparams->srate;
+	entry->delivery_system=tuneparams->delivery_system;
+#if STREAM_ID
+	entry->stream_id=tuneparams->stream_id;
+#endif
+	entry->sat_number=tuneparams->sat_number;
+	entry->switch_no=tuneparams->switch_no;
+}
+
+static int tune_cache_same_key(tune_cache_entry_t *a, tune_cache_entry_t *b)
+{
+	return a->freq==b->freq && a->pol==b->pol && a->srate==b->srate &&
+			a->delivery_system==b->delivery_system && a->stream_id==b->stream_id &&
+			a->sat_number==b->sat_number && a->switch_no==b->switch_no;
+}
+
+/** @brief Read one line of the cache file
+ * @return 0 if the line is valid
+ */
+static int tune_cache_read_entry(char *line, tune_cache_entry_t *entry)
+{
+	if(sscanf(line, "%" SCNu64 " %d %u %d %d %d %d %d %d %d %d %d %d %d %d %d %" SCNu32,
+			&entry->freq, &entry->pol, &entry->srate, &entry->delivery_system,
+			&entry->stream_id, &entry->sat_number, &entry->switch_no,
+			&entry->modulation, &entry->fec, &entry->fec_lp, &entry->rolloff,
+			&entry->pilot, &entry->inversion, &entry->guard_interval,
+			&entry->transmission_mode, &entry->hierarchy, &entry->bandwidth) != 17)
+		return -1;
+	return 0;
+}
+
+static void tune_cache_write_entry(FILE *cache_file, tune_cache_entry_t *entry)
+{
+	fprintf(cache_file, "%" PRIu64 " %d %u %d %d %d %d %d %d %d %d %d %d %d %d %d %" PRIu32 "\n",
+			entry->freq, entry->pol, entry->srate, entry->delivery_system,
+			entry->stream_id, entry->sat_number, entry->switch_no,
+			entry->modulation, entry->fec, entry->fec_lp, entry->rolloff,
+			entry->pilot, entry->inversion, entry->guard_interval,
+			entry->transmission_mode, entry->hierarchy, entry->bandwidth);
+}
+
+/** @brief Look for the transponder in the cache
+ *
+ * @param tuneparams the tuning parameters (the key)
+ * @param entry filled with the cached parameters
+ * @return 0 if found
+ */
+int tune_cache_get(tune_p_t *tuneparams, tune_cache_entry_t *entry)
+{
+	char filename[DEFAULT_PATH_LEN];
+	char line[CONF_LINELEN];
+	tune_cache_entry_t key;
+	FILE *cache_file;
+	int found=-1;
+
+	tune_cache_key(tuneparams, &key);
+	snprintf(filename, DEFAULT_PATH_LEN, TUNE_CACHE_PATH, tuneparams->card, tuneparams->tuner);
+	cache_file=fopen(filename, "r");
+	if(cache_file==NULL)
+		return -1;
+	while(fgets(line, CONF_LINELEN, cache_file))
+	{
+		if(!tune_cache_read_entry(line, entry) && tune_cache_same_key(&key, entry))
+		{
+			found=0;
+			break;
+		}
+	}
+	fclose(cache_file);
+	return found;
+}
+
+/** @brief Replace the tuning parameters by the cached ones
+ *
+ */
+void tune_cache_apply(tune_cache_entry_t *entry, tune_p_t *tuneparams, int *dvbt_bandwidth)
+{
+	tuneparams->modulation=entry->modulation;
+	tuneparams->HP_CodeRate=entry->fec;
+	tuneparams->LP_CodeRate=entry->fec_lp;
+	tuneparams->rolloff=entry->rolloff;
+	tuneparams->pilot=entry->pilot;
+	tuneparams->inversion=entry->inversion;
+	tuneparams->guardInterval=entry->guard_interval;
+	tuneparams->TransmissionMode=entry->transmission_mode;
+	tuneparams->hier=entry->hierarchy;
+	if(entry->bandwidth)
+		*dvbt_bandwidth=entry->bandwidth;
+	log_message( log_module,  MSG_DETAIL, "Cached parameters : modulation %d fec %d/%d rolloff %d pilot %d inversion %d guard interval %d transmission mode %d hierarchy %d bandwidth %u\n",
+			entry->modulation, entry->fec, entry->fec_lp, entry->rolloff, entry->pilot, entry->inversion,
+			entry->guard_interval, entry->transmission_mode, entry->hierarchy, entry->bandwidth);
+}
+
+/** @brief Read back the parameters found by the (locked) frontend and store them in the cache
+ *
+ */
+int tune_cache_store(int fd_frontend, tune_p_t *tuneparams)
+{
+	char filename[DEFAULT_PATH_LEN];
+	char filename_tmp[DEFAULT_PATH_LEN+4];
+	char line[CONF_LINELEN];
+	tune_cache_entry_t entry;
+	tune_cache_entry_t *entries;
+	FILE *cache_file;
+	int num_entries=0;
+	int first=0;
+
+	struct dtv_property props[] = {
+			{ .cmd = DTV_MODULATION },
+			{ .cmd = DTV_INNER_FEC },
+			{ .cmd = DTV_CODE_RATE_HP },
+			{ .cmd = DTV_CODE_RATE_LP },
+			{ .cmd = DTV_ROLLOFF },
+			{ .cmd = DTV_PILOT },
+			{ .cmd = DTV_INVERSION },
+			{ .cmd = DTV_GUARD_INTERVAL },
+			{ .cmd = DTV_TRANSMISSION_MODE },
+			{ .cmd = DTV_HIERARCHY },
+			{ .cmd = DTV_BANDWIDTH_HZ },
+	};
+	struct dtv_properties cmdseq = {
+			.num = sizeof(props)/sizeof(props[0]),
+			.props = props
+	};
+
+	if(dvb_ioctl(fd_frontend, FE_GET_PROPERTY, &cmdseq) < 0)
+	{
+		log_message( log_module,  MSG_DETAIL, "FE_GET_PROPERTY failed : %s, parameters not cached\n", strerror(errno));
+		return -1;
+	}
+	tune_cache_key(tuneparams, &entry);
+	entry.modulation=props[0].u.data;
+	//Terrestrial frontends give the FEC in CODE_RATE_HP
+	if(tuneparams->delivery_system==SYS_DVBT
+#ifdef DVBT2
+			|| tuneparams->delivery_system==SYS_DVBT2
+#endif
+			)
+		entry.fec=props[2].u.data;
+	else
+		entry.fec=props[1].u.data;
+	entry.fec_lp=props[3].u.data;
+	entry.rolloff=props[4].u.data;
+	entry.pilot=props[5].u.data;
+	entry.inversion=props[6].u.data;
+	entry.guard_interval=props[7].u.data;
+	entry.transmission_mode=props[8].u.data;
+	entry.hierarchy=props[9].u.data;
+	entry.bandwidth=props[10].u.data;
+
+	entries=calloc(TUNE_CACHE_MAX_ENTRIES+1, sizeof(tune_cache_entry_t));
+	if(entries==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return -1;
+	}
+	//We keep the other transponders, the most recent at the end
+	snprintf(filename, DEFAULT_PATH_LEN, TUNE_CACHE_PATH, tuneparams->card, tuneparams->tuner);
+	cache_file=fopen(filename, "r");
+	if(cache_file!=NULL)
+	{
+		while(num_entries<TUNE_CACHE_MAX_ENTRIES && fgets(line, CONF_LINELEN, cache_file))
+		{
+			if(!tune_cache_read_entry(line, &entries[num_entries]) && !tune_cache_same_key(&entry, &entries[num_entries]))
+				num_entries++;
+		}
+		fclose(cache_file);
+	}
+	entries[num_entries++]=entry;
+	if(num_entries>TUNE_CACHE_MAX_ENTRIES)
+		first=1;
+
+	snprintf(filename_tmp, sizeof(filename_tmp), "%s.tmp", filename);
+	cache_file=fopen(filename_tmp, "w");
+	if(cache_file==NULL)
+	{
+		log_message( log_module,  MSG_WARN, "Cannot write %s : %s\n", filename_tmp, strerror(errno));
+		free(entries);
+		return -1;
+	}
+	for(int i=first;i<num_entries;i++)
+		tune_cache_write_entry(cache_file, &entries[i]);
+	fclose(cache_file);
+	free(entries);
+	if(rename(filename_tmp, filename) < 0)
+	{
+		log_message( log_module,  MSG_WARN, "Cannot rename %s : %s\n", filename_tmp, strerror(errno));
+		return -1;
+	}
+	log_message( log_module,  MSG_DEBUG, "Parameters of the transponder stored in %s\n", filename);
+	return 0;
+}
+
+#endif
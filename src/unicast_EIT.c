@@ -26,10 +26,10 @@
 #endif
 
 static char *log_module="Unicast : ";
-void eit_display_contents(mumudvb_ts_packet_t *full_eit, struct unicast_reply* reply);
+void eit_display_contents(mumudvb_section_t *full_eit, struct unicast_reply* reply);
 
 void
-unicast_send_EIT_section (mumudvb_ts_packet_t *eit_section, int num, struct unicast_reply* reply)
+unicast_send_EIT_section (mumudvb_section_t *eit_section, int num, struct unicast_reply* reply)
 {
 
 	unicast_reply_write(reply, "\n{\n");
@@ -163,7 +163,7 @@ void mumu_string_to_json(char *in, int lin, char *out, int lout)
 /** @brief Display the contents of the EIT table
  *
  */
-void eit_display_contents(mumudvb_ts_packet_t *full_eit, struct unicast_reply* reply)
+void eit_display_contents(mumudvb_section_t *full_eit, struct unicast_reply* reply)
 {
 	eit_t       *eit=NULL;
 	eit=(eit_t*)(full_eit->data_full);
@@ -91,8 +91,16 @@ unicast_send_streamed_channels_list_js (int number_of_channels, mumudvb_channel_
 int
 unicast_send_signal_power_js (int Socket, strength_parameters_t *strengthparams);
 int
+unicast_send_signal_history_js (int Socket, strength_parameters_t *strengthparams);
+int
 unicast_send_channel_traffic_js (int number_of_channels, mumudvb_channel_t *channels, int Socket);
 int
+unicast_send_pid_stats_js (int Socket, strength_parameters_t *strengthparams);
+int
+unicast_send_tr101290_js (int Socket, strength_parameters_t *strengthparams);
+int
+unicast_send_pcr_stats_js (int Socket, strength_parameters_t *strengthparams);
+int
 unicast_send_json_state (int number_of_channels, mumudvb_channel_t* channels, int Socket, strength_parameters_t* strengthparams, auto_p_t* auto_p, void* cam_p_v, void* scam_vars_v);
 int
 unicast_send_prometheus (int number_of_channels, mumudvb_channel_t* channels, int Socket, strength_parameters_t* strengthparams);
@@ -831,12 +839,36 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
 				unicast_send_signal_power_js(client->Socket, strengthparams);
 				return -2; //We close the connection afterwards
 			}
+			else if(strstr(client->buffer +pos ,"/monitor/signal_history.json ")==(client->buffer +pos))
+			{
+				log_message( log_module, MSG_DETAIL,"Signal history json\n");
+				unicast_send_signal_history_js(client->Socket, strengthparams);
+				return -2; //We close the connection afterwards
+			}
 			else if(strstr(client->buffer +pos ,"/monitor/channels_traffic.json ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"Channel traffic json\n");
 				unicast_send_channel_traffic_js(number_of_channels, channels, client->Socket);
 				return -2; //We close the connection afterwards
 			}
+			else if(strstr(client->buffer +pos ,"/monitor/pid_stats.json ")==(client->buffer +pos))
+			{
+				log_message( log_module, MSG_DETAIL,"PID statistics json\n");
+				unicast_send_pid_stats_js(client->Socket, strengthparams);
+				return -2; //We close the connection afterwards
+			}
+			else if(strstr(client->buffer +pos ,"/monitor/tr101290.json ")==(client->buffer +pos))
+			{
+				log_message( log_module, MSG_DETAIL,"TR 101 290 json\n");
+				unicast_send_tr101290_js(client->Socket, strengthparams);
+				return -2; //We close the connection afterwards
+			}
+			else if(strstr(client->buffer +pos ,"/monitor/pcr_stats.json ")==(client->buffer +pos))
+			{
+				log_message( log_module, MSG_DETAIL,"PCR statistics json\n");
+				unicast_send_pcr_stats_js(client->Socket, strengthparams);
+				return -2; //We close the connection afterwards
+			}
 			else if(strstr(client->buffer +pos ,"/monitor/state.xml ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"HTTP request for XML State\n");
@@ -1248,7 +1280,11 @@ unicast_send_index_page (int Socket)
 
 	unicast_reply_write(reply, "<br>  <a href=\"/channels_list.json\">Channels list (json)</a><br><br>\r\n");
 	unicast_reply_write(reply, "<br>  <a href=\"/monitor/signal_power.json\">Signal strength (json)</a><br><br>\r\n");
+	unicast_reply_write(reply, "<br>  <a href=\"/monitor/signal_history.json\">Signal statistics history (json)</a><br><br>\r\n");
 	unicast_reply_write(reply, "<br>  <a href=\"/monitor/channels_traffic.json\">Channels traffic (json)</a><br><br>\r\n");
+	unicast_reply_write(reply, "<br>  <a href=\"/monitor/pid_stats.json\">Statistics of each PID (json)</a><br><br>\r\n");
+	unicast_reply_write(reply, "<br>  <a href=\"/monitor/tr101290.json\">TR 101 290 errors of the TS and of each service (json)</a><br><br>\r\n");
+	unicast_reply_write(reply, "<br>  <a href=\"/monitor/pcr_stats.json\">Bitrate and PCR jitter of each service (json)</a><br><br>\r\n");
 	unicast_reply_write(reply, "<br>  <a href=\"/monitor/state.xml\">Server state : channel list, pids, traffic (XML)</a><br><br>\r\n");
 	unicast_reply_write(reply, "<br>  <a href=\"/monitor/state.json\">Server state : channel list, pids, traffic (json)</a><br><br>\r\n");
 	unicast_reply_write(reply, "<br>  <a href=\"/monitor/EIT.json\">Contents of the EIT tables (json)</a><br><br>\r\n");
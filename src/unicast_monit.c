@@ -194,6 +194,32 @@ int unicast_send_streamed_channels_list_js (int number_of_channels, mumudvb_chan
 	return 0;
 }
 
+/** @brief Write a sample of the signal statistics as a JSON object, only the available measures
+ *
+ */
+static void
+unicast_write_fe_stats_js (struct unicast_reply* reply, fe_stats_t *sample)
+{
+	unicast_reply_write(reply, "{\"time\":%llu", (unsigned long long) sample->time);
+	if(sample->valid & FE_STATS_STRENGTH_DBM)
+		unicast_reply_write(reply, ", \"strength_dbm\":%.3f", sample->strength);
+	else if(sample->valid & FE_STATS_STRENGTH_REL)
+		unicast_reply_write(reply, ", \"strength_percent\":%.1f", sample->strength);
+	if(sample->valid & FE_STATS_CNR_DB)
+		unicast_reply_write(reply, ", \"cnr_db\":%.3f", sample->cnr);
+	else if(sample->valid & FE_STATS_CNR_REL)
+		unicast_reply_write(reply, ", \"cnr_percent\":%.1f", sample->cnr);
+	if(sample->valid & FE_STATS_PRE_BER)
+		unicast_reply_write(reply, ", \"pre_ber\":%g", sample->pre_ber);
+	if(sample->valid & FE_STATS_POST_BER)
+		unicast_reply_write(reply, ", \"post_ber\":%g", sample->post_ber);
+	if(sample->valid & FE_STATS_PER)
+		unicast_reply_write(reply, ", \"per\":%g", sample->per);
+	if(sample->valid & FE_STATS_BLOCK_COUNT)
+		unicast_reply_write(reply, ", \"error_blocks\":%llu", (unsigned long long) sample->error_blocks);
+	unicast_reply_write(reply, "}");
+}
+
 /** @brief Send a basic JSON file containig the reception power
  *
  * @param Socket the socket on wich the information have to be sent
@@ -208,7 +234,47 @@ unicast_send_signal_power_js (int Socket, strength_parameters_t *strengthparams)
 		return -1;
 	}
 
-	unicast_reply_write(reply, "{\"ber\":%d, \"strength\":%d, \"snr\":%d, \"ub\":%d}\n", strengthparams->ber,strengthparams->strength,strengthparams->snr,strengthparams->ub);
+	unicast_reply_write(reply, "{\"ber\":%d, \"strength\":%d, \"snr\":%d, \"ub\":%d, \"stats_v5\":%d, \"stats\":", strengthparams->ber,strengthparams->strength,strengthparams->snr,strengthparams->ub,strengthparams->stats_v5);
+	pthread_mutex_lock(&strengthparams->stats_lock);
+	unicast_write_fe_stats_js(reply, &strengthparams->stats);
+	pthread_mutex_unlock(&strengthparams->stats_lock);
+	unicast_reply_write(reply, "}\n");
+
+	unicast_reply_send(reply, Socket, 200, "application/json");
+
+	if (0 != unicast_reply_free(reply)) {
+		log_message( log_module, MSG_INFO,"Error when releasing the HTTP reply after sendinf it\n");
+		return -1;
+	}
+	return 0;
+}
+
+/** @brief Send the history of the signal statistics in JSON, the oldest sample first
+ *
+ * @param Socket the socket on wich the information have to be sent
+ */
+int
+unicast_send_signal_history_js (int Socket, strength_parameters_t *strengthparams)
+{
+	int num,pos;
+	struct unicast_reply* reply = unicast_reply_init();
+	if (NULL == reply)
+	{
+		log_message( log_module, MSG_INFO,"Error when creating the HTTP reply\n");
+		return -1;
+	}
+
+	pthread_mutex_lock(&strengthparams->stats_lock);
+	num=strengthparams->stats_history_num;
+	pos=(strengthparams->stats_history_pos+FE_STATS_HISTORY_LEN-num)%FE_STATS_HISTORY_LEN;
+	unicast_reply_write(reply, "{\"interval_ms\":%d, \"samples\":[\n", strengthparams->tune_p->stats_interval);
+	for(int i=0;i<num;i++)
+	{
+		unicast_write_fe_stats_js(reply, &strengthparams->stats_history[(pos+i)%FE_STATS_HISTORY_LEN]);
+		unicast_reply_write(reply, "%s\n", i<num-1 ? "," : "");
+	}
+	pthread_mutex_unlock(&strengthparams->stats_lock);
+	unicast_reply_write(reply, "]}\n");
 
 	unicast_reply_send(reply, Socket, 200, "application/json");
 
@@ -221,7 +287,7 @@ unicast_send_signal_power_js (int Socket, strength_parameters_t *strengthparams)
 
 //in unicast_EIT.c
 void
-unicast_send_EIT_section (mumudvb_ts_packet_t *eit_section, int num, struct unicast_reply* reply);
+unicast_send_EIT_section (mumudvb_section_t *eit_section, int num, struct unicast_reply* reply);
 
 
 int
@@ -241,6 +307,8 @@ unicast_send_EIT (eit_packet_t *eit_packets, int Socket)
 	unicast_reply_write(reply, "\"EIT_tables\":[\n");
 	while(actual_eit!=NULL)
 	{
+		//The sections can be replaced by the EIT storage, we hold its lock while reading them
+		pthread_mutex_lock(&actual_eit->sections_lock);
 		unicast_reply_write(reply, "{\n");
 		unicast_reply_write(reply, "\t\"sid\" : \"%d\",\n",actual_eit->service_id);
 		unicast_reply_write(reply, "\t\"table_id\" : %d,\n",actual_eit->table_id);
@@ -260,7 +328,8 @@ unicast_send_EIT (eit_packet_t *eit_packets, int Socket)
 			}
 		unicast_reply_write(reply, "]\n");
 		unicast_reply_write(reply, "}");
-		actual_eit=actual_eit->next;
+		pthread_mutex_unlock(&actual_eit->sections_lock);
+		actual_eit=__atomic_load_n(&actual_eit->next, __ATOMIC_ACQUIRE);
 		if(actual_eit!=NULL)
 			unicast_reply_write(reply, ",\n");
 	}
@@ -318,6 +387,158 @@ unicast_send_channel_traffic_js (int number_of_channels, mumudvb_channel_t *chan
 	return 0;
 }
 
+/** @brief Send the statistics of each PID seen in JSON
+ *
+ * @param Socket the socket on wich the information have to be sent
+ */
+int
+unicast_send_pid_stats_js (int Socket, strength_parameters_t *strengthparams)
+{
+	pid_stats_t *pid_stats=strengthparams->pid_stats;
+	int first=1;
+
+	struct unicast_reply* reply = unicast_reply_init();
+	if (NULL == reply) {
+		log_message( log_module, MSG_INFO,"Error when creating the HTTP reply\n");
+		return -1;
+	}
+
+	if(pid_stats)
+	{
+		pthread_mutex_lock(&pid_stats->lock);
+		unicast_reply_write(reply, "{\"window_s\":%.1f, \"pids\":[\n", pid_stats->window_length);
+		for(int pid=0;pid<PID_STATS_PIDS;pid++)
+		{
+			if(!pid_stats->merged.packets[pid])
+				continue;
+			unicast_reply_write(reply, "%s{\"pid\":%d, \"packets\":%llu, \"cc_errors\":%u, \"tei\":%u, \"scrambled\":%llu, \"bitrate\":%.1f}",
+					first ? "" : ",\n",
+					pid,
+					(unsigned long long) pid_stats->merged.packets[pid],
+					pid_stats->merged.cc_errors[pid],
+					pid_stats->merged.tei[pid],
+					(unsigned long long) pid_stats->merged.scrambled[pid],
+					pid_stats->bitrate[pid]);
+			first=0;
+		}
+		pthread_mutex_unlock(&pid_stats->lock);
+		unicast_reply_write(reply, "\n]}\n");
+	}
+	else
+		unicast_reply_write(reply, "{}\n");
+
+	unicast_reply_send(reply, Socket, 200, "application/json");
+
+	if (0 != unicast_reply_free(reply)) {
+		log_message( log_module, MSG_INFO,"Error when releasing the HTTP reply after sendinf it\n");
+		return -1;
+	}
+	return 0;
+}
+
+/** @brief Send the TR 101 290 errors of the TS and of each service in JSON
+ *
+ * @param Socket the socket on wich the information have to be sent
+ */
+int
+unicast_send_tr101290_js (int Socket, strength_parameters_t *strengthparams)
+{
+	tr101290_t *tr101290=strengthparams->tr101290;
+	tr101290_service_t *service;
+
+	struct unicast_reply* reply = unicast_reply_init();
+	if (NULL == reply) {
+		log_message( log_module, MSG_INFO,"Error when creating the HTTP reply\n");
+		return -1;
+	}
+
+	if(tr101290)
+	{
+		pthread_mutex_lock(&tr101290->lock);
+		unicast_reply_write(reply, "{\"ts\":{");
+		for(int i=0;i<TR101290_NUM_INDICATORS;i++)
+			unicast_reply_write(reply, "%s\"%s\":%llu", i ? ", " : "", tr101290_names[i],
+					(unsigned long long) tr101290->ts_errors[i]);
+		unicast_reply_write(reply, "},\n\"services\":[\n");
+		for(int s=0;s<tr101290->num_services;s++)
+		{
+			service=&tr101290->services[s];
+			unicast_reply_write(reply, "%s{\"name\":\"%s\", \"service_id\":%d",
+					s ? ",\n" : "", service->name, service->service_id);
+			for(int i=0;i<TR101290_NUM_INDICATORS;i++)
+				unicast_reply_write(reply, ", \"%s\":%llu", tr101290_names[i],
+						(unsigned long long) service->errors[i]);
+			unicast_reply_write(reply, "}");
+		}
+		pthread_mutex_unlock(&tr101290->lock);
+		unicast_reply_write(reply, "\n]}\n");
+	}
+	else
+		unicast_reply_write(reply, "{}\n");
+
+	unicast_reply_send(reply, Socket, 200, "application/json");
+
+	if (0 != unicast_reply_free(reply)) {
+		log_message( log_module, MSG_INFO,"Error when releasing the HTTP reply after sendinf it\n");
+		return -1;
+	}
+	return 0;
+}
+
+/** @brief Send the bitrates and the PCR jitter of each service in JSON, with their history
+ *
+ * @param Socket the socket on wich the information have to be sent
+ */
+int
+unicast_send_pcr_stats_js (int Socket, strength_parameters_t *strengthparams)
+{
+	pcr_stats_t *pcr_stats=strengthparams->pcr_stats;
+	pcr_program_t *program;
+	pcr_sample_t *sample;
+	int first=1;
+
+	struct unicast_reply* reply = unicast_reply_init();
+	if (NULL == reply) {
+		log_message( log_module, MSG_INFO,"Error when creating the HTTP reply\n");
+		return -1;
+	}
+
+	if(pcr_stats)
+	{
+		pthread_mutex_lock(&pcr_stats->lock);
+		unicast_reply_write(reply, "{\"programs\":[\n");
+		for(int p=0;p<pcr_stats->num_programs;p++)
+		{
+			program=&pcr_stats->programs[p];
+			if(!program->history_num)
+				continue;
+			//The oldest sample first
+			unicast_reply_write(reply, "%s{\"name\":\"%s\", \"service_id\":%d, \"pcr_pid\":%d, \"history\":[",
+					first ? "" : ",\n", program->name, program->service_id, program->pcr_pid);
+			for(int i=0;i<program->history_num;i++)
+			{
+				sample=&program->history[(program->history_pos+PCR_STATS_HISTORY-program->history_num+i)%PCR_STATS_HISTORY];
+				unicast_reply_write(reply, "%s{\"time\":%.3f, \"mux_bitrate\":%.1f, \"bitrate\":%.1f, \"jitter_us\":%.1f}",
+						i ? ", " : "", sample->time, sample->mux_bitrate, sample->bitrate, sample->jitter);
+			}
+			unicast_reply_write(reply, "]}");
+			first=0;
+		}
+		pthread_mutex_unlock(&pcr_stats->lock);
+		unicast_reply_write(reply, "\n]}\n");
+	}
+	else
+		unicast_reply_write(reply, "{}\n");
+
+	unicast_reply_send(reply, Socket, 200, "application/json");
+
+	if (0 != unicast_reply_free(reply)) {
+		log_message( log_module, MSG_INFO,"Error when releasing the HTTP reply after sendinf it\n");
+		return -1;
+	}
+	return 0;
+}
+
 /** @brief Send a full json state of the mumudvb instance
  *
  * @param number_of_channels the number of channels
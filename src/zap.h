@@ -0,0 +1,112 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/** @file
+ * @brief Zapping helpers : the zap server keeping the adapters open and
+ * the tuning of several adapters at once
+ */
+
+#ifndef _ZAP_H
+#define _ZAP_H
+
+#include "mumudvb.h"
+#include "tune.h"
+
+/** The default path of the zap server socket */
+#define ZAP_SERVER_SOCKET_PATH "/var/run/mumudvb/dvbzap.sock"
+/** The maximum number of adapters kept open by the server */
+#define MAX_ZAP_ADAPTERS 32
+/** The maximum length of the socket path (size of sun_path) */
+#define ZAP_SERVER_PATH_LEN 108
+/** The maximum number of clients waiting to be served */
+#define ZAP_SERVER_BACKLOG 8
+/** The seconds a client can stay without sending a request, the clients are served one at a time */
+#define ZAP_SERVER_CLIENT_TIMEOUT 10
+
+/** @brief An adapter kept open between two zaps */
+typedef struct zap_adapter_t{
+  /** The card number */
+  int card;
+  /** The tuner number */
+  int tuner;
+  /** The file descriptors of the card */
+  fds_t *fds;
+  /** The number of zaps done on this adapter */
+  int num_zaps;
+}zap_adapter_t;
+
+/** @brief The result of a zap, in microseconds */
+typedef struct zap_result_t{
+  /** The value returned by tune_it (TUNE_NO_LOCK if not locked before the deadline) */
+  int ret;
+  /** Did the card lock ? */
+  int locked;
+  /** The frontend status after tuning */
+  fe_status_t festatus;
+  /** Time spent opening the frontend (0 if it was already open) */
+  uint64_t open_time;
+  /** Time spent tuning the frontend */
+  uint64_t tune_time;
+  /** Total time for the request */
+  uint64_t total_time;
+}zap_result_t;
+
+/** @brief Parameters for the zap server */
+typedef struct zap_server_p_t{
+  /** Do we run as a zap server ? */
+  int server;
+  /** The path of the UNIX socket */
+  char socket_path[ZAP_SERVER_PATH_LEN];
+  /** The card dev path template (before %card is replaced) */
+  char card_dev_path[256];
+  /** The listening socket */
+  int socket;
+  /** The number of open adapters */
+  int num_adapters;
+  /** The open adapters */
+  zap_adapter_t adapters[MAX_ZAP_ADAPTERS];
+}zap_server_p_t;
+
+/** @brief The adapters to tune at once (one "new_adapter" block each in the configuration) */
+typedef struct zap_multi_p_t{
+  /** The number of blocks */
+  int num_blocks;
+  /** The tuning parameters of each block */
+  tune_p_t *blocks[MAX_ZAP_ADAPTERS];
+  /** The results of each block */
+  zap_result_t results[MAX_ZAP_ADAPTERS];
+}zap_multi_p_t;
+
+void init_zap_server_v(zap_server_p_t *zap_server_p);
+int read_zap_server_configuration(zap_server_p_t *zap_server_p, char *substring);
+int zap_server_run(zap_server_p_t *zap_server_p, tune_p_t *tune_p);
+void zap_server_close(zap_server_p_t *zap_server_p);
+
+void init_zap_multi_v(zap_multi_p_t *zap_multi_p);
+tune_p_t *zap_multi_new_block(zap_multi_p_t *zap_multi_p, tune_p_t *common_tune_p);
+int zap_multi_run(zap_multi_p_t *zap_multi_p);
+void zap_multi_free(zap_multi_p_t *zap_multi_p);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/** @file
+ * @brief Tuning of several adapters at once
+ *
+ * Each "new_adapter" line of the configuration file starts a tuning block. The
+ * tuning parameters given before the first block are common to all the blocks.
+ * Each block is tuned by its own thread, so the time to tune all the adapters
+ * is the longest time to lock instead of the sum.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+#include "zap.h"
+#include "dvb.h"
+#include "errors.h"
+#include "log.h"
+
+static char *log_module="Zap: ";
+
+/** @brief The parameters of a tuning thread */
+typedef struct zap_multi_thread_t{
+  tune_p_t *tune_p;
+  zap_result_t *result;
+}zap_multi_thread_t;
+
+/** Initialize the multi adapter variables*/
+void init_zap_multi_v(zap_multi_p_t *zap_multi_p)
+{
+	memset(zap_multi_p, 0, sizeof(zap_multi_p_t));
+}
+
+/** @brief Start a new tuning block ("new_adapter" in the configuration)
+ *
+ * @param common_tune_p the parameters common to all the blocks, the new block starts from them
+ * @return the tuning parameters of the new block, NULL on error
+ */
+tune_p_t *zap_multi_new_block(zap_multi_p_t *zap_multi_p, tune_p_t *common_tune_p)
+{
+	tune_p_t *tune_p;
+
+	if(zap_multi_p->num_blocks>=MAX_ZAP_ADAPTERS)
+	{
+		log_message( log_module,  MSG_ERROR, "Too many adapters : limit : %d\n", MAX_ZAP_ADAPTERS);
+		return NULL;
+	}
+	tune_p=malloc(sizeof(tune_p_t));
+	if(tune_p==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	*tune_p=*common_tune_p;
+	//The card has to be given in each block
+	tune_p->card=-1;
+	zap_multi_p->blocks[zap_multi_p->num_blocks]=tune_p;
+	zap_multi_p->num_blocks++;
+	log_message( log_module, MSG_INFO,"New adapter, current number %d\n", zap_multi_p->num_blocks-1);
+	return tune_p;
+}
+
+/** @brief Thread tuning one adapter
+ *
+ */
+static void *zap_multi_thread_func(void *arg)
+{
+	zap_multi_thread_t *params=(zap_multi_thread_t *) arg;
+	tune_p_t *tune_p=params->tune_p;
+	zap_result_t *result=params->result;
+	int fd_frontend=0;
+	uint64_t start_time;
+	char number[10];
+	int l;
+
+	start_time=get_time();
+	sprintf(number,"%d",tune_p->card);
+	l=sizeof(tune_p->card_dev_path);
+	mumu_string_replace(tune_p->card_dev_path,&l,0,"%card",number);
+	if(open_fe(&fd_frontend, tune_p->card_dev_path, tune_p->tuner, 1, 0)<0)
+	{
+		result->ret=-1;
+		result->total_time=get_time()-start_time;
+		return NULL;
+	}
+	result->open_time=get_time()-start_time;
+	result->ret=tune_it(fd_frontend, tune_p);
+	result->tune_time=get_time()-start_time-result->open_time;
+	if(dvb_ioctl(fd_frontend, FE_READ_STATUS, &result->festatus) < 0)
+		result->festatus=0;
+	result->locked=(result->ret>=0) && (result->festatus & FE_HAS_LOCK);
+	tune_p->card_tuned=result->locked;
+	dvb_close(fd_frontend);
+	result->total_time=get_time()-start_time;
+	return NULL;
+}
+
+/** @brief Tune all the blocks, each one in its own thread, and report the results
+ *
+ * @return 0 if all the adapters locked, the exit code otherwise
+ */
+int zap_multi_run(zap_multi_p_t *zap_multi_p)
+{
+	pthread_t threads[MAX_ZAP_ADAPTERS];
+	zap_multi_thread_t params[MAX_ZAP_ADAPTERS];
+	zap_result_t *result;
+	tune_p_t *tune_p;
+	uint64_t start_time;
+	int num_locked=0;
+	int ret=0;
+	int iRet;
+
+	for(int i=0;i<zap_multi_p->num_blocks;i++)
+	{
+		tune_p=zap_multi_p->blocks[i];
+		if(tune_p->card==-1)
+		{
+			log_message( log_module,  MSG_ERROR, "No card given for the adapter %d\n", i);
+			return ERROR_CONF;
+		}
+		for(int j=0;j<i;j++)
+			if(zap_multi_p->blocks[j]->card==tune_p->card && zap_multi_p->blocks[j]->tuner==tune_p->tuner)
+			{
+				log_message( log_module,  MSG_ERROR, "Card %d tuner %d is given twice\n", tune_p->card, tune_p->tuner);
+				return ERROR_CONF;
+			}
+	}
+
+	start_time=get_time();
+	for(int i=0;i<zap_multi_p->num_blocks;i++)
+	{
+		memset(&zap_multi_p->results[i], 0, sizeof(zap_result_t));
+		params[i].tune_p=zap_multi_p->blocks[i];
+		params[i].result=&zap_multi_p->results[i];
+		if((iRet=pthread_create(&threads[i], NULL, zap_multi_thread_func, &params[i])))
+		{
+			log_message( log_module,  MSG_ERROR, "Cannot start the tuning thread for card %d : %s\n",
+					zap_multi_p->blocks[i]->card, strerror(iRet));
+			//We wait for the threads already started
+			for(int j=0;j<i;j++)
+				pthread_join(threads[j], NULL);
+			return ERROR_GENERIC;
+		}
+	}
+	for(int i=0;i<zap_multi_p->num_blocks;i++)
+		pthread_join(threads[i], NULL);
+
+	log_message( log_module,  MSG_INFO, "========== Tuning report ==========\n");
+	for(int i=0;i<zap_multi_p->num_blocks;i++)
+	{
+		tune_p=zap_multi_p->blocks[i];
+		result=&zap_multi_p->results[i];
+		if(result->locked)
+		{
+			num_locked++;
+			log_message( log_module,  MSG_INFO, "Card %d, tuner %d : locked in %.1f ms (total %.1f ms)\n",
+					tune_p->card, tune_p->tuner, tune_p->lock_time/1000.0, result->total_time/1000.0);
+		}
+		else
+		{
+			log_message( log_module,  MSG_INFO, "Card %d, tuner %d : NOT locked (%s) after %.1f ms\n",
+					tune_p->card, tune_p->tuner,
+					result->ret==TUNE_NO_LOCK ? "no lock" : "tuning error",
+					result->total_time/1000.0);
+			if(result->ret==TUNE_NO_LOCK)
+			{
+				if(!ret)
+					ret=ERROR_NO_LOCK;
+			}
+			else
+				ret=ERROR_TUNE;
+		}
+	}
+	log_message( log_module,  MSG_INFO, "%d/%d adapters locked in %.1f ms\n",
+			num_locked, zap_multi_p->num_blocks, (get_time()-start_time)/1000.0);
+	return ret;
+}
+
+/** @brief Free the tuning blocks */
+void zap_multi_free(zap_multi_p_t *zap_multi_p)
+{
+	for(int i=0;i<zap_multi_p->num_blocks;i++)
+	{
+		free(zap_multi_p->blocks[i]);
+		zap_multi_p->blocks[i]=NULL;
+	}
+	zap_multi_p->num_blocks=0;
+}
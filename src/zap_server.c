@@ -0,0 +1,409 @@
+/*
+ * dvbzap - zap DVB adapter
+ *
+ * (C) 2022 Roberto TVEpg.eu <l2mrroberto@gmail.com>
+ *
+ * The latest version can be found at https://github.com/l2mrroberto/dvbzap
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/** @file
+ * @brief Zap server : keep the frontends open and tune them on request
+ *
+ * The server listens on a UNIX socket. A client sends the tuning parameters,
+ * one per line, with the same syntax as the configuration file (ie freq=11778).
+ * An empty line or the "zap" command tunes the card, the server then replies
+ * with a single line :
+ *   status=locked card=0 tuner=0 fe_status=0x1f open_ms=0.0 tune_ms=182.3 lock_ms=80.2 total_ms=182.4
+ * The parameters not given in the request are taken from the configuration
+ * the server was started with. "quit" closes the connection.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/ioctl.h>
+
+#include "zap.h"
+#include "dvb.h"
+#include "errors.h"
+#include "log.h"
+
+static char *log_module="Zap server: ";
+
+/** Set by the signal handler when the server has to stop */
+static volatile sig_atomic_t zap_server_stop=0;
+
+/** Initialize the zap server variables*/
+void init_zap_server_v(zap_server_p_t *zap_server_p)
+{
+	*zap_server_p=(zap_server_p_t){
+			.server=0,
+			.socket_path=ZAP_SERVER_SOCKET_PATH,
+			.card_dev_path=DVB_DEV_PATH,
+			.socket=-1,
+			.num_adapters=0,
+	};
+}
+
+/** @brief Read a line of the configuration file to check if there is a zap server parameter
+ *
+ * @param zap_server_p the zap server parameters
+ * @param substring The currrent line
+ */
+int read_zap_server_configuration(zap_server_p_t *zap_server_p, char *substring)
+{
+	char delimiteurs[] = CONFIG_FILE_SEPARATOR;
+	if (!strcmp (substring, "zap_server"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		zap_server_p->server = atoi (substring);
+	}
+	else if (!strcmp (substring, "zap_server_socket"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		if(strlen(substring)>=ZAP_SERVER_PATH_LEN)
+		{
+			log_message( log_module,  MSG_ERROR,
+					"The zap server socket path is too long\n");
+			return -1;
+		}
+		strcpy(zap_server_p->socket_path,substring);
+	}
+	else
+		return 0; //Nothing concerning the zap server, we return 0 to explore the other possibilities
+
+	return 1;//We found something for the zap server, we tell main to go for a new line
+}
+
+static void zap_server_signal_handler(int signum)
+{
+	zap_server_stop=signum;
+}
+
+/** @brief Return the adapter corresponding to card/tuner, open it if needed
+ *
+ * @param open_time filled with the time spent opening the frontend
+ */
+static zap_adapter_t *zap_server_get_adapter(zap_server_p_t *zap_server_p, int card, int tuner, uint64_t *open_time)
+{
+	zap_adapter_t *adapter;
+	char card_dev_path[256];
+	char number[10];
+	int l;
+	uint64_t start_time;
+
+	*open_time=0;
+	for(int i=0;i<zap_server_p->num_adapters;i++)
+	{
+		adapter=&zap_server_p->adapters[i];
+		if(adapter->card==card && adapter->tuner==tuner)
+			return adapter;
+	}
+	if(zap_server_p->num_adapters>=MAX_ZAP_ADAPTERS)
+	{
+		log_message( log_module,  MSG_ERROR, "Too many adapters open, limit : %d\n", MAX_ZAP_ADAPTERS);
+		return NULL;
+	}
+
+	adapter=&zap_server_p->adapters[zap_server_p->num_adapters];
+	adapter->fds=calloc(1,sizeof(fds_t));
+	if(adapter->fds==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	strcpy(card_dev_path,zap_server_p->card_dev_path);
+	sprintf(number,"%d",card);
+	l=sizeof(card_dev_path);
+	mumu_string_replace(card_dev_path,&l,0,"%card",number);
+
+	start_time=get_time();
+	if(open_fe(&adapter->fds->fd_frontend, card_dev_path, tuner, 1, 0)<0)
+	{
+		free(adapter->fds);
+		adapter->fds=NULL;
+		return NULL;
+	}
+	*open_time=get_time()-start_time;
+	adapter->card=card;
+	adapter->tuner=tuner;
+	adapter->num_zaps=0;
+	zap_server_p->num_adapters++;
+	log_message( log_module,  MSG_INFO, "Card %d, tuner %d opened\n", card, tuner);
+	return adapter;
+}
+
+/** @brief Tune a card with the parameters of a request
+ *
+ */
+static int zap_server_zap(zap_server_p_t *zap_server_p, tune_p_t *tune_p, zap_result_t *result)
+{
+	zap_adapter_t *adapter;
+	uint64_t start_time;
+	int iRet;
+
+	memset(result,0,sizeof(zap_result_t));
+	start_time=get_time();
+	adapter=zap_server_get_adapter(zap_server_p, tune_p->card, tune_p->tuner, &result->open_time);
+	if(adapter==NULL)
+		return -1;
+
+	iRet=tune_it(adapter->fds->fd_frontend, tune_p);
+	result->ret=iRet;
+	result->tune_time=get_time()-start_time-result->open_time;
+	adapter->num_zaps++;
+	if(dvb_ioctl(adapter->fds->fd_frontend, FE_READ_STATUS, &result->festatus) < 0)
+		result->festatus=0;
+	result->locked=(iRet>=0) && (result->festatus & FE_HAS_LOCK);
+	result->total_time=get_time()-start_time;
+	log_message( log_module,  MSG_INFO, "Card %d, tuner %d %s after %.1f ms\n",
+			tune_p->card, tune_p->tuner,
+			result->locked ? "tuned" : "NOT tuned",
+			result->total_time/1000.0);
+	return 0;
+}
+
+/** @brief Send a reply line to the client */
+static void zap_server_reply(int client, const char *format, ...)
+{
+	char reply[CONF_LINELEN];
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len=vsnprintf(reply, sizeof(reply)-1, format, args);
+	va_end(args);
+	if(len<0)
+		return;
+	if(len>(int)sizeof(reply)-2)
+		len=sizeof(reply)-2;
+	reply[len++]='\n';
+	if(write(client, reply, len)!=len)
+		log_message( log_module,  MSG_DETAIL, "Cannot reply to the client : %s\n", strerror(errno));
+}
+
+/** @brief Serve a client until it closes the connection
+ *
+ * @param tune_p the default tuning parameters (from the configuration)
+ */
+static void zap_server_client(zap_server_p_t *zap_server_p, tune_p_t *tune_p, int client)
+{
+	char buffer[CONF_LINELEN];
+	char delimiteurs[] = CONFIG_FILE_SEPARATOR;
+	char *line,*end,*substring;
+	int len=0;
+	int request_error=0;
+	int iRet;
+	ssize_t nread;
+	struct pollfd pfd;
+	int idle_ms=0;
+	zap_result_t result;
+	tune_p_t request;
+
+	request=*tune_p;
+	request.card=-1;
+
+	pfd.fd=client;
+	pfd.events=POLLIN;
+	while(!zap_server_stop)
+	{
+		iRet=poll(&pfd, 1, 500);
+		if(iRet<0)
+		{
+			if(errno==EINTR)
+				continue;
+			log_message( log_module,  MSG_WARN, "poll : %s\n", strerror(errno));
+			return;
+		}
+		if(iRet==0)
+		{
+			//A client sending nothing would block the other ones
+			idle_ms+=500;
+			if(idle_ms>=ZAP_SERVER_CLIENT_TIMEOUT*1000)
+			{
+				log_message( log_module,  MSG_WARN, "No request for %ds, connection closed\n", ZAP_SERVER_CLIENT_TIMEOUT);
+				return;
+			}
+			continue;
+		}
+		idle_ms=0;
+		nread=read(client, buffer+len, sizeof(buffer)-1-len);
+		if(nread<=0)
+			return; //Client closed the connection
+		len+=nread;
+		buffer[len]='\0';
+		line=buffer;
+		while((end=strchr(line,'\n'))!=NULL)
+		{
+			*end='\0';
+			if(end>line && *(end-1)=='\r')
+				*(end-1)='\0';
+			if(!strlen(line) || !strcmp(line,"zap"))
+			{
+				if(request_error)
+					zap_server_reply(client, "status=error message=invalid request");
+				else
+				{
+					if(request.card==-1)
+						request.card=tune_p->card;
+					if(zap_server_zap(zap_server_p, &request, &result)<0)
+						zap_server_reply(client, "status=error card=%d tuner=%d message=cannot open the frontend",
+								request.card, request.tuner);
+					else
+						zap_server_reply(client, "status=%s card=%d tuner=%d fe_status=0x%02x open_ms=%.1f tune_ms=%.1f lock_ms=%.1f total_ms=%.1f",
+								result.locked ? "locked" : "nolock",
+								request.card, request.tuner, result.festatus,
+								result.open_time/1000.0, result.tune_time/1000.0,
+								request.lock_time/1000.0, result.total_time/1000.0);
+				}
+				//next request starts again from the configuration
+				request=*tune_p;
+				request.card=-1;
+				request_error=0;
+			}
+			else if(!strcmp(line,"quit"))
+				return;
+			else if(line[0]!='#')
+			{
+				substring=NULL;
+				if(strstr(line,"=")!=NULL)
+					substring = strtok (line, delimiteurs);
+				if(substring==NULL || (iRet=read_tuning_configuration(&request, substring))==0)
+				{
+					zap_server_reply(client, "status=error message=unknown parameter");
+					request_error=1;
+				}
+				else if(iRet==-1)
+				{
+					zap_server_reply(client, "status=error message=bad parameter");
+					request_error=1;
+				}
+			}
+			line=end+1;
+		}
+		//we keep the beginning of the next line
+		len-=line-buffer;
+		memmove(buffer,line,len);
+		if(len>=(int)sizeof(buffer)-1)
+		{
+			log_message( log_module,  MSG_WARN, "Line too long, connection closed\n");
+			return;
+		}
+	}
+}
+
+/** @brief Run the zap server until we get a SIGINT/SIGTERM
+ *
+ * @param tune_p the default tuning parameters (from the configuration)
+ */
+int zap_server_run(zap_server_p_t *zap_server_p, tune_p_t *tune_p)
+{
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	int client;
+	int iRet;
+
+	signal(SIGINT, zap_server_signal_handler);
+	signal(SIGTERM, zap_server_signal_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	zap_server_p->socket=socket(AF_UNIX, SOCK_STREAM, 0);
+	if(zap_server_p->socket<0)
+	{
+		log_message( log_module,  MSG_ERROR, "socket() failed : %s\n", strerror(errno));
+		return ERROR_NETWORK;
+	}
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	snprintf(addr.sun_path,sizeof(addr.sun_path),"%s",zap_server_p->socket_path);
+	//A previous instance could have left the socket
+	unlink(zap_server_p->socket_path);
+	if(bind(zap_server_p->socket, (struct sockaddr *)&addr, sizeof(addr))<0)
+	{
+		log_message( log_module,  MSG_ERROR, "bind() on %s failed : %s\n",
+				zap_server_p->socket_path, strerror(errno));
+		close(zap_server_p->socket);
+		zap_server_p->socket=-1;
+		return ERROR_NETWORK;
+	}
+	if(listen(zap_server_p->socket, ZAP_SERVER_BACKLOG)<0)
+	{
+		log_message( log_module,  MSG_ERROR, "listen() failed : %s\n", strerror(errno));
+		close(zap_server_p->socket);
+		zap_server_p->socket=-1;
+		unlink(zap_server_p->socket_path);
+		return ERROR_NETWORK;
+	}
+	log_message( log_module,  MSG_INFO, "Waiting for zap requests on %s\n", zap_server_p->socket_path);
+
+	pfd.fd=zap_server_p->socket;
+	pfd.events=POLLIN;
+	while(!zap_server_stop)
+	{
+		iRet=poll(&pfd, 1, 500);
+		if(iRet<0 && errno!=EINTR)
+		{
+			log_message( log_module,  MSG_ERROR, "poll : %s\n", strerror(errno));
+			return ERROR_NETWORK;
+		}
+		if(iRet<=0)
+			continue;
+		client=accept(zap_server_p->socket, NULL, NULL);
+		if(client<0)
+		{
+			if(errno!=EINTR)
+				log_message( log_module,  MSG_WARN, "accept : %s\n", strerror(errno));
+			continue;
+		}
+		log_message( log_module,  MSG_DEBUG, "New client\n");
+		zap_server_client(zap_server_p, tune_p, client);
+		close(client);
+		log_message( log_module,  MSG_DEBUG, "Client disconnected\n");
+	}
+	log_message( log_module,  MSG_INFO, "Caught signal %d, stopping\n", zap_server_stop);
+	return 0;
+}
+
+/** @brief Close the adapters and the socket of the zap server */
+void zap_server_close(zap_server_p_t *zap_server_p)
+{
+	for(int i=0;i<zap_server_p->num_adapters;i++)
+	{
+		close_card_fd(zap_server_p->adapters[i].fds);
+		free(zap_server_p->adapters[i].fds);
+		zap_server_p->adapters[i].fds=NULL;
+	}
+	zap_server_p->num_adapters=0;
+	if(zap_server_p->socket>=0)
+	{
+		close(zap_server_p->socket);
+		unlink(zap_server_p->socket_path);
+		zap_server_p->socket=-1;
+	}
+}